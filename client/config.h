@@ -8,5 +8,8 @@
 #define KEY_LEN         16
 #define VAL_LEN         1024
 #define NUM_PREFETCH    5
+#define PREFETCH_WORKERS 4
+#define PREFETCH_QUEUE  1024
+#define NUM_WORKERS     8
 
 #endif //LEVELDB_CONFIG_H
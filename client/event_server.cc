@@ -0,0 +1,528 @@
+//
+// Event-driven request server for glakv_server.
+//
+
+#include "event_server.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+using std::condition_variable;
+using std::deque;
+using std::function;
+using std::lock_guard;
+using std::mutex;
+using std::string;
+using std::thread;
+using std::unique_lock;
+using std::unordered_map;
+using std::vector;
+
+// epoll tags of the listening socket and the wakeup eventfd.  Connections
+// are tagged with their id, which is never reused, so that a completion
+// can not be delivered to a later connection that got the same fd.
+static const uint64_t LISTEN_TAG = 0;
+static const uint64_t WAKE_TAG = 1;
+static const uint64_t FIRST_CONNECTION_ID = 2;
+
+static const int MAX_EVENTS = 64;
+static const size_t READ_CHUNK = 64 * 1024;
+
+// Stop reading from a connection once this much unprocessed input has
+// piled up, until the workers catch up.
+static const size_t MAX_BUFFERED_INPUT = 4 * 1024 * 1024;
+
+// Maximum number of independent requests of one connection handed to the
+// workers at a time, so that one client can not monopolize them.
+static const int MAX_OUTSTANDING = 64;
+
+struct event_server::connection {
+    uint64_t id;
+    int fd;
+    string in;
+    string out;
+    size_t out_pos;
+    uint32_t events;  // Events currently registered with epoll
+    int outstanding;  // Tasks handed to the workers and not completed yet
+    bool barrier;     // The outstanding task is a batch of ordered requests
+    bool closing;     // Close once the pending output has been sent
+
+    connection(uint64_t id_in, int fd_in)
+            : id(id_in), fd(fd_in), out_pos(0), events(0), outstanding(0), barrier(false),
+              closing(false) {}
+};
+
+struct event_server::reactor {
+    int epfd;
+    int listen_fd;
+    bool owns_listen_fd;
+    int wake_fd;
+    thread t;
+    uint64_t next_id;
+    unordered_map<uint64_t, connection *> conns;
+    // Closed connections to delete at the end of the current event batch.
+    vector<uint64_t> closed;
+
+    struct completion {
+        uint64_t id;
+        string response;
+        bool close;
+    };
+
+    // Completions posted by the workers.
+    mutex mu;
+    vector<completion> completions;
+
+    reactor() : epfd(-1), listen_fd(-1), owns_listen_fd(false), wake_fd(-1),
+                next_id(FIRST_CONNECTION_ID) {}
+
+    void post(uint64_t id, string response, bool close) {
+        {
+            lock_guard<mutex> l(mu);
+            completions.push_back(completion{id, std::move(response), close});
+        }
+        wake();
+    }
+
+    void wake() {
+        uint64_t one = 1;
+        ssize_t ignored = write(wake_fd, &one, sizeof(one));
+        (void) ignored;
+    }
+};
+
+class event_server::worker_pool {
+public:
+    explicit worker_pool(int num_threads) : stopping(false) {
+        for (int i = 0; i < num_threads; ++i) {
+            threads.push_back(thread(&worker_pool::work, this));
+        }
+    }
+
+    // Runs the tasks still queued, then joins the threads.
+    ~worker_pool() {
+        {
+            lock_guard<mutex> l(mu);
+            stopping = true;
+        }
+        cv.notify_all();
+        for (auto &t : threads) {
+            t.join();
+        }
+    }
+
+    void submit(function<void()> task) {
+        {
+            lock_guard<mutex> l(mu);
+            tasks.push_back(std::move(task));
+        }
+        cv.notify_one();
+    }
+
+private:
+    void work() {
+        while (true) {
+            function<void()> task;
+            {
+                unique_lock<mutex> l(mu);
+                while (tasks.empty() && !stopping) {
+                    cv.wait(l);
+                }
+                if (tasks.empty()) {
+                    return;
+                }
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+    mutex mu;
+    condition_variable cv;
+    deque<function<void()>> tasks;
+    bool stopping;
+    vector<thread> threads;
+};
+
+static bool set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+static int open_listen_socket(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    int yes = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+#ifdef SO_REUSEPORT
+    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes));
+#endif
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+        listen(fd, SOMAXCONN) < 0 || !set_nonblocking(fd)) {
+        perror("listen socket");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static bool epoll_add(int epfd, int fd, uint32_t events, uint64_t tag) {
+    struct epoll_event ev;
+    ev.events = events;
+    ev.data.u64 = tag;
+    return epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == 0;
+}
+
+event_server::event_server(int port_in, int num_reactors_in, int num_workers_in,
+                           framer f, handler h)
+        : port(port_in), num_reactors(num_reactors_in > 0 ? num_reactors_in : 1),
+          num_workers(num_workers_in > 0 ? num_workers_in : 1), frame(f), handle(h),
+          workers(nullptr), stopping(false), connections(0) {}
+
+event_server::~event_server() {
+    stop();
+}
+
+bool event_server::start() {
+    for (int i = 0; i < num_reactors; ++i) {
+        reactor *r = new reactor;
+        reactors.push_back(r);
+#ifdef SO_REUSEPORT
+        r->listen_fd = open_listen_socket(port);
+        r->owns_listen_fd = true;
+#else
+        // Without SO_REUSEPORT all reactors watch the same socket and race
+        // to accept new connections.
+        if (i == 0) {
+            r->listen_fd = open_listen_socket(port);
+            r->owns_listen_fd = true;
+        } else {
+            r->listen_fd = reactors[0]->listen_fd;
+        }
+#endif
+        r->epfd = epoll_create1(0);
+        r->wake_fd = eventfd(0, EFD_NONBLOCK);
+        if (r->listen_fd < 0 || r->epfd < 0 || r->wake_fd < 0 ||
+            !epoll_add(r->epfd, r->listen_fd, EPOLLIN, LISTEN_TAG) ||
+            !epoll_add(r->epfd, r->wake_fd, EPOLLIN, WAKE_TAG)) {
+            stop();
+            return false;
+        }
+    }
+    workers = new worker_pool(num_workers);
+    for (auto r : reactors) {
+        r->t = thread(&event_server::run, this, r);
+    }
+    return true;
+}
+
+void event_server::stop() {
+    stopping = true;
+    for (auto r : reactors) {
+        if (r->t.joinable()) {
+            r->wake();
+            r->t.join();
+        }
+    }
+    // Workers may still post completions, so the reactors must outlive them.
+    delete workers;
+    workers = nullptr;
+    for (auto r : reactors) {
+        for (auto &entry : r->conns) {
+            connection *c = entry.second;
+            if (c->fd >= 0) {
+                close(c->fd);
+                --connections;
+            }
+            delete c;
+        }
+        if (r->owns_listen_fd && r->listen_fd >= 0) {
+            close(r->listen_fd);
+        }
+        if (r->epfd >= 0) {
+            close(r->epfd);
+        }
+        if (r->wake_fd >= 0) {
+            close(r->wake_fd);
+        }
+        delete r;
+    }
+    reactors.clear();
+}
+
+void event_server::run(reactor *r) {
+    struct epoll_event events[MAX_EVENTS];
+    while (!stopping) {
+        int n = epoll_wait(r->epfd, events, MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("epoll_wait");
+            break;
+        }
+        for (int i = 0; i < n; ++i) {
+            uint64_t tag = events[i].data.u64;
+            if (tag == LISTEN_TAG) {
+                accept_connections(r);
+            } else if (tag == WAKE_TAG) {
+                uint64_t count;
+                while (read(r->wake_fd, &count, sizeof(count)) > 0) {}
+                on_completions(r);
+            } else {
+                auto it = r->conns.find(tag);
+                if (it == r->conns.end()) {
+                    continue;
+                }
+                connection *c = it->second;
+                if (events[i].events & EPOLLOUT) {
+                    flush(r, c);
+                }
+                if (c->fd >= 0 && (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+                    on_readable(r, c);
+                }
+            }
+        }
+        for (uint64_t id : r->closed) {
+            auto it = r->conns.find(id);
+            delete it->second;
+            r->conns.erase(it);
+        }
+        r->closed.clear();
+    }
+}
+
+void event_server::accept_connections(reactor *r) {
+    while (true) {
+        int fd = accept4(r->listen_fd, nullptr, nullptr, SOCK_NONBLOCK);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                perror("accept");
+            }
+            return;
+        }
+        int yes = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+        connection *c = new connection(r->next_id++, fd);
+        c->events = EPOLLIN;
+        if (!epoll_add(r->epfd, fd, c->events, c->id)) {
+            perror("epoll_ctl");
+            close(fd);
+            delete c;
+            continue;
+        }
+        r->conns[c->id] = c;
+        ++connections;
+    }
+}
+
+void event_server::on_readable(reactor *r, connection *c) {
+    char buf[READ_CHUNK];
+    while (c->in.size() < MAX_BUFFERED_INPUT) {
+        ssize_t n = read(c->fd, buf, sizeof(buf));
+        if (n > 0) {
+            c->in.append(buf, n);
+        } else if (n == 0) {
+            // The peer is done sending; answer what it already sent.
+            c->closing = true;
+            break;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        } else {
+            close_connection(r, c);
+            return;
+        }
+    }
+    dispatch(r, c);
+}
+
+void event_server::submit(reactor *r, connection *c, string requests,
+                          vector<size_t> lengths) {
+    uint64_t id = c->id;
+    handler h = handle;
+    c->outstanding++;
+    workers->submit([r, id, h, requests, lengths]() {
+        string out;
+        bool keep = true;
+        size_t offset = 0;
+        for (size_t len : lengths) {
+            keep = h(requests.data() + offset, len, &out);
+            if (!keep) {
+                break;
+            }
+            offset += len;
+        }
+        r->post(id, std::move(out), !keep);
+    });
+}
+
+void event_server::dispatch(reactor *r, connection *c) {
+    size_t pos = 0;
+    while (c->fd >= 0 && !c->barrier && pos < c->in.size()) {
+        bool independent = false;
+        ssize_t len = frame(c->in.data() + pos, c->in.size() - pos, &independent);
+        if (len < 0) {
+            close_connection(r, c);
+            return;
+        }
+        if (len == 0) {
+            break;
+        }
+        if (independent) {
+            if (c->outstanding >= MAX_OUTSTANDING) {
+                break;
+            }
+            submit(r, c, c->in.substr(pos, len), vector<size_t>(1, len));
+            pos += len;
+            continue;
+        }
+        // Ordered requests wait for everything before them, and everything
+        // after them waits for them.  Consecutive ones are executed as one
+        // batch so that their responses come back in order.
+        if (c->outstanding > 0) {
+            break;
+        }
+        size_t batch_start = pos;
+        vector<size_t> lengths;
+        lengths.push_back(len);
+        pos += len;
+        while (pos < c->in.size()) {
+            len = frame(c->in.data() + pos, c->in.size() - pos, &independent);
+            if (len <= 0 || independent) {
+                break;
+            }
+            lengths.push_back(len);
+            pos += len;
+        }
+        submit(r, c, c->in.substr(batch_start, pos - batch_start), lengths);
+        c->barrier = true;
+    }
+    if (c->fd < 0) {
+        return;
+    }
+    c->in.erase(0, pos);
+    if (c->closing && c->outstanding == 0 && c->out_pos == c->out.size()) {
+        close_connection(r, c);
+        return;
+    }
+    update_interest(r, c);
+}
+
+void event_server::on_completions(reactor *r) {
+    vector<reactor::completion> done;
+    {
+        lock_guard<mutex> l(r->mu);
+        done.swap(r->completions);
+    }
+    for (auto &completion : done) {
+        auto it = r->conns.find(completion.id);
+        if (it == r->conns.end()) {
+            continue;
+        }
+        connection *c = it->second;
+        if (--c->outstanding == 0) {
+            c->barrier = false;
+        }
+        if (c->fd < 0) {
+            if (c->outstanding == 0) {
+                // Closed while its requests were executing.
+                r->closed.push_back(c->id);
+            }
+            continue;
+        }
+        c->out.append(completion.response);
+        if (completion.close) {
+            c->closing = true;
+            c->in.clear();
+        }
+        flush(r, c);
+        dispatch(r, c);
+    }
+}
+
+void event_server::flush(reactor *r, connection *c) {
+    if (c->fd < 0) {
+        return;
+    }
+    while (c->out_pos < c->out.size()) {
+        ssize_t n = send(c->fd, c->out.data() + c->out_pos, c->out.size() - c->out_pos,
+                         MSG_NOSIGNAL);
+        if (n >= 0) {
+            c->out_pos += n;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        } else {
+            close_connection(r, c);
+            return;
+        }
+    }
+    if (c->out_pos == c->out.size()) {
+        c->out.clear();
+        c->out_pos = 0;
+        if (c->closing && c->outstanding == 0) {
+            close_connection(r, c);
+            return;
+        }
+    }
+    update_interest(r, c);
+}
+
+void event_server::update_interest(reactor *r, connection *c) {
+    uint32_t events = 0;
+    if (!c->closing && c->in.size() < MAX_BUFFERED_INPUT) {
+        events |= EPOLLIN;
+    }
+    if (c->out_pos < c->out.size()) {
+        events |= EPOLLOUT;
+    }
+    if (events != c->events) {
+        struct epoll_event ev;
+        ev.events = events;
+        ev.data.u64 = c->id;
+        epoll_ctl(r->epfd, EPOLL_CTL_MOD, c->fd, &ev);
+        c->events = events;
+    }
+}
+
+void event_server::close_connection(reactor *r, connection *c) {
+    if (c->fd >= 0) {
+        epoll_ctl(r->epfd, EPOLL_CTL_DEL, c->fd, nullptr);
+        close(c->fd);
+        c->fd = -1;
+        --connections;
+        if (c->outstanding == 0) {
+            // Otherwise deleted once its last task completes.
+            r->closed.push_back(c->id);
+        }
+    }
+}
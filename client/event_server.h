@@ -0,0 +1,87 @@
+//
+// Event-driven request server for glakv_server.
+//
+// A fixed number of reactor threads each run an epoll loop over their own
+// listening socket (bound with SO_REUSEPORT, so the kernel spreads new
+// connections over the reactors) and the connections accepted on it.
+// Reactors only move bytes: complete requests are cut out of the input
+// stream by a framer and executed on a shared pool of worker threads, and
+// responses are handed back to the reactor that owns the connection.
+//
+// Requests the framer marks as independent (they carry their own request
+// id) are executed concurrently and answered as they complete.  Other
+// requests are ordered: they run after everything received before them
+// and before anything received after them.
+//
+
+#ifndef LEVELDB_EVENT_SERVER_H
+#define LEVELDB_EVENT_SERVER_H
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <vector>
+
+class event_server {
+public:
+    // Returns the length of the request at the start of buf, 0 if buf does
+    // not hold all of it yet, or -1 if buf does not start with a valid
+    // request, in which case the connection is closed.  Sets *independent
+    // if the request may be executed and answered out of order.
+    typedef std::function<ssize_t(const char *buf, size_t len, bool *independent)> framer;
+
+    // Executes the request in req[0, len) and appends its response to *out.
+    // Returns false if the connection should be closed once the responses
+    // so far have been sent.  Called concurrently from the worker threads.
+    typedef std::function<bool(const char *req, size_t len, std::string *out)> handler;
+
+    event_server(int port, int num_reactors, int num_workers, framer f, handler h);
+
+    // Stops the server if it is running.
+    ~event_server();
+
+    // Opens the listening sockets and starts the reactor and worker threads.
+    // Returns false if the sockets cannot be set up.
+    bool start();
+
+    // Stops accepting and serving requests and closes all connections.
+    // Requests already handed to the workers are still executed.
+    void stop();
+
+    int num_connections() const { return connections; }
+
+private:
+    struct connection;
+    struct reactor;
+    class worker_pool;
+
+    void run(reactor *r);
+    void accept_connections(reactor *r);
+    void on_readable(reactor *r, connection *c);
+    void dispatch(reactor *r, connection *c);
+    void submit(reactor *r, connection *c, std::string requests, std::vector<size_t> lengths);
+    void on_completions(reactor *r);
+    void flush(reactor *r, connection *c);
+    void update_interest(reactor *r, connection *c);
+    void close_connection(reactor *r, connection *c);
+
+    const int port;
+    const int num_reactors;
+    const int num_workers;
+    const framer frame;
+    const handler handle;
+
+    std::vector<reactor *> reactors;
+    worker_pool *workers;
+    std::atomic<bool> stopping;
+    std::atomic<int> connections;
+
+    // No copying allowed
+    event_server(const event_server &);
+    void operator=(const event_server &);
+};
+
+
+#endif //LEVELDB_EVENT_SERVER_H
@@ -5,12 +5,14 @@
 #include "config.h"
 #include "exponential_distribution.h"
 
+#include <algorithm>
 #include <getopt.h>
 #include <iostream>
+#include <string.h>
 #include <thread>
 #include <leveldb/cache.h>
 #include <leveldb/db.h>
-#include <leveldb/write_batch.h>
+#include <leveldb/sst_file_writer.h>
 
 #define DB_SIZE     1000000
 #define NUM_CLIENTS 128
@@ -22,6 +24,7 @@ using std::endl;
 using std::min;
 using std::ostream;
 using std::rand;
+using std::sort;
 using std::string;
 using std::thread;
 using std::uniform_int_distribution;
@@ -31,9 +34,8 @@ using leveldb::DB;
 using leveldb::Options;
 using leveldb::Status;
 using leveldb::Slice;
-using leveldb::WriteOptions;
+using leveldb::SstFileWriter;
 using leveldb::ReadOptions;
-using leveldb::WriteBatch;
 using leveldb::NewLRUCache;
 
 static inline uint64_t *id_field(char *key, int klen) {
@@ -60,32 +62,49 @@ void load_data(string &dir, uint64_t db_size) {
     bzero(key_buf, KEY_LEN);
     uint64_t *id = id_field(key_buf, KEY_LEN);
 
-    // Load data into the database, one batch at a time
-    WriteBatch batch;
-    WriteOptions options;
-    options.sync = true;
+    // Table files are written in key order. Keys compare bytewise, and
+    // hold the ids in native byte order.
+    vector<uint64_t> ids(db_size);
+    for (uint64_t i = 0; i < db_size; ++i) {
+        ids[i] = i;
+    }
+    sort(ids.begin(), ids.end(), [](uint64_t a, uint64_t b) {
+        return memcmp(&a, &b, sizeof(uint64_t)) < 0;
+    });
+
+    // Write the data into table files, one key range at a time, then add
+    // them all to the database at once
+    SstFileWriter writer((Options()));
+    vector<string> files;
     const uint64_t batch_size = db_size / 5;
     uint64_t count = 0;
-    while (count < db_size) {
+    Status status;
+    while (count < db_size && status.ok()) {
         uint64_t num_writes = min(batch_size, db_size - count);
-        for (uint64_t i = 0; i < num_writes; ++i, ++count) {
+        files.push_back(dir + "/load-" + std::to_string(files.size()) + ".sst");
+        status = writer.Open(files.back());
+        for (uint64_t i = 0; i < num_writes && status.ok(); ++i, ++count) {
             char val_buf[VAL_LEN];
-            *id = count;
+            *id = ids[count];
             Slice key(key_buf, KEY_LEN);
             Slice val(val_buf, VAL_LEN);
-            batch.Put(key, val);
+            status = writer.Put(key, val);
         }
-        Status status = db->Write(options, &batch);
-        if (!status.ok()) {
-            cerr << status.ToString() << endl;
-            break;
+        if (status.ok()) {
+            status = writer.Finish();
         }
-        batch.Clear();
         uint64_t percentage_done = (count * 100) / db_size;
         string progress_bar(percentage_done, '.');
         cout << "Loading" << progress_bar << percentage_done << '%' << endl;
     }
-    cout << "All kv pairs loaded into the database." << endl;
+    if (status.ok()) {
+        status = db->IngestExternalFiles(files);
+    }
+    if (!status.ok()) {
+        cerr << status.ToString() << endl;
+    } else {
+        cout << "All kv pairs loaded into the database." << endl;
+    }
     delete db;
 }
 
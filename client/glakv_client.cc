@@ -4,6 +4,7 @@
 
 #include "config.h"
 #include "exponential_distribution.h"
+#include "protocol.h"
 
 #include <getopt.h>
 #include <unistd.h>
@@ -19,15 +20,11 @@
 #include <leveldb/db.h>
 #include <leveldb/write_batch.h>
 
-#define BUF_LEN     (VAL_LEN * 2)
-#define GET         "Get"
-#define PUT         "Put"
-#define DEL         "Del"
-#define QUIT        "Quit"
 #define DB_SIZE     1000000
 #define NUM_CLIENTS 128
 #define NUM_EXP     100000
 #define INT_LEN     (sizeof(uint64_t) / sizeof(char))
+#define LOAD_BATCH  100
 
 using std::cerr;
 using std::cout;
@@ -50,6 +47,7 @@ using leveldb::WriteBatch;
 using leveldb::NewLRUCache;
 
 static int lambda = 1;
+static int depth = 1;
 
 static inline uint64_t *id_field(char *key, int klen) {
     return (uint64_t *) (key + klen - INT_LEN);
@@ -86,56 +84,43 @@ static int connect() {
     return sockfd;
 }
 
-void store_uint64(char *buf, uint64_t val) {
-    *((uint64_t *) buf) = val;
-}
-
-uint64_t get_unit64(char *buf) {
-    return *((uint64_t *) buf);
-}
-
-Slice send_get(int sockfd, const char *key_buf, int klen) {
-    char cmd_buf[BUF_LEN];
-    char res_buf[BUF_LEN];
-    int GET_LEN = strlen(GET);
-    memcpy(cmd_buf, GET, GET_LEN);
-    store_uint64(cmd_buf + GET_LEN, klen);
-    memcpy(cmd_buf + GET_LEN + INT_LEN, key_buf, klen);
-    int len = GET_LEN + INT_LEN + klen;
-    if (write(sockfd, cmd_buf, len) != len) {
-        error("ERROR sending command");
-    }
-    if (read(sockfd, res_buf, BUF_LEN) < 0) {
-        error("ERROR receiving result");
+void send_all(int sockfd, const string &buf) {
+    size_t pos = 0;
+    while (pos < buf.size()) {
+        ssize_t n = write(sockfd, buf.data() + pos, buf.size() - pos);
+        if (n < 0) {
+            error("ERROR sending command");
+        }
+        pos += n;
     }
-    assert(res_buf[0] == 1);
-    uint64_t vlen = get_unit64(res_buf + 1);
-    Slice val(res_buf + 1 + INT_LEN, vlen);
-    return val;
 }
 
-void send_put(int sockfd, const char *key_buf, int klen, const char *val_buf, int vlen) {
-    char cmd_buf[BUF_LEN];
-    char res_buf[BUF_LEN];
-    int PUT_LEN = strlen(PUT);
-    memcpy(cmd_buf, PUT, PUT_LEN);
-    store_uint64(cmd_buf + PUT_LEN, klen);
-    assert(get_unit64(cmd_buf + PUT_LEN) == klen);
-    memcpy(cmd_buf + PUT_LEN + INT_LEN, key_buf, klen);
-    store_uint64(cmd_buf + PUT_LEN + INT_LEN + klen, vlen);
-    memcpy(cmd_buf + PUT_LEN + INT_LEN + klen + INT_LEN, val_buf, vlen);
-    int len = PUT_LEN + INT_LEN + klen + INT_LEN + vlen;
-    if (write(sockfd, cmd_buf, len) != len) {
-        error("ERROR sending command");
-    }
-    if (read(sockfd, res_buf, BUF_LEN) < 0) {
-        error("ERROR receiving result");
+// Reads the next response from sockfd into *header and *body.  *buffered
+// holds the bytes received from sockfd but not consumed yet.
+void recv_response(int sockfd, string *buffered, message_header *header, string *body) {
+    char buf[64 * 1024];
+    while (true) {
+        if (buffered->size() >= HEADER_LEN) {
+            decode_header(buffered->data(), header);
+            size_t len = HEADER_LEN + header->body_len;
+            if (buffered->size() >= len) {
+                body->assign(*buffered, HEADER_LEN, header->body_len);
+                buffered->erase(0, len);
+                return;
+            }
+        }
+        ssize_t n = read(sockfd, buf, sizeof(buf));
+        if (n <= 0) {
+            error("ERROR receiving result");
+        }
+        buffered->append(buf, n);
     }
-    assert(res_buf[0] == 1);
 }
 
 void send_quit(int sockfd) {
-    write(sockfd, QUIT, strlen(QUIT));
+    string cmd;
+    put_header(&cmd, OP_QUIT, 0, 0);
+    send_all(sockfd, cmd);
     close(sockfd);
 }
 
@@ -145,16 +130,35 @@ void load_data(uint64_t db_size) {
     char key_buf[KEY_LEN];
     bzero(key_buf, KEY_LEN);
     uint64_t *id = id_field(key_buf, KEY_LEN);
+    char val_buf[VAL_LEN];
+    string body;
+    string cmd;
+    string buffered;
+    string res;
+    message_header header;
 
     // Load data into the database, one batch at a time
     const uint64_t batch_size = db_size / 5;
     uint64_t count = 0;
     while (count < db_size) {
         uint64_t num_writes = min(batch_size, db_size - count);
-        for (uint64_t i = 0; i < num_writes; ++i, ++count) {
-            char val_buf[VAL_LEN];
-            *id = count;
-            send_put(sockfd, key_buf, KEY_LEN, val_buf, VAL_LEN);
+        uint64_t i = 0;
+        while (i < num_writes) {
+            // Send the kv pairs LOAD_BATCH at a time as one atomic MPUT.
+            uint32_t n = (uint32_t) min<uint64_t>(LOAD_BATCH, num_writes - i);
+            body.clear();
+            put_fixed32(&body, n);
+            for (uint32_t j = 0; j < n; ++j, ++i, ++count) {
+                *id = count;
+                put_string(&body, key_buf, KEY_LEN);
+                put_string(&body, val_buf, VAL_LEN);
+            }
+            cmd.clear();
+            put_header(&cmd, OP_MPUT, body.size(), count);
+            cmd.append(body);
+            send_all(sockfd, cmd);
+            recv_response(sockfd, &buffered, &header, &res);
+            assert(header.code == STATUS_OK);
         }
         uint64_t percentage_done = (count * 100) / db_size;
         string progress_bar(percentage_done, '.');
@@ -180,18 +184,33 @@ void execute(uint64_t database_size, int num_exps) {
     bzero(key_buf, KEY_LEN);
     uint64_t *id = id_field(key_buf, KEY_LEN);
     uint64_t key = (uint64_t) (rand() % database_size);
-    for (int count = 0; count < num_exps; ++count) {
-        *id = key;
-        send_get(sockfd, key_buf, KEY_LEN);
-        if (count % 10 == 0) {
-            key = uni_dist(generator);
-        } else {
-            uint64_t next_rank = exp_dist.next();
-            key = (next_rank + key + database_size / 3) % database_size;
+    string cmd;
+    string buffered;
+    string val;
+    message_header header;
+    int sent = 0;
+    int received = 0;
+    while (received < num_exps) {
+        // Keep up to depth requests outstanding, sending them in one write.
+        cmd.clear();
+        while (sent - received < depth && sent < num_exps) {
+            *id = key;
+            put_header(&cmd, OP_GET, KEY_LEN, sent);
+            cmd.append(key_buf, KEY_LEN);
+            if (sent % 10 == 0) {
+                key = uni_dist(generator);
+            } else {
+                uint64_t next_rank = exp_dist.next();
+                key = (next_rank + key + database_size / 3) % database_size;
+            }
+            ++sent;
         }
+        send_all(sockfd, cmd);
+        recv_response(sockfd, &buffered, &header, &val);
+        assert(header.code == STATUS_OK);
+        ++received;
     }
     send_quit(sockfd);
-    close(sockfd);
 }
 
 void run(int num_threads, uint64_t database_size, int num_exps) {
@@ -222,6 +241,8 @@ void usage(ostream &os) {
     os << "-m       parameter for exponential distribution" << endl;
     os << "--num" << endl;
     os << "-n       number of operations each client does" << endl;
+    os << "--depth" << endl;
+    os << "-D       number of outstanding requests per client" << endl;
 }
 
 int main(int argc, char *argv[]) {
@@ -233,6 +254,7 @@ int main(int argc, char *argv[]) {
             {"client",  required_argument, 0, 'c'},
             {"num",     required_argument, 0, 'n'},
             {"lambda",  required_argument, 0, 'm'},
+            {"depth",   required_argument, 0, 'D'},
             {0, 0, 0, 0}
     };
 
@@ -244,7 +266,7 @@ int main(int argc, char *argv[]) {
     uint64_t database_size = DB_SIZE;
     int num_clients = NUM_CLIENTS;
     int num_exps = NUM_EXP;
-    while ((c = getopt_long(argc, argv, "lehs:c:m:n:", long_options, &option_index)) != -1) {
+    while ((c = getopt_long(argc, argv, "lehs:c:m:n:D:", long_options, &option_index)) != -1) {
         switch(c) {
             case 'l':
                 load_flag = 1;
@@ -266,6 +288,12 @@ int main(int argc, char *argv[]) {
             case 'n':
                 num_exps = atoi(optarg);
                 break;
+            case 'D':
+                depth = atoi(optarg);
+                if (depth < 1) {
+                    depth = 1;
+                }
+                break;
             case '?':
                 break;
             default:
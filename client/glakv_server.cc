@@ -1,5 +1,8 @@
 #include "config.h"
 #include "exponential_distribution.h"
+#include "event_server.h"
+#include "prefetcher.h"
+#include "protocol.h"
 
 #include <getopt.h>
 #include <unistd.h>
@@ -8,6 +11,7 @@
 #include <netinet/in.h>
 #include <netdb.h>
 #include <signal.h>
+#include <sys/uio.h>
 
 #include <atomic>
 #include <iostream>
@@ -29,6 +33,7 @@
 #define NUM_CLIENTS 128
 #define NUM_EXP     100000
 #define INT_LEN     (sizeof(uint64_t) / sizeof(char))
+#define PORT        4242
 
 using std::atomic;
 using std::cerr;
@@ -46,6 +51,7 @@ using std::vector;
 using leveldb::Cache;
 using leveldb::DB;
 using leveldb::Options;
+using leveldb::PinnedValue;
 using leveldb::Status;
 using leveldb::Slice;
 using leveldb::WriteOptions;
@@ -56,6 +62,11 @@ using leveldb::NewLRUCache;
 static bool quit = false;
 static bool prefetch = false;
 static int num_prefetch = NUM_PREFETCH;
+static int prefetch_workers = PREFETCH_WORKERS;
+static int prefetch_queue = PREFETCH_QUEUE;
+static prefetcher *prefetch_engine = nullptr;
+static int num_reactors = 0;
+static int num_workers = NUM_WORKERS;
 static vector<thread> threads;
 static atomic<int> num_threads(0);
 static bool reported = true;
@@ -81,6 +92,17 @@ void usage(ostream &os) {
     os << "-h       show this message" << endl;
     os << "--dir" << endl;
     os << "-d       directory to store the database files" << endl;
+    os << "--prefetch[=N]" << endl;
+    os << "-p N     prefetch N keys for every Get" << endl;
+    os << "--prefetch-workers" << endl;
+    os << "-w       number of prefetch worker threads" << endl;
+    os << "--prefetch-queue" << endl;
+    os << "-q       maximum number of queued prefetches" << endl;
+    os << "--reactors" << endl;
+    os << "-r N     serve connections from N epoll event loops instead of" << endl;
+    os << "         one thread per connection" << endl;
+    os << "--workers" << endl;
+    os << "-t       number of threads executing requests for the event loops" << endl;
 }
 
 static inline DB *db_open(string &dir, Cache *cache, bool create) {
@@ -102,6 +124,10 @@ void parse_opts(int argc, char *argv[], int &help_flag, string &dir, int &num_ex
             {"prefetch",optional_argument, 0, 'p'},
             {"num",     required_argument, 0, 'n'},
             {"dir",     required_argument, 0, 'd'},
+            {"prefetch-workers", required_argument, 0, 'w'},
+            {"prefetch-queue",   required_argument, 0, 'q'},
+            {"reactors", required_argument, 0, 'r'},
+            {"workers",  required_argument, 0, 't'},
             {0, 0, 0, 0}
     };
 
@@ -109,7 +135,7 @@ void parse_opts(int argc, char *argv[], int &help_flag, string &dir, int &num_ex
     int option_index;
     help_flag = 0;
     dir = "glakv_home";
-    while ((c = getopt_long(argc, argv, "hn:p:d:", long_options, &option_index)) != -1) {
+    while ((c = getopt_long(argc, argv, "hn:p:d:w:q:r:t:", long_options, &option_index)) != -1) {
         switch(c) {
             case 'h':
                 help_flag = 1;
@@ -126,6 +152,18 @@ void parse_opts(int argc, char *argv[], int &help_flag, string &dir, int &num_ex
             case 'd':
                 dir = optarg;
                 break;
+            case 'w':
+                prefetch_workers = atoi(optarg);
+                break;
+            case 'q':
+                prefetch_queue = atoi(optarg);
+                break;
+            case 'r':
+                num_reactors = atoi(optarg);
+                break;
+            case 't':
+                num_workers = atoi(optarg);
+                break;
             case '?':
                 break;
             default:
@@ -145,7 +183,7 @@ int setup_server() {
     int yes = 1;
     setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(int));
     bzero((char *) &serv_addr, sizeof(serv_addr));
-    portno = 4242;
+    portno = PORT;
     serv_addr.sin_family = AF_INET;
     serv_addr.sin_addr.s_addr = INADDR_ANY;
     serv_addr.sin_port = htons(portno);
@@ -168,121 +206,420 @@ static inline uint64_t *id_field(const char *key, uint64_t klen) {
     return (uint64_t *) (key + klen - INT_LEN);
 }
 
-void prefetch_kv(DB* db, Slice key) {
-    string val;
-    db->Get(ReadOptions(), key, &val);
-}
-
-void prefetch_for_key(DB *db, char *key_buf, uint64_t klen) {
-    if (prefetch) {
+void prefetch_for_key(char *key_buf, uint64_t klen) {
+    // Prefetch targets are derived from the id in the last bytes of the key.
+    if (prefetch_engine != nullptr && klen >= INT_LEN && db_size > 0) {
         uint64_t *id = id_field(key_buf, klen);
         uint64_t key_val = *id;
         for (int count = 0; count < num_prefetch; ++count) {
-            *id = (key_val + db_size / 3) % db_size;
-            Slice key(key_buf, klen);
-            thread t(prefetch_kv, db, key);
-            t.detach();
+            *id = (key_val + db_size / 3 + count) % db_size;
+            prefetch_engine->submit(string(key_buf, klen));
         }
+        *id = key_val;
     }
 }
 
-void serve_client(int sockfd, DB *db, vector<double> &latencies, mutex &lock) {
-    reported = false;
-    char buffer[BUF_LEN];
-    char res[BUF_LEN];
-    uint64_t res_len = 0;
-    ssize_t len = 0;
-    bool is_get = false;
-    char *key_buf;
-    uint64_t klen;
-    while (!quit) {
-        is_get = false;
-        bzero(buffer, BUF_LEN);
-        if ((len = read(sockfd, buffer, BUF_LEN)) < 0) {
-            cerr << "Error reading from client" << endl;
+static inline bool has_prefix(const char *buf, size_t len, const char *op) {
+    size_t op_len = strlen(op);
+    return len >= op_len && memcmp(buf, op, op_len) == 0;
+}
+
+// Returns the length of the request at the start of buf, 0 if buf does not
+// hold all of it yet, or -1 if buf does not start with a request.  Keys and
+// values are prefixed with their length, so requests delimit themselves.
+ssize_t request_length(const char *buf, size_t len) {
+    size_t GET_LEN = strlen(GET);
+    size_t PUT_LEN = strlen(PUT);
+    size_t DEL_LEN = strlen(DEL);
+    size_t QUIT_LEN = strlen(QUIT);
+    size_t header_len = 0;
+    if (has_prefix(buf, len, GET)) {
+        header_len = GET_LEN;
+    } else if (has_prefix(buf, len, DEL)) {
+        header_len = DEL_LEN;
+    } else if (has_prefix(buf, len, PUT)) {
+        if (len < PUT_LEN + INT_LEN) {
+            return 0;
+        }
+        uint64_t klen = get_unit64((char *) buf + PUT_LEN);
+        if (klen > BUF_LEN) {
+            return -1;
+        }
+        size_t vlen_pos = PUT_LEN + INT_LEN + klen;
+        if (len < vlen_pos + INT_LEN) {
+            return 0;
+        }
+        uint64_t vlen = get_unit64((char *) buf + vlen_pos);
+        if (vlen > BUF_LEN) {
+            return -1;
+        }
+        size_t total = vlen_pos + INT_LEN + vlen;
+        return len < total ? 0 : total;
+    } else if (has_prefix(buf, len, QUIT)) {
+        return QUIT_LEN;
+    } else if (len < QUIT_LEN) {
+        // Not enough to tell the opcodes apart yet.
+        return 0;
+    } else {
+        return -1;
+    }
+    if (len < header_len + INT_LEN) {
+        return 0;
+    }
+    uint64_t klen = get_unit64((char *) buf + header_len);
+    if (klen > BUF_LEN) {
+        return -1;
+    }
+    size_t total = header_len + INT_LEN + klen;
+    return len < total ? 0 : total;
+}
+
+// Executes the complete request in req[0, len) and appends the response to
+// *res, except for a value read from the database, which is left pinned in
+// *tail and follows *res on the wire.  Stores the time spent in the database
+// in *latency.  Returns false if the client asked to quit.
+bool execute_request(DB *db, const char *req, size_t len, string *res, PinnedValue *tail,
+                     double *latency) {
+    size_t GET_LEN = strlen(GET);
+    size_t PUT_LEN = strlen(PUT);
+    size_t DEL_LEN = strlen(DEL);
+    char header[1 + INT_LEN];
+    std::chrono::duration<double> diff(0);
+    Status s;
+    if (has_prefix(req, len, GET)) {
+        uint64_t klen = get_unit64((char *) req + GET_LEN);
+        string key(req + GET_LEN + INT_LEN, klen);
+        if (prefetch_engine != nullptr) {
+            prefetch_engine->record_access(key);
+        }
+        auto start = std::chrono::high_resolution_clock::now();
+        s = db->GetPinned(ReadOptions(), key, tail);
+        auto end = std::chrono::high_resolution_clock::now();
+        diff = end - start;
+        if (s.ok()) {
+            header[0] = 1;
+            store_uint64(header + 1, tail->size());
+            res->append(header, 1 + INT_LEN);
+        } else {
+            res->push_back(0);
+        }
+        prefetch_for_key(&key[0], klen);
+    } else if (has_prefix(req, len, PUT)) {
+        uint64_t klen = get_unit64((char *) req + PUT_LEN);
+        uint64_t vlen = get_unit64((char *) req + PUT_LEN + INT_LEN + klen);
+        Slice key(req + PUT_LEN + INT_LEN, klen);
+        Slice val(req + PUT_LEN + INT_LEN + klen + INT_LEN, vlen);
+        auto start = std::chrono::high_resolution_clock::now();
+        s = db->Put(WriteOptions(), key, val);
+        auto end = std::chrono::high_resolution_clock::now();
+        diff = end - start;
+        res->push_back(s.ok() ? 1 : 0);
+    } else if (has_prefix(req, len, DEL)) {
+        uint64_t klen = get_unit64((char *) req + DEL_LEN);
+        Slice key(req + DEL_LEN + INT_LEN, klen);
+        auto start = std::chrono::high_resolution_clock::now();
+        s = db->Delete(WriteOptions(), key);
+        auto end = std::chrono::high_resolution_clock::now();
+        diff = end - start;
+        res->push_back(s.ok() ? 1 : 0);
+    } else {
+        return false;
+    }
+    *latency = diff.count();
+    return true;
+}
+
+static inline uint8_t status_of(const Status &s) {
+    if (s.ok()) {
+        return STATUS_OK;
+    }
+    return s.IsNotFound() ? STATUS_NOT_FOUND : STATUS_ERROR;
+}
+
+// Executes the complete version 1 message in req[0, len) and appends the
+// response to *res and *tail like execute_request().  Stores the time spent
+// in the database in *latency.  Returns false for OP_QUIT.
+bool execute_message(DB *db, const char *req, size_t len, string *res, PinnedValue *tail,
+                     double *latency) {
+    message_header header;
+    decode_header(req, &header);
+    if (header.code == OP_QUIT) {
+        return false;
+    }
+    const char *p = req + HEADER_LEN;
+    const char *limit = p + header.body_len;
+    vector<string> accessed;
+    string body;
+    uint8_t status = STATUS_OK;
+    auto start = std::chrono::high_resolution_clock::now();
+    switch (header.code) {
+        case OP_GET: {
+            accessed.push_back(string(p, header.body_len));
+            status = status_of(db->GetPinned(ReadOptions(), accessed.back(), tail));
             break;
         }
-        size_t GET_LEN = strlen(GET);
-        size_t PUT_LEN = strlen(PUT);
-        size_t DEL_LEN = strlen(DEL);
-        size_t QUIT_LEN = strlen(QUIT);
-        std::chrono::duration<double> diff;
-        if (strncmp(GET, buffer, GET_LEN) == 0) {
-            is_get = true;
-            klen = get_unit64(buffer + GET_LEN);
-//            assert(len == GET_LEN + INT_LEN + klen);
-            key_buf = buffer + GET_LEN + INT_LEN;
-            Slice key(key_buf, klen);
-            string val;
-            auto start = std::chrono::high_resolution_clock::now();
-            Status s = db->Get(ReadOptions(), key, &val);
-            auto end = std::chrono::high_resolution_clock::now();
-            diff = end - start;
-            if (s.ok()) {
-                res[0] = 1;
-                store_uint64(res + 1, val.size());
-                memcpy(res + 1 + INT_LEN, val.c_str(), val.size());
-                res_len = 1 + INT_LEN + val.size();
-            } else {
-                res[0] = 0;
-                res_len = 1;
+        case OP_PUT: {
+            const char *key;
+            uint32_t klen;
+            if (!get_string(&p, limit, &key, &klen)) {
+                status = STATUS_BAD_REQUEST;
+                break;
             }
-        } else if (strncmp(PUT, buffer, PUT_LEN) == 0) {
-            klen = get_unit64(buffer + PUT_LEN);
-            uint64_t vlen = get_unit64(buffer + PUT_LEN + INT_LEN + klen);
-            if (len != PUT_LEN + INT_LEN + klen + INT_LEN + vlen) {
-                cout << len << "," << PUT_LEN + INT_LEN + klen + INT_LEN + vlen << endl;
+            status = status_of(db->Put(WriteOptions(), Slice(key, klen), Slice(p, limit - p)));
+            break;
+        }
+        case OP_DEL: {
+            status = status_of(db->Delete(WriteOptions(), Slice(p, header.body_len)));
+            break;
+        }
+        case OP_MGET: {
+            vector<Slice> keys;
+            uint32_t n = limit - p >= 4 ? decode_fixed32(p) : 0;
+            p += 4;
+            for (uint32_t i = 0; i < n && status == STATUS_OK; ++i) {
+                const char *key;
+                uint32_t klen;
+                if (get_string(&p, limit, &key, &klen)) {
+                    keys.push_back(Slice(key, klen));
+                } else {
+                    status = STATUS_BAD_REQUEST;
+                }
             }
-//            assert(len == PUT_LEN + INT_LEN + klen + INT_LEN + vlen);
-            char *key_buf = buffer + PUT_LEN + INT_LEN;
-            char *val_buf = buffer + PUT_LEN + INT_LEN + klen + INT_LEN;
-            Slice key(key_buf, klen);
-            Slice val(val_buf, vlen);
-            auto start = std::chrono::high_resolution_clock::now();
-            Status s = db->Put(WriteOptions(), key, val);
-            auto end = std::chrono::high_resolution_clock::now();
-            diff = end - start;
-            if (s.ok()) {
-                res[0] = 1;
-                res_len = 1;
-            } else {
-                res[0] = 0;
-                res_len = 1;
+            if (status != STATUS_OK || p != limit) {
+                status = STATUS_BAD_REQUEST;
+                break;
+            }
+            vector<string> values;
+            vector<Status> statuses = db->MultiGet(ReadOptions(), keys, &values);
+            for (uint32_t i = 0; i < n; ++i) {
+                uint8_t s = status_of(statuses[i]);
+                body.push_back((char) s);
+                if (s == STATUS_OK) {
+                    put_string(&body, values[i].data(), values[i].size());
+                } else {
+                    put_fixed32(&body, 0);
+                }
+                accessed.push_back(keys[i].ToString());
+            }
+            break;
+        }
+        case OP_MPUT: {
+            WriteBatch batch;
+            uint32_t n = limit - p >= 4 ? decode_fixed32(p) : 0;
+            p += 4;
+            for (uint32_t i = 0; i < n && status == STATUS_OK; ++i) {
+                const char *key, *val;
+                uint32_t klen, vlen;
+                if (get_string(&p, limit, &key, &klen) && get_string(&p, limit, &val, &vlen)) {
+                    batch.Put(Slice(key, klen), Slice(val, vlen));
+                } else {
+                    status = STATUS_BAD_REQUEST;
+                }
             }
-        } else if (strncmp(DEL, buffer, DEL_LEN) == 0) {
-            klen = get_unit64(buffer + DEL_LEN);
-//            assert(len == DEL_LEN + INT_LEN + klen);
-            char *key_buf = buffer + strlen(DEL) + INT_LEN;
-            Slice key(key_buf, klen);
-            auto start = std::chrono::high_resolution_clock::now();
-            Status s = db->Delete(WriteOptions(), key);
-            auto end = std::chrono::high_resolution_clock::now();
-            diff = end - start;
-            if (s.ok()) {
-                res[0] = 1;
-                res_len = 1;
+            if (status == STATUS_OK && p == limit) {
+                status = status_of(db->Write(WriteOptions(), &batch));
             } else {
-                res[0] = 0;
-                res_len = 1;
+                status = STATUS_BAD_REQUEST;
+            }
+            break;
+        }
+        default:
+            status = STATUS_BAD_REQUEST;
+            break;
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> diff = end - start;
+    *latency = diff.count();
+    if (status != STATUS_OK && header.code != OP_MGET) {
+        body.clear();
+    }
+    put_header(res, status, body.size() + tail->size(), header.request_id);
+    res->append(body);
+    for (auto &key : accessed) {
+        if (prefetch_engine != nullptr) {
+            prefetch_engine->record_access(key);
+        }
+        prefetch_for_key(&key[0], key.size());
+    }
+    return true;
+}
+
+// Frames requests of either protocol.  Only version 1 messages, which carry
+// a request id, may be answered out of order.
+ssize_t frame_request(const char *buf, size_t len, bool *independent) {
+    *independent = false;
+    if (len == 0) {
+        return 0;
+    }
+    if ((uint8_t) buf[0] != PROTOCOL_VERSION) {
+        return request_length(buf, len);
+    }
+    if (len < HEADER_LEN) {
+        return 0;
+    }
+    message_header header;
+    decode_header(buf, &header);
+    if (header.body_len > MAX_BODY_LEN) {
+        return -1;
+    }
+    *independent = header.code != OP_QUIT;
+    size_t total = HEADER_LEN + (size_t) header.body_len;
+    return len < total ? 0 : total;
+}
+
+// Executes a complete request of either protocol.  The response consists of
+// *res followed by *tail.
+bool handle_request(DB *db, const char *req, size_t len, string *res, PinnedValue *tail,
+                    double *latency) {
+    tail->Reset();
+    if ((uint8_t) req[0] == PROTOCOL_VERSION) {
+        return execute_message(db, req, len, res, tail, latency);
+    }
+    return execute_request(db, req, len, res, tail, latency);
+}
+
+// Writes res followed by tail to sockfd with as few system calls as
+// possible.  Returns false on error.
+bool send_response(int sockfd, const string &res, const PinnedValue &tail) {
+    struct iovec iov[2];
+    iov[0].iov_base = (void *) res.data();
+    iov[0].iov_len = res.size();
+    iov[1].iov_base = (void *) tail.data();
+    iov[1].iov_len = tail.size();
+    struct iovec *next = iov;
+    int count = 2;
+    while (count > 0) {
+        ssize_t n = writev(sockfd, next, count);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        while (count > 0 && (size_t) n >= next->iov_len) {
+            n -= next->iov_len;
+            ++next;
+            --count;
+        }
+        if (count > 0) {
+            next->iov_base = (char *) next->iov_base + n;
+            next->iov_len -= n;
+        }
+    }
+    return true;
+}
+
+void record_latency(vector<double> &latencies, mutex &lock, double latency) {
+    lock.lock();
+    latencies.push_back(latency);
+    lock.unlock();
+}
+
+void serve_client(int sockfd, DB *db, vector<double> &latencies, mutex &lock) {
+    reported = false;
+    char buffer[BUF_LEN];
+    string pending;
+    string res;
+    // Values are sent straight from the block cache or memtable.
+    PinnedValue tail;
+    ssize_t len = 0;
+    bool done = false;
+    while (!quit && !done) {
+        if ((len = read(sockfd, buffer, BUF_LEN)) <= 0) {
+            if (len < 0) {
+                cerr << "Error reading from client" << endl;
             }
-        } else if (strncmp(QUIT, buffer, QUIT_LEN) == 0) {
             break;
         }
-        if (is_get) {
-            prefetch_for_key(db, key_buf, klen);
+        pending.append(buffer, len);
+        size_t pos = 0;
+        ssize_t req_len;
+        bool independent;
+        while (!done && (req_len = frame_request(pending.data() + pos, pending.size() - pos,
+                                                 &independent)) > 0) {
+            double latency;
+            res.clear();
+            if (!handle_request(db, pending.data() + pos, req_len, &res, &tail, &latency)) {
+                done = true;
+                break;
+            }
+            pos += req_len;
+            if (!send_response(sockfd, res, tail)) {
+                cerr << "Error sending result to client" << endl;
+                done = true;
+                break;
+            }
+            tail.Reset();
+            record_latency(latencies, lock, latency);
         }
-        if (write(sockfd, res, res_len) != res_len) {
-            cerr << "Error sending result to client" << endl;
+        if (req_len < 0) {
+            cerr << "Malformed request from client" << endl;
             break;
         }
-        lock.lock();
-        latencies.push_back(diff.count());
-        lock.unlock();
+        pending.erase(0, pos);
     }
     --num_threads;
     close(sockfd);
 }
 
+// Prints the average latency of the requests served since the last report.
+// Returns true once num_exp experiments have been reported.
+bool report(vector<double> &latencies, mutex &lock, int num_exp, int &count) {
+    lock.lock();
+    double sum = 0;
+    for (auto latency : latencies) {
+        sum += latency;
+    }
+    cout << sum / latencies.size();
+    if (prefetch_engine != nullptr) {
+        cout << "," << prefetch_engine->issued()
+             << "," << prefetch_engine->dropped()
+             << "," << prefetch_engine->useful();
+        prefetch_engine->reset_stats();
+    }
+    cout << endl;
+    latencies.clear();
+    lock.unlock();
+    reported = true;
+    if (num_exp > 0) {
+        ++count;
+        if (count == num_exp) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void serve_events(DB *db, int num_exp) {
+    vector<double> latencies;
+    mutex lock;
+    int count = 0;
+    event_server server(PORT, num_reactors, num_workers, frame_request,
+                        [db, &latencies, &lock](const char *req, size_t len, string *res) {
+                            reported = false;
+                            double latency;
+                            PinnedValue tail;
+                            if (!handle_request(db, req, len, res, &tail, &latency)) {
+                                return false;
+                            }
+                            res->append(tail.data(), tail.size());
+                            record_latency(latencies, lock, latency);
+                            return true;
+                        });
+    if (!server.start()) {
+        error("ERROR starting event loops");
+    }
+    while (!quit) {
+        if (server.num_connections() == 0 && !reported) {
+            if (report(latencies, lock, num_exp, count)) {
+                break;
+            }
+        }
+        usleep(1000);
+    }
+    server.stop();
+}
+
 int main(int argc, char *argv[])
 {
     signal(SIGINT, quit_server);
@@ -299,6 +636,15 @@ int main(int argc, char *argv[])
 
     DB *db = db_open(dir, nullptr, true);
     count_kvs(db);
+    if (prefetch && num_prefetch > 0) {
+        prefetch_engine = new prefetcher(db, prefetch_workers, prefetch_queue);
+    }
+    if (num_reactors > 0) {
+        serve_events(db, num_exp);
+        delete prefetch_engine;
+        delete db;
+        return 0;
+    }
     int sockfd = setup_server();
     int newsockfd;
     socklen_t clilen;
@@ -317,18 +663,8 @@ int main(int argc, char *argv[])
         if (newsockfd < 0) {
             if (errno == EAGAIN || errno == EWOULDBLOCK) {
                 if (num_threads == 0 && !reported) {
-                    double sum = 0;
-                    for (auto latency : latencies) {
-                        sum += latency;
-                    }
-                    cout << sum / latencies.size() << endl;
-                    latencies.clear();
-                    reported = true;
-                    if (num_exp > 0) {
-                        ++count;
-                        if (count == num_exp) {
-                            break;
-                        }
+                    if (report(latencies, lock, num_exp, count)) {
+                        break;
                     }
                 }
                 usleep(100);
@@ -349,6 +685,7 @@ int main(int argc, char *argv[])
     }
 
     close(sockfd);
+    delete prefetch_engine;
     delete db;
     return 0;
 }
@@ -0,0 +1,156 @@
+//
+// Speculative prefetching for glakv_server.
+//
+
+#include "prefetcher.h"
+
+#include <algorithm>
+#include <functional>
+
+using std::condition_variable;
+using std::lock_guard;
+using std::mutex;
+using std::string;
+using std::thread;
+using std::unique_lock;
+using std::vector;
+using leveldb::DB;
+using leveldb::PinnedValue;
+using leveldb::ReadOptions;
+
+// Maximum number of keys a worker takes off the queue at once.
+static const size_t MAX_BATCH = 16;
+
+// Number of prefetched keys remembered for the useful counter, as a
+// multiple of the queue capacity.
+static const size_t HISTORY_FACTOR = 8;
+
+prefetcher::prefetcher(DB *db_in, int num_workers, size_t queue_capacity)
+        : db(db_in), capacity(std::max<size_t>(queue_capacity, 1)), stopping(false),
+          shard_history(std::max<size_t>(capacity * HISTORY_FACTOR / NUM_HISTORY_SHARDS, 1)),
+          issued_(0), dropped_(0), deduplicated_(0), useful_(0) {
+    for (int i = 0; i < num_workers; ++i) {
+        workers.push_back(thread(&prefetcher::work, this));
+    }
+}
+
+prefetcher::~prefetcher() {
+    {
+        lock_guard<mutex> l(mu);
+        stopping = true;
+    }
+    not_empty.notify_all();
+    for (auto &t : workers) {
+        t.join();
+    }
+}
+
+prefetcher::history_shard &prefetcher::shard_for(const string &key) {
+    return shards[std::hash<string>()(key) % NUM_HISTORY_SHARDS];
+}
+
+bool prefetcher::submit(const string &key) {
+    {
+        history_shard &shard = shard_for(key);
+        lock_guard<mutex> l(shard.mu);
+        if (shard.prefetched.count(key) > 0) {
+            ++deduplicated_;
+            return false;
+        }
+    }
+    {
+        lock_guard<mutex> l(mu);
+        if (!pending.insert(key).second) {
+            ++deduplicated_;
+            return false;
+        }
+        if (queue.size() >= capacity) {
+            // The oldest request is the least likely to still be ahead of
+            // the client, so cancel it rather than the new one.
+            pending.erase(queue.front());
+            queue.pop_front();
+            ++dropped_;
+        }
+        queue.push_back(key);
+    }
+    not_empty.notify_one();
+    return true;
+}
+
+void prefetcher::record_access(const string &key) {
+    history_shard &shard = shard_for(key);
+    lock_guard<mutex> l(shard.mu);
+    auto it = shard.prefetched.find(key);
+    if (it != shard.prefetched.end()) {
+        shard.prefetched.erase(it);
+        ++useful_;
+    }
+}
+
+void prefetcher::reset_stats() {
+    issued_ = 0;
+    dropped_ = 0;
+    deduplicated_ = 0;
+    useful_ = 0;
+}
+
+void prefetcher::work() {
+    vector<string> batch;
+    while (true) {
+        batch.clear();
+        {
+            unique_lock<mutex> l(mu);
+            while (queue.empty() && !stopping) {
+                not_empty.wait(l);
+            }
+            if (stopping) {
+                return;
+            }
+            while (!queue.empty() && batch.size() < MAX_BATCH) {
+                batch.push_back(std::move(queue.front()));
+                queue.pop_front();
+            }
+        }
+        warm(batch);
+        for (auto &key : batch) {
+            remember(key);
+        }
+        {
+            lock_guard<mutex> l(mu);
+            for (auto &key : batch) {
+                pending.erase(key);
+            }
+        }
+        issued_ += batch.size();
+    }
+}
+
+void prefetcher::warm(const vector<string> &keys) {
+    // Point lookups use the filters to skip tables without the key, where
+    // an iterator seek would read a block of every level.  GetPinned()
+    // fills the block cache with the blocks holding the key and only pins
+    // the value there instead of copying it out.
+    ReadOptions options;
+    options.fill_cache = true;
+    PinnedValue value;
+    for (auto &key : keys) {
+        db->GetPinned(options, key, &value);
+        value.Reset();
+    }
+}
+
+void prefetcher::remember(const string &key) {
+    history_shard &shard = shard_for(key);
+    lock_guard<mutex> l(shard.mu);
+    uint64_t gen = ++shard.generation;
+    shard.prefetched[key] = gen;
+    shard.history.push_back(std::make_pair(key, gen));
+    while (shard.history.size() > shard_history) {
+        auto &oldest = shard.history.front();
+        auto it = shard.prefetched.find(oldest.first);
+        if (it != shard.prefetched.end() && it->second == oldest.second) {
+            shard.prefetched.erase(it);
+        }
+        shard.history.pop_front();
+    }
+}
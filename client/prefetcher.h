@@ -0,0 +1,93 @@
+//
+// Speculative prefetching for glakv_server.
+//
+// A fixed pool of worker threads drains a bounded queue of keys and looks
+// each of them up just far enough to pull its index and data blocks into
+// the block cache.  Values are pinned in the cache, never copied out.
+// Keys that are already queued or being prefetched are not queued again,
+// and when the queue is full the oldest queued key is cancelled to make
+// room for the new one.
+//
+
+#ifndef LEVELDB_PREFETCHER_H
+#define LEVELDB_PREFETCHER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <leveldb/db.h>
+
+class prefetcher {
+public:
+    prefetcher(leveldb::DB *db, int num_workers, size_t queue_capacity);
+
+    // Stops the workers.  Keys still in the queue are discarded.
+    ~prefetcher();
+
+    // Queues key for prefetching.  Returns false if the key is already
+    // queued, being prefetched, or was prefetched and not accessed since.
+    bool submit(const std::string &key);
+
+    // Records an access to key by a client request.  If key was
+    // prefetched since its last access the prefetch is counted as useful.
+    void record_access(const std::string &key);
+
+    uint64_t issued() const { return issued_; }
+    uint64_t dropped() const { return dropped_; }
+    uint64_t deduplicated() const { return deduplicated_; }
+    uint64_t useful() const { return useful_; }
+
+    void reset_stats();
+
+private:
+    void work();
+    void warm(const std::vector<std::string> &keys);
+    void remember(const std::string &key);
+
+    // Keys prefetched and not accessed since, split by key hash so that
+    // client requests and workers rarely wait on each other.
+    struct history_shard {
+        // Protects the members below.
+        std::mutex mu;
+        // Oldest first.  A key that is prefetched again gets a new
+        // generation; stale entries are skipped when they fall off the end.
+        std::deque<std::pair<std::string, uint64_t>> history;
+        std::unordered_map<std::string, uint64_t> prefetched;
+        uint64_t generation = 0;
+    };
+    static const size_t NUM_HISTORY_SHARDS = 16;
+
+    history_shard &shard_for(const std::string &key);
+
+    leveldb::DB *db;
+    const size_t capacity;
+
+    // Protects queue, pending and stopping.
+    std::mutex mu;
+    std::condition_variable not_empty;
+    std::deque<std::string> queue;
+    // Keys that are queued or being prefetched.
+    std::unordered_set<std::string> pending;
+    bool stopping;
+
+    // Number of keys each history shard remembers.
+    const size_t shard_history;
+    history_shard shards[NUM_HISTORY_SHARDS];
+
+    std::vector<std::thread> workers;
+
+    std::atomic<uint64_t> issued_;
+    std::atomic<uint64_t> dropped_;
+    std::atomic<uint64_t> deduplicated_;
+    std::atomic<uint64_t> useful_;
+};
+
+
+#endif //LEVELDB_PREFETCHER_H
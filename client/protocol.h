@@ -0,0 +1,128 @@
+//
+// Binary glakv wire protocol, version 1.
+//
+// Every message is a fixed 16 byte header followed by a body:
+//
+//   uint8  version      PROTOCOL_VERSION
+//   uint8  code         opcode in requests, status in responses
+//   uint16 reserved     zero
+//   uint32 body_len     length of the body
+//   uint64 request_id   chosen by the client, echoed in the response
+//
+// All integers are little-endian.  The server answers every request except
+// OP_QUIT with one response carrying the request's id, but not necessarily
+// in the order the requests were sent, so a client may keep many requests
+// outstanding on one connection.  Outstanding requests may also be executed
+// in any order: a request that must observe the effect of another one has
+// to be sent after the other one's response arrived.  Bodies:
+//
+//   OP_GET   request:  key                  response: value
+//   OP_PUT   request:  u32 klen, key, value response: empty
+//   OP_DEL   request:  key                  response: empty
+//   OP_MGET  request:  u32 n, n x (u32 klen, key)
+//            response: n x (u8 status, u32 vlen, value)
+//   OP_MPUT  request:  u32 n, n x (u32 klen, key, u32 vlen, value), applied
+//            atomically; response: empty
+//   OP_QUIT  request:  empty; the server closes the connection once all
+//            earlier requests have been answered
+//
+// The first byte of a version 1 message can never start one of the legacy
+// "Get"/"Put"/"Del"/"Quit" requests, so a server can accept both.
+//
+
+#ifndef LEVELDB_PROTOCOL_H
+#define LEVELDB_PROTOCOL_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+
+#include "util/coding.h"
+
+#define PROTOCOL_VERSION    1
+#define HEADER_LEN          16
+#define MAX_BODY_LEN        (64 << 20)
+
+enum opcode {
+    OP_GET = 1,
+    OP_PUT = 2,
+    OP_DEL = 3,
+    OP_MGET = 4,
+    OP_MPUT = 5,
+    OP_QUIT = 6,
+};
+
+enum status_code {
+    STATUS_OK = 0,
+    STATUS_NOT_FOUND = 1,
+    STATUS_ERROR = 2,
+    STATUS_BAD_REQUEST = 3,
+};
+
+struct message_header {
+    uint8_t version;
+    uint8_t code;
+    uint32_t body_len;
+    uint64_t request_id;
+};
+
+static inline void put_fixed32(std::string *dst, uint32_t value) {
+    leveldb::PutFixed32(dst, value);
+}
+
+static inline void put_fixed64(std::string *dst, uint64_t value) {
+    leveldb::PutFixed64(dst, value);
+}
+
+static inline uint32_t decode_fixed32(const char *ptr) {
+    return leveldb::DecodeFixed32(ptr);
+}
+
+static inline uint64_t decode_fixed64(const char *ptr) {
+    return leveldb::DecodeFixed64(ptr);
+}
+
+// Appends a length-prefixed string to *dst.
+static inline void put_string(std::string *dst, const char *data, size_t len) {
+    put_fixed32(dst, (uint32_t) len);
+    dst->append(data, len);
+}
+
+// Reads a length-prefixed string from [*ptr, limit) and advances *ptr past
+// it.  Returns false if the input is truncated.
+static inline bool get_string(const char **ptr, const char *limit, const char **data,
+                              uint32_t *len) {
+    if (limit - *ptr < 4) {
+        return false;
+    }
+    *len = decode_fixed32(*ptr);
+    if ((size_t) (limit - *ptr - 4) < *len) {
+        return false;
+    }
+    *data = *ptr + 4;
+    *ptr += 4 + *len;
+    return true;
+}
+
+// Appends a message header to *dst.  The body must be appended next.
+static inline void put_header(std::string *dst, uint8_t code, uint32_t body_len,
+                              uint64_t request_id) {
+    dst->push_back((char) PROTOCOL_VERSION);
+    dst->push_back((char) code);
+    dst->push_back(0);
+    dst->push_back(0);
+    put_fixed32(dst, body_len);
+    put_fixed64(dst, request_id);
+}
+
+// Parses the header at the start of buf, which must hold HEADER_LEN bytes.
+static inline void decode_header(const char *buf, message_header *header) {
+    header->version = (uint8_t) buf[0];
+    header->code = (uint8_t) buf[1];
+    header->body_len = decode_fixed32(buf + 4);
+    header->request_id = decode_fixed64(buf + 8);
+}
+
+
+#endif //LEVELDB_PROTOCOL_H
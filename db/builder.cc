@@ -6,6 +6,7 @@
 
 #include "db/filename.h"
 #include "db/dbformat.h"
+#include "db/range_del.h"
 #include "db/table_cache.h"
 #include "db/version_edit.h"
 #include "leveldb/db.h"
@@ -14,32 +15,70 @@
 
 namespace leveldb {
 
+// Advances "iter" past the range tombstones that cover no key.  The
+// memtable drops them, so this only keeps any that got through from
+// giving the table inverted bounds.
+static void SkipEmptyRangeTombstones(const Comparator* ucmp, Iterator* iter) {
+  while (iter->Valid() &&
+         ucmp->Compare(ExtractUserKey(iter->key()), iter->value()) >= 0) {
+    iter->Next();
+  }
+}
+
 Status BuildTable(const std::string& dbname,
                   Env* env,
                   const Options& options,
                   TableCache* table_cache,
                   Iterator* iter,
+                  Iterator* range_del_iter,
                   FileMetaData* meta) {
   Status s;
   meta->file_size = 0;
+  meta->has_range_dels = false;
   iter->SeekToFirst();
+  const Comparator* ucmp =
+      static_cast<const InternalKeyComparator*>(options.comparator)
+          ->user_comparator();
+  if (range_del_iter != NULL) {
+    range_del_iter->SeekToFirst();
+    SkipEmptyRangeTombstones(ucmp, range_del_iter);
+    meta->has_range_dels = range_del_iter->Valid();
+  }
 
   std::string fname = TableFileName(dbname, meta->number);
-  if (iter->Valid()) {
+  if (iter->Valid() || meta->has_range_dels) {
     WritableFile* file;
-    s = env->NewWritableFile(fname, &file);
+    s = options.use_direct_io_for_flush_and_compaction
+        ? env->NewDirectWritableFile(fname, &file)
+        : env->NewWritableFile(fname, &file);
     if (!s.ok()) {
       return s;
     }
 
     TableBuilder* builder = new TableBuilder(options, file);
-    meta->smallest.DecodeFrom(iter->key());
+    meta->smallest.Clear();
+    meta->largest.Clear();
+    if (iter->Valid()) {
+      meta->smallest.DecodeFrom(iter->key());
+    }
     for (; iter->Valid(); iter->Next()) {
       Slice key = iter->key();
       meta->largest.DecodeFrom(key);
       builder->Add(key, iter->value());
     }
 
+    // The tombstones come in order: copy them, widening the key range
+    // of the table to cover them
+    while (meta->has_range_dels && range_del_iter->Valid()) {
+      Slice key = range_del_iter->key();
+      builder->AddRangeTombstone(key, range_del_iter->value());
+      ExtendRangeTombstoneBounds(options.comparator, ExtractUserKey(key),
+                                 range_del_iter->value(),
+                                 &meta->smallest, &meta->largest);
+      range_del_iter->Next();
+      SkipEmptyRangeTombstones(ucmp, range_del_iter);
+    }
+
     // Finish and check for builder errors
     if (s.ok()) {
       s = builder->Finish();
@@ -66,7 +105,8 @@ Status BuildTable(const std::string& dbname,
       // Verify that the table is usable
       Iterator* it = table_cache->NewIterator(ReadOptions(),
                                               meta->number,
-                                              meta->file_size);
+                                              meta->file_size,
+                                              0);
       s = it->status();
       delete it;
     }
@@ -76,6 +116,9 @@ Status BuildTable(const std::string& dbname,
   if (!iter->status().ok()) {
     s = iter->status();
   }
+  if (range_del_iter != NULL && !range_del_iter->status().ok()) {
+    s = range_del_iter->status();
+  }
 
   if (s.ok() && meta->file_size > 0) {
     // Keep it
@@ -5,6 +5,7 @@
 #include <sys/types.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <algorithm>
 #include "db/db_impl.h"
 #include "db/version_set.h"
 #include "leveldb/cache.h"
@@ -22,6 +23,7 @@
 //   Actual benchmarks:
 //      fillseq       -- write N values in sequential key order in async mode
 //      fillrandom    -- write N values in random key order in async mode
+//      fillrandomconcurrent -- fillrandom with concurrent memtable writes
 //      overwrite     -- overwrite N values in random key order in async mode
 //      fillsync      -- write N/100 values in random key order in sync mode
 //      fill100K      -- write N/1000 100K values in random order in async mode
@@ -35,7 +37,12 @@
 //      seekrandom    -- N random seeks
 //      open          -- cost of opening a DB
 //      crc32c        -- repeated crc32c of 4K of data
+//      snappycomp    -- snappy compression of 4K of data (also lz4, zstd)
+//      snappyuncomp  -- snappy uncompression of 4K of data (also lz4, zstd)
 //      acquireload   -- load N*1000 times
+//      filterbuild   -- build filters over N keys, 10000 keys per filter
+//      filterquery   -- check N keys, half of them absent, against a filter
+//                       over 10000 keys
 //   Meta operations:
 //      compact     -- Compact the entire DB
 //      stats       -- Print DB stats
@@ -58,6 +65,10 @@ static const char* FLAGS_benchmarks =
     "crc32c,"
     "snappycomp,"
     "snappyuncomp,"
+    "lz4comp,"
+    "lz4uncomp,"
+    "zstdcomp,"
+    "zstduncomp,"
     "acquireload,"
     ;
 
@@ -84,6 +95,28 @@ static bool FLAGS_histogram = false;
 // (initialized to default value by "main")
 static int FLAGS_write_buffer_size = 0;
 
+// Number of partitions the memtable is split into
+static int FLAGS_memtable_partitions = 1;
+
+// Fraction of the write buffer given to a bloom filter over its keys
+static double FLAGS_memtable_bloom_size_ratio = 0;
+
+// Data structure of the memtable: skiplist or hash
+static const char* FLAGS_memtable_rep = "skiplist";
+
+// Number of hash buckets of a hash memtable
+static int FLAGS_memtable_hash_buckets = 50000;
+
+// If true, let the writers of a group commit insert into the memtable
+// in parallel
+static bool FLAGS_concurrent_memtable_writes = false;
+
+// Maximum number of concurrent background compactions
+static int FLAGS_max_background_compactions = 1;
+
+// Maximum number of threads a single compaction is split over
+static int FLAGS_max_subcompactions = 1;
+
 // Number of bytes to use as a cache of uncompressed data.
 // Negative means use default settings.
 static int FLAGS_cache_size = -1;
@@ -95,6 +128,24 @@ static int FLAGS_open_files = 0;
 // Negative means use default settings.
 static int FLAGS_bloom_bits = -1;
 
+// If true, use bloom filters blocked by cache line
+static bool FLAGS_blocked_bloom = false;
+
+// If true, use Ribbon filters instead of bloom filters
+static bool FLAGS_ribbon = false;
+
+// Comma-separated filter policy for each level: none, bloom, blocked or
+// ribbon, e.g. "bloom,bloom,ribbon", with --bloom_bits bits per key (10
+// if not set).  Overrides the policy of --bloom_bits for writing if set.
+static const char* FLAGS_filter_per_level = NULL;
+
+// If true, build one filter per table instead of per 2KB of blocks
+static bool FLAGS_whole_file_filter = false;
+
+// If positive, the length of key prefixes added to the filters, and
+// seekrandom confines its iterators to the prefix of their target
+static int FLAGS_prefix_size = 0;
+
 // If true, do not destroy the existing database.  If you set this
 // flag and also specify a benchmark that wants a fresh database, that
 // benchmark will fail.
@@ -103,6 +154,23 @@ static bool FLAGS_use_existing_db = false;
 // If true, reuse existing log/MANIFEST files when re-opening a database.
 static bool FLAGS_reuse_logs = false;
 
+// Compression of table blocks: none, snappy, lz4 or zstd
+static const char* FLAGS_compression = "snappy";
+
+// Comma-separated compression of table blocks for each level, e.g.
+// "lz4,lz4,zstd".  Overrides --compression if set.
+static const char* FLAGS_compression_per_level = NULL;
+
+// If true, give each data block a hash index for point lookups
+static bool FLAGS_data_block_hash_index = false;
+
+// If true, partition the index and filter of each table
+static bool FLAGS_partition_index_and_filters = false;
+
+// If non-zero, size of the Zstandard dictionary each table trains to
+// compress its data blocks with; requires --compression=zstd
+static int FLAGS_zstd_max_dict_bytes = 0;
+
 // Use the db with the following name.
 static const char* FLAGS_db = NULL;
 
@@ -303,17 +371,85 @@ struct ThreadState {
   }
 };
 
+static bool ParseCompressionType(const Slice& name, CompressionType* type) {
+  if (name == Slice("none")) {
+    *type = kNoCompression;
+  } else if (name == Slice("snappy")) {
+    *type = kSnappyCompression;
+  } else if (name == Slice("lz4")) {
+    *type = kLZ4Compression;
+  } else if (name == Slice("zstd")) {
+    *type = kZstdCompression;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// Returns a new filter policy named "name", or NULL if name is "none".
+// Exits if the name is unknown.
+static const FilterPolicy* NewFilterPolicyByName(const Slice& name,
+                                                 int bits_per_key) {
+  if (name == Slice("none")) {
+    return NULL;
+  } else if (name == Slice("bloom")) {
+    return NewBloomFilterPolicy(bits_per_key);
+  } else if (name == Slice("blocked")) {
+    return NewBlockedBloomFilterPolicy(bits_per_key);
+  } else if (name == Slice("ribbon")) {
+    return NewRibbonFilterPolicy(bits_per_key);
+  }
+  fprintf(stderr, "unknown filter policy '%s'\n", name.ToString().c_str());
+  exit(1);
+}
+
+// Compress "input" into *output as a table block of the given type
+// would be.  Returns false if the type is not supported.
+static bool CompressBlock(CompressionType type, const Slice& input,
+                          std::string* output) {
+  switch (type) {
+    case kSnappyCompression:
+      return port::Snappy_Compress(input.data(), input.size(), output);
+    case kLZ4Compression:
+      return port::LZ4_Compress(input.data(), input.size(), output);
+    case kZstdCompression:
+      return port::Zstd_Compress(input.data(), input.size(), output);
+    default:
+      return false;
+  }
+}
+
+// Uncompress the result of CompressBlock() into output[0,length-1].
+static bool UncompressBlock(CompressionType type, const std::string& input,
+                            char* output, size_t length) {
+  switch (type) {
+    case kSnappyCompression:
+      return port::Snappy_Uncompress(input.data(), input.size(), output);
+    case kLZ4Compression:
+      return port::LZ4_Uncompress(input.data(), input.size(), output, length);
+    case kZstdCompression:
+      return port::Zstd_Uncompress(input.data(), input.size(), output,
+                                   length);
+    default:
+      return false;
+  }
+}
+
 }  // namespace
 
 class Benchmark {
  private:
   Cache* cache_;
   const FilterPolicy* filter_policy_;
+  std::vector<const FilterPolicy*> filter_policy_per_level_;
+  std::vector<const FilterPolicy*> owned_filter_policies_;
+  const SliceTransform* prefix_extractor_;
   DB* db_;
   int num_;
   int value_size_;
   int entries_per_batch_;
   WriteOptions write_options_;
+  bool concurrent_memtable_writes_;
   int reads_;
   int heap_counter_;
 
@@ -394,13 +530,20 @@ class Benchmark {
  public:
   Benchmark()
   : cache_(FLAGS_cache_size >= 0 ? NewLRUCache(FLAGS_cache_size) : NULL),
-    filter_policy_(FLAGS_bloom_bits >= 0
-                   ? NewBloomFilterPolicy(FLAGS_bloom_bits)
-                   : NULL),
+    filter_policy_(FLAGS_bloom_bits < 0 ? NULL
+                   : FLAGS_ribbon
+                   ? NewRibbonFilterPolicy(FLAGS_bloom_bits)
+                   : FLAGS_blocked_bloom
+                   ? NewBlockedBloomFilterPolicy(FLAGS_bloom_bits)
+                   : NewBloomFilterPolicy(FLAGS_bloom_bits)),
+    prefix_extractor_(FLAGS_prefix_size > 0
+                      ? NewFixedPrefixTransform(FLAGS_prefix_size)
+                      : NULL),
     db_(NULL),
     num_(FLAGS_num),
     value_size_(FLAGS_value_size),
     entries_per_batch_(1),
+    concurrent_memtable_writes_(FLAGS_concurrent_memtable_writes),
     reads_(FLAGS_reads < 0 ? FLAGS_num : FLAGS_reads),
     heap_counter_(0) {
     std::vector<std::string> files;
@@ -413,12 +556,35 @@ class Benchmark {
     if (!FLAGS_use_existing_db) {
       DestroyDB(FLAGS_db, Options());
     }
+    if (FLAGS_filter_per_level != NULL) {
+      // One policy object per name, which levels using it share
+      std::vector<std::string> names;
+      Slice list(FLAGS_filter_per_level);
+      while (!list.empty()) {
+        const char* comma = strchr(list.data(), ',');
+        const size_t len = comma ? comma - list.data() : list.size();
+        const std::string name(list.data(), len);
+        const size_t i =
+            std::find(names.begin(), names.end(), name) - names.begin();
+        if (i == names.size()) {
+          names.push_back(name);
+          owned_filter_policies_.push_back(NewFilterPolicyByName(
+              name, FLAGS_bloom_bits < 0 ? 10 : FLAGS_bloom_bits));
+        }
+        filter_policy_per_level_.push_back(owned_filter_policies_[i]);
+        list.remove_prefix(comma ? len + 1 : len);
+      }
+    }
   }
 
   ~Benchmark() {
     delete db_;
     delete cache_;
     delete filter_policy_;
+    for (size_t i = 0; i < owned_filter_policies_.size(); i++) {
+      delete owned_filter_policies_[i];
+    }
+    delete prefix_extractor_;
   }
 
   void Run() {
@@ -443,6 +609,7 @@ class Benchmark {
       value_size_ = FLAGS_value_size;
       entries_per_batch_ = 1;
       write_options_ = WriteOptions();
+      concurrent_memtable_writes_ = FLAGS_concurrent_memtable_writes;
 
       void (Benchmark::*method)(ThreadState*) = NULL;
       bool fresh_db = false;
@@ -462,6 +629,10 @@ class Benchmark {
       } else if (name == Slice("fillrandom")) {
         fresh_db = true;
         method = &Benchmark::WriteRandom;
+      } else if (name == Slice("fillrandomconcurrent")) {
+        fresh_db = true;
+        concurrent_memtable_writes_ = true;
+        method = &Benchmark::WriteRandom;
       } else if (name == Slice("overwrite")) {
         fresh_db = false;
         method = &Benchmark::WriteRandom;
@@ -503,10 +674,22 @@ class Benchmark {
         method = &Benchmark::Crc32c;
       } else if (name == Slice("acquireload")) {
         method = &Benchmark::AcquireLoad;
+      } else if (name == Slice("filterbuild")) {
+        method = &Benchmark::FilterBuild;
+      } else if (name == Slice("filterquery")) {
+        method = &Benchmark::FilterQuery;
       } else if (name == Slice("snappycomp")) {
         method = &Benchmark::SnappyCompress;
       } else if (name == Slice("snappyuncomp")) {
         method = &Benchmark::SnappyUncompress;
+      } else if (name == Slice("lz4comp")) {
+        method = &Benchmark::LZ4Compress;
+      } else if (name == Slice("lz4uncomp")) {
+        method = &Benchmark::LZ4Uncompress;
+      } else if (name == Slice("zstdcomp")) {
+        method = &Benchmark::ZstdCompress;
+      } else if (name == Slice("zstduncomp")) {
+        method = &Benchmark::ZstdUncompress;
       } else if (name == Slice("heapprofile")) {
         HeapProfile();
       } else if (name == Slice("stats")) {
@@ -619,10 +802,30 @@ class Benchmark {
     // Checksum about 500MB of data total
     const int size = 4096;
     const char* label = "(4K per op)";
+    const int64_t total = 500 * 1048576;
     std::string data(size, 'x');
     int64_t bytes = 0;
     uint32_t crc = 0;
-    while (bytes < 500 * 1048576) {
+
+    // If Value() uses the hardware, time the portable implementation on
+    // the same data first and report it next to the measured speed.
+    std::string portable = "(portable)";
+    if (crc32c::IsAccelerated()) {
+      const uint64_t start = Env::Default()->NowMicros();
+      for (bytes = 0; bytes < total; bytes += size) {
+        crc = crc32c::ExtendPortable(0, data.data(), size);
+      }
+      const uint64_t micros = Env::Default()->NowMicros() - start + 1;
+      fprintf(stderr, "... crc=0x%x\r", static_cast<unsigned int>(crc));
+      char msg[100];
+      snprintf(msg, sizeof(msg), "(sse4.2; portable: %.1f MB/s)",
+               (bytes / 1048576.0) / (micros * 1e-6));
+      portable = msg;
+      thread->stats.Start();
+    }
+
+    bytes = 0;
+    while (bytes < total) {
       crc = crc32c::Value(data.data(), size);
       thread->stats.FinishedSingleOp();
       bytes += size;
@@ -632,6 +835,7 @@ class Benchmark {
 
     thread->stats.AddBytes(bytes);
     thread->stats.AddMessage(label);
+    thread->stats.AddMessage(portable);
   }
 
   void AcquireLoad(ThreadState* thread) {
@@ -650,7 +854,104 @@ class Benchmark {
     if (ptr == NULL) exit(1); // Disable unused variable warning.
   }
 
+  // Keys of the filters built by filterbuild and filterquery
+  static const int kFilterKeys = 10000;
+
+  static void FilterKeys(int start, std::vector<std::string>* keys) {
+    keys->resize(kFilterKeys);
+    for (int i = 0; i < kFilterKeys; i++) {
+      char key[100];
+      snprintf(key, sizeof(key), "%016d", start + i);
+      (*keys)[i] = key;
+    }
+  }
+
+  void FilterBuild(ThreadState* thread) {
+    if (filter_policy_ == NULL) {
+      thread->stats.AddMessage("(no filter: set --bloom_bits)");
+      return;
+    }
+    std::vector<std::string> keys;
+    std::vector<Slice> slices(kFilterKeys);
+    std::string filter;
+    int64_t filter_bytes = 0;
+    int done = 0;
+    while (done < reads_) {
+      FilterKeys(done, &keys);
+      for (int i = 0; i < kFilterKeys; i++) {
+        slices[i] = keys[i];
+      }
+      filter.clear();
+      filter_policy_->CreateFilter(&slices[0], kFilterKeys, &filter);
+      filter_bytes += filter.size();
+      for (int i = 0; i < kFilterKeys; i++) {
+        thread->stats.FinishedSingleOp();
+      }
+      done += kFilterKeys;
+    }
+    char msg[100];
+    snprintf(msg, sizeof(msg), "(%s, %.2f bits/key)",
+             filter_policy_->Name(), filter_bytes * 8.0 / done);
+    thread->stats.AddMessage(msg);
+  }
+
+  void FilterQuery(ThreadState* thread) {
+    if (filter_policy_ == NULL) {
+      thread->stats.AddMessage("(no filter: set --bloom_bits)");
+      return;
+    }
+    // The filter holds keys [0, kFilterKeys); queries are drawn from
+    // twice as many, so half of them are absent.
+    std::vector<std::string> keys;
+    FilterKeys(0, &keys);
+    std::vector<Slice> slices(keys.begin(), keys.end());
+    std::string filter;
+    filter_policy_->CreateFilter(&slices[0], kFilterKeys, &filter);
+    int absent = 0;
+    int false_positives = 0;
+    for (int i = 0; i < reads_; i++) {
+      char key[100];
+      const int k = thread->rand.Next() % (2 * kFilterKeys);
+      snprintf(key, sizeof(key), "%016d", k);
+      const bool match = filter_policy_->KeyMayMatch(key, filter);
+      if (k >= kFilterKeys) {
+        absent++;
+        false_positives += match;
+      }
+      thread->stats.FinishedSingleOp();
+    }
+    char msg[100];
+    snprintf(msg, sizeof(msg), "(%s, %.2f bits/key, %.2f%% false positives)",
+             filter_policy_->Name(), filter.size() * 8.0 / kFilterKeys,
+             absent ? false_positives * 100.0 / absent : 0.0);
+    thread->stats.AddMessage(msg);
+  }
+
   void SnappyCompress(ThreadState* thread) {
+    Compress(thread, kSnappyCompression, "snappy");
+  }
+
+  void SnappyUncompress(ThreadState* thread) {
+    Uncompress(thread, kSnappyCompression, "snappy");
+  }
+
+  void LZ4Compress(ThreadState* thread) {
+    Compress(thread, kLZ4Compression, "lz4");
+  }
+
+  void LZ4Uncompress(ThreadState* thread) {
+    Uncompress(thread, kLZ4Compression, "lz4");
+  }
+
+  void ZstdCompress(ThreadState* thread) {
+    Compress(thread, kZstdCompression, "zstd");
+  }
+
+  void ZstdUncompress(ThreadState* thread) {
+    Uncompress(thread, kZstdCompression, "zstd");
+  }
+
+  void Compress(ThreadState* thread, CompressionType type, const char* name) {
     RandomGenerator gen;
     Slice input = gen.Generate(Options().block_size);
     int64_t bytes = 0;
@@ -658,14 +959,16 @@ class Benchmark {
     bool ok = true;
     std::string compressed;
     while (ok && bytes < 1024 * 1048576) {  // Compress 1G
-      ok = port::Snappy_Compress(input.data(), input.size(), &compressed);
+      ok = CompressBlock(type, input, &compressed);
       produced += compressed.size();
       bytes += input.size();
       thread->stats.FinishedSingleOp();
     }
 
     if (!ok) {
-      thread->stats.AddMessage("(snappy failure)");
+      char buf[100];
+      snprintf(buf, sizeof(buf), "(%s failure)", name);
+      thread->stats.AddMessage(buf);
     } else {
       char buf[100];
       snprintf(buf, sizeof(buf), "(output: %.1f%%)",
@@ -675,23 +978,25 @@ class Benchmark {
     }
   }
 
-  void SnappyUncompress(ThreadState* thread) {
+  void Uncompress(ThreadState* thread, CompressionType type,
+                  const char* name) {
     RandomGenerator gen;
     Slice input = gen.Generate(Options().block_size);
     std::string compressed;
-    bool ok = port::Snappy_Compress(input.data(), input.size(), &compressed);
+    bool ok = CompressBlock(type, input, &compressed);
     int64_t bytes = 0;
     char* uncompressed = new char[input.size()];
     while (ok && bytes < 1024 * 1048576) {  // Compress 1G
-      ok =  port::Snappy_Uncompress(compressed.data(), compressed.size(),
-                                    uncompressed);
+      ok = UncompressBlock(type, compressed, uncompressed, input.size());
       bytes += input.size();
       thread->stats.FinishedSingleOp();
     }
     delete[] uncompressed;
 
     if (!ok) {
-      thread->stats.AddMessage("(snappy failure)");
+      char buf[100];
+      snprintf(buf, sizeof(buf), "(%s failure)", name);
+      thread->stats.AddMessage(buf);
     } else {
       thread->stats.AddBytes(bytes);
     }
@@ -703,9 +1008,48 @@ class Benchmark {
     options.create_if_missing = !FLAGS_use_existing_db;
     options.block_cache = cache_;
     options.write_buffer_size = FLAGS_write_buffer_size;
+    options.memtable_partitions = FLAGS_memtable_partitions;
+    options.memtable_bloom_size_ratio = FLAGS_memtable_bloom_size_ratio;
+    if (strcmp(FLAGS_memtable_rep, "skiplist") == 0) {
+      options.memtable_rep = kSkipListMemTable;
+    } else if (strcmp(FLAGS_memtable_rep, "hash") == 0) {
+      options.memtable_rep = kHashMemTable;
+    } else {
+      fprintf(stderr, "unknown memtable rep '%s'\n", FLAGS_memtable_rep);
+      exit(1);
+    }
+    options.memtable_hash_buckets = FLAGS_memtable_hash_buckets;
+    options.allow_concurrent_memtable_write = concurrent_memtable_writes_;
+    options.max_background_compactions = FLAGS_max_background_compactions;
+    options.max_subcompactions = FLAGS_max_subcompactions;
     options.max_open_files = FLAGS_open_files;
     options.filter_policy = filter_policy_;
+    options.filter_policy_per_level = filter_policy_per_level_;
     options.reuse_logs = FLAGS_reuse_logs;
+    if (!ParseCompressionType(FLAGS_compression, &options.compression)) {
+      fprintf(stderr, "unknown compression '%s'\n", FLAGS_compression);
+      exit(1);
+    }
+    options.zstd_max_dict_bytes = FLAGS_zstd_max_dict_bytes;
+    options.data_block_hash_index = FLAGS_data_block_hash_index;
+    options.partition_index_and_filters = FLAGS_partition_index_and_filters;
+    options.whole_file_filter = FLAGS_whole_file_filter;
+    options.prefix_extractor = prefix_extractor_;
+    if (FLAGS_compression_per_level != NULL) {
+      Slice names(FLAGS_compression_per_level);
+      while (!names.empty()) {
+        const char* comma = strchr(names.data(), ',');
+        const size_t len = comma ? comma - names.data() : names.size();
+        CompressionType type;
+        if (!ParseCompressionType(Slice(names.data(), len), &type)) {
+          fprintf(stderr, "unknown compression in '%s'\n",
+                  FLAGS_compression_per_level);
+          exit(1);
+        }
+        options.compression_per_level.push_back(type);
+        names.remove_prefix(comma ? len + 1 : len);
+      }
+    }
     Status s = DB::Open(options, FLAGS_db, &db_);
     if (!s.ok()) {
       fprintf(stderr, "open error: %s\n", s.ToString().c_str());
@@ -830,6 +1174,7 @@ class Benchmark {
 
   void SeekRandom(ThreadState* thread) {
     ReadOptions options;
+    options.prefix_same_as_start = (prefix_extractor_ != NULL);
     int found = 0;
     for (int i = 0; i < reads_; i++) {
       Iterator* iter = db_->NewIterator(options);
@@ -963,6 +1308,14 @@ int main(int argc, char** argv) {
     } else if (sscanf(argv[i], "--reuse_logs=%d%c", &n, &junk) == 1 &&
                (n == 0 || n == 1)) {
       FLAGS_reuse_logs = n;
+    } else if (sscanf(argv[i], "--data_block_hash_index=%d%c",
+                      &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_data_block_hash_index = n;
+    } else if (sscanf(argv[i], "--partition_index_and_filters=%d%c",
+                      &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_partition_index_and_filters = n;
     } else if (sscanf(argv[i], "--num=%d%c", &n, &junk) == 1) {
       FLAGS_num = n;
     } else if (sscanf(argv[i], "--reads=%d%c", &n, &junk) == 1) {
@@ -973,12 +1326,51 @@ int main(int argc, char** argv) {
       FLAGS_value_size = n;
     } else if (sscanf(argv[i], "--write_buffer_size=%d%c", &n, &junk) == 1) {
       FLAGS_write_buffer_size = n;
+    } else if (sscanf(argv[i], "--memtable_partitions=%d%c",
+                      &n, &junk) == 1) {
+      FLAGS_memtable_partitions = n;
+    } else if (sscanf(argv[i], "--memtable_bloom_size_ratio=%lf%c",
+                      &d, &junk) == 1) {
+      FLAGS_memtable_bloom_size_ratio = d;
+    } else if (strncmp(argv[i], "--memtable_rep=", 15) == 0) {
+      FLAGS_memtable_rep = argv[i] + 15;
+    } else if (sscanf(argv[i], "--memtable_hash_buckets=%d%c",
+                      &n, &junk) == 1) {
+      FLAGS_memtable_hash_buckets = n;
+    } else if (sscanf(argv[i], "--concurrent_memtable_writes=%d%c",
+                      &n, &junk) == 1 && (n == 0 || n == 1)) {
+      FLAGS_concurrent_memtable_writes = n;
+    } else if (sscanf(argv[i], "--max_background_compactions=%d%c",
+                      &n, &junk) == 1) {
+      FLAGS_max_background_compactions = n;
+    } else if (sscanf(argv[i], "--max_subcompactions=%d%c",
+                      &n, &junk) == 1) {
+      FLAGS_max_subcompactions = n;
     } else if (sscanf(argv[i], "--cache_size=%d%c", &n, &junk) == 1) {
       FLAGS_cache_size = n;
     } else if (sscanf(argv[i], "--bloom_bits=%d%c", &n, &junk) == 1) {
       FLAGS_bloom_bits = n;
+    } else if (sscanf(argv[i], "--blocked_bloom=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_blocked_bloom = n;
+    } else if (sscanf(argv[i], "--ribbon=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_ribbon = n;
+    } else if (strncmp(argv[i], "--filter_per_level=", 19) == 0) {
+      FLAGS_filter_per_level = argv[i] + 19;
+    } else if (sscanf(argv[i], "--whole_file_filter=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_whole_file_filter = n;
+    } else if (sscanf(argv[i], "--prefix_size=%d%c", &n, &junk) == 1) {
+      FLAGS_prefix_size = n;
     } else if (sscanf(argv[i], "--open_files=%d%c", &n, &junk) == 1) {
       FLAGS_open_files = n;
+    } else if (strncmp(argv[i], "--compression=", 14) == 0) {
+      FLAGS_compression = argv[i] + 14;
+    } else if (strncmp(argv[i], "--compression_per_level=", 24) == 0) {
+      FLAGS_compression_per_level = argv[i] + 24;
+    } else if (sscanf(argv[i], "--zstd_max_dict_bytes=%d%c", &n, &junk) == 1) {
+      FLAGS_zstd_max_dict_bytes = n;
     } else if (strncmp(argv[i], "--db=", 5) == 0) {
       FLAGS_db = argv[i] + 5;
     } else {
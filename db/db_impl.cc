@@ -17,6 +17,7 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/range_del.h"
 #include "db/table_cache.h"
 #include "db/version_set.h"
 #include "db/write_batch_internal.h"
@@ -32,6 +33,7 @@
 #include "util/coding.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
+#include "util/thread_local.h"
 
 namespace leveldb {
 
@@ -45,9 +47,109 @@ struct DBImpl::Writer {
   bool done;
   port::CondVar cv;
 
-  explicit Writer(port::Mutex* mu) : cv(mu) { }
+  // Set by the leader of a write group when this writer should insert
+  // one shard of the group's batch into a partitioned memtable.
+  InsertJob* insert_job;
+  int insert_shard;
+
+  explicit Writer(port::Mutex* mu) : cv(mu), insert_job(NULL) { }
 };
 
+// The memtable insertion of a write group, split into shards that are
+// inserted in parallel by the leader and some of the waiting members of
+// the group (see WriteBatchInternal::InsertInto).  The members are handed
+// their shards while the leader still holds mutex_ and then wait for the
+// leader to append the batch to the log.  The job lives on the leader's
+// stack, so nobody may touch it after finishing its shard.
+struct DBImpl::InsertJob {
+  const WriteBatch* batch;
+  MemTable* mem;
+  int num_shards;
+
+  port::Mutex mu;
+  port::CondVar cv;
+  bool logged;          // The leader finished writing the log
+  Status log_status;    // Result of writing the log
+  int pending;          // Number of shards not yet inserted
+  Status status;        // First error from inserting a shard
+
+  InsertJob(const WriteBatch* b, MemTable* m, int n)
+      : batch(b), mem(m), num_shards(n), cv(&mu), logged(false),
+        pending(n) { }
+
+  // Called by the leader once the batch has been logged.  If s is not ok
+  // the shards are not inserted.
+  void StartInsert(const Status& s) {
+    MutexLock l(&mu);
+    logged = true;
+    log_status = s;
+    cv.SignalAll();
+  }
+
+  // Inserts the given shard, waiting for the leader to log the batch
+  // first.
+  void RunShard(int shard) {
+    mu.Lock();
+    while (!logged) {
+      cv.Wait();
+    }
+    Status s = log_status;
+    mu.Unlock();
+    if (s.ok()) {
+      s = WriteBatchInternal::InsertInto(batch, mem, shard, num_shards);
+    }
+    MutexLock l(&mu);
+    if (status.ok() && log_status.ok()) {
+      status = s;
+    }
+    if (--pending == 0) {
+      cv.SignalAll();
+    }
+  }
+
+  // Waits until all shards have been inserted and returns their status.
+  Status WaitForInsert() {
+    MutexLock l(&mu);
+    while (pending > 0) {
+      cv.Wait();
+    }
+    return status;
+  }
+};
+
+// A referenced (mem, imm, version) triple.  The read path uses it to
+// find everything it needs without acquiring mutex_: each thread caches a
+// reference in local_sv_ and only falls back to mutex_ after
+// InstallSuperVersion() has invalidated the cached reference.
+struct DBImpl::SuperVersion {
+  DBImpl* const db;
+  MemTable* const mem;
+  MemTable* const imm;           // May be NULL
+  Version* const current;
+  int refs;                      // Protected by db->mutex_
+
+  SuperVersion(DBImpl* d, MemTable* m, MemTable* i, Version* v)
+      : db(d), mem(m), imm(i), current(v), refs(1) {
+    mem->Ref();
+    if (imm != NULL) imm->Ref();
+    current->Ref();
+  }
+
+  ~SuperVersion() {
+    mem->Unref();
+    if (imm != NULL) imm->Unref();
+    current->Unref();
+  }
+};
+
+namespace {
+// Stored in a thread's local_sv_ slot while that thread is using the
+// SuperVersion it took from the slot.  A NULL slot means there is no
+// cached SuperVersion (or it was invalidated).
+char sv_in_use_marker;
+void* const kSVInUse = &sv_in_use_marker;
+}  // namespace
+
 struct DBImpl::CompactionState {
   Compaction* const compaction;
 
@@ -62,6 +164,7 @@ struct DBImpl::CompactionState {
     uint64_t number;
     uint64_t file_size;
     InternalKey smallest, largest;
+    bool has_range_dels;
   };
   std::vector<Output> outputs;
 
@@ -69,7 +172,29 @@ struct DBImpl::CompactionState {
   WritableFile* outfile;
   TableBuilder* builder;
 
+  // The range tombstones of the inputs, and the ones the outputs keep, or
+  // NULL if the inputs have none.  Shared by the parts of a compaction.
+  const RangeDelMap* range_dels;
+  const RangeDelMap* output_range_dels;
+
+  // With range tombstones, outputs are only cut between user keys, so
+  // that the tombstones of each output, clipped to [lower, upper), end
+  // where the next output begins.  "lower" is where the current output
+  // begins: the start of the part, then the end of the previous output.
+  bool has_lower;   // If false, the output is unbounded below
+  std::string lower;
+  bool cut_pending; // The current output is to end at the next user key
+
   uint64_t total_bytes;
+  int64_t imm_micros;  // Micros spent doing imm_ compactions
+
+  // Range of user keys [start, end) compacted by this state.  A compaction
+  // split into subcompactions has one state per part.
+  bool has_start;   // If false, the range is unbounded below
+  bool has_end;     // If false, the range is unbounded above
+  std::string start;
+  std::string end;
+  Compaction::Cursor cursor;
 
   Output* current_output() { return &outputs[outputs.size()-1]; }
 
@@ -77,7 +202,14 @@ struct DBImpl::CompactionState {
       : compaction(c),
         outfile(NULL),
         builder(NULL),
-        total_bytes(0) {
+        range_dels(NULL),
+        output_range_dels(NULL),
+        has_lower(false),
+        cut_pending(false),
+        total_bytes(0),
+        imm_micros(0),
+        has_start(false),
+        has_end(false) {
   }
 };
 
@@ -89,14 +221,22 @@ static void ClipToRange(T* ptr, V minvalue, V maxvalue) {
 }
 Options SanitizeOptions(const std::string& dbname,
                         const InternalKeyComparator* icmp,
-                        const InternalFilterPolicy* ipolicy,
+                        const InternalFilterPolicies* ipolicies,
                         const Options& src) {
   Options result = src;
   result.comparator = icmp;
-  result.filter_policy = (src.filter_policy != NULL) ? ipolicy : NULL;
+  result.filter_policy = ipolicies->Wrap(src.filter_policy);
+  for (size_t i = 0; i < result.filter_policy_per_level.size(); i++) {
+    result.filter_policy_per_level[i] =
+        ipolicies->Wrap(src.filter_policy_per_level[i]);
+  }
   ClipToRange(&result.max_open_files,    64 + kNumNonTableCacheFiles, 50000);
   ClipToRange(&result.write_buffer_size, 64<<10,                      1<<30);
+  ClipToRange(&result.memtable_partitions, 1,                           64);
+  ClipToRange(&result.memtable_bloom_size_ratio, 0.0,                 0.25);
   ClipToRange(&result.block_size,        1<<10,                       4<<20);
+  ClipToRange(&result.max_background_compactions, 1,                    64);
+  ClipToRange(&result.max_subcompactions, 1,                            64);
   if (result.info_log == NULL) {
     // Open a log file in the same directory as the db
     src.env->CreateDir(dbname);  // In case it does not exist
@@ -113,12 +253,29 @@ Options SanitizeOptions(const std::string& dbname,
   return result;
 }
 
+Options OptionsForLevel(const Options& options, int level) {
+  Options result = options;
+  const std::vector<CompressionType>& per_level =
+      options.compression_per_level;
+  if (!per_level.empty()) {
+    result.compression =
+        per_level[std::min<size_t>(level, per_level.size() - 1)];
+  }
+  const std::vector<const FilterPolicy*>& filter_per_level =
+      options.filter_policy_per_level;
+  if (!filter_per_level.empty()) {
+    result.filter_policy = filter_per_level[
+        std::min<size_t>(level, filter_per_level.size() - 1)];
+  }
+  return result;
+}
+
 DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
     : env_(raw_options.env),
       internal_comparator_(raw_options.comparator),
-      internal_filter_policy_(raw_options.filter_policy),
+      internal_filter_policies_(raw_options),
       options_(SanitizeOptions(dbname, &internal_comparator_,
-                               &internal_filter_policy_, raw_options)),
+                               &internal_filter_policies_, raw_options)),
       owns_info_log_(options_.info_log != raw_options.info_log),
       owns_cache_(options_.block_cache != raw_options.block_cache),
       dbname_(dbname),
@@ -131,14 +288,24 @@ DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
       logfile_number_(0),
       log_(NULL),
       seed_(0),
+      super_version_(NULL),
       tmp_batch_(new WriteBatch),
-      bg_compaction_scheduled_(false),
+      bg_flush_scheduled_(false),
+      flush_running_(false),
+      inline_flushes_(!env_->HasPriorityPools()),
+      bg_compaction_scheduled_(0),
+      manifest_busy_(false),
+      flush_install_pending_(false),
       manual_compaction_(NULL) {
   has_imm_.Release_Store(NULL);
+  env_->IncreaseBackgroundThreads(
+      options_.max_background_compactions * options_.max_subcompactions,
+      Env::kLowPriority);
 
   // Reserve ten files or so for other uses and give the rest to TableCache.
   const int table_cache_size = options_.max_open_files - kNumNonTableCacheFiles;
   table_cache_ = new TableCache(dbname_, &options_, table_cache_size);
+  local_sv_ = new ThreadLocalPtr(&DBImpl::UnrefSuperVersionHandler);
 
   versions_ = new VersionSet(dbname_, &options_, table_cache_,
                              &internal_comparator_);
@@ -148,10 +315,21 @@ DBImpl::~DBImpl() {
   // Wait for background work to finish
   mutex_.Lock();
   shutting_down_.Release_Store(this);  // Any non-NULL value is ok
-  while (bg_compaction_scheduled_) {
+  while (bg_flush_scheduled_ || bg_compaction_scheduled_ > 0) {
     bg_cv_.Wait();
   }
+  std::vector<void*> cached;
+  local_sv_->Scrape(&cached, NULL);
+  for (size_t i = 0; i < cached.size(); i++) {
+    UnrefSuperVersion(reinterpret_cast<SuperVersion*>(cached[i]));
+  }
+  if (super_version_ != NULL) {
+    UnrefSuperVersion(super_version_);
+    super_version_ = NULL;
+  }
   mutex_.Unlock();
+  // Waits for threads that are exiting to drop their cached references.
+  delete local_sv_;
 
   if (db_lock_ != NULL) {
     env_->UnlockFile(db_lock_);
@@ -173,6 +351,14 @@ DBImpl::~DBImpl() {
   }
 }
 
+MemTable* DBImpl::NewMemTable() const {
+  const size_t bloom_bits = static_cast<size_t>(
+      options_.write_buffer_size * options_.memtable_bloom_size_ratio * 8);
+  return new MemTable(internal_comparator_, options_.memtable_partitions,
+                      options_.allow_concurrent_memtable_write, bloom_bits,
+                      options_.memtable_rep, options_.memtable_hash_buckets);
+}
+
 Status DBImpl::NewDB() {
   VersionEdit new_db;
   new_db.SetComparatorName(user_comparator()->Name());
@@ -419,7 +605,7 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
     WriteBatchInternal::SetContents(&batch, record);
 
     if (mem == NULL) {
-      mem = new MemTable(internal_comparator_);
+      mem = NewMemTable();
       mem->Ref();
     }
     status = WriteBatchInternal::InsertInto(&batch, mem);
@@ -437,7 +623,9 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
     if (mem->ApproximateMemoryUsage() > options_.write_buffer_size) {
       compactions++;
       *save_manifest = true;
-      status = WriteLevel0Table(mem, edit, NULL);
+      uint64_t number;
+      status = WriteLevel0Table(mem, edit, false, &number);
+      pending_outputs_.erase(number);
       mem->Unref();
       mem = NULL;
       if (!status.ok()) {
@@ -466,7 +654,7 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
         mem = NULL;
       } else {
         // mem can be NULL if lognum exists but was empty.
-        mem_ = new MemTable(internal_comparator_);
+        mem_ = NewMemTable();
         mem_->Ref();
       }
     }
@@ -476,7 +664,9 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
     // mem did not get reused; compact it.
     if (status.ok()) {
       *save_manifest = true;
-      status = WriteLevel0Table(mem, edit, NULL);
+      uint64_t number;
+      status = WriteLevel0Table(mem, edit, false, &number);
+      pending_outputs_.erase(number);
     }
     mem->Unref();
   }
@@ -485,20 +675,23 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
 }
 
 Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
-                                Version* base) {
+                                bool pick_level, uint64_t* number) {
   mutex_.AssertHeld();
   const uint64_t start_micros = env_->NowMicros();
   FileMetaData meta;
   meta.number = versions_->NewFileNumber();
   pending_outputs_.insert(meta.number);
+  *number = meta.number;
   Iterator* iter = mem->NewIterator();
+  Iterator* range_del_iter = mem->NewRangeTombstoneIterator();
   Log(options_.info_log, "Level-0 table #%llu: started",
       (unsigned long long) meta.number);
 
   Status s;
   {
     mutex_.Unlock();
-    s = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+    s = BuildTable(dbname_, env_, OptionsForLevel(options_, 0), table_cache_,
+                   iter, range_del_iter, &meta);
     mutex_.Lock();
   }
 
@@ -507,8 +700,7 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
       (unsigned long long) meta.file_size,
       s.ToString().c_str());
   delete iter;
-  pending_outputs_.erase(meta.number);
-
+  delete range_del_iter;
 
   // Note that if file_size is zero, the file has been deleted and
   // should not be added to the manifest.
@@ -516,11 +708,23 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
   if (s.ok() && meta.file_size > 0) {
     const Slice min_user_key = meta.smallest.user_key();
     const Slice max_user_key = meta.largest.user_key();
-    if (base != NULL) {
-      level = base->PickLevelForMemTableOutput(min_user_key, max_user_key);
+    if (pick_level) {
+      level = versions_->current()->PickLevelForMemTableOutput(
+          min_user_key, max_user_key);
+      // Running compactions may still write older data for the range
+      // of the table into the levels it would skip.
+      for (int l = 1; l <= level; l++) {
+        if (versions_->RangeUnderCompaction(l, min_user_key, max_user_key)) {
+          level = l - 1;
+          break;
+        }
+      }
+      if (level > 0) {
+        flush_install_pending_ = true;
+      }
     }
     edit->AddFile(level, meta.number, meta.file_size,
-                  meta.smallest, meta.largest);
+                  meta.smallest, meta.largest, meta.has_range_dels);
   }
 
   CompactionStats stats;
@@ -533,13 +737,13 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
 void DBImpl::CompactMemTable() {
   mutex_.AssertHeld();
   assert(imm_ != NULL);
+  assert(!flush_running_);
+  flush_running_ = true;
 
   // Save the contents of the memtable as a new Table
   VersionEdit edit;
-  Version* base = versions_->current();
-  base->Ref();
-  Status s = WriteLevel0Table(imm_, &edit, base);
-  base->Unref();
+  uint64_t number;
+  Status s = WriteLevel0Table(imm_, &edit, true, &number);
 
   if (s.ok() && shutting_down_.Acquire_Load()) {
     s = Status::IOError("Deleting DB during memtable compaction");
@@ -549,18 +753,36 @@ void DBImpl::CompactMemTable() {
   if (s.ok()) {
     edit.SetPrevLogNumber(0);
     edit.SetLogNumber(logfile_number_);  // Earlier logs no longer needed
-    s = versions_->LogAndApply(&edit, &mutex_);
+    s = LogAndApply(&edit);
   }
+  // Compactions finishing while the edit was being logged must not
+  // delete the new table, so it is only released now.
+  pending_outputs_.erase(number);
+  flush_install_pending_ = false;
 
   if (s.ok()) {
     // Commit to the new state
     imm_->Unref();
     imm_ = NULL;
     has_imm_.Release_Store(NULL);
+    InstallSuperVersion();
     DeleteObsoleteFiles();
   } else {
     RecordBackgroundError(s);
   }
+  flush_running_ = false;
+}
+
+Status DBImpl::LogAndApply(VersionEdit* edit) {
+  mutex_.AssertHeld();
+  while (manifest_busy_) {
+    bg_cv_.Wait();
+  }
+  manifest_busy_ = true;
+  Status s = versions_->LogAndApply(edit, &mutex_);
+  manifest_busy_ = false;
+  bg_cv_.SignalAll();
+  return s;
 }
 
 void DBImpl::CompactRange(const Slice* begin, const Slice* end) {
@@ -617,6 +839,287 @@ void DBImpl::TEST_CompactRange(int level, const Slice* begin,const Slice* end) {
   }
 }
 
+Status DBImpl::BulkDeleteForRange(const WriteOptions& options,
+                                  const Slice& begin, const Slice& end) {
+  if (user_comparator()->Compare(begin, end) >= 0) {
+    return Status::OK();
+  }
+
+  // Files numbered below this one only hold entries written before the
+  // tombstone: later ones may hold newer entries, which must be kept.
+  uint64_t file_number_limit;
+  {
+    MutexLock l(&mutex_);
+    file_number_limit = versions_->NewFileNumber();
+  }
+
+  // The tombstone deletes the keys held by the memtables and by the
+  // files that straddle the bounds, and hides the keys of the dropped
+  // files that a running compaction may write out again.
+  Status s = DeleteRange(options, begin, end);
+  if (!s.ok()) {
+    return s;
+  }
+
+  {
+    MutexLock l(&mutex_);
+    VersionEdit edit;
+    int dropped = 0;
+    uint64_t dropped_bytes = 0;
+    std::vector<FileMetaData*> files;
+    for (int level = 0; level < config::kNumLevels; level++) {
+      versions_->current()->GetContainedInputs(level, begin, end, &files);
+      for (size_t i = 0; i < files.size(); i++) {
+        const FileMetaData* f = files[i];
+        if (f->number < file_number_limit && !f->being_compacted) {
+          edit.DeleteFile(level, f->number);
+          dropped++;
+          dropped_bytes += f->file_size;
+        }
+      }
+    }
+    if (dropped > 0) {
+      s = LogAndApply(&edit);
+      if (s.ok()) {
+        InstallSuperVersion();
+        DeleteObsoleteFiles();
+      } else {
+        RecordBackgroundError(s);
+      }
+    }
+    Log(options_.info_log, "Bulk delete dropped %d files, %llu bytes: %s",
+        dropped, static_cast<unsigned long long>(dropped_bytes),
+        s.ToString().c_str());
+  }
+
+  // What is left of the range is the files straddling its bounds, and
+  // the memtable holding the tombstone, which the compactions need
+  if (s.ok()) {
+    CompactRange(&begin, &end);
+  }
+  return s;
+}
+
+Status DBImpl::ReadExternalFile(const std::string& fname,
+                                FileMetaData* meta) {
+  RandomAccessFile* file = NULL;
+  Table* table = NULL;
+  Status s = env_->GetFileSize(fname, &meta->file_size);
+  if (s.ok()) {
+    s = env_->NewRandomAccessFile(fname, &file);
+  }
+  if (s.ok()) {
+    s = Table::Open(options_, file, meta->file_size, &table);
+  }
+  std::string marker;
+  if (s.ok() && !table->GetProperty(kExternalFileProperty, &marker)) {
+    s = Status::InvalidArgument(fname, "not written by SstFileWriter");
+  }
+  if (s.ok()) {
+    // SstFileWriter writes no range tombstones and at least one key
+    Iterator* range_del_iter = table->NewRangeTombstoneIterator(ReadOptions());
+    ReadOptions read_options;
+    read_options.fill_cache = false;
+    Iterator* iter = table->NewIterator(read_options);
+    ParsedInternalKey ikey(Slice(), 0, kTypeValue);
+    iter->SeekToFirst();
+    bool valid = iter->Valid() && ParseInternalKey(iter->key(), &ikey);
+    if (valid) {
+      meta->smallest.DecodeFrom(iter->key());
+      iter->SeekToLast();
+      valid = iter->Valid() && ParseInternalKey(iter->key(), &ikey);
+    }
+    if (valid) {
+      meta->largest.DecodeFrom(iter->key());
+    }
+    if (!iter->status().ok()) {
+      s = iter->status();
+    } else if (!valid || range_del_iter != NULL) {
+      s = Status::InvalidArgument(fname, "not written by SstFileWriter");
+    }
+    delete iter;
+    delete range_del_iter;
+  }
+  delete table;
+  delete file;
+  return s;
+}
+
+namespace {
+struct BySmallestKey {
+  const InternalKeyComparator* icmp;
+
+  explicit BySmallestKey(const InternalKeyComparator* c) : icmp(c) { }
+
+  bool operator()(const FileMetaData* a, const FileMetaData* b) const {
+    return icmp->Compare(a->smallest, b->smallest) < 0;
+  }
+};
+}  // namespace
+
+// Returns true iff "mem" holds entries or range tombstones for user keys
+// in [smallest,largest].
+static bool MemTableOverlaps(MemTable* mem, const Comparator* ucmp,
+                             const Slice& smallest, const Slice& largest) {
+  Iterator* iter = mem->NewIterator();
+  const InternalKey start(smallest, kMaxSequenceNumber, kValueTypeForSeek);
+  iter->Seek(start.Encode());
+  bool overlap = iter->Valid() &&
+                 ucmp->Compare(ExtractUserKey(iter->key()), largest) <= 0;
+  delete iter;
+  Iterator* range_del_iter = mem->NewRangeTombstoneIterator();
+  if (range_del_iter != NULL) {
+    for (range_del_iter->SeekToFirst();
+         !overlap && range_del_iter->Valid();
+         range_del_iter->Next()) {
+      overlap =
+          ucmp->Compare(ExtractUserKey(range_del_iter->key()), largest) <= 0 &&
+          ucmp->Compare(range_del_iter->value(), smallest) > 0;
+    }
+    delete range_del_iter;
+  }
+  return overlap;
+}
+
+// Replaces the sequence number of "*key" by "seq".
+static void SetSequence(InternalKey* key, SequenceNumber seq) {
+  ParsedInternalKey parsed;
+  ParseInternalKey(key->Encode(), &parsed);
+  parsed.sequence = seq;
+  InternalKey result;
+  result.SetFrom(parsed);
+  *key = result;
+}
+
+Status DBImpl::IngestExternalFiles(const std::vector<std::string>& files) {
+  const Comparator* ucmp = user_comparator();
+  std::vector<FileMetaData> metas(files.size());
+  Status s;
+  for (size_t i = 0; i < files.size() && s.ok(); i++) {
+    s = ReadExternalFile(files[i], &metas[i]);
+  }
+  if (!s.ok() || files.empty()) {
+    return s;
+  }
+
+  // All files get the same sequence number, so none may hide the keys
+  // of another
+  std::vector<const FileMetaData*> sorted;
+  for (size_t i = 0; i < metas.size(); i++) {
+    sorted.push_back(&metas[i]);
+  }
+  std::sort(sorted.begin(), sorted.end(),
+            BySmallestKey(&internal_comparator_));
+  for (size_t i = 1; i < sorted.size(); i++) {
+    if (ucmp->Compare(sorted[i-1]->largest.user_key(),
+                      sorted[i]->smallest.user_key()) >= 0) {
+      return Status::InvalidArgument("key ranges of external files overlap");
+    }
+  }
+
+  // Hold the write queue, so that no write takes a sequence number or
+  // fills the memtable until the files are installed
+  Writer w(&mutex_);
+  w.batch = NULL;
+  w.sync = false;
+  w.done = false;
+  MutexLock l(&mutex_);
+  writers_.push_back(&w);
+  while (&w != writers_.front()) {
+    w.cv.Wait();
+  }
+
+  // Older entries for the keys of the files must go to levels below them
+  // first.  A memtable being flushed may be about to take the level a
+  // file would get, so the flush is always waited for.
+  s = bg_error_;
+  bool flush = false;
+  for (size_t i = 0; i < metas.size() && s.ok() && !flush; i++) {
+    flush = MemTableOverlaps(mem_, ucmp, metas[i].smallest.user_key(),
+                             metas[i].largest.user_key());
+  }
+  if (flush) {
+    s = MakeRoomForWrite(true);
+  }
+  while (s.ok() && imm_ != NULL) {
+    bg_cv_.Wait();
+    s = bg_error_;
+  }
+
+  // Move the files in.  They are numbered only now, after the flushes,
+  // since level-0 files are ordered by number.
+  const bool numbered = s.ok();
+  size_t moved = 0;
+  if (numbered) {
+    for (size_t i = 0; i < metas.size(); i++) {
+      metas[i].number = versions_->NewFileNumber();
+      pending_outputs_.insert(metas[i].number);
+    }
+    mutex_.Unlock();
+    for (; moved < metas.size() && s.ok(); moved++) {
+      s = env_->RenameFile(files[moved],
+                           TableFileName(dbname_, metas[moved].number));
+    }
+    if (!s.ok()) {
+      moved--;  // The failed rename moved nothing
+    }
+    mutex_.Lock();
+  }
+
+  if (s.ok()) {
+    const SequenceNumber seq = versions_->LastSequence() + 1;
+    Version* current = versions_->current();
+    VersionEdit edit;
+    for (size_t i = 0; i < metas.size(); i++) {
+      FileMetaData* f = &metas[i];
+      SetSequence(&f->smallest, seq);
+      SetSequence(&f->largest, seq);
+
+      // The deepest level above every level holding keys in the range of
+      // the file, or into which a running compaction may write some
+      const Slice smallest = f->smallest.user_key();
+      const Slice largest = f->largest.user_key();
+      int level = 0;
+      for (int l = 0; l < config::kNumLevels; l++) {
+        if (current->OverlapInLevel(l, &smallest, &largest) ||
+            versions_->RangeUnderCompaction(l, smallest, largest)) {
+          break;
+        }
+        level = l;
+      }
+      edit.AddFile(level, f->number, f->file_size, f->smallest, f->largest,
+                   false, seq);
+      Log(options_.info_log, "Ingested %s as table #%llu@%d: %lld bytes",
+          files[i].c_str(), static_cast<unsigned long long>(f->number), level,
+          static_cast<long long>(f->file_size));
+    }
+    versions_->SetLastSequence(seq);
+    s = LogAndApply(&edit);
+    if (s.ok()) {
+      InstallSuperVersion();
+    }
+  }
+
+  if (!s.ok()) {
+    // Give the files back
+    for (size_t i = 0; i < moved; i++) {
+      env_->RenameFile(TableFileName(dbname_, metas[i].number), files[i]);
+    }
+  }
+  for (size_t i = 0; numbered && i < metas.size(); i++) {
+    pending_outputs_.erase(metas[i].number);
+  }
+  if (s.ok()) {
+    MaybeScheduleCompaction();
+  }
+
+  writers_.pop_front();
+  if (!writers_.empty()) {
+    writers_.front()->cv.Signal();
+  }
+  return s;
+}
+
 Status DBImpl::TEST_CompactMemTable() {
   // NULL batch means just wait for earlier writes to be done
   Status s = Write(WriteOptions(), NULL);
@@ -641,40 +1144,110 @@ void DBImpl::RecordBackgroundError(const Status& s) {
   }
 }
 
+namespace {
+struct CompactionArg {
+  DBImpl* db;
+  Compaction* compaction;
+};
+}  // namespace
+
 void DBImpl::MaybeScheduleCompaction() {
   mutex_.AssertHeld();
-  if (bg_compaction_scheduled_) {
-    // Already scheduled
-  } else if (shutting_down_.Acquire_Load()) {
+  if (shutting_down_.Acquire_Load()) {
     // DB is being deleted; no more background compactions
+    return;
   } else if (!bg_error_.ok()) {
     // Already got an error; no more changes
-  } else if (imm_ == NULL &&
-             manual_compaction_ == NULL &&
-             !versions_->NeedsCompaction()) {
-    // No work to be done
-  } else {
-    bg_compaction_scheduled_ = true;
-    env_->Schedule(&DBImpl::BGWork, this);
+    return;
+  }
+
+  // Memtable flushes run in the high priority pool so that they never
+  // wait behind a long compaction.
+  if (imm_ != NULL && !bg_flush_scheduled_) {
+    bg_flush_scheduled_ = true;
+    env_->Schedule(&DBImpl::BGWorkFlush, this, Env::kHighPriority);
+  }
+
+  // Compactions are picked here, so that every scheduled compaction has
+  // work to do and the inputs of the running ones are known to
+  // PickCompaction().  A manual compaction runs alone: it waits for the
+  // running compactions to finish and no others start meanwhile.
+  while (bg_compaction_scheduled_ < options_.max_background_compactions &&
+         !flush_install_pending_) {
+    Compaction* c = NULL;
+    if (manual_compaction_ != NULL) {
+      if (bg_compaction_scheduled_ > 0) {
+        break;
+      }
+    } else if (!versions_->NeedsCompaction()) {
+      // No work to be done
+      break;
+    } else {
+      c = versions_->PickCompaction();
+      if (c == NULL) {
+        // Remaining work conflicts with running compactions
+        break;
+      }
+    }
+    bg_compaction_scheduled_++;
+    CompactionArg* arg = new CompactionArg;
+    arg->db = this;
+    arg->compaction = c;
+    env_->Schedule(&DBImpl::BGWorkCompaction, arg, Env::kLowPriority);
+    if (c == NULL) {
+      break;
+    }
   }
 }
 
-void DBImpl::BGWork(void* db) {
-  reinterpret_cast<DBImpl*>(db)->BackgroundCall();
+void DBImpl::BGWorkFlush(void* db) {
+  reinterpret_cast<DBImpl*>(db)->BackgroundFlushCall();
 }
 
-void DBImpl::BackgroundCall() {
+void DBImpl::BGWorkCompaction(void* arg) {
+  CompactionArg* a = reinterpret_cast<CompactionArg*>(arg);
+  DBImpl* db = a->db;
+  Compaction* c = a->compaction;
+  delete a;
+  db->BackgroundCompactionCall(c);
+}
+
+void DBImpl::BackgroundFlushCall() {
   MutexLock l(&mutex_);
-  assert(bg_compaction_scheduled_);
+  assert(bg_flush_scheduled_);
+  if (shutting_down_.Acquire_Load()) {
+    // No more background work when shutting down.
+  } else if (!bg_error_.ok()) {
+    // No more background work after a background error.
+  } else if (imm_ != NULL && !flush_running_) {
+    CompactMemTable();
+  }
+
+  bg_flush_scheduled_ = false;
+
+  // The new table may have produced too many files in level-0, so
+  // schedule a compaction if needed.
+  MaybeScheduleCompaction();
+  bg_cv_.SignalAll();
+}
+
+void DBImpl::BackgroundCompactionCall(Compaction* c) {
+  MutexLock l(&mutex_);
+  assert(bg_compaction_scheduled_ > 0);
   if (shutting_down_.Acquire_Load()) {
     // No more background work when shutting down.
   } else if (!bg_error_.ok()) {
     // No more background work after a background error.
   } else {
-    BackgroundCompaction();
+    BackgroundCompaction(c);
+    c = NULL;
+  }
+  if (c != NULL) {
+    versions_->ReleaseCompaction(c);
+    delete c;
   }
 
-  bg_compaction_scheduled_ = false;
+  bg_compaction_scheduled_--;
 
   // Previous compaction may have produced too many files in a level,
   // so reschedule another compaction if needed.
@@ -682,17 +1255,15 @@ void DBImpl::BackgroundCall() {
   bg_cv_.SignalAll();
 }
 
-void DBImpl::BackgroundCompaction() {
+void DBImpl::BackgroundCompaction(Compaction* c) {
   mutex_.AssertHeld();
 
-  if (imm_ != NULL) {
-    CompactMemTable();
+  bool is_manual = (c == NULL);
+  InternalKey manual_end;
+  if (is_manual && manual_compaction_ == NULL) {
+    // The manual compaction was cancelled before it could run
     return;
   }
-
-  Compaction* c;
-  bool is_manual = (manual_compaction_ != NULL);
-  InternalKey manual_end;
   if (is_manual) {
     ManualCompaction* m = manual_compaction_;
     c = versions_->CompactRange(m->level, m->begin, m->end);
@@ -706,8 +1277,6 @@ void DBImpl::BackgroundCompaction() {
         (m->begin ? m->begin->DebugString().c_str() : "(begin)"),
         (m->end ? m->end->DebugString().c_str() : "(end)"),
         (m->done ? "(end)" : manual_end.DebugString().c_str()));
-  } else {
-    c = versions_->PickCompaction();
   }
 
   Status status;
@@ -719,11 +1288,15 @@ void DBImpl::BackgroundCompaction() {
     FileMetaData* f = c->input(0, 0);
     c->edit()->DeleteFile(c->level(), f->number);
     c->edit()->AddFile(c->level() + 1, f->number, f->file_size,
-                       f->smallest, f->largest);
-    status = versions_->LogAndApply(c->edit(), &mutex_);
-    if (!status.ok()) {
+                       f->smallest, f->largest, f->has_range_dels,
+                       f->global_seqno);
+    status = LogAndApply(c->edit());
+    if (status.ok()) {
+      InstallSuperVersion();
+    } else {
       RecordBackgroundError(status);
     }
+    versions_->ReleaseCompaction(c);
     VersionSet::LevelSummaryStorage tmp;
     Log(options_.info_log, "Moved #%lld to level-%d %lld bytes %s: %s\n",
         static_cast<unsigned long long>(f->number),
@@ -738,6 +1311,7 @@ void DBImpl::BackgroundCompaction() {
       RecordBackgroundError(status);
     }
     CleanupCompaction(compact);
+    versions_->ReleaseCompaction(c);
     c->ReleaseInputs();
     DeleteObsoleteFiles();
   }
@@ -796,21 +1370,27 @@ Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
     out.number = file_number;
     out.smallest.Clear();
     out.largest.Clear();
+    out.has_range_dels = false;
     compact->outputs.push_back(out);
     mutex_.Unlock();
   }
 
   // Make the output file
   std::string fname = TableFileName(dbname_, file_number);
-  Status s = env_->NewWritableFile(fname, &compact->outfile);
+  Status s = options_.use_direct_io_for_flush_and_compaction
+      ? env_->NewDirectWritableFile(fname, &compact->outfile)
+      : env_->NewWritableFile(fname, &compact->outfile);
   if (s.ok()) {
-    compact->builder = new TableBuilder(options_, compact->outfile);
+    compact->builder = new TableBuilder(
+        OptionsForLevel(options_, compact->compaction->level() + 1),
+        compact->outfile);
   }
   return s;
 }
 
 Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
-                                          Iterator* input) {
+                                          Iterator* input,
+                                          const Slice* upper) {
   assert(compact != NULL);
   assert(compact->outfile != NULL);
   assert(compact->builder != NULL);
@@ -821,6 +1401,18 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
   // Check for iterator errors
   Status s = input->status();
   const uint64_t current_entries = compact->builder->NumEntries();
+  CompactionState::Output* out = compact->current_output();
+  if (s.ok() && compact->output_range_dels != NULL) {
+    Slice lower = compact->lower;
+    out->has_range_dels = compact->output_range_dels->AddTo(
+        compact->builder, compact->has_lower ? &lower : NULL, upper,
+        &out->smallest, &out->largest) > 0;
+    compact->has_lower = (upper != NULL);
+    if (upper != NULL) {
+      compact->lower.assign(upper->data(), upper->size());
+    }
+    compact->cut_pending = false;
+  }
   if (s.ok()) {
     s = compact->builder->Finish();
   } else {
@@ -842,11 +1434,12 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
   delete compact->outfile;
   compact->outfile = NULL;
 
-  if (s.ok() && current_entries > 0) {
+  if (s.ok() && (current_entries > 0 || out->has_range_dels)) {
     // Verify that the table is usable
     Iterator* iter = table_cache_->NewIterator(ReadOptions(),
                                                output_number,
-                                               current_bytes);
+                                               current_bytes,
+                                               0);
     s = iter->status();
     delete iter;
     if (s.ok()) {
@@ -878,14 +1471,39 @@ Status DBImpl::InstallCompactionResults(CompactionState* compact) {
     const CompactionState::Output& out = compact->outputs[i];
     compact->compaction->edit()->AddFile(
         level + 1,
-        out.number, out.file_size, out.smallest, out.largest);
+        out.number, out.file_size, out.smallest, out.largest,
+        out.has_range_dels);
+  }
+  Status s = LogAndApply(compact->compaction->edit());
+  if (s.ok()) {
+    InstallSuperVersion();
   }
-  return versions_->LogAndApply(compact->compaction->edit(), &mutex_);
+  return s;
 }
 
+// The parts of a compaction, shared by the compaction and the tasks it
+// schedules on the low priority pool to help with them.  Workers claim
+// parts in order until none is left.  The compaction itself works through
+// the parts too, so that it finishes even if no thread of the pool frees
+// up, and then only waits for the parts that tasks claimed.  Tasks that
+// run after all parts are claimed just drop their reference.
+struct DBImpl::SubcompactionQueue {
+  DBImpl* db;
+  std::vector<CompactionState*> parts;
+  std::vector<Status> statuses;
+  port::Mutex mu;
+  port::CondVar cv;
+  size_t next;        // Index of the next part to claim
+  int running;        // Number of claimed parts not done yet
+  int refs;           // The compaction and its tasks that have not run
+
+  SubcompactionQueue(DBImpl* d, const std::vector<CompactionState*>& p)
+      : db(d), parts(p), statuses(p.size()), cv(&mu),
+        next(0), running(0), refs(1) { }
+};
+
 Status DBImpl::DoCompactionWork(CompactionState* compact) {
   const uint64_t start_micros = env_->NowMicros();
-  int64_t imm_micros = 0;  // Micros spent doing imm_ compactions
 
   Log(options_.info_log,  "Compacting %d@%d + %d@%d files",
       compact->compaction->num_input_files(0),
@@ -905,8 +1523,168 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   // Release mutex while we're actually doing the compaction work
   mutex_.Unlock();
 
+  // Entries that the range tombstones of the inputs delete for every
+  // snapshot are dropped.  The outputs keep the tombstones that some
+  // snapshot needs, and the oldest one that all of them see unless no
+  // data it may delete remains below the output level.
+  Compaction* const c = compact->compaction;
+  RangeDelMap range_dels(user_comparator());
+  RangeDelMap output_range_dels(user_comparator());
+  Status status;
+  for (int which = 0; which < 2 && status.ok(); which++) {
+    for (int i = 0; i < c->num_input_files(which) && status.ok(); i++) {
+      const FileMetaData* f = c->input(which, i);
+      if (f->has_range_dels) {
+        status = table_cache_->AddRangeTombstones(f->number, f->file_size,
+                                                  &range_dels);
+      }
+    }
+  }
+  if (!status.ok()) {
+    mutex_.Lock();
+    return status;
+  }
+  range_dels.Finish();
+  for (size_t i = 0; i < range_dels.fragments().size(); i++) {
+    const RangeDelMap::Fragment& f = range_dels.fragments()[i];
+    for (size_t j = 0; j < f.seqs.size(); j++) {
+      if (f.seqs[j] <= compact->smallest_snapshot) {
+        if (!c->IsBaseLevelForRange(f.begin, f.end)) {
+          output_range_dels.Add(f.begin, f.end, f.seqs[j]);
+        }
+        break;
+      }
+      output_range_dels.Add(f.begin, f.end, f.seqs[j]);
+    }
+  }
+  output_range_dels.Finish();
+  if (!range_dels.empty()) {
+    compact->range_dels = &range_dels;
+    compact->output_range_dels = &output_range_dels;
+  }
+
+  // Split the key range at input file boundaries.  compact takes the
+  // first part itself and collects the outputs of the others at the end.
+  std::vector<std::string> boundaries;
+  versions_->SplitCompaction(compact->compaction, options_.max_subcompactions,
+                             &boundaries);
+  std::vector<CompactionState*> parts(1, compact);
+  for (size_t i = 0; i < boundaries.size(); i++) {
+    parts.back()->has_end = true;
+    parts.back()->end = boundaries[i];
+    CompactionState* part = new CompactionState(compact->compaction);
+    part->smallest_snapshot = compact->smallest_snapshot;
+    part->range_dels = compact->range_dels;
+    part->output_range_dels = compact->output_range_dels;
+    part->has_start = true;
+    part->start = boundaries[i];
+    parts.push_back(part);
+  }
+  if (parts.size() > 1) {
+    Log(options_.info_log, "Compacting in %d subcompactions",
+        static_cast<int>(parts.size()));
+  }
+
+  SubcompactionQueue* queue = new SubcompactionQueue(this, parts);
+  queue->refs += parts.size() - 1;
+  for (size_t i = 1; i < parts.size(); i++) {
+    env_->Schedule(&DBImpl::BGWorkSubcompaction, queue, Env::kLowPriority);
+  }
+  RunSubcompactions(queue);
+  queue->mu.Lock();
+  while (queue->running > 0) {
+    queue->cv.Wait();
+  }
+  const std::vector<Status> statuses = queue->statuses;
+  const bool last_ref = (--queue->refs == 0);
+  queue->mu.Unlock();
+  if (last_ref) {
+    delete queue;
+  }
+
+  for (size_t i = 0; i < parts.size(); i++) {
+    if (status.ok()) {
+      status = statuses[i];
+    }
+    if (i > 0) {
+      // The outputs are disjoint and in key order across the parts.
+      compact->outputs.insert(compact->outputs.end(),
+                              parts[i]->outputs.begin(),
+                              parts[i]->outputs.end());
+      compact->total_bytes += parts[i]->total_bytes;
+      compact->imm_micros += parts[i]->imm_micros;
+      parts[i]->outputs.clear();
+    }
+  }
+
+  CompactionStats stats;
+  stats.micros = env_->NowMicros() - start_micros - compact->imm_micros;
+  for (int which = 0; which < 2; which++) {
+    for (int i = 0; i < compact->compaction->num_input_files(which); i++) {
+      stats.bytes_read += compact->compaction->input(which, i)->file_size;
+    }
+  }
+  for (size_t i = 0; i < compact->outputs.size(); i++) {
+    stats.bytes_written += compact->outputs[i].file_size;
+  }
+
+  mutex_.Lock();
+  for (size_t i = 1; i < parts.size(); i++) {
+    CleanupCompaction(parts[i]);
+  }
+  stats_[compact->compaction->level() + 1].Add(stats);
+
+  if (status.ok()) {
+    status = InstallCompactionResults(compact);
+  }
+  if (!status.ok()) {
+    RecordBackgroundError(status);
+  }
+  VersionSet::LevelSummaryStorage tmp;
+  Log(options_.info_log,
+      "compacted to: %s", versions_->LevelSummary(&tmp));
+  compact->range_dels = NULL;
+  compact->output_range_dels = NULL;
+  return status;
+}
+
+void DBImpl::BGWorkSubcompaction(void* arg) {
+  SubcompactionQueue* queue = reinterpret_cast<SubcompactionQueue*>(arg);
+  RunSubcompactions(queue);
+  queue->mu.Lock();
+  const bool last_ref = (--queue->refs == 0);
+  queue->mu.Unlock();
+  if (last_ref) {
+    delete queue;
+  }
+}
+
+void DBImpl::RunSubcompactions(SubcompactionQueue* queue) {
+  MutexLock l(&queue->mu);
+  while (queue->next < queue->parts.size()) {
+    const size_t i = queue->next++;
+    queue->running++;
+    queue->mu.Unlock();
+    Status s = queue->db->DoSubcompactionWork(queue->parts[i]);
+    queue->mu.Lock();
+    queue->statuses[i] = s;
+    if (--queue->running == 0) {
+      queue->cv.SignalAll();
+    }
+  }
+}
+
+Status DBImpl::DoSubcompactionWork(CompactionState* compact) {
   Iterator* input = versions_->MakeInputIterator(compact->compaction);
-  input->SeekToFirst();
+  if (compact->has_start) {
+    InternalKey start(compact->start, kMaxSequenceNumber, kValueTypeForSeek);
+    input->Seek(start.Encode());
+  } else {
+    input->SeekToFirst();
+  }
+  compact->has_lower = compact->has_start;
+  compact->lower = compact->start;
+  const RangeDelMap* const range_dels = compact->range_dels;
   Status status;
   ParsedInternalKey ikey;
   std::string current_user_key;
@@ -914,21 +1692,39 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   SequenceNumber last_sequence_for_key = kMaxSequenceNumber;
   for (; input->Valid() && !shutting_down_.Acquire_Load(); ) {
     // Prioritize immutable compaction work
-    if (has_imm_.NoBarrier_Load() != NULL) {
+    if (inline_flushes_ && has_imm_.NoBarrier_Load() != NULL) {
       const uint64_t imm_start = env_->NowMicros();
       mutex_.Lock();
-      if (imm_ != NULL) {
+      if (imm_ != NULL && !flush_running_) {
         CompactMemTable();
         bg_cv_.SignalAll();  // Wakeup MakeRoomForWrite() if necessary
       }
       mutex_.Unlock();
-      imm_micros += (env_->NowMicros() - imm_start);
+      compact->imm_micros += (env_->NowMicros() - imm_start);
     }
 
     Slice key = input->key();
-    if (compact->compaction->ShouldStopBefore(key) &&
+    if (compact->has_end && ParseInternalKey(key, &ikey) &&
+        user_comparator()->Compare(ikey.user_key, compact->end) >= 0) {
+      // The rest of the input belongs to the next subcompaction
+      break;
+    }
+    if (compact->compaction->ShouldStopBefore(key, &compact->cursor) &&
         compact->builder != NULL) {
-      status = FinishCompactionOutputFile(compact, input);
+      if (range_dels == NULL) {
+        status = FinishCompactionOutputFile(compact, input, NULL);
+        if (!status.ok()) {
+          break;
+        }
+      } else {
+        compact->cut_pending = true;
+      }
+    }
+    if (compact->cut_pending && has_current_user_key &&
+        ParseInternalKey(key, &ikey) &&
+        user_comparator()->Compare(ikey.user_key,
+                                   Slice(current_user_key)) != 0) {
+      status = FinishCompactionOutputFile(compact, input, &ikey.user_key);
       if (!status.ok()) {
         break;
       }
@@ -954,9 +1750,16 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
       if (last_sequence_for_key <= compact->smallest_snapshot) {
         // Hidden by an newer entry for same user key
         drop = true;    // (A)
+      } else if (range_dels != NULL &&
+                 range_dels->MaxCoveringSeq(ikey.user_key,
+                                            compact->smallest_snapshot) >
+                 ikey.sequence) {
+        // Deleted by a range tombstone that every snapshot sees
+        drop = true;
       } else if (ikey.type == kTypeDeletion &&
                  ikey.sequence <= compact->smallest_snapshot &&
-                 compact->compaction->IsBaseLevelForKey(ikey.user_key)) {
+                 compact->compaction->IsBaseLevelForKey(ikey.user_key,
+                                                       &compact->cursor)) {
         // For this user key:
         // (1) there is no data in higher levels
         // (2) data in lower levels will have larger sequence numbers
@@ -975,7 +1778,7 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         "%d smallest_snapshot: %d",
         ikey.user_key.ToString().c_str(),
         (int)ikey.sequence, ikey.type, kTypeValue, drop,
-        compact->compaction->IsBaseLevelForKey(ikey.user_key),
+        compact->compaction->IsBaseLevelForKey(ikey.user_key, &compact->cursor),
         (int)last_sequence_for_key, (int)compact->smallest_snapshot);
 #endif
 
@@ -996,9 +1799,13 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
       // Close output file if it is big enough
       if (compact->builder->FileSize() >=
           compact->compaction->MaxOutputFileSize()) {
-        status = FinishCompactionOutputFile(compact, input);
-        if (!status.ok()) {
-          break;
+        if (range_dels == NULL) {
+          status = FinishCompactionOutputFile(compact, input, NULL);
+          if (!status.ok()) {
+            break;
+          }
+        } else {
+          compact->cut_pending = true;
         }
       }
     }
@@ -1009,38 +1816,23 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   if (status.ok() && shutting_down_.Acquire_Load()) {
     status = Status::IOError("Deleting DB during compaction");
   }
+  Slice end = compact->end;
+  const Slice* upper = compact->has_end ? &end : NULL;
+  if (status.ok() && compact->builder == NULL && range_dels != NULL) {
+    // Tombstones past the last output still need one
+    Slice lower = compact->lower;
+    if (compact->output_range_dels->Overlaps(
+            compact->has_lower ? &lower : NULL, upper)) {
+      status = OpenCompactionOutputFile(compact);
+    }
+  }
   if (status.ok() && compact->builder != NULL) {
-    status = FinishCompactionOutputFile(compact, input);
+    status = FinishCompactionOutputFile(compact, input, upper);
   }
   if (status.ok()) {
     status = input->status();
   }
   delete input;
-  input = NULL;
-
-  CompactionStats stats;
-  stats.micros = env_->NowMicros() - start_micros - imm_micros;
-  for (int which = 0; which < 2; which++) {
-    for (int i = 0; i < compact->compaction->num_input_files(which); i++) {
-      stats.bytes_read += compact->compaction->input(which, i)->file_size;
-    }
-  }
-  for (size_t i = 0; i < compact->outputs.size(); i++) {
-    stats.bytes_written += compact->outputs[i].file_size;
-  }
-
-  mutex_.Lock();
-  stats_[compact->compaction->level() + 1].Add(stats);
-
-  if (status.ok()) {
-    status = InstallCompactionResults(compact);
-  }
-  if (!status.ok()) {
-    RecordBackgroundError(status);
-  }
-  VersionSet::LevelSummaryStorage tmp;
-  Log(options_.info_log,
-      "compacted to: %s", versions_->LevelSummary(&tmp));
   return status;
 }
 
@@ -1065,7 +1857,8 @@ static void CleanupIteratorState(void* arg1, void* arg2) {
 
 Iterator* DBImpl::NewInternalIterator(const ReadOptions& options,
                                       SequenceNumber* latest_snapshot,
-                                      uint32_t* seed) {
+                                      uint32_t* seed,
+                                      RangeDelMap* range_dels) {
   IterState* cleanup = new IterState;
   mutex_.Lock();
   *latest_snapshot = versions_->LastSequence();
@@ -1091,6 +1884,28 @@ Iterator* DBImpl::NewInternalIterator(const ReadOptions& options,
 
   *seed = ++seed_;
   mutex_.Unlock();
+
+  if (range_dels != NULL) {
+    // The references taken above keep the sources alive
+    Status s;
+    MemTable* mems[2] = { cleanup->mem, cleanup->imm };
+    for (int i = 0; i < 2 && s.ok(); i++) {
+      Iterator* iter =
+          (mems[i] != NULL) ? mems[i]->NewRangeTombstoneIterator() : NULL;
+      if (iter != NULL) {
+        s = range_dels->AddTombstones(iter);
+        delete iter;
+      }
+    }
+    if (s.ok()) {
+      s = cleanup->version->AddRangeTombstones(range_dels);
+    }
+    range_dels->Finish();
+    if (!s.ok()) {
+      delete internal_iter;
+      return NewErrorIterator(s);
+    }
+  }
   return internal_iter;
 }
 
@@ -1105,63 +1920,252 @@ int64_t DBImpl::TEST_MaxNextLevelOverlappingBytes() {
   return versions_->MaxNextLevelOverlappingBytes();
 }
 
+DBImpl::SuperVersion* DBImpl::GetAndRefSuperVersion() {
+  // The reference held by the slot (if any) is handed over to the caller
+  // while the slot is marked as in use.
+  void* ptr = local_sv_->Swap(kSVInUse);
+  assert(ptr != kSVInUse);
+  SuperVersion* sv = reinterpret_cast<SuperVersion*>(ptr);
+  if (sv == NULL) {
+    // No cached reference, or it was invalidated by InstallSuperVersion().
+    MutexLock l(&mutex_);
+    sv = super_version_;
+    sv->refs++;
+  }
+  return sv;
+}
+
+void DBImpl::ReturnAndCleanupSuperVersion(SuperVersion* sv) {
+  void* expected = kSVInUse;
+  if (!local_sv_->CompareAndSwap(sv, &expected)) {
+    // InstallSuperVersion() cleared the slot while we were using sv, so sv
+    // is stale and the reference cannot be cached.
+    assert(expected == NULL);
+    MutexLock l(&mutex_);
+    UnrefSuperVersion(sv);
+  }
+}
+
+void DBImpl::InstallSuperVersion() {
+  mutex_.AssertHeld();
+  SuperVersion* old = super_version_;
+  super_version_ = new SuperVersion(this, mem_, imm_, versions_->current());
+
+  // Drop the references cached by idle threads.  Threads that are in the
+  // middle of a read find their slot cleared and drop theirs themselves.
+  std::vector<void*> cached;
+  local_sv_->Scrape(&cached, NULL);
+  for (size_t i = 0; i < cached.size(); i++) {
+    if (cached[i] != kSVInUse) {
+      UnrefSuperVersion(reinterpret_cast<SuperVersion*>(cached[i]));
+    }
+  }
+  if (old != NULL) {
+    UnrefSuperVersion(old);
+  }
+}
+
+void DBImpl::UnrefSuperVersion(SuperVersion* sv) {
+  mutex_.AssertHeld();
+  assert(sv->refs > 0);
+  if (--sv->refs == 0) {
+    delete sv;
+  }
+}
+
+void DBImpl::UnrefSuperVersionHandler(void* ptr) {
+  // Called when a thread that cached a reference exits.
+  SuperVersion* sv = reinterpret_cast<SuperVersion*>(ptr);
+  if (ptr != kSVInUse) {
+    MutexLock l(&sv->db->mutex_);
+    sv->db->UnrefSuperVersion(sv);
+  }
+}
+
 Status DBImpl::Get(const ReadOptions& options,
                    const Slice& key,
                    std::string* value) {
+  return GetImpl(options, key, value, NULL);
+}
+
+Status DBImpl::GetPinned(const ReadOptions& options,
+                         const Slice& key,
+                         PinnedValue* value) {
+  value->Reset();
+  Status s = GetImpl(options, key, NULL, value);
+  if (!s.ok()) {
+    value->Reset();
+  }
+  return s;
+}
+
+static void UnrefMemTable(void* arg1, void* arg2) {
+  reinterpret_cast<MemTable*>(arg1)->Unref();
+}
+
+// Looks up "key" in "mem" like MemTable::Get(), storing a found value in
+// exactly one of *value and *pinned.  A pinned value keeps "mem" alive.
+static bool GetFromMemTable(MemTable* mem, const LookupKey& key,
+                            std::string* value, PinnedValue* pinned,
+                            Status* s) {
+  if (pinned == NULL) {
+    return mem->Get(key, value, s);
+  }
+  Slice v;
+  if (!mem->Get(key, &v, s)) {
+    return false;
+  }
+  if (s->ok()) {
+    mem->Ref();
+    pinned->PinSlice(v);
+    pinned->RegisterCleanup(&UnrefMemTable, mem, NULL);
+  }
+  return true;
+}
+
+Status DBImpl::GetImpl(const ReadOptions& options,
+                       const Slice& key,
+                       std::string* value,
+                       PinnedValue* pinned) {
   Status s;
-  MutexLock l(&mutex_);
+  SuperVersion* sv = GetAndRefSuperVersion();
   SequenceNumber snapshot;
   if (options.snapshot != NULL) {
     snapshot = reinterpret_cast<const SnapshotImpl*>(options.snapshot)->number_;
   } else {
+    // Read after acquiring sv: sv holds every entry up to this sequence
+    // unless a memtable switch happened in between, in which case we
+    // simply observe the state as of that switch.
     snapshot = versions_->LastSequence();
   }
 
-  MemTable* mem = mem_;
-  MemTable* imm = imm_;
-  Version* current = versions_->current();
-  mem->Ref();
-  if (imm != NULL) imm->Ref();
-  current->Ref();
-
   bool have_stat_update = false;
   Version::GetStats stats;
 
-  // Unlock while reading from files and memtables
-  {
-    mutex_.Unlock();
-    // First look in the memtable, then in the immutable memtable (if any).
-    LookupKey lkey(key, snapshot);
-    if (mem->Get(lkey, value, &s)) {
+  // First look in the memtable, then in the immutable memtable (if any).
+  LookupKey lkey(key, snapshot);
+  if (GetFromMemTable(sv->mem, lkey, value, pinned, &s)) {
+    // Done
+  } else if (sv->imm != NULL &&
+             GetFromMemTable(sv->imm, lkey, value, pinned, &s)) {
+    // Done
+  } else {
+    if (pinned != NULL) {
+      s = sv->current->Get(options, lkey, pinned, &stats);
+    } else {
+      s = sv->current->Get(options, lkey, value, &stats);
+    }
+    have_stat_update = true;
+  }
+
+  // Seeks are charged without the lock; mutex_ is only needed once a file
+  // runs out of allowed seeks and has to be scheduled for compaction.
+  if (have_stat_update && sv->current->ChargeSeek(stats)) {
+    MutexLock l(&mutex_);
+    if (sv->current->RecordSeekCompaction(stats)) {
+      MaybeScheduleCompaction();
+    }
+  }
+  ReturnAndCleanupSuperVersion(sv);
+  return s;
+}
+
+namespace {
+struct UserKeyLess {
+  const Comparator* ucmp;
+  bool operator()(const Version::KeyRequest& a,
+                  const Version::KeyRequest& b) const {
+    return ucmp->Compare(a.key->user_key(), b.key->user_key()) < 0;
+  }
+};
+}  // namespace
+
+std::vector<Status> DBImpl::MultiGet(const ReadOptions& options,
+                                     const std::vector<Slice>& keys,
+                                     std::vector<std::string>* values) {
+  const size_t num_keys = keys.size();
+  std::vector<Status> statuses(num_keys);
+  values->resize(num_keys);
+
+  SuperVersion* sv = GetAndRefSuperVersion();
+  SequenceNumber snapshot;
+  if (options.snapshot != NULL) {
+    snapshot = reinterpret_cast<const SnapshotImpl*>(options.snapshot)->number_;
+  } else {
+    snapshot = versions_->LastSequence();  // See the comment in Get()
+  }
+
+  // Keys that are not resolved by the memtables are looked up in the
+  // current version as one batch, sorted so that each level is walked once.
+  std::vector<LookupKey*> lkeys(num_keys);
+  std::vector<Version::KeyRequest> requests;
+  for (size_t i = 0; i < num_keys; i++) {
+    lkeys[i] = new LookupKey(keys[i], snapshot);
+    std::string* value = &(*values)[i];
+    if (sv->mem->Get(*lkeys[i], value, &statuses[i])) {
       // Done
-    } else if (imm != NULL && imm->Get(lkey, value, &s)) {
+    } else if (sv->imm != NULL && sv->imm->Get(*lkeys[i], value,
+                                               &statuses[i])) {
       // Done
     } else {
-      s = current->Get(options, lkey, value, &stats);
-      have_stat_update = true;
+      Version::KeyRequest r;
+      r.key = lkeys[i];
+      r.value = value;
+      r.status = &statuses[i];
+      requests.push_back(r);
     }
-    mutex_.Lock();
   }
+  if (!requests.empty()) {
+    UserKeyLess less;
+    less.ucmp = user_comparator();
+    std::stable_sort(requests.begin(), requests.end(), less);
+    sv->current->MultiGet(options, &requests);
 
-  if (have_stat_update && current->UpdateStats(stats)) {
-    MaybeScheduleCompaction();
+    std::vector<size_t> exhausted;
+    for (size_t i = 0; i < requests.size(); i++) {
+      if (sv->current->ChargeSeek(requests[i].stats)) {
+        exhausted.push_back(i);
+      }
+    }
+    if (!exhausted.empty()) {
+      MutexLock l(&mutex_);
+      bool schedule = false;
+      for (size_t i = 0; i < exhausted.size(); i++) {
+        if (sv->current->RecordSeekCompaction(requests[exhausted[i]].stats)) {
+          schedule = true;
+        }
+      }
+      if (schedule) {
+        MaybeScheduleCompaction();
+      }
+    }
   }
-  mem->Unref();
-  if (imm != NULL) imm->Unref();
-  current->Unref();
-  return s;
+  ReturnAndCleanupSuperVersion(sv);
+
+  for (size_t i = 0; i < num_keys; i++) {
+    delete lkeys[i];
+  }
+  return statuses;
 }
 
 Iterator* DBImpl::NewIterator(const ReadOptions& options) {
   SequenceNumber latest_snapshot;
   uint32_t seed;
-  Iterator* iter = NewInternalIterator(options, &latest_snapshot, &seed);
+  RangeDelMap* range_dels = new RangeDelMap(user_comparator());
+  Iterator* iter = NewInternalIterator(options, &latest_snapshot, &seed,
+                                       range_dels);
+  if (range_dels->empty()) {
+    delete range_dels;
+    range_dels = NULL;
+  }
   return NewDBIterator(
       this, user_comparator(), iter,
       (options.snapshot != NULL
        ? reinterpret_cast<const SnapshotImpl*>(options.snapshot)->number_
        : latest_snapshot),
-      seed);
+      seed,
+      options.prefix_same_as_start ? options_.prefix_extractor : NULL,
+      range_dels);
 }
 
 void DBImpl::RecordReadSample(Slice key) {
@@ -1200,6 +2204,14 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* my_batch) {
   writers_.push_back(&w);
   while (!w.done && &w != writers_.front()) {
     w.cv.Wait();
+    if (w.insert_job != NULL) {
+      // The leader of our group wants help inserting into the memtable.
+      InsertJob* job = w.insert_job;
+      w.insert_job = NULL;
+      mutex_.Unlock();
+      job->RunShard(w.insert_shard);
+      mutex_.Lock();
+    }
   }
   if (w.done) {
     return w.status;
@@ -1214,6 +2226,23 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* my_batch) {
     WriteBatchInternal::SetSequence(updates, last_sequence + 1);
     last_sequence += WriteBatchInternal::Count(updates);
 
+    // With a partitioned or concurrent memtable, let waiting members of
+    // the group insert parts of the batch while we insert the rest.
+    std::vector<Writer*> helpers;
+    const size_t max_helpers =
+        mem_->concurrent_adds() ? writers_.size() : mem_->num_partitions() - 1;
+    std::deque<Writer*>::iterator iter = writers_.begin();
+    while (*iter != last_writer && helpers.size() < max_helpers) {
+      ++iter;
+      helpers.push_back(*iter);
+    }
+    InsertJob job(updates, mem_, static_cast<int>(helpers.size()) + 1);
+    for (size_t i = 0; i < helpers.size(); i++) {
+      helpers[i]->insert_job = &job;
+      helpers[i]->insert_shard = static_cast<int>(i) + 1;
+      helpers[i]->cv.Signal();
+    }
+
     // Add to log and apply to memtable.  We can release the lock
     // during this phase since &w is currently responsible for logging
     // and protects against concurrent loggers and concurrent writes
@@ -1228,8 +2257,17 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* my_batch) {
           sync_error = true;
         }
       }
-      if (status.ok()) {
-        status = WriteBatchInternal::InsertInto(updates, mem_);
+      if (helpers.empty()) {
+        if (status.ok()) {
+          status = WriteBatchInternal::InsertInto(updates, mem_);
+        }
+      } else {
+        job.StartInsert(status);
+        job.RunShard(0);
+        Status insert_status = job.WaitForInsert();
+        if (status.ok()) {
+          status = insert_status;
+        }
       }
       mutex_.Lock();
       if (sync_error) {
@@ -1291,22 +2329,26 @@ WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
       break;
     }
 
-    if (w->batch != NULL) {
-      size += WriteBatchInternal::ByteSize(w->batch);
-      if (size > max_size) {
-        // Do not make batch too big
-        break;
-      }
+    if (w->batch == NULL) {
+      // Memtable compactions and ingestions must run at the front of the
+      // queue themselves.
+      break;
+    }
 
-      // Append to *result
-      if (result == first->batch) {
-        // Switch to temporary batch instead of disturbing caller's batch
-        result = tmp_batch_;
-        assert(WriteBatchInternal::Count(result) == 0);
-        WriteBatchInternal::Append(result, first->batch);
-      }
-      WriteBatchInternal::Append(result, w->batch);
+    size += WriteBatchInternal::ByteSize(w->batch);
+    if (size > max_size) {
+      // Do not make batch too big
+      break;
     }
+
+    // Append to *result
+    if (result == first->batch) {
+      // Switch to temporary batch instead of disturbing caller's batch
+      result = tmp_batch_;
+      assert(WriteBatchInternal::Count(result) == 0);
+      WriteBatchInternal::Append(result, first->batch);
+    }
+    WriteBatchInternal::Append(result, w->batch);
     *last_writer = w;
   }
   return result;
@@ -1368,8 +2410,9 @@ Status DBImpl::MakeRoomForWrite(bool force) {
       log_ = new log::Writer(lfile);
       imm_ = mem_;
       has_imm_.Release_Store(imm_);
-      mem_ = new MemTable(internal_comparator_);
+      mem_ = NewMemTable();
       mem_->Ref();
+      InstallSuperVersion();
       force = false;   // Do not force another compaction if have room
       MaybeScheduleCompaction();
     }
@@ -1484,6 +2527,52 @@ Status DB::Delete(const WriteOptions& opt, const Slice& key) {
   return Write(opt, &batch);
 }
 
+Status DB::DeleteRange(const WriteOptions& opt,
+                       const Slice& begin, const Slice& end) {
+  WriteBatch batch;
+  batch.DeleteRange(begin, end);
+  return Write(opt, &batch);
+}
+
+Status DB::BulkDeleteForRange(const WriteOptions& opt,
+                              const Slice& begin, const Slice& end) {
+  return DeleteRange(opt, begin, end);
+}
+
+Status DB::IngestExternalFiles(const std::vector<std::string>& files) {
+  return Status::NotSupported("IngestExternalFiles");
+}
+
+std::vector<Status> DB::MultiGet(const ReadOptions& options,
+                                 const std::vector<Slice>& keys,
+                                 std::vector<std::string>* values) {
+  ReadOptions read_options = options;
+  const Snapshot* snapshot = NULL;
+  if (read_options.snapshot == NULL) {
+    snapshot = GetSnapshot();
+    read_options.snapshot = snapshot;
+  }
+  std::vector<Status> statuses(keys.size());
+  values->resize(keys.size());
+  for (size_t i = 0; i < keys.size(); i++) {
+    statuses[i] = Get(read_options, keys[i], &(*values)[i]);
+  }
+  if (snapshot != NULL) {
+    ReleaseSnapshot(snapshot);
+  }
+  return statuses;
+}
+
+Status DB::GetPinned(const ReadOptions& options, const Slice& key,
+                     PinnedValue* value) {
+  value->Reset();
+  Status s = Get(options, key, value->GetSelf());
+  if (s.ok()) {
+    value->PinSelf();
+  }
+  return s;
+}
+
 DB::~DB() { }
 
 Status DB::Open(const Options& options, const std::string& dbname,
@@ -1507,7 +2596,7 @@ Status DB::Open(const Options& options, const std::string& dbname,
       impl->logfile_ = lfile;
       impl->logfile_number_ = new_log_number;
       impl->log_ = new log::Writer(lfile);
-      impl->mem_ = new MemTable(impl->internal_comparator_);
+      impl->mem_ = impl->NewMemTable();
       impl->mem_->Ref();
     }
   }
@@ -1517,6 +2606,7 @@ Status DB::Open(const Options& options, const std::string& dbname,
     s = impl->versions_->LogAndApply(&edit, &impl->mutex_);
   }
   if (s.ok()) {
+    impl->InstallSuperVersion();
     impl->DeleteObsoleteFiles();
     impl->MaybeScheduleCompaction();
   }
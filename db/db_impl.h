@@ -17,8 +17,12 @@
 
 namespace leveldb {
 
+class Compaction;
+struct FileMetaData;
 class MemTable;
+class RangeDelMap;
 class TableCache;
+class ThreadLocalPtr;
 class Version;
 class VersionEdit;
 class VersionSet;
@@ -35,12 +39,21 @@ class DBImpl : public DB {
   virtual Status Get(const ReadOptions& options,
                      const Slice& key,
                      std::string* value);
+  virtual Status GetPinned(const ReadOptions& options,
+                           const Slice& key,
+                           PinnedValue* value);
+  virtual std::vector<Status> MultiGet(const ReadOptions& options,
+                                       const std::vector<Slice>& keys,
+                                       std::vector<std::string>* values);
   virtual Iterator* NewIterator(const ReadOptions&);
   virtual const Snapshot* GetSnapshot();
   virtual void ReleaseSnapshot(const Snapshot* snapshot);
   virtual bool GetProperty(const Slice& property, std::string* value);
   virtual void GetApproximateSizes(const Range* range, int n, uint64_t* sizes);
   virtual void CompactRange(const Slice* begin, const Slice* end);
+  virtual Status BulkDeleteForRange(const WriteOptions& options,
+                                    const Slice& begin, const Slice& end);
+  virtual Status IngestExternalFiles(const std::vector<std::string>& files);
 
   // Extra methods (for testing) that are not in the public DB interface
 
@@ -67,14 +80,44 @@ class DBImpl : public DB {
  private:
   friend class DB;
   struct CompactionState;
+  struct SubcompactionQueue;
+  struct SuperVersion;
   struct Writer;
+  struct InsertJob;
 
+  // If "range_dels" is non-NULL, the range tombstones of the sources of
+  // the iterator are added to it, and it is finished.
   Iterator* NewInternalIterator(const ReadOptions&,
                                 SequenceNumber* latest_snapshot,
-                                uint32_t* seed);
+                                uint32_t* seed,
+                                RangeDelMap* range_dels = NULL);
 
   Status NewDB();
 
+  // Check that "fname" holds a table written by SstFileWriter, and store
+  // its size and key range in *meta.
+  Status ReadExternalFile(const std::string& fname, FileMetaData* meta);
+
+  // Returns an unreferenced memtable configured by options_.
+  MemTable* NewMemTable() const;
+
+  // Return a referenced SuperVersion for the read path.  Normally served
+  // from the calling thread's cached reference without touching mutex_.
+  // The result must be passed to ReturnAndCleanupSuperVersion().
+  SuperVersion* GetAndRefSuperVersion();
+  void ReturnAndCleanupSuperVersion(SuperVersion* sv);
+
+  // Shared implementation of Get() and GetPinned().  Exactly one of
+  // "value" and "pinned" is non-NULL.
+  Status GetImpl(const ReadOptions& options, const Slice& key,
+                 std::string* value, PinnedValue* pinned);
+
+  // Publish a new SuperVersion for the current mem_, imm_ and version.
+  // Must be called after any of them changes.
+  void InstallSuperVersion() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void UnrefSuperVersion(SuperVersion* sv) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  static void UnrefSuperVersionHandler(void* ptr);
+
   // Recover the descriptor from persistent storage.  May do a significant
   // amount of work to recover recently logged updates.  Any changes to
   // be made to the descriptor are added to *edit.
@@ -91,11 +134,23 @@ class DBImpl : public DB {
   // Errors are recorded in bg_error_.
   void CompactMemTable() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+  // Apply *edit to the current version and save it in the manifest.
+  // Waits for other threads applying edits, since the background
+  // threads may finish flushes and compactions concurrently.
+  Status LogAndApply(VersionEdit* edit) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
   Status RecoverLogFile(uint64_t log_number, bool last_log, bool* save_manifest,
                         VersionEdit* edit, SequenceNumber* max_sequence)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
-  Status WriteLevel0Table(MemTable* mem, VersionEdit* edit, Version* base)
+  // Write the contents of mem into a new table and add it to *edit.  If
+  // pick_level is true the table may be placed in a level above 0; the
+  // caller must then apply *edit with LogAndApply() and reset
+  // flush_install_pending_.  Otherwise the table goes to level 0.  The
+  // table is kept in pending_outputs_ under *number until the caller has
+  // installed *edit and erases it.
+  Status WriteLevel0Table(MemTable* mem, VersionEdit* edit, bool pick_level,
+                          uint64_t* number)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   Status MakeRoomForWrite(bool force /* compact even if there is room? */)
@@ -105,23 +160,36 @@ class DBImpl : public DB {
   void RecordBackgroundError(const Status& s);
 
   void MaybeScheduleCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
-  static void BGWork(void* db);
-  void BackgroundCall();
-  void  BackgroundCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  static void BGWorkFlush(void* db);
+  static void BGWorkCompaction(void* arg);
+  void BackgroundFlushCall();
+  void BackgroundCompactionCall(Compaction* c);
+  // Runs compaction c, or the pending manual compaction if c is NULL.
+  void BackgroundCompaction(Compaction* c) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   void CleanupCompaction(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   Status DoCompactionWork(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Compacts the parts of *queue that no other worker claimed first.  Run
+  // by a compaction and by the pool tasks that help with its parts.
+  static void BGWorkSubcompaction(void* arg);
+  static void RunSubcompactions(SubcompactionQueue* queue);
+  // Compacts the part of the input that falls into compact's key range.
+  // Runs without mutex_ held, concurrently with the other parts.
+  Status DoSubcompactionWork(CompactionState* compact);
 
   Status OpenCompactionOutputFile(CompactionState* compact);
-  Status FinishCompactionOutputFile(CompactionState* compact, Iterator* input);
+  // "upper" is the user key the next output of the part starts at, or
+  // NULL if this is its last output.
+  Status FinishCompactionOutputFile(CompactionState* compact, Iterator* input,
+                                    const Slice* upper);
   Status InstallCompactionResults(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   // Constant after construction
   Env* const env_;
   const InternalKeyComparator internal_comparator_;
-  const InternalFilterPolicy internal_filter_policy_;
+  const InternalFilterPolicies internal_filter_policies_;
   const Options options_;  // options_.comparator == &internal_comparator_
   bool owns_info_log_;
   bool owns_cache_;
@@ -130,6 +198,11 @@ class DBImpl : public DB {
   // table_cache_ provides its own synchronization
   TableCache* table_cache_;
 
+  // Per-thread cached reference to a SuperVersion; provides its own
+  // synchronization.  Cleared by InstallSuperVersion() so that readers
+  // notice that their cached reference is stale.
+  ThreadLocalPtr* local_sv_;
+
   // Lock over the persistent DB state.  Non-NULL iff successfully acquired.
   FileLock* db_lock_;
 
@@ -139,11 +212,12 @@ class DBImpl : public DB {
   port::CondVar bg_cv_;          // Signalled when background work finishes
   MemTable* mem_;
   MemTable* imm_;                // Memtable being compacted
-  port::AtomicPointer has_imm_;  // So bg thread can detect non-NULL imm_
+  port::AtomicPointer has_imm_;  // So compactions can detect non-null imm_
   WritableFile* logfile_;
   uint64_t logfile_number_;
   log::Writer* log_;
   uint32_t seed_;                // For sampling.
+  SuperVersion* super_version_;  // Current (mem_, imm_, version) triple
 
   // Queue of writers.
   std::deque<Writer*> writers_;
@@ -155,8 +229,28 @@ class DBImpl : public DB {
   // part of ongoing compactions.
   std::set<uint64_t> pending_outputs_;
 
-  // Has a background compaction been scheduled or is running?
-  bool bg_compaction_scheduled_;
+  // Has a flush of imm_ been scheduled or is it running?
+  bool bg_flush_scheduled_;
+
+  // Is CompactMemTable() running?
+  bool flush_running_;
+
+  // If env_ has no priority pools, the scheduled flush of imm_ may wait
+  // behind a compaction, so compactions flush imm_ themselves.
+  const bool inline_flushes_;
+
+  // Number of background compactions scheduled or running.  Each one
+  // has been registered with versions_ when it was scheduled, except
+  // for manual compactions.
+  int bg_compaction_scheduled_;
+
+  // Is a thread inside LogAndApply()?
+  bool manifest_busy_;
+
+  // Has a flush picked a level above 0 for its table without having
+  // installed it yet?  No compactions are picked meanwhile, since they
+  // would not know about the table.
+  bool flush_install_pending_;
 
   // Information for a manual compaction
   struct ManualCompaction {
@@ -203,9 +297,13 @@ class DBImpl : public DB {
 // it is not equal to src.info_log.
 extern Options SanitizeOptions(const std::string& db,
                                const InternalKeyComparator* icmp,
-                               const InternalFilterPolicy* ipolicy,
+                               const InternalFilterPolicies* ipolicies,
                                const Options& src);
 
+// Return a copy of "options" whose "compression" and "filter_policy" are
+// the ones configured for tables written to "level".
+extern Options OptionsForLevel(const Options& options, int level);
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_DB_DB_IMPL_H_
@@ -7,6 +7,7 @@
 #include "db/filename.h"
 #include "db/db_impl.h"
 #include "db/dbformat.h"
+#include "db/range_del.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
 #include "port/port.h"
@@ -49,18 +50,23 @@ class DBIter: public Iterator {
   };
 
   DBIter(DBImpl* db, const Comparator* cmp, Iterator* iter, SequenceNumber s,
-         uint32_t seed)
+         uint32_t seed, const SliceTransform* prefix_extractor,
+         RangeDelMap* range_dels)
       : db_(db),
         user_comparator_(cmp),
         iter_(iter),
         sequence_(s),
+        prefix_extractor_(prefix_extractor),
+        range_dels_(range_dels),
         direction_(kForward),
         valid_(false),
+        has_prefix_(false),
         rnd_(seed),
         bytes_counter_(RandomPeriod()) {
   }
   virtual ~DBIter() {
     delete iter_;
+    delete range_dels_;
   }
   virtual bool Valid() const { return valid_; }
   virtual Slice key() const {
@@ -90,6 +96,27 @@ class DBIter: public Iterator {
   void FindPrevUserEntry();
   bool ParseKey(ParsedInternalKey* key);
 
+  // Returns the type of "ikey", seen as a deletion if a range tombstone
+  // deletes it
+  ValueType EntryType(const ParsedInternalKey& ikey) const {
+    if (ikey.type == kTypeValue && range_dels_ != NULL &&
+        range_dels_->MaxCoveringSeq(ikey.user_key, sequence_) > ikey.sequence) {
+      return kTypeDeletion;
+    }
+    return ikey.type;
+  }
+
+  // Invalidates the iterator if its key is outside of prefix_
+  void CheckPrefix() {
+    if (valid_ && has_prefix_) {
+      Slice k = key();
+      if (!prefix_extractor_->InDomain(k) ||
+          prefix_extractor_->Transform(k) != Slice(prefix_)) {
+        valid_ = false;
+      }
+    }
+  }
+
   inline void SaveKey(const Slice& k, std::string* dst) {
     dst->assign(k.data(), k.size());
   }
@@ -112,12 +139,16 @@ class DBIter: public Iterator {
   const Comparator* const user_comparator_;
   Iterator* const iter_;
   SequenceNumber const sequence_;
+  const SliceTransform* const prefix_extractor_;
+  const RangeDelMap* const range_dels_;
 
   Status status_;
   std::string saved_key_;     // == current key when direction_==kReverse
   std::string saved_value_;   // == current raw value when direction_==kReverse
   Direction direction_;
   bool valid_;
+  bool has_prefix_;           // Whether keys are confined to prefix_
+  std::string prefix_;
 
   Random rnd_;
   ssize_t bytes_counter_;
@@ -168,6 +199,7 @@ void DBIter::Next() {
   }
 
   FindNextUserEntry(true, &saved_key_);
+  CheckPrefix();
 }
 
 void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
@@ -177,8 +209,9 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
   do {
     ParsedInternalKey ikey;
     if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
-      switch (ikey.type) {
+      switch (EntryType(ikey)) {
         case kTypeDeletion:
+        case kTypeRangeDeletion:
           // Arrange to skip all upcoming entries for this key since
           // they are hidden by this deletion.
           SaveKey(ikey.user_key, skip);
@@ -205,6 +238,14 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
 void DBIter::Prev() {
   assert(valid_);
 
+  if (has_prefix_) {
+    // Tables ruled out by their filters are left invalid after the
+    // Seek(), which would be misread when switching directions
+    valid_ = false;
+    status_ = Status::NotSupported("Prev() with prefix_same_as_start");
+    return;
+  }
+
   if (direction_ == kForward) {  // Switch directions?
     // iter_ is pointing at the current entry.  Scan backwards until
     // the key changes so we can use the normal reverse scanning code.
@@ -227,6 +268,7 @@ void DBIter::Prev() {
   }
 
   FindPrevUserEntry();
+  CheckPrefix();
 }
 
 void DBIter::FindPrevUserEntry() {
@@ -242,7 +284,7 @@ void DBIter::FindPrevUserEntry() {
           // We encountered a non-deleted value in entries for previous keys,
           break;
         }
-        value_type = ikey.type;
+        value_type = EntryType(ikey);
         if (value_type == kTypeDeletion) {
           saved_key_.clear();
           ClearSavedValue();
@@ -274,12 +316,19 @@ void DBIter::FindPrevUserEntry() {
 void DBIter::Seek(const Slice& target) {
   direction_ = kForward;
   ClearSavedValue();
+  has_prefix_ = (prefix_extractor_ != NULL &&
+                 prefix_extractor_->InDomain(target));
+  if (has_prefix_) {
+    Slice prefix = prefix_extractor_->Transform(target);
+    prefix_.assign(prefix.data(), prefix.size());
+  }
   saved_key_.clear();
   AppendInternalKey(
       &saved_key_, ParsedInternalKey(target, sequence_, kValueTypeForSeek));
   iter_->Seek(saved_key_);
   if (iter_->Valid()) {
     FindNextUserEntry(false, &saved_key_ /* temporary storage */);
+    CheckPrefix();
   } else {
     valid_ = false;
   }
@@ -287,6 +336,7 @@ void DBIter::Seek(const Slice& target) {
 
 void DBIter::SeekToFirst() {
   direction_ = kForward;
+  has_prefix_ = false;
   ClearSavedValue();
   iter_->SeekToFirst();
   if (iter_->Valid()) {
@@ -298,6 +348,7 @@ void DBIter::SeekToFirst() {
 
 void DBIter::SeekToLast() {
   direction_ = kReverse;
+  has_prefix_ = false;
   ClearSavedValue();
   iter_->SeekToLast();
   FindPrevUserEntry();
@@ -310,8 +361,11 @@ Iterator* NewDBIterator(
     const Comparator* user_key_comparator,
     Iterator* internal_iter,
     SequenceNumber sequence,
-    uint32_t seed) {
-  return new DBIter(db, user_key_comparator, internal_iter, sequence, seed);
+    uint32_t seed,
+    const SliceTransform* prefix_extractor,
+    RangeDelMap* range_dels) {
+  return new DBIter(db, user_key_comparator, internal_iter, sequence, seed,
+                    prefix_extractor, range_dels);
 }
 
 }  // namespace leveldb
@@ -12,16 +12,22 @@
 namespace leveldb {
 
 class DBImpl;
+class RangeDelMap;
 
 // Return a new iterator that converts internal keys (yielded by
 // "*internal_iter") that were live at the specified "sequence" number
-// into appropriate user keys.
+// into appropriate user keys.  If "prefix_extractor" is non-NULL, the
+// iterator stops at the end of the prefix of each Seek() target.  If
+// "range_dels" is non-NULL, the entries its tombstones delete are
+// skipped; the iterator takes ownership of it.
 extern Iterator* NewDBIterator(
     DBImpl* db,
     const Comparator* user_key_comparator,
     Iterator* internal_iter,
     SequenceNumber sequence,
-    uint32_t seed);
+    uint32_t seed,
+    const SliceTransform* prefix_extractor = NULL,
+    RangeDelMap* range_dels = NULL);
 
 }  // namespace leveldb
 
@@ -3,6 +3,9 @@
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
 #include "leveldb/db.h"
+
+#include <algorithm>
+#include <map>
 #include "leveldb/filter_policy.h"
 #include "db/db_impl.h"
 #include "db/filename.h"
@@ -10,7 +13,10 @@
 #include "db/write_batch_internal.h"
 #include "leveldb/cache.h"
 #include "leveldb/env.h"
+#include "leveldb/slice_transform.h"
+#include "leveldb/sst_file_writer.h"
 #include "leveldb/table.h"
+#include "leveldb/table_builder.h"
 #include "util/hash.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
@@ -78,12 +84,24 @@ class SpecialEnv : public EnvWrapper {
   bool count_random_reads_;
   AtomicCounter random_read_counter_;
 
+  // Random reads of the files opened while this pointer is non-NULL take
+  // 10ms longer while it still is.
+  port::AtomicPointer slow_random_reads_;
+
+  // Schedule() ignores priorities, like the default Env implementation.
+  bool single_pool_;
+
+  // Number of threads started through StartThread()
+  AtomicCounter started_threads_;
+
   explicit SpecialEnv(Env* base) : EnvWrapper(base) {
     delay_data_sync_.Release_Store(NULL);
     data_sync_error_.Release_Store(NULL);
     no_space_.Release_Store(NULL);
     non_writable_.Release_Store(NULL);
     count_random_reads_ = false;
+    slow_random_reads_.Release_Store(NULL);
+    single_pool_ = false;
     manifest_sync_error_.Release_Store(NULL);
     manifest_write_error_.Release_Store(NULL);
   }
@@ -178,17 +196,62 @@ class SpecialEnv : public EnvWrapper {
       }
     };
 
+    class SlowFile : public RandomAccessFile {
+     private:
+      RandomAccessFile* target_;
+      SpecialEnv* env_;
+     public:
+      SlowFile(RandomAccessFile* target, SpecialEnv* env)
+          : target_(target), env_(env) {
+      }
+      virtual ~SlowFile() { delete target_; }
+      virtual Status Read(uint64_t offset, size_t n, Slice* result,
+                          char* scratch) const {
+        if (env_->slow_random_reads_.Acquire_Load() != NULL) {
+          DelayMilliseconds(10);
+        }
+        return target_->Read(offset, n, result, scratch);
+      }
+    };
+
     Status s = target()->NewRandomAccessFile(f, r);
     if (s.ok() && count_random_reads_) {
       *r = new CountingFile(*r, &random_read_counter_);
     }
+    if (s.ok() && slow_random_reads_.Acquire_Load() != NULL) {
+      *r = new SlowFile(*r, this);
+    }
     return s;
   }
+
+  void Schedule(void (*function)(void*), void* arg) {
+    target()->Schedule(function, arg);
+  }
+
+  void Schedule(void (*function)(void*), void* arg, Priority pri) {
+    if (single_pool_) {
+      target()->Schedule(function, arg);
+    } else {
+      target()->Schedule(function, arg, pri);
+    }
+  }
+
+  bool HasPriorityPools() {
+    return !single_pool_ && target()->HasPriorityPools();
+  }
+
+  void StartThread(void (*function)(void* arg), void* arg) {
+    started_threads_.Increment();
+    target()->StartThread(function, arg);
+  }
 };
 
 class DBTest {
  private:
   const FilterPolicy* filter_policy_;
+  const FilterPolicy* blocked_filter_policy_;
+  const FilterPolicy* ribbon_filter_policy_;
+  const SliceTransform* prefix_extractor_;
 
   // Sequence of option configurations to try
   enum OptionConfig {
@@ -196,6 +259,20 @@ class DBTest {
     kReuse,
     kFilter,
     kUncompressed,
+    kPartitionedMemTable,
+    kConcurrentMemTable,
+    kParallelCompactions,
+    kSubcompactions,
+    kZstdDictionary,
+    kBlockHashIndex,
+    kPartitionedIndex,
+    kBlockedBloomFilter,
+    kWholeFileFilter,
+    kPrefixFilter,
+    kFilterPerLevel,
+    kMemTableBloom,
+    kHashMemTableRep,
+    kDirectIO,
     kEnd
   };
   int option_config_;
@@ -210,6 +287,9 @@ class DBTest {
   DBTest() : option_config_(kDefault),
              env_(new SpecialEnv(Env::Default())) {
     filter_policy_ = NewBloomFilterPolicy(10);
+    blocked_filter_policy_ = NewBlockedBloomFilterPolicy(10);
+    ribbon_filter_policy_ = NewRibbonFilterPolicy(10);
+    prefix_extractor_ = NewFixedPrefixTransform(3);
     dbname_ = test::TmpDir() + "/db_test";
     DestroyDB(dbname_, Options());
     db_ = NULL;
@@ -221,6 +301,9 @@ class DBTest {
     DestroyDB(dbname_, Options());
     delete env_;
     delete filter_policy_;
+    delete blocked_filter_policy_;
+    delete ribbon_filter_policy_;
+    delete prefix_extractor_;
   }
 
   // Switch to a fresh database with the next option configuration to
@@ -249,6 +332,61 @@ class DBTest {
       case kUncompressed:
         options.compression = kNoCompression;
         break;
+      case kPartitionedMemTable:
+        options.memtable_partitions = 4;
+        break;
+      case kConcurrentMemTable:
+        options.allow_concurrent_memtable_write = true;
+        break;
+      case kParallelCompactions:
+        options.max_background_compactions = 4;
+        break;
+      case kSubcompactions:
+        options.max_subcompactions = 4;
+        break;
+      case kZstdDictionary:
+        options.filter_policy = filter_policy_;
+        options.compression = kZstdCompression;
+        options.zstd_max_dict_bytes = 4096;
+        options.zstd_max_train_bytes = 64 << 10;
+        break;
+      case kBlockHashIndex:
+        options.data_block_hash_index = true;
+        break;
+      case kPartitionedIndex:
+        options.filter_policy = filter_policy_;
+        options.partition_index_and_filters = true;
+        options.index_partition_size = 256;
+        break;
+      case kBlockedBloomFilter:
+        options.filter_policy = blocked_filter_policy_;
+        break;
+      case kWholeFileFilter:
+        options.filter_policy = filter_policy_;
+        options.whole_file_filter = true;
+        break;
+      case kPrefixFilter:
+        options.filter_policy = filter_policy_;
+        options.prefix_extractor = prefix_extractor_;
+        break;
+      case kFilterPerLevel:
+        options.filter_policy_per_level.push_back(filter_policy_);
+        options.filter_policy_per_level.push_back(ribbon_filter_policy_);
+        options.whole_file_filter = true;
+        break;
+      case kMemTableBloom:
+        options.memtable_bloom_size_ratio = 0.02;
+        options.memtable_partitions = 2;
+        break;
+      case kHashMemTableRep:
+        options.memtable_rep = kHashMemTable;
+        options.memtable_hash_buckets = 1000;
+        options.allow_concurrent_memtable_write = true;
+        break;
+      case kDirectIO:
+        options.use_direct_io_for_flush_and_compaction = true;
+        options.use_direct_reads = true;
+        break;
       default:
         break;
     }
@@ -311,6 +449,31 @@ class DBTest {
     return result;
   }
 
+  // Return the results of a MultiGet() of "keys", separated by commas,
+  // in the format used by Get().
+  std::string MultiGet(const std::vector<std::string>& keys,
+                       const Snapshot* snapshot = NULL) {
+    ReadOptions options;
+    options.snapshot = snapshot;
+    std::vector<Slice> key_slices(keys.begin(), keys.end());
+    std::vector<std::string> values;
+    std::vector<Status> statuses = db_->MultiGet(options, key_slices, &values);
+    ASSERT_EQ(keys.size(), statuses.size());
+    ASSERT_EQ(keys.size(), values.size());
+    std::string result;
+    for (size_t i = 0; i < statuses.size(); i++) {
+      if (i > 0) result += ",";
+      if (statuses[i].IsNotFound()) {
+        result += "NOT_FOUND";
+      } else if (!statuses[i].ok()) {
+        result += statuses[i].ToString();
+      } else {
+        result += values[i];
+      }
+    }
+    return result;
+  }
+
   // Return a string that contains all key,value pairs in order,
   // formatted like "(k1->v1)(k2->v2)".
   std::string Contents() {
@@ -367,6 +530,9 @@ class DBTest {
             case kTypeDeletion:
               result += "DEL";
               break;
+            case kTypeRangeDeletion:
+              result += "RANGEDEL";
+              break;
           }
         }
         iter->Next();
@@ -634,6 +800,199 @@ TEST(DBTest, GetPicksCorrectFile) {
   } while (ChangeOptions());
 }
 
+TEST(DBTest, MultiGet) {
+  do {
+    std::vector<std::string> keys;
+    keys.push_back("x");
+    keys.push_back("a");
+    keys.push_back("missing");
+    keys.push_back("f");
+    keys.push_back("a");
+    keys.push_back("deleted");
+    keys.push_back("mem");
+    ASSERT_EQ("NOT_FOUND,NOT_FOUND,NOT_FOUND,NOT_FOUND,NOT_FOUND,NOT_FOUND,"
+              "NOT_FOUND", MultiGet(keys));
+
+    // Spread the keys over several files and levels and the memtable.
+    ASSERT_OK(Put("a", "va"));
+    ASSERT_OK(Put("deleted", "vd"));
+    Compact("a", "b");
+    ASSERT_OK(Put("x", "vx"));
+    Compact("x", "y");
+    ASSERT_OK(Put("f", "vf"));
+    ASSERT_OK(Delete("deleted"));
+    ASSERT_OK(dbfull()->TEST_CompactMemTable());
+    ASSERT_OK(Put("mem", "vm"));
+    ASSERT_EQ("vx,va,NOT_FOUND,vf,va,NOT_FOUND,vm", MultiGet(keys));
+
+    const Snapshot* snapshot = db_->GetSnapshot();
+    ASSERT_OK(Put("a", "va2"));
+    ASSERT_OK(Put("missing", "vmissing"));
+    ASSERT_OK(Delete("x"));
+    ASSERT_EQ("NOT_FOUND,va2,vmissing,vf,va2,NOT_FOUND,vm", MultiGet(keys));
+    ASSERT_EQ("vx,va,NOT_FOUND,vf,va,NOT_FOUND,vm", MultiGet(keys, snapshot));
+    db_->ReleaseSnapshot(snapshot);
+  } while (ChangeOptions());
+}
+
+TEST(DBTest, MultiGetSharesBlocks) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.block_size = 1024;
+  Reopen(&options);
+  Random rnd(301);
+  std::vector<std::string> keys;
+  std::vector<std::string> expected;
+  char buf[100];
+  for (int i = 0; i < 1000; i++) {
+    snprintf(buf, sizeof(buf), "key%06d", i);
+    std::string value = RandomString(&rnd, 100);
+    ASSERT_OK(Put(buf, value));
+    if (i % 3 == 0) {
+      keys.push_back(buf);
+      expected.push_back(value);
+    }
+  }
+  dbfull()->TEST_CompactMemTable();
+  dbfull()->TEST_CompactRange(0, NULL, NULL);
+  keys.push_back("key999999");   // Past the end of the last file
+  expected.push_back("NOT_FOUND");
+
+  std::string want;
+  for (size_t i = 0; i < expected.size(); i++) {
+    if (i > 0) want += ",";
+    want += expected[i];
+  }
+  env_->random_read_counter_.Reset();
+  ASSERT_EQ(want, MultiGet(keys));
+  const int multiget_reads = env_->random_read_counter_.Read();
+
+  // About three of the keys share each block, which Get() reads for each
+  // of them and MultiGet() reads once
+  env_->random_read_counter_.Reset();
+  for (size_t i = 0; i < keys.size(); i++) {
+    ASSERT_EQ(expected[i], Get(keys[i]));
+  }
+  const int get_reads = env_->random_read_counter_.Read();
+  fprintf(stderr, "%d keys => %d reads, %d with Get()\n",
+          static_cast<int>(keys.size()), multiget_reads, get_reads);
+  ASSERT_LE(multiget_reads, get_reads / 2);
+
+  std::reverse(keys.begin(), keys.end());
+  std::reverse(expected.begin(), expected.end());
+  want.clear();
+  for (size_t i = 0; i < expected.size(); i++) {
+    if (i > 0) want += ",";
+    want += expected[i];
+  }
+  env_->random_read_counter_.Reset();
+  ASSERT_EQ(want, MultiGet(keys));
+  ASSERT_EQ(multiget_reads, env_->random_read_counter_.Read());
+
+  Close();
+  delete options.block_cache;
+}
+
+TEST(DBTest, MultiGetHashIndex) {
+  Options options = CurrentOptions();
+  options.data_block_hash_index = true;
+  options.block_size = 1024;
+  Reopen(&options);
+
+  // Two versions of every fourth key, both kept for a snapshot, in
+  // blocks whose hash indexes lack the odd keys
+  char buf[100];
+  for (int i = 0; i < 1000; i += 2) {
+    snprintf(buf, sizeof(buf), "key%06d", i);
+    ASSERT_OK(Put(buf, std::string("v1") + buf));
+  }
+  const Snapshot* snapshot = db_->GetSnapshot();
+  for (int i = 0; i < 1000; i += 4) {
+    snprintf(buf, sizeof(buf), "key%06d", i);
+    ASSERT_OK(Put(buf, std::string("v2") + buf));
+  }
+  dbfull()->TEST_CompactMemTable();
+  dbfull()->TEST_CompactRange(0, NULL, NULL);
+
+  std::vector<std::string> keys;
+  for (int i = 0; i < 1000; i++) {
+    snprintf(buf, sizeof(buf), "key%06d", i);
+    keys.push_back(buf);
+  }
+  for (int pass = 0; pass < 2; pass++) {
+    const Snapshot* s = (pass == 0) ? NULL : snapshot;
+    std::string want;
+    for (size_t i = 0; i < keys.size(); i++) {
+      if (i > 0) want += ",";
+      want += Get(keys[i], s);
+    }
+    ASSERT_EQ(want, MultiGet(keys, s));
+  }
+  db_->ReleaseSnapshot(snapshot);
+}
+
+TEST(DBTest, GetPinned) {
+  do {
+    PinnedValue value;
+    ASSERT_TRUE(db_->GetPinned(ReadOptions(), "foo", &value).IsNotFound());
+    ASSERT_EQ(0, value.size());
+
+    // From the memtable, which stays alive while it is pinned
+    ASSERT_OK(Put("foo", "v1"));
+    ASSERT_OK(db_->GetPinned(ReadOptions(), "foo", &value));
+    ASSERT_EQ("v1", value.value().ToString());
+    ASSERT_TRUE(value.pinned());
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_OK(Put("foo", "v2"));
+    ASSERT_EQ("v1", value.value().ToString());
+
+    // From a table, which stays alive while it is pinned
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_OK(db_->GetPinned(ReadOptions(), "foo", &value));
+    ASSERT_EQ("v2", value.value().ToString());
+    ASSERT_TRUE(value.pinned());
+    ASSERT_OK(Put("foo", "v3"));
+    dbfull()->TEST_CompactMemTable();
+    dbfull()->TEST_CompactRange(0, NULL, NULL);
+    ASSERT_EQ("v2", value.value().ToString());
+
+    ASSERT_OK(Delete("foo"));
+    ASSERT_TRUE(db_->GetPinned(ReadOptions(), "foo", &value).IsNotFound());
+    ASSERT_EQ(0, value.size());
+    ASSERT_TRUE(!value.pinned());
+  } while (ChangeOptions());
+}
+
+TEST(DBTest, GetPinnedMatchesGet) {
+  Options options = CurrentOptions();
+  options.block_size = 1024;
+  Reopen(&options);
+  Random rnd(301);
+  char buf[100];
+  for (int i = 0; i < 1000; i++) {
+    snprintf(buf, sizeof(buf), "key%06d", i);
+    ASSERT_OK(Put(buf, RandomString(&rnd, 100 + i % 500)));
+    if (i % 300 == 299) {
+      dbfull()->TEST_CompactMemTable();
+    }
+  }
+  // Keep many values pinned at once, from different blocks and files
+  std::vector<PinnedValue*> values;
+  for (int i = 0; i < 1000; i += 7) {
+    snprintf(buf, sizeof(buf), "key%06d", i);
+    values.push_back(new PinnedValue);
+    ASSERT_OK(db_->GetPinned(ReadOptions(), buf, values.back()));
+  }
+  dbfull()->TEST_CompactRange(0, NULL, NULL);
+  for (size_t j = 0; j < values.size(); j++) {
+    snprintf(buf, sizeof(buf), "key%06d", static_cast<int>(j * 7));
+    ASSERT_EQ(Get(buf), values[j]->value().ToString());
+    delete values[j];
+  }
+}
+
 TEST(DBTest, GetEncountersEmptyLevel) {
   do {
     // Arrange for the following to happen:
@@ -1002,6 +1361,128 @@ TEST(DBTest, CompactionsGenerateMultipleFiles) {
   }
 }
 
+TEST(DBTest, ParallelCompactions) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000;  // Small write buffer
+  options.max_background_compactions = 4;
+  Reopen(&options);
+
+  // Overwrite a key space large enough to keep several levels busy at once.
+  Random rnd(301);
+  std::vector<std::string> values(2000);
+  for (int i = 0; i < 20000; i++) {
+    const int k = rnd.Uniform(values.size());
+    values[k] = RandomString(&rnd, 500);
+    ASSERT_OK(Put(Key(k), values[k]));
+  }
+
+  for (int pass = 0; pass < 2; pass++) {
+    for (size_t k = 0; k < values.size(); k++) {
+      ASSERT_EQ(values[k].empty() ? "NOT_FOUND" : values[k], Get(Key(k)));
+    }
+    Reopen(&options);
+  }
+}
+
+namespace {
+struct CompactRangeThread {
+  DBImpl* db;
+  port::AtomicPointer done;
+};
+
+static void CompactLevel1(void* arg) {
+  CompactRangeThread* t = reinterpret_cast<CompactRangeThread*>(arg);
+  t->db->TEST_CompactRange(1, NULL, NULL);
+  t->done.Release_Store(t);
+}
+}  // namespace
+
+TEST(DBTest, FlushDuringCompactionWithoutPriorityPools) {
+  // The flush scheduled while the compaction runs is queued behind it
+  env_->single_pool_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  Reopen(&options);
+
+  // A level-1 file overlapping a level-2 file of 2MB
+  Random rnd(301);
+  for (int i = 0; i < 2000; i++) {
+    ASSERT_OK(Put(Key(i), RandomString(&rnd, 1000)));
+  }
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_OK(Put(Key(0), "v0"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("0,1,1", FilesPerLevel());
+
+  // Make the compaction of the two read slowly, and fill three write
+  // buffers meanwhile, which waits for the earlier ones to be flushed
+  env_->slow_random_reads_.Release_Store(env_);
+  options.write_buffer_size = 100000;  // Small write buffer
+  Reopen(&options);
+  CompactRangeThread thread;
+  thread.db = dbfull();
+  thread.done.Release_Store(NULL);
+  env_->StartThread(&CompactLevel1, &thread);
+  DelayMilliseconds(200);
+  const uint64_t start = env_->NowMicros();
+  for (int i = 0; i < 300; i++) {
+    ASSERT_OK(Put(Key(i), std::string(1000, 'x')));
+  }
+  // The compaction reads 2MB in blocks of 4KB, taking at least 5 seconds
+  const uint64_t elapsed = env_->NowMicros() - start;
+  fprintf(stderr, "writes took %d ms\n", static_cast<int>(elapsed / 1000));
+  ASSERT_LT(elapsed, 2500000);
+
+  env_->slow_random_reads_.Release_Store(NULL);
+  while (thread.done.Acquire_Load() == NULL) {
+    DelayMilliseconds(10);
+  }
+  ASSERT_EQ(std::string(1000, 'x'), Get(Key(0)));
+  ASSERT_EQ(std::string(1000, 'x'), Get(Key(299)));
+  Close();
+  env_->single_pool_ = false;
+}
+
+TEST(DBTest, Subcompactions) {
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.write_buffer_size = 100000000;        // Large write buffer
+  options.max_subcompactions = 4;
+  Reopen(&options);
+
+  // Build several level-0 files that each span the key space, with
+  // overwrites and deletions of the keys in the earlier files.
+  Random rnd(301);
+  std::vector<std::string> values(400);
+  for (int file = 0; file < 4; file++) {
+    for (size_t k = file; k < values.size(); k += 2) {
+      if (file > 0 && rnd.OneIn(4)) {
+        values[k].clear();
+        ASSERT_OK(Delete(Key(k)));
+      } else {
+        values[k] = RandomString(&rnd, 20000);
+        ASSERT_OK(Put(Key(k), values[k]));
+      }
+    }
+    dbfull()->TEST_CompactMemTable();
+  }
+  ASSERT_GT(NumTableFilesAtLevel(0), 1);
+
+  dbfull()->TEST_CompactRange(0, NULL, NULL);
+  ASSERT_EQ(NumTableFilesAtLevel(0), 0);
+  ASSERT_GT(NumTableFilesAtLevel(1), 1);
+  // The parts ran on the background pool, not on threads of their own
+  ASSERT_EQ(0, env_->started_threads_.Read());
+  for (size_t k = 0; k < values.size(); k++) {
+    ASSERT_EQ(values[k].empty() ? "NOT_FOUND" : values[k], Get(Key(k)));
+  }
+
+  Reopen(&options);
+  for (size_t k = 0; k < values.size(); k++) {
+    ASSERT_EQ(values[k].empty() ? "NOT_FOUND" : values[k], Get(Key(k)));
+  }
+}
+
 TEST(DBTest, RepeatedWritesToSameKey) {
   Options options = CurrentOptions();
   options.env = env_;
@@ -1173,6 +1654,62 @@ TEST(DBTest, ApproximateSizes_MixOfSmallAndLarge) {
   } while (ChangeOptions());
 }
 
+TEST(DBTest, CompressionPerLevel) {
+  std::string out;
+  if (!port::Zstd_Compress("aaaaaaaaaaaaaaaa", 16, &out)) {
+    fprintf(stderr, "skipping zstd compression tests\n");
+    return;
+  }
+
+  // Flushes use the entry for level 0, compactions that of their output
+  // level, so exactly one of the flushed and the compacted tables is
+  // compressed.
+  const int N = 100;
+  const uint64_t raw = N * 10000;
+  for (int compress_flushes = 0; compress_flushes < 2; compress_flushes++) {
+    Options options = CurrentOptions();
+    options.create_if_missing = true;
+    options.compression_per_level.push_back(kNoCompression);
+    options.compression_per_level.push_back(kZstdCompression);
+    if (compress_flushes) {
+      std::swap(options.compression_per_level[0],
+                options.compression_per_level[1]);
+    }
+    DestroyAndReopen(&options);
+
+    Random rnd(301);
+    std::string tmp;
+    std::vector<std::string> values;
+    for (int i = 0; i < N; i++) {
+      values.push_back(
+          test::CompressibleString(&rnd, 0.25, 10000, &tmp).ToString());
+      ASSERT_OK(Put(Key(i), values[i]));
+    }
+    ASSERT_OK(dbfull()->TEST_CompactMemTable());
+    const uint64_t flushed = Size("", Key(N));
+
+    // Write the keys again, so that compacting them is no trivial move
+    for (int i = 0; i < N; i++) {
+      ASSERT_OK(Put(Key(i), values[i]));
+    }
+    ASSERT_OK(dbfull()->TEST_CompactMemTable());
+    db_->CompactRange(NULL, NULL);
+    ASSERT_EQ(0, NumTableFilesAtLevel(0));
+    const uint64_t compacted = Size("", Key(N));
+
+    if (compress_flushes) {
+      ASSERT_LT(flushed, raw / 2);
+      ASSERT_GT(compacted, raw);
+    } else {
+      ASSERT_GT(flushed, raw);
+      ASSERT_LT(compacted, raw / 2);
+    }
+    for (int i = 0; i < N; i++) {
+      ASSERT_EQ(values[i], Get(Key(i)));
+    }
+  }
+}
+
 TEST(DBTest, IteratorPinsRef) {
   Put("foo", "hello");
 
@@ -1240,7 +1777,10 @@ TEST(DBTest, HiddenValuesAreRemoved) {
     ASSERT_GT(NumTableFilesAtLevel(0), 0);
 
     ASSERT_EQ(big, Get("foo", snapshot));
-    ASSERT_TRUE(Between(Size("", "pastfoo"), 50000, 60000));
+    if (CurrentOptions().compression != kZstdCompression) {
+      // Unlike snappy, zstd entropy-codes the printable random string
+      ASSERT_TRUE(Between(Size("", "pastfoo"), 50000, 60000));
+    }
     db_->ReleaseSnapshot(snapshot);
     ASSERT_EQ(AllEntriesFor("foo"), "[ tiny, " + big + " ]");
     Slice x("x");
@@ -1310,6 +1850,358 @@ TEST(DBTest, DeletionMarkers2) {
   ASSERT_EQ(AllEntriesFor("foo"), "[ ]");
 }
 
+TEST(DBTest, DeleteRange) {
+  do {
+    ASSERT_OK(Put("a", "va"));
+    ASSERT_OK(Put("b", "vb"));
+    ASSERT_OK(Put("c", "vc"));
+    ASSERT_OK(Put("d", "vd"));
+    ASSERT_OK(db_->DeleteRange(WriteOptions(), "b", "d"));
+    ASSERT_EQ("va", Get("a"));
+    ASSERT_EQ("NOT_FOUND", Get("b"));
+    ASSERT_EQ("NOT_FOUND", Get("c"));
+    ASSERT_EQ("vd", Get("d"));
+    ASSERT_EQ("(a->va)(d->vd)", Contents());
+
+    // Later writes are not deleted
+    ASSERT_OK(Put("c", "vc2"));
+    ASSERT_EQ("(a->va)(c->vc2)(d->vd)", Contents());
+
+    // Nor is anything by an empty range
+    ASSERT_OK(db_->DeleteRange(WriteOptions(), "d", "a"));
+    ASSERT_OK(db_->DeleteRange(WriteOptions(), "a", "a"));
+    ASSERT_EQ("(a->va)(c->vc2)(d->vd)", Contents());
+
+    Reopen();
+    ASSERT_EQ("NOT_FOUND", Get("b"));
+    ASSERT_EQ("vc2", Get("c"));
+    ASSERT_EQ("(a->va)(c->vc2)(d->vd)", Contents());
+    ASSERT_OK(dbfull()->TEST_CompactMemTable());
+    ASSERT_EQ("NOT_FOUND", Get("b"));
+    ASSERT_EQ("vc2", Get("c"));
+    ASSERT_EQ("(a->va)(c->vc2)(d->vd)", Contents());
+  } while (ChangeOptions());
+}
+
+TEST(DBTest, EmptyDeleteRangeInTables) {
+  do {
+    // An inverted range must not give its table bounds that overlap the
+    // other tables of its level
+    ASSERT_OK(db_->DeleteRange(WriteOptions(), "b", "a"));
+    ASSERT_OK(dbfull()->TEST_CompactMemTable());
+    ASSERT_OK(Put("a1", "va1"));
+    ASSERT_OK(Put("c", "vc"));
+    ASSERT_OK(dbfull()->TEST_CompactMemTable());
+    db_->CompactRange(NULL, NULL);
+    ASSERT_EQ("va1", Get("a1"));
+    ASSERT_EQ("vc", Get("c"));
+    ASSERT_EQ("(a1->va1)(c->vc)", Contents());
+    ASSERT_EQ(1, TotalTableFiles());
+  } while (ChangeOptions());
+}
+
+TEST(DBTest, DeleteRangeInTables) {
+  do {
+    std::vector<std::string> keys;
+    for (int i = 0; i < 20; i++) {
+      ASSERT_OK(Put(Key(i), "v" + Key(i)));
+      keys.push_back(Key(i));
+    }
+    Compact(Key(0), Key(20));
+    const Snapshot* snapshot = db_->GetSnapshot();
+
+    // The tombstone goes to a table of its own
+    ASSERT_OK(db_->DeleteRange(WriteOptions(), Key(5), Key(15)));
+    ASSERT_OK(dbfull()->TEST_CompactMemTable());
+    for (int i = 0; i < 20; i++) {
+      const bool deleted = (i >= 5 && i < 15);
+      ASSERT_EQ(deleted ? "NOT_FOUND" : "v" + Key(i), Get(Key(i)));
+      ASSERT_EQ("v" + Key(i), Get(Key(i), snapshot));
+    }
+    std::string expected = "v" + Key(0);
+    for (int i = 1; i < 20; i++) {
+      expected += ",";
+      expected += (i >= 5 && i < 15) ? "NOT_FOUND" : "v" + Key(i);
+    }
+    ASSERT_EQ(expected, MultiGet(keys));
+
+    // The snapshot keeps the deleted entries through compactions
+    db_->CompactRange(NULL, NULL);
+    ASSERT_EQ("NOT_FOUND", Get(Key(7)));
+    ASSERT_EQ("v" + Key(7), Get(Key(7), snapshot));
+    ASSERT_EQ("v" + Key(15), Get(Key(15)));
+    ASSERT_EQ(expected, MultiGet(keys));
+
+    // Then compactions drop them
+    db_->ReleaseSnapshot(snapshot);
+    ASSERT_OK(Put(Key(0), "v" + Key(0)));
+    ASSERT_OK(Put(Key(19), "v" + Key(19)));
+    ASSERT_OK(dbfull()->TEST_CompactMemTable());
+    db_->CompactRange(NULL, NULL);
+    ASSERT_EQ("[ ]", AllEntriesFor(Key(7)));
+    ASSERT_EQ("NOT_FOUND", Get(Key(7)));
+    ASSERT_EQ(expected, MultiGet(keys));
+
+    Reopen();
+    ASSERT_EQ(expected, MultiGet(keys));
+    Iterator* iter = db_->NewIterator(ReadOptions());
+    iter->Seek(Key(3));
+    ASSERT_EQ(Key(3) + "->v" + Key(3), IterStatus(iter));
+    iter->Next();
+    ASSERT_EQ(Key(4) + "->v" + Key(4), IterStatus(iter));
+    iter->Next();
+    ASSERT_EQ(Key(15) + "->v" + Key(15), IterStatus(iter));
+    iter->Prev();
+    ASSERT_EQ(Key(4) + "->v" + Key(4), IterStatus(iter));
+    delete iter;
+  } while (ChangeOptions());
+}
+
+TEST(DBTest, BulkDeleteForRange) {
+  do {
+    // One table per group of ten keys
+    for (int t = 0; t < 4; t++) {
+      for (int i = t * 10; i < t * 10 + 10; i++) {
+        ASSERT_OK(Put(Key(i), "v" + Key(i)));
+      }
+      ASSERT_OK(dbfull()->TEST_CompactMemTable());
+    }
+    ASSERT_EQ(4, TotalTableFiles());
+
+    // The tables of keys 10..19 and 20..29 are dropped, the other two are
+    // compacted
+    ASSERT_OK(db_->BulkDeleteForRange(WriteOptions(), Key(5), Key(35)));
+    for (int i = 0; i < 40; i++) {
+      const bool deleted = (i >= 5 && i < 35);
+      ASSERT_EQ(deleted ? "NOT_FOUND" : "v" + Key(i), Get(Key(i)));
+    }
+    ASSERT_EQ("[ ]", AllEntriesFor(Key(7)));
+    ASSERT_EQ("[ ]", AllEntriesFor(Key(15)));
+    ASSERT_EQ("[ ]", AllEntriesFor(Key(25)));
+    ASSERT_EQ("[ ]", AllEntriesFor(Key(32)));
+
+    // Keys written after the call are kept
+    ASSERT_OK(Put(Key(20), "new"));
+    ASSERT_OK(db_->BulkDeleteForRange(WriteOptions(), Key(35), Key(30)));
+    Reopen();
+    ASSERT_EQ("new", Get(Key(20)));
+    ASSERT_EQ("NOT_FOUND", Get(Key(21)));
+    ASSERT_EQ("v" + Key(4), Get(Key(4)));
+    ASSERT_EQ("v" + Key(35), Get(Key(35)));
+  } while (ChangeOptions());
+}
+
+// Writes with SstFileWriter a table holding Key(i) -> value + Key(i) for
+// every i in [first,limit), and returns its file name.
+static std::string WriteExternalFile(const Options& options,
+                                     const std::string& fname,
+                                     int first, int limit,
+                                     const std::string& value) {
+  SstFileWriter writer(options);
+  ASSERT_OK(writer.Open(fname));
+  for (int i = first; i < limit; i++) {
+    ASSERT_OK(writer.Put(Key(i), value + Key(i)));
+  }
+  ASSERT_OK(writer.Finish());
+  ASSERT_EQ(static_cast<uint64_t>(limit - first), writer.NumEntries());
+  return fname;
+}
+
+TEST(DBTest, IngestExternalFiles) {
+  do {
+    // Into an empty database, the files go to the last level
+    std::vector<std::string> files;
+    files.push_back(WriteExternalFile(last_options_, dbname_ + "/ext1",
+                                      20, 30, "a"));
+    files.push_back(WriteExternalFile(last_options_, dbname_ + "/ext2",
+                                      0, 10, "a"));
+    ASSERT_OK(db_->IngestExternalFiles(files));
+    ASSERT_EQ("0,0,0,0,0,0,2", FilesPerLevel());
+    ASSERT_TRUE(!env_->FileExists(files[0]));
+    ASSERT_EQ("a" + Key(5), Get(Key(5)));
+    ASSERT_EQ("a" + Key(29), Get(Key(29)));
+    ASSERT_EQ("NOT_FOUND", Get(Key(15)));
+
+    // Newer than the entries of the memtable and of the levels, which
+    // snapshots still see
+    ASSERT_OK(Put(Key(8), "b" + Key(8)));
+    ASSERT_OK(Put(Key(12), "b" + Key(12)));
+    const Snapshot* snapshot = db_->GetSnapshot();
+    files.clear();
+    files.push_back(WriteExternalFile(last_options_, dbname_ + "/ext3",
+                                      5, 15, "c"));
+    ASSERT_OK(db_->IngestExternalFiles(files));
+    for (int i = 0; i < 30; i++) {
+      std::string expected = "NOT_FOUND";
+      if (i >= 5 && i < 15) {
+        expected = "c" + Key(i);
+      } else if (i < 10 || i >= 20) {
+        expected = "a" + Key(i);
+      }
+      ASSERT_EQ(expected, Get(Key(i)));
+    }
+    ASSERT_EQ("b" + Key(8), Get(Key(8), snapshot));
+    ASSERT_EQ("b" + Key(12), Get(Key(12), snapshot));
+    ASSERT_EQ("a" + Key(5), Get(Key(5), snapshot));
+    std::vector<std::string> keys;
+    keys.push_back(Key(4));
+    keys.push_back(Key(8));
+    keys.push_back(Key(12));
+    ASSERT_EQ("a" + Key(4) + ",c" + Key(8) + ",c" + Key(12), MultiGet(keys));
+    Iterator* iter = db_->NewIterator(ReadOptions());
+    iter->Seek(Key(8));
+    ASSERT_EQ(Key(8) + "->c" + Key(8), IterStatus(iter));
+    iter->Prev();
+    ASSERT_EQ(Key(7) + "->c" + Key(7), IterStatus(iter));
+    delete iter;
+    db_->ReleaseSnapshot(snapshot);
+
+    // Deletions, and files written before the last write
+    SstFileWriter writer(last_options_);
+    ASSERT_OK(writer.Open(dbname_ + "/ext4"));
+    ASSERT_OK(writer.Delete(Key(6)));
+    ASSERT_OK(writer.Put(Key(7), "d"));
+    ASSERT_OK(writer.Finish());
+    ASSERT_OK(Put(Key(7), "e"));
+    files.clear();
+    files.push_back(dbname_ + "/ext4");
+    ASSERT_OK(db_->IngestExternalFiles(files));
+    ASSERT_EQ("NOT_FOUND", Get(Key(6)));
+    ASSERT_EQ("d", Get(Key(7)));
+
+    db_->CompactRange(NULL, NULL);
+    ASSERT_EQ("NOT_FOUND", Get(Key(6)));
+    ASSERT_EQ("d", Get(Key(7)));
+    ASSERT_EQ("c" + Key(12), Get(Key(12)));
+    Reopen();
+    ASSERT_EQ("d", Get(Key(7)));
+    ASSERT_EQ("c" + Key(12), Get(Key(12)));
+    ASSERT_EQ("a" + Key(25), Get(Key(25)));
+  } while (ChangeOptions());
+}
+
+TEST(DBTest, IngestExternalFilesErrors) {
+  SstFileWriter writer(last_options_);
+  ASSERT_OK(writer.Open(dbname_ + "/ext"));
+  ASSERT_OK(writer.Put("b", "v"));
+  ASSERT_TRUE(!writer.Put("b", "v").ok());
+  ASSERT_TRUE(!writer.Put("a", "v").ok());
+  ASSERT_OK(writer.Put("c", "v"));
+  ASSERT_OK(writer.Finish());
+  ASSERT_OK(writer.Open(dbname_ + "/empty"));
+  ASSERT_TRUE(!writer.Finish().ok());
+  ASSERT_TRUE(!env_->FileExists(dbname_ + "/empty"));
+
+  // Overlapping files are left alone
+  std::vector<std::string> files;
+  files.push_back(dbname_ + "/ext");
+  files.push_back(WriteExternalFile(last_options_, dbname_ + "/ext2",
+                                    0, 10, "v"));
+  files.push_back(WriteExternalFile(last_options_, dbname_ + "/ext3",
+                                    9, 20, "v"));
+  ASSERT_TRUE(db_->IngestExternalFiles(files).IsInvalidArgument());
+  ASSERT_TRUE(env_->FileExists(files[1]));
+  ASSERT_EQ("NOT_FOUND", Get(Key(1)));
+
+  // So are tables of databases
+  ASSERT_OK(Put("a", "v"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  std::vector<std::string> children;
+  ASSERT_OK(env_->GetChildren(dbname_, &children));
+  files.clear();
+  for (size_t i = 0; i < children.size(); i++) {
+    uint64_t number;
+    FileType type;
+    if (ParseFileName(children[i], &number, &type) && type == kTableFile) {
+      files.push_back(dbname_ + "/" + children[i]);
+    }
+  }
+  ASSERT_EQ(1, files.size());
+  ASSERT_TRUE(db_->IngestExternalFiles(files).IsInvalidArgument());
+
+  // And other tables, even those holding only sequence numbers of zero
+  InternalKeyComparator icmp(BytewiseComparator());
+  Options table_options = last_options_;
+  table_options.comparator = &icmp;
+  WritableFile* file;
+  ASSERT_OK(env_->NewWritableFile(dbname_ + "/other", &file));
+  TableBuilder builder(table_options, file);
+  builder.Add(InternalKey("x", 0, kTypeValue).Encode(), "v");
+  builder.Add(InternalKey("y", 0, kTypeValue).Encode(), "v");
+  ASSERT_OK(builder.Finish());
+  ASSERT_OK(file->Close());
+  delete file;
+  files.clear();
+  files.push_back(dbname_ + "/other");
+  ASSERT_TRUE(db_->IngestExternalFiles(files).IsInvalidArgument());
+  ASSERT_EQ("NOT_FOUND", Get("x"));
+}
+
+// Returns the contents of "model" in the format of DBTest::Contents().
+static std::string ModelContents(const std::map<std::string,
+                                                std::string>& model) {
+  std::string result;
+  for (std::map<std::string, std::string>::const_iterator it = model.begin();
+       it != model.end(); ++it) {
+    result += "(" + it->first + "->" + it->second + ")";
+  }
+  return result;
+}
+
+TEST(DBTest, DeleteRangeRandomized) {
+  // Enough data for compactions to have several outputs
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000;
+  options.max_subcompactions = 4;
+  Reopen(&options);
+  Random rnd(301);
+  std::map<std::string, std::string> model;
+  const Snapshot* snapshot = NULL;
+  std::string snapshot_contents;
+  for (int i = 0; i < 5000; i++) {
+    const int k = rnd.Uniform(1000);
+    const std::string key = Key(k);
+    if (rnd.OneIn(50)) {
+      const std::string end = Key(k + rnd.Uniform(30));
+      ASSERT_OK(db_->DeleteRange(WriteOptions(), key, end));
+      if (key < end) {
+        model.erase(model.lower_bound(key), model.lower_bound(end));
+      }
+    } else {
+      const std::string value = RandomString(&rnd, 1000);
+      ASSERT_OK(Put(key, value));
+      model[key] = value;
+    }
+    if (i == 1000) {
+      snapshot = db_->GetSnapshot();
+      snapshot_contents = ModelContents(model);
+    }
+    if (i % 1000 == 999) {
+      db_->CompactRange(NULL, NULL);
+      ASSERT_EQ(ModelContents(model), Contents());
+      for (int k = 0; k < 1000; k += 7) {
+        std::map<std::string, std::string>::const_iterator it =
+            model.find(Key(k));
+        ASSERT_EQ(it == model.end() ? "NOT_FOUND" : it->second, Get(Key(k)));
+      }
+    }
+  }
+
+  ReadOptions read_options;
+  read_options.snapshot = snapshot;
+  Iterator* iter = db_->NewIterator(read_options);
+  std::string contents;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    contents += "(" + IterStatus(iter) + ")";
+  }
+  delete iter;
+  ASSERT_TRUE(contents == snapshot_contents);
+  db_->ReleaseSnapshot(snapshot);
+
+  Reopen(&options);
+  ASSERT_EQ(ModelContents(model), Contents());
+}
+
 TEST(DBTest, OverlapInLevel0) {
   do {
     ASSERT_EQ(config::kMaxMemCompactLevel, 2) << "Fix test to match config";
@@ -1755,6 +2647,266 @@ TEST(DBTest, BloomFilter) {
   delete options.filter_policy;
 }
 
+TEST(DBTest, WholeFileFilter) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.filter_policy = NewBloomFilterPolicy(10);
+  options.whole_file_filter = true;
+  Reopen(&options);
+
+  const int N = 10000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_OK(Put(Key(i), Key(i)));
+  }
+  Compact("a", "z");
+
+  // Prevent auto compactions triggered by seeks
+  env_->delay_data_sync_.Release_Store(env_);
+
+  // Lookup present keys.  Each one reads its data block.
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(Key(i), Get(Key(i)));
+  }
+  int reads = env_->random_read_counter_.Read();
+  fprintf(stderr, "%d present => %d reads\n", N, reads);
+  ASSERT_GE(reads, N);
+  ASSERT_LE(reads, N + N/100);
+
+  // Lookup missing keys.  Should rarely read a data block.
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+  }
+  reads = env_->random_read_counter_.Read();
+  fprintf(stderr, "%d missing => %d reads\n", N, reads);
+  ASSERT_LE(reads, 2*N/100);
+
+  env_->delay_data_sync_.Release_Store(NULL);
+  Close();
+  delete options.block_cache;
+  delete options.filter_policy;
+}
+
+TEST(DBTest, FilterPerLevel) {
+  env_->count_random_reads_ = true;
+  const FilterPolicy* bloom = NewBloomFilterPolicy(10);
+  const FilterPolicy* ribbon = NewRibbonFilterPolicy(10);
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.filter_policy = NULL;
+  options.filter_policy_per_level.clear();
+  options.filter_policy_per_level.push_back(bloom);
+  options.filter_policy_per_level.push_back(ribbon);
+  options.whole_file_filter = true;
+  Reopen(&options);
+
+  const int N = 10000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_OK(Put(Key(i), Key(i)));
+  }
+  Compact("a", "z");
+  ASSERT_EQ(0, NumTableFilesAtLevel(0));
+
+  // Prevent auto compactions triggered by seeks
+  env_->delay_data_sync_.Release_Store(env_);
+
+  // The tables below level 0 have ribbon filters.  Then read them with
+  // ribbon as the main policy, while new tables get bloom filters.
+  for (int pass = 0; pass < 2; pass++) {
+    if (pass == 1) {
+      options.filter_policy = ribbon;
+      options.filter_policy_per_level.clear();
+      options.filter_policy_per_level.push_back(bloom);
+      Reopen(&options);
+    }
+    env_->random_read_counter_.Reset();
+    for (int i = 0; i < N; i++) {
+      ASSERT_EQ(Key(i), Get(Key(i)));
+    }
+    int reads = env_->random_read_counter_.Read();
+    fprintf(stderr, "%d present => %d reads\n", N, reads);
+    ASSERT_GE(reads, N);
+    ASSERT_LE(reads, N + N/100);
+
+    env_->random_read_counter_.Reset();
+    for (int i = 0; i < N; i++) {
+      ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+    }
+    reads = env_->random_read_counter_.Read();
+    fprintf(stderr, "%d missing => %d reads\n", N, reads);
+    ASSERT_LE(reads, 2*N/100);
+  }
+
+  env_->delay_data_sync_.Release_Store(NULL);
+  Close();
+  delete options.block_cache;
+  delete bloom;
+  delete ribbon;
+}
+
+namespace {
+std::string PrefixKey(int prefix, int i) {
+  char buf[100];
+  snprintf(buf, sizeof(buf), "p%03d.%02d", prefix, i);
+  return std::string(buf);
+}
+
+// Returns the number of keys from a Seek() to "target" that are
+// returned before the iterator becomes invalid, or -1 if a key does not
+// start with "prefix".
+int CountPrefix(DB* db, const ReadOptions& options, const Slice& target,
+                const Slice& prefix) {
+  Iterator* iter = db->NewIterator(options);
+  int count = 0;
+  for (iter->Seek(target); iter->Valid(); iter->Next()) {
+    if (!iter->key().starts_with(prefix)) {
+      if (options.prefix_same_as_start) {
+        count = -1;
+      }
+      break;
+    }
+    count++;
+  }
+  if (!iter->status().ok()) {
+    count = -1;
+  }
+  delete iter;
+  return count;
+}
+}  // namespace
+
+TEST(DBTest, PrefixSameAsStart) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.filter_policy = NewBloomFilterPolicy(10);
+  options.prefix_extractor = NewFixedPrefixTransform(4);
+  Reopen(&options);
+
+  // Three tables that overlap, but share no prefix
+  const int kPrefixes = 30;
+  for (int t = 0; t < 3; t++) {
+    for (int p = t; p < kPrefixes; p += 3) {
+      for (int i = 0; i < 10; i++) {
+        ASSERT_OK(Put(PrefixKey(p, i), "v"));
+      }
+    }
+    dbfull()->TEST_CompactMemTable();
+  }
+  ASSERT_OK(Put(PrefixKey(kPrefixes, 0), "v"));  // Only in the memtable
+
+  // Prevent auto compactions triggered by seeks
+  env_->delay_data_sync_.Release_Store(env_);
+
+  ReadOptions prefix_options;
+  prefix_options.prefix_same_as_start = true;
+  env_->random_read_counter_.Reset();
+  for (int p = 0; p < kPrefixes; p++) {
+    std::string prefix = PrefixKey(p, 0).substr(0, 4);
+    ASSERT_EQ(10, CountPrefix(db_, prefix_options, prefix, prefix));
+  }
+  const int prefix_reads = env_->random_read_counter_.Read();
+
+  env_->random_read_counter_.Reset();
+  for (int p = 0; p < kPrefixes; p++) {
+    std::string prefix = PrefixKey(p, 0).substr(0, 4);
+    ASSERT_EQ(10, CountPrefix(db_, ReadOptions(), prefix, prefix));
+  }
+  const int reads = env_->random_read_counter_.Read();
+  fprintf(stderr, "%d prefixes => %d reads, %d without prefix filtering\n",
+          kPrefixes, prefix_reads, reads);
+  ASSERT_LE(prefix_reads, reads / 2);
+
+  ASSERT_EQ(5, CountPrefix(db_, prefix_options, PrefixKey(5, 5), "p005"));
+  ASSERT_EQ(1, CountPrefix(db_, prefix_options, "p030", "p030"));
+  ASSERT_EQ(0, CountPrefix(db_, prefix_options, "p031", "p031"));
+
+  // Iterators without a prefix pass the end of the prefix
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  iter->Seek(PrefixKey(5, 9));
+  iter->Next();
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ(PrefixKey(6, 0), iter->key().ToString());
+  delete iter;
+
+  // Moving backwards is not supported
+  iter = db_->NewIterator(prefix_options);
+  iter->Seek(PrefixKey(5, 5));
+  ASSERT_TRUE(iter->Valid());
+  iter->Prev();
+  ASSERT_TRUE(!iter->Valid());
+  ASSERT_TRUE(iter->status().IsNotSupportedError());
+  delete iter;
+
+  env_->delay_data_sync_.Release_Store(NULL);
+  Close();
+  delete options.block_cache;
+  delete options.filter_policy;
+  delete options.prefix_extractor;
+}
+
+TEST(DBTest, PrefixSameAsStartSkipsLevelFiles) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.filter_policy = NewBloomFilterPolicy(10);
+  options.prefix_extractor = NewFixedPrefixTransform(4);
+  Reopen(&options);
+
+  // Three files that do not overlap, holding the even prefixes
+  const int kFiles = 3;
+  for (int t = 0; t < kFiles; t++) {
+    for (int p = 10 * t; p < 10 * t + 10; p += 2) {
+      for (int i = 0; i < 10; i++) {
+        ASSERT_OK(Put(PrefixKey(p, i), "v"));
+      }
+    }
+    dbfull()->TEST_CompactMemTable();
+  }
+  ASSERT_EQ(0, NumTableFilesAtLevel(0));
+  ASSERT_EQ(kFiles, TotalTableFiles());
+
+  // Prevent auto compactions triggered by seeks
+  env_->delay_data_sync_.Release_Store(env_);
+
+  // Open every table before counting
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  delete iter;
+  ASSERT_EQ(5 * 10 * kFiles, count);
+
+  // Seeks to the odd prefixes, which no file holds, land on a file whose
+  // filter rules them out, and read nothing from the next file either
+  ReadOptions prefix_options;
+  prefix_options.prefix_same_as_start = true;
+  env_->random_read_counter_.Reset();
+  for (int p = 1; p < 10 * kFiles; p += 2) {
+    std::string prefix = PrefixKey(p, 0).substr(0, 4);
+    ASSERT_EQ(0, CountPrefix(db_, prefix_options, prefix, prefix));
+  }
+  ASSERT_EQ(0, env_->random_read_counter_.Read());
+
+  for (int p = 0; p < 10 * kFiles; p += 2) {
+    std::string prefix = PrefixKey(p, 0).substr(0, 4);
+    ASSERT_EQ(10, CountPrefix(db_, prefix_options, prefix, prefix));
+  }
+
+  env_->delay_data_sync_.Release_Store(NULL);
+  Close();
+  delete options.block_cache;
+  delete options.filter_policy;
+  delete options.prefix_extractor;
+}
+
 // Multi-threaded test:
 namespace {
 
@@ -1907,6 +3059,12 @@ class ModelDB: public DB {
       virtual void Delete(const Slice& key) {
         map_->erase(key.ToString());
       }
+      virtual void DeleteRange(const Slice& begin, const Slice& end) {
+        if (begin.compare(end) < 0) {
+          map_->erase(map_->lower_bound(begin.ToString()),
+                      map_->lower_bound(end.ToString()));
+        }
+      }
     };
     Handler handler;
     handler.map_ = &map_;
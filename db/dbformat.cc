@@ -3,6 +3,7 @@
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
 #include <stdio.h>
+#include <vector>
 #include "db/dbformat.h"
 #include "port/port.h"
 #include "util/coding.h"
@@ -11,7 +12,7 @@ namespace leveldb {
 
 static uint64_t PackSequenceAndType(uint64_t seq, ValueType t) {
   assert(seq <= kMaxSequenceNumber);
-  assert(t <= kValueTypeForSeek);
+  assert(t <= kTypeRangeDeletion);
   return (seq << 8) | t;
 }
 
@@ -98,8 +99,27 @@ void InternalKeyComparator::FindShortSuccessor(std::string* key) const {
   }
 }
 
+Slice InternalKeyComparator::KeyForHashing(const Slice& key) const {
+  // All versions of a user key must land in the same bucket
+  return user_comparator_->KeyForHashing(ExtractUserKey(key));
+}
+
+InternalFilterPolicy::InternalFilterPolicy(
+    const FilterPolicy* p, const SliceTransform* prefix_extractor)
+    : user_policy_(p),
+      prefix_extractor_(prefix_extractor) {
+  if (user_policy_ != NULL) {
+    name_ = user_policy_->Name();
+    if (prefix_extractor_ != NULL) {
+      // Filters with prefixes must not be mistaken for ones without
+      name_.append("+");
+      name_.append(prefix_extractor_->Name());
+    }
+  }
+}
+
 const char* InternalFilterPolicy::Name() const {
-  return user_policy_->Name();
+  return name_.c_str();
 }
 
 void InternalFilterPolicy::CreateFilter(const Slice* keys, int n,
@@ -111,13 +131,65 @@ void InternalFilterPolicy::CreateFilter(const Slice* keys, int n,
     mkey[i] = ExtractUserKey(keys[i]);
     // TODO(sanjay): Suppress dups?
   }
-  user_policy_->CreateFilter(keys, n, dst);
+  if (prefix_extractor_ == NULL) {
+    user_policy_->CreateFilter(keys, n, dst);
+    return;
+  }
+
+  // Add the prefixes after the keys.  Keys with the same prefix are
+  // adjacent, so each prefix is added once per run of them.
+  std::vector<Slice> all(keys, keys + n);
+  Slice last_prefix;
+  bool has_last_prefix = false;
+  for (int i = 0; i < n; i++) {
+    if (prefix_extractor_->InDomain(keys[i])) {
+      Slice prefix = prefix_extractor_->Transform(keys[i]);
+      if (!has_last_prefix || prefix != last_prefix) {
+        all.push_back(prefix);
+        last_prefix = prefix;
+        has_last_prefix = true;
+      }
+    }
+  }
+  user_policy_->CreateFilter(all.empty() ? NULL : &all[0],
+                             static_cast<int>(all.size()), dst);
 }
 
 bool InternalFilterPolicy::KeyMayMatch(const Slice& key, const Slice& f) const {
   return user_policy_->KeyMayMatch(ExtractUserKey(key), f);
 }
 
+InternalFilterPolicies::InternalFilterPolicies(const Options& options) {
+  Add(options.filter_policy, options.prefix_extractor);
+  for (size_t i = 0; i < options.filter_policy_per_level.size(); i++) {
+    Add(options.filter_policy_per_level[i], options.prefix_extractor);
+  }
+}
+
+InternalFilterPolicies::~InternalFilterPolicies() {
+  for (size_t i = 0; i < policies_.size(); i++) {
+    delete policies_[i];
+  }
+}
+
+void InternalFilterPolicies::Add(const FilterPolicy* p,
+                                 const SliceTransform* prefix_extractor) {
+  if (p == NULL || Wrap(p) != NULL) {
+    return;
+  }
+  user_policies_.push_back(p);
+  policies_.push_back(new InternalFilterPolicy(p, prefix_extractor));
+}
+
+const FilterPolicy* InternalFilterPolicies::Wrap(const FilterPolicy* p) const {
+  for (size_t i = 0; i < user_policies_.size(); i++) {
+    if (user_policies_[i] == p) {
+      return policies_[i];
+    }
+  }
+  return NULL;
+}
+
 LookupKey::LookupKey(const Slice& user_key, SequenceNumber s) {
   size_t usize = user_key.size();
   size_t needed = usize + 13;  // A conservative estimate
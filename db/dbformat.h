@@ -6,10 +6,12 @@
 #define STORAGE_LEVELDB_DB_DBFORMAT_H_
 
 #include <stdio.h>
+#include <vector>
 #include "leveldb/comparator.h"
 #include "leveldb/db.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/slice.h"
+#include "leveldb/slice_transform.h"
 #include "leveldb/table_builder.h"
 #include "util/coding.h"
 #include "util/logging.h"
@@ -43,6 +45,10 @@ static const int kReadBytesPeriod = 1048576;
 
 }  // namespace config
 
+// Table property SstFileWriter sets on every table it writes.  Only
+// tables carrying it can be ingested by DB::IngestExternalFiles().
+static const char kExternalFileProperty[] = "leveldb.external_file";
+
 class InternalKey;
 
 // Value types encoded as the last component of internal keys.
@@ -50,14 +56,17 @@ class InternalKey;
 // data structures.
 enum ValueType {
   kTypeDeletion = 0x0,
-  kTypeValue = 0x1
+  kTypeValue = 0x1,
+  kTypeRangeDeletion = 0x2
 };
 // kValueTypeForSeek defines the ValueType that should be passed when
 // constructing a ParsedInternalKey object for seeking to a particular
 // sequence number (since we sort sequence numbers in decreasing order
 // and the value type is embedded as the low 8 bits in the sequence
 // number in internal keys, we need to use the highest-numbered
-// ValueType, not the lowest).
+// ValueType, not the lowest).  Range tombstones are kept apart from
+// the entries seeks are made among (see db/range_del.h), so it is
+// the highest type of those.
 static const ValueType kValueTypeForSeek = kTypeValue;
 
 typedef uint64_t SequenceNumber;
@@ -121,6 +130,7 @@ class InternalKeyComparator : public Comparator {
       std::string* start,
       const Slice& limit) const;
   virtual void FindShortSuccessor(std::string* key) const;
+  virtual Slice KeyForHashing(const Slice& key) const;
 
   const Comparator* user_comparator() const { return user_comparator_; }
 
@@ -128,16 +138,44 @@ class InternalKeyComparator : public Comparator {
 };
 
 // Filter policy wrapper that converts from internal keys to user keys
+// If given a prefix extractor, it also adds the prefix of each user key
+// to the filter, so that a filter can be probed for a prefix by passing
+// an internal key whose user key is the prefix.
 class InternalFilterPolicy : public FilterPolicy {
  private:
   const FilterPolicy* const user_policy_;
+  const SliceTransform* const prefix_extractor_;
+  std::string name_;
  public:
-  explicit InternalFilterPolicy(const FilterPolicy* p) : user_policy_(p) { }
+  explicit InternalFilterPolicy(const FilterPolicy* p,
+                                const SliceTransform* prefix_extractor = NULL);
   virtual const char* Name() const;
   virtual void CreateFilter(const Slice* keys, int n, std::string* dst) const;
   virtual bool KeyMayMatch(const Slice& key, const Slice& filter) const;
 };
 
+// The InternalFilterPolicy wrappers, with the options' prefix extractor,
+// of options.filter_policy and the entries of
+// options.filter_policy_per_level: one per distinct policy.
+class InternalFilterPolicies {
+ private:
+  std::vector<const FilterPolicy*> user_policies_;
+  std::vector<InternalFilterPolicy*> policies_;
+
+  // No copying allowed
+  InternalFilterPolicies(const InternalFilterPolicies&);
+  void operator=(const InternalFilterPolicies&);
+
+  void Add(const FilterPolicy* p, const SliceTransform* prefix_extractor);
+ public:
+  explicit InternalFilterPolicies(const Options& options);
+  ~InternalFilterPolicies();
+
+  // Returns the wrapper of "p", which must be one of the policies of the
+  // options passed to the constructor, or NULL if p is NULL.
+  const FilterPolicy* Wrap(const FilterPolicy* p) const;
+};
+
 // Modules in this directory should keep internal keys wrapped inside
 // the following class instead of plain strings so that we do not
 // incorrectly use string comparisons instead of an InternalKeyComparator.
@@ -164,6 +202,7 @@ class InternalKey {
   }
 
   void Clear() { rep_.clear(); }
+  bool empty() const { return rep_.empty(); }
 
   std::string DebugString() const;
 };
@@ -182,7 +221,7 @@ inline bool ParseInternalKey(const Slice& internal_key,
   result->sequence = num >> 8;
   result->type = static_cast<ValueType>(c);
   result->user_key = Slice(internal_key.data(), n - 8);
-  return (c <= static_cast<unsigned char>(kTypeValue));
+  return (c <= static_cast<unsigned char>(kTypeRangeDeletion));
 }
 
 // A helper class useful for DBImpl::Get()
@@ -203,6 +242,9 @@ class LookupKey {
   // Return the user key
   Slice user_key() const { return Slice(kstart_, end_ - kstart_ - 8); }
 
+  // Return the sequence number of the snapshot
+  SequenceNumber sequence() const { return DecodeFixed64(end_ - 8) >> 8; }
+
  private:
   // We construct a char array of the form:
   //    klength  varint32               <-- start_
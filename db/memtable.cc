@@ -4,10 +4,14 @@
 
 #include "db/memtable.h"
 #include "db/dbformat.h"
+#include "db/range_del.h"
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
+#include "table/merger.h"
 #include "util/coding.h"
+#include "util/hash.h"
+#include "util/mutexlock.h"
 
 namespace leveldb {
 
@@ -18,24 +22,70 @@ static Slice GetLengthPrefixedSlice(const char* data) {
   return Slice(p, len);
 }
 
-MemTable::MemTable(const InternalKeyComparator& cmp)
+// The fragmented tombstones, which hold at least the first "count"
+// tombstones added.  Lookups that are still using it when it is replaced
+// keep it alive with a reference.
+struct MemTable::RangeDelCache {
+  RangeDelMap map;
+  const int count;
+  std::atomic<int> refs;
+
+  RangeDelCache(const Comparator* ucmp, int n)
+      : map(ucmp), count(n), refs(1) { }
+
+  void Unref() {
+    if (--refs == 0) {
+      delete this;
+    }
+  }
+};
+
+MemTable::MemTable(const InternalKeyComparator& cmp, int partitions,
+                   bool concurrent_adds, size_t bloom_bits,
+                   MemTableRepType rep, size_t hash_buckets)
     : comparator_(cmp),
       refs_(0),
-      table_(comparator_, &arena_) {
+      concurrent_adds_(concurrent_adds),
+      range_dels_(new Partition(comparator_, kSkipListMemTable, 0, 0)),
+      num_range_dels_(0),
+      range_del_cache_(NULL) {
+  if (partitions < 1) partitions = 1;
+  for (int i = 0; i < partitions; i++) {
+    partitions_.push_back(new Partition(comparator_, rep,
+                                        hash_buckets / partitions,
+                                        bloom_bits / partitions));
+  }
 }
 
 MemTable::~MemTable() {
   assert(refs_ == 0);
+  for (size_t i = 0; i < partitions_.size(); i++) {
+    delete partitions_[i];
+  }
+  delete range_dels_;
+  if (range_del_cache_ != NULL) {
+    range_del_cache_->Unref();
+  }
 }
 
-size_t MemTable::ApproximateMemoryUsage() { return arena_.MemoryUsage(); }
+size_t MemTable::ApproximateMemoryUsage() {
+  size_t usage = 0;
+  for (size_t i = 0; i < partitions_.size(); i++) {
+    usage += partitions_[i]->arena.MemoryUsage();
+    usage += partitions_[i]->rep->ApproximateMemoryUsage();
+    if (partitions_[i]->bloom != NULL) {
+      usage += partitions_[i]->bloom->MemoryUsage();
+    }
+  }
+  usage += range_dels_->arena.MemoryUsage();
+  return usage;
+}
 
-int MemTable::KeyComparator::operator()(const char* aptr, const char* bptr)
-    const {
-  // Internal keys are encoded as length-prefixed strings.
-  Slice a = GetLengthPrefixedSlice(aptr);
-  Slice b = GetLengthPrefixedSlice(bptr);
-  return comparator.Compare(a, b);
+int MemTable::PartitionOf(const Slice& user_key) const {
+  if (partitions_.size() == 1) {
+    return 0;
+  }
+  return Hash(user_key.data(), user_key.size(), 0) % partitions_.size();
 }
 
 // Encode a suitable internal key target for "target" and return it.
@@ -50,24 +100,25 @@ static const char* EncodeKey(std::string* scratch, const Slice& target) {
 
 class MemTableIterator: public Iterator {
  public:
-  explicit MemTableIterator(MemTable::Table* table) : iter_(table) { }
-
-  virtual bool Valid() const { return iter_.Valid(); }
-  virtual void Seek(const Slice& k) { iter_.Seek(EncodeKey(&tmp_, k)); }
-  virtual void SeekToFirst() { iter_.SeekToFirst(); }
-  virtual void SeekToLast() { iter_.SeekToLast(); }
-  virtual void Next() { iter_.Next(); }
-  virtual void Prev() { iter_.Prev(); }
-  virtual Slice key() const { return GetLengthPrefixedSlice(iter_.key()); }
+  explicit MemTableIterator(MemTableRep* rep) : iter_(rep->NewIterator()) { }
+  virtual ~MemTableIterator() { delete iter_; }
+
+  virtual bool Valid() const { return iter_->Valid(); }
+  virtual void Seek(const Slice& k) { iter_->Seek(EncodeKey(&tmp_, k)); }
+  virtual void SeekToFirst() { iter_->SeekToFirst(); }
+  virtual void SeekToLast() { iter_->SeekToLast(); }
+  virtual void Next() { iter_->Next(); }
+  virtual void Prev() { iter_->Prev(); }
+  virtual Slice key() const { return GetLengthPrefixedSlice(iter_->key()); }
   virtual Slice value() const {
-    Slice key_slice = GetLengthPrefixedSlice(iter_.key());
+    Slice key_slice = GetLengthPrefixedSlice(iter_->key());
     return GetLengthPrefixedSlice(key_slice.data() + key_slice.size());
   }
 
   virtual Status status() const { return Status::OK(); }
 
  private:
-  MemTable::Table::Iterator iter_;
+  MemTableRep::Iterator* const iter_;
   std::string tmp_;       // For passing to EncodeKey
 
   // No copying allowed
@@ -76,7 +127,24 @@ class MemTableIterator: public Iterator {
 };
 
 Iterator* MemTable::NewIterator() {
-  return new MemTableIterator(&table_);
+  const int n = num_partitions();
+  if (n == 1) {
+    return new MemTableIterator(partitions_[0]->rep);
+  }
+  Iterator** list = new Iterator*[n];
+  for (int i = 0; i < n; i++) {
+    list[i] = new MemTableIterator(partitions_[i]->rep);
+  }
+  Iterator* result = NewMergingIterator(&comparator_.comparator, list, n);
+  delete[] list;
+  return result;
+}
+
+Iterator* MemTable::NewRangeTombstoneIterator() {
+  if (num_range_dels_.load(std::memory_order_acquire) == 0) {
+    return NULL;
+  }
+  return new MemTableIterator(range_dels_->rep);
 }
 
 void MemTable::Add(SequenceNumber s, ValueType type,
@@ -87,13 +155,17 @@ void MemTable::Add(SequenceNumber s, ValueType type,
   //  key bytes    : char[internal_key.size()]
   //  value_size   : varint32 of value.size()
   //  value bytes  : char[value.size()]
+  Partition* partition = (type == kTypeRangeDeletion)
+      ? range_dels_ : partitions_[PartitionOf(key)];
   size_t key_size = key.size();
   size_t val_size = value.size();
   size_t internal_key_size = key_size + 8;
   const size_t encoded_len =
       VarintLength(internal_key_size) + internal_key_size +
       VarintLength(val_size) + val_size;
-  char* buf = arena_.Allocate(encoded_len);
+  char* buf = concurrent_adds_
+      ? partition->arena.AllocateConcurrently(encoded_len)
+      : partition->arena.Allocate(encoded_len);
   char* p = EncodeVarint32(buf, internal_key_size);
   memcpy(p, key.data(), key_size);
   p += key_size;
@@ -102,43 +174,116 @@ void MemTable::Add(SequenceNumber s, ValueType type,
   p = EncodeVarint32(p, val_size);
   memcpy(p, value.data(), val_size);
   assert((p + val_size) - buf == encoded_len);
-  table_.Insert(buf);
+  // The key goes into the filter first: a reader that finds the entry in
+  // the table also finds the key in the filter.
+  if (partition->bloom != NULL) {
+    if (concurrent_adds_) {
+      partition->bloom->AddConcurrently(key);
+    } else {
+      partition->bloom->Add(key);
+    }
+  }
+  if (concurrent_adds_) {
+    partition->rep->InsertConcurrently(buf);
+  } else {
+    partition->rep->Insert(buf);
+  }
+  if (type == kTypeRangeDeletion) {
+    num_range_dels_.fetch_add(1, std::memory_order_release);
+  }
+}
+
+SequenceNumber MemTable::MaxCoveringTombstone(const Slice& user_key,
+                                              SequenceNumber snapshot) {
+  // Every tombstone counted here is visible to the iterator below, since
+  // Add() counts a tombstone only after inserting it.
+  const int count = num_range_dels_.load(std::memory_order_acquire);
+  RangeDelCache* cache = NULL;
+  {
+    MutexLock l(&range_del_mu_);
+    if (range_del_cache_ != NULL && range_del_cache_->count >= count) {
+      cache = range_del_cache_;
+      cache->refs++;
+    }
+  }
+  if (cache == NULL) {
+    // Build outside the lock; if another lookup installs a cache at
+    // least as fresh first, ours is simply used once and dropped.
+    cache = new RangeDelCache(user_comparator(), count);
+    MemTableIterator iter(range_dels_->rep);
+    Status s = cache->map.AddTombstones(&iter);
+    assert(s.ok());
+    cache->map.Finish();
+    MutexLock l(&range_del_mu_);
+    if (range_del_cache_ == NULL || range_del_cache_->count < count) {
+      if (range_del_cache_ != NULL) {
+        range_del_cache_->Unref();
+      }
+      range_del_cache_ = cache;
+      cache->refs++;
+    }
+  }
+  const SequenceNumber result = cache->map.MaxCoveringSeq(user_key, snapshot);
+  cache->Unref();
+  return result;
 }
 
 bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
-  Slice memkey = key.memtable_key();
-  Table::Iterator iter(&table_);
-  iter.Seek(memkey.data());
-  if (iter.Valid()) {
+  Slice v;
+  Status status;
+  if (!Get(key, &v, &status)) {
+    return false;
+  }
+  if (status.ok()) {
+    value->assign(v.data(), v.size());
+  } else {
+    *s = status;
+  }
+  return true;
+}
+
+bool MemTable::Get(const LookupKey& key, Slice* value, Status* s) {
+  // Every older entry for the key is deleted by a covering tombstone,
+  // and so are the entries of this memtable below it.
+  const SequenceNumber tombstone =
+      num_range_dels_.load(std::memory_order_acquire) == 0
+      ? 0 : MaxCoveringTombstone(key.user_key(), key.sequence());
+  Partition* partition = partitions_[PartitionOf(key.user_key())];
+  const char* entry = NULL;
+  if (partition->bloom == NULL ||
+      partition->bloom->MayContain(key.user_key())) {
+    // The rep returns the first entry at or after memkey if it has the
+    // same user key.  We do not check the sequence number since entries
+    // with overly large sequence numbers come before memkey.
+    entry = partition->rep->Get(key.memtable_key().data());
+  }
+  if (entry != NULL) {
     // entry format is:
     //    klength  varint32
     //    userkey  char[klength]
     //    tag      uint64
     //    vlength  varint32
     //    value    char[vlength]
-    // Check that it belongs to same user key.  We do not check the
-    // sequence number since the Seek() call above should have skipped
-    // all entries with overly large sequence numbers.
-    const char* entry = iter.key();
     uint32_t key_length;
     const char* key_ptr = GetVarint32Ptr(entry, entry+5, &key_length);
-    if (comparator_.comparator.user_comparator()->Compare(
-            Slice(key_ptr, key_length - 8),
-            key.user_key()) == 0) {
-      // Correct user key
-      const uint64_t tag = DecodeFixed64(key_ptr + key_length - 8);
+    const uint64_t tag = DecodeFixed64(key_ptr + key_length - 8);
+    if ((tag >> 8) > tombstone) {
       switch (static_cast<ValueType>(tag & 0xff)) {
         case kTypeValue: {
-          Slice v = GetLengthPrefixedSlice(key_ptr + key_length);
-          value->assign(v.data(), v.size());
+          *value = GetLengthPrefixedSlice(key_ptr + key_length);
           return true;
         }
         case kTypeDeletion:
+        case kTypeRangeDeletion:
           *s = Status::NotFound(Slice());
           return true;
       }
     }
   }
+  if (tombstone > 0) {
+    *s = Status::NotFound(Slice());
+    return true;
+  }
   return false;
 }
 
@@ -5,11 +5,15 @@
 #ifndef STORAGE_LEVELDB_DB_MEMTABLE_H_
 #define STORAGE_LEVELDB_DB_MEMTABLE_H_
 
+#include <atomic>
 #include <string>
+#include <vector>
 #include "leveldb/db.h"
 #include "db/dbformat.h"
-#include "db/skiplist.h"
+#include "db/memtable_rep.h"
+#include "port/port.h"
 #include "util/arena.h"
+#include "util/dynamic_bloom.h"
 
 namespace leveldb {
 
@@ -21,16 +25,35 @@ class MemTable {
  public:
   // MemTables are reference counted.  The initial reference count
   // is zero and the caller must call Ref() at least once.
-  explicit MemTable(const InternalKeyComparator& comparator);
-
-  // Increase reference count.
+  //
+  // Entries are spread over "partitions" skiplists by a hash of their
+  // user key.  Add() calls for keys in different partitions may run
+  // concurrently with each other; if concurrent_adds is true, any Add()
+  // calls may.
+  //
+  // If bloom_bits is positive, a bloom filter of that many bits over the
+  // user keys, split over the partitions, lets Get() skip the skiplist
+  // for most keys that were never added.
+  //
+  // Each partition keeps its entries in a MemTableRep of type "rep",
+  // which for kHashMemTable gets hash_buckets / partitions buckets.
+  // Range tombstones are kept apart, in a skiplist of their own.
+  explicit MemTable(const InternalKeyComparator& comparator,
+                    int partitions = 1, bool concurrent_adds = false,
+                    size_t bloom_bits = 0,
+                    MemTableRepType rep = kSkipListMemTable,
+                    size_t hash_buckets = 0);
+
+  // Increase reference count.  Unlike most of MemTable, reference
+  // counting is thread-safe: values handed out by DB::GetPinned() keep
+  // their memtable alive without holding the DB mutex.
   void Ref() { ++refs_; }
 
   // Drop reference count.  Delete if no more references exist.
   void Unref() {
-    --refs_;
-    assert(refs_ >= 0);
-    if (refs_ <= 0) {
+    int refs = --refs_;
+    assert(refs >= 0);
+    if (refs <= 0) {
       delete this;
     }
   }
@@ -47,36 +70,82 @@ class MemTable {
   // db/format.{h,cc} module.
   Iterator* NewIterator();
 
+  // Return an iterator over the range tombstones in the memtable, encoded
+  // as described in db/range_del.h, or NULL if there are none.  The same
+  // requirements as for NewIterator() apply.
+  Iterator* NewRangeTombstoneIterator();
+
   // Add an entry into memtable that maps key to value at the
   // specified sequence number and with the specified type.
   // Typically value will be empty if type==kTypeDeletion.
+  // If type==kTypeRangeDeletion, the entry is a tombstone for the user
+  // keys in [key, value).
+  // Unless concurrent_adds() is true, requires external synchronization
+  // with other Add() calls for keys in the same partition.
   void Add(SequenceNumber seq, ValueType type,
            const Slice& key,
            const Slice& value);
 
   // If memtable contains a value for key, store it in *value and return true.
-  // If memtable contains a deletion for key, store a NotFound() error
-  // in *status and return true.
+  // If memtable contains a deletion for key, or a range tombstone covering
+  // key newer than any value, store a NotFound() error in *status and
+  // return true.
   // Else, return false.
   bool Get(const LookupKey& key, std::string* value, Status* s);
 
+  // Like the above, but point *value at the value stored in the memtable,
+  // which remains valid for as long as the memtable is live.
+  bool Get(const LookupKey& key, Slice* value, Status* s);
+
+  int num_partitions() const { return static_cast<int>(partitions_.size()); }
+
+  bool concurrent_adds() const { return concurrent_adds_; }
+
+  const Comparator* user_comparator() const {
+    return comparator_.comparator.user_comparator();
+  }
+
+  // Returns the partition entries for user_key are stored in.
+  int PartitionOf(const Slice& user_key) const;
+
  private:
   ~MemTable();  // Private since only Unref() should be used to delete it
 
-  struct KeyComparator {
-    const InternalKeyComparator comparator;
-    explicit KeyComparator(const InternalKeyComparator& c) : comparator(c) { }
-    int operator()(const char* a, const char* b) const;
+  // Returns the largest sequence number at or below "snapshot" of a range
+  // tombstone covering user_key, or zero if there is none.
+  SequenceNumber MaxCoveringTombstone(const Slice& user_key,
+                                      SequenceNumber snapshot);
+
+  // Every partition allocates from its own arena, and has its own bloom
+  // filter, so that partitions can be written concurrently.
+  struct Partition {
+    Arena arena;
+    MemTableRep* rep;
+    DynamicBloom* bloom;  // NULL if the memtable has no filter
+    Partition(const MemTableKeyComparator& cmp, MemTableRepType type,
+              size_t hash_buckets, size_t bloom_bits)
+        : rep(NewMemTableRep(type, cmp, &arena, hash_buckets)),
+          bloom(bloom_bits > 0 ? new DynamicBloom(bloom_bits) : NULL) { }
+    ~Partition() {
+      delete rep;
+      delete bloom;
+    }
   };
-  friend class MemTableIterator;
-  friend class MemTableBackwardIterator;
 
-  typedef SkipList<const char*, KeyComparator> Table;
+  MemTableKeyComparator comparator_;
+  std::atomic<int> refs_;
+  std::vector<Partition*> partitions_;
+  const bool concurrent_adds_;
+
+  // Range tombstones, in a partition with no filter.
+  Partition* range_dels_;
+  std::atomic<int> num_range_dels_;
 
-  KeyComparator comparator_;
-  int refs_;
-  Arena arena_;
-  Table table_;
+  // Lookups search a fragmented copy of the tombstones, which is rebuilt
+  // when one finds that tombstones were added since it was built.
+  struct RangeDelCache;
+  port::Mutex range_del_mu_;
+  RangeDelCache* range_del_cache_;  // NULL until first needed
 
   // No copying allowed
   MemTable(const MemTable&);
@@ -0,0 +1,318 @@
+// Copyright (c) 2026 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/memtable_rep.h"
+
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <vector>
+#include "db/skiplist.h"
+#include "port/port.h"
+#include "util/arena.h"
+#include "util/coding.h"
+#include "util/hash.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+static Slice GetLengthPrefixedSlice(const char* data) {
+  uint32_t len;
+  const char* p = data;
+  p = GetVarint32Ptr(p, p + 5, &len);  // +5: we assume "p" is not corrupted
+  return Slice(p, len);
+}
+
+int MemTableKeyComparator::operator()(const char* aptr, const char* bptr)
+    const {
+  // Internal keys are encoded as length-prefixed strings.
+  Slice a = GetLengthPrefixedSlice(aptr);
+  Slice b = GetLengthPrefixedSlice(bptr);
+  return comparator.Compare(a, b);
+}
+
+bool MemTableKeyComparator::SameUserKey(const char* a, const char* b) const {
+  return comparator.user_comparator()->Compare(
+      ExtractUserKey(GetLengthPrefixedSlice(a)),
+      ExtractUserKey(GetLengthPrefixedSlice(b))) == 0;
+}
+
+MemTableRep::~MemTableRep() { }
+
+MemTableRep::Iterator::~Iterator() { }
+
+namespace {
+
+// The entries in a skiplist: O(log n) inserts and lookups, and
+// iteration in order at no extra cost.
+class SkipListRep : public MemTableRep {
+ public:
+  SkipListRep(const MemTableKeyComparator& cmp, Arena* arena)
+      : cmp_(cmp),
+        table_(cmp, arena) {
+  }
+
+  virtual void Insert(const char* entry) {
+    table_.Insert(entry);
+  }
+
+  virtual void InsertConcurrently(const char* entry) {
+    table_.InsertConcurrently(entry);
+  }
+
+  virtual const char* Get(const char* key) const {
+    Table::Iterator iter(&table_);
+    iter.Seek(key);
+    if (iter.Valid() && cmp_.SameUserKey(iter.key(), key)) {
+      return iter.key();
+    }
+    return NULL;
+  }
+
+  virtual size_t ApproximateMemoryUsage() const {
+    return 0;  // The nodes come from the arena
+  }
+
+  virtual MemTableRep::Iterator* NewIterator() {
+    return new Iterator(&table_);
+  }
+
+ private:
+  typedef SkipList<const char*, MemTableKeyComparator> Table;
+
+  class Iterator : public MemTableRep::Iterator {
+   public:
+    explicit Iterator(const Table* table) : iter_(table) { }
+    virtual bool Valid() const { return iter_.Valid(); }
+    virtual const char* key() const { return iter_.key(); }
+    virtual void Next() { iter_.Next(); }
+    virtual void Prev() { iter_.Prev(); }
+    virtual void Seek(const char* target) { iter_.Seek(target); }
+    virtual void SeekToFirst() { iter_.SeekToFirst(); }
+    virtual void SeekToLast() { iter_.SeekToLast(); }
+
+   private:
+    Table::Iterator iter_;
+  };
+
+  const MemTableKeyComparator cmp_;
+  Table table_;
+};
+
+// The entries hashed by user key into buckets, each a sorted linked
+// list.  With enough buckets for the lists to stay short, inserts and
+// lookups take O(1).
+//
+// Iterators need all entries in order: the first one sorts a snapshot of
+// the entries, which later iterators share until an entry is added.  An
+// immutable memtable is thus sorted once, when it is flushed, while
+// every iterator over a memtable that keeps changing sorts it anew.
+class HashRep : public MemTableRep {
+ public:
+  HashRep(const MemTableKeyComparator& cmp, Arena* arena, size_t buckets)
+      : cmp_(cmp),
+        arena_(arena),
+        num_buckets_(buckets < 1 ? 1 : buckets),
+        buckets_(new std::atomic<Node*>[num_buckets_]),
+        num_entries_(0),
+        view_(NULL) {
+    for (size_t i = 0; i < num_buckets_; i++) {
+      buckets_[i].store(NULL, std::memory_order_relaxed);
+    }
+  }
+
+  virtual ~HashRep() {
+    if (view_ != NULL) {
+      view_->Unref();
+    }
+    delete[] buckets_;
+  }
+
+  virtual void Insert(const char* entry) {
+    Insert(entry, false);
+  }
+
+  virtual void InsertConcurrently(const char* entry) {
+    Insert(entry, true);
+  }
+
+  virtual const char* Get(const char* key) const {
+    const Node* node = buckets_[BucketOf(key)].load(std::memory_order_acquire);
+    while (node != NULL && cmp_(node->entry, key) < 0) {
+      node = node->next.load(std::memory_order_acquire);
+    }
+    if (node != NULL && cmp_.SameUserKey(node->entry, key)) {
+      return node->entry;
+    }
+    return NULL;
+  }
+
+  virtual size_t ApproximateMemoryUsage() const {
+    size_t usage = num_buckets_ * sizeof(std::atomic<Node*>);
+    MutexLock l(&mu_);
+    if (view_ != NULL) {
+      usage += view_->entries.capacity() * sizeof(const char*);
+    }
+    return usage;
+  }
+
+  virtual MemTableRep::Iterator* NewIterator() {
+    return new Iterator(&cmp_, SortedEntries());
+  }
+
+ private:
+  struct Node {
+    std::atomic<Node*> next;
+    const char* entry;
+  };
+
+  // A sorted snapshot of the entries, shared by the iterators created
+  // while no entry was added.
+  struct SortedView {
+    std::atomic<int> refs;
+    size_t count;  // num_entries_ when the snapshot was taken
+    std::vector<const char*> entries;
+
+    void Unref() {
+      if (--refs == 0) {
+        delete this;
+      }
+    }
+  };
+
+  struct EntryLess {
+    const MemTableKeyComparator* cmp;
+    bool operator()(const char* a, const char* b) const {
+      return (*cmp)(a, b) < 0;
+    }
+  };
+
+  class Iterator : public MemTableRep::Iterator {
+   public:
+    Iterator(const MemTableKeyComparator* cmp, SortedView* view)
+        : view_(view),
+          pos_(view->entries.size()) {
+      less_.cmp = cmp;
+    }
+    virtual ~Iterator() { view_->Unref(); }
+
+    virtual bool Valid() const { return pos_ < view_->entries.size(); }
+    virtual const char* key() const { return view_->entries[pos_]; }
+    virtual void Next() { pos_++; }
+    virtual void Prev() {
+      pos_ = (pos_ == 0) ? view_->entries.size() : pos_ - 1;
+    }
+    virtual void Seek(const char* target) {
+      pos_ = std::lower_bound(view_->entries.begin(), view_->entries.end(),
+                              target, less_) - view_->entries.begin();
+    }
+    virtual void SeekToFirst() { pos_ = 0; }
+    virtual void SeekToLast() {
+      pos_ = view_->entries.empty() ? 0 : view_->entries.size() - 1;
+    }
+
+   private:
+    SortedView* const view_;
+    EntryLess less_;
+    size_t pos_;  // entries.size() if not valid
+  };
+
+  size_t BucketOf(const char* entry) const {
+    // Keys the comparator considers equal must share a bucket
+    const Slice key = cmp_.comparator.user_comparator()->KeyForHashing(
+        ExtractUserKey(GetLengthPrefixedSlice(entry)));
+    const uint32_t h = Hash(key.data(), key.size(), 0x9747b28c);
+    // Maps h to [0, num_buckets_) without a division
+    return static_cast<size_t>(
+        (static_cast<uint64_t>(h) * num_buckets_) >> 32);
+  }
+
+  void Insert(const char* entry, bool concurrent) {
+    char* mem = concurrent ? arena_->AllocateAlignedConcurrently(sizeof(Node))
+                           : arena_->AllocateAligned(sizeof(Node));
+    Node* node = new (mem) Node;
+    node->entry = entry;
+    std::atomic<Node*>* prev = &buckets_[BucketOf(entry)];
+    while (true) {
+      Node* next = prev->load(std::memory_order_acquire);
+      while (next != NULL && cmp_(next->entry, entry) < 0) {
+        prev = &next->next;
+        next = prev->load(std::memory_order_acquire);
+      }
+      node->next.store(next, std::memory_order_relaxed);
+      if (!concurrent) {
+        prev->store(node, std::memory_order_release);
+        break;
+      }
+      if (prev->compare_exchange_strong(next, node,
+                                        std::memory_order_release,
+                                        std::memory_order_relaxed)) {
+        break;
+      }
+      // Another node went in after prev: look for the position again
+      // from there, since nodes are never removed.
+    }
+    // Counted once linked, so a snapshot taken at this count has it
+    if (concurrent) {
+      num_entries_.fetch_add(1, std::memory_order_release);
+    } else {
+      num_entries_.store(num_entries_.load(std::memory_order_relaxed) + 1,
+                         std::memory_order_release);
+    }
+  }
+
+  // Returns a reference to a sorted snapshot holding at least every
+  // entry counted so far.
+  SortedView* SortedEntries() {
+    MutexLock l(&mu_);
+    const size_t count = num_entries_.load(std::memory_order_acquire);
+    if (view_ == NULL || view_->count != count) {
+      SortedView* view = new SortedView;
+      view->refs = 1;  // Held by view_
+      view->count = count;
+      view->entries.reserve(count);
+      for (size_t i = 0; i < num_buckets_; i++) {
+        const Node* node = buckets_[i].load(std::memory_order_acquire);
+        while (node != NULL) {
+          view->entries.push_back(node->entry);
+          node = node->next.load(std::memory_order_acquire);
+        }
+      }
+      EntryLess less;
+      less.cmp = &cmp_;
+      std::sort(view->entries.begin(), view->entries.end(), less);
+      if (view_ != NULL) {
+        view_->Unref();
+      }
+      view_ = view;
+    }
+    ++view_->refs;
+    return view_;
+  }
+
+  const MemTableKeyComparator cmp_;
+  Arena* const arena_;
+  const size_t num_buckets_;
+  std::atomic<Node*>* const buckets_;
+  std::atomic<size_t> num_entries_;
+
+  mutable port::Mutex mu_;
+  SortedView* view_;  // Latest snapshot, or NULL.  Guarded by mu_
+};
+
+}  // namespace
+
+MemTableRep* NewMemTableRep(MemTableRepType type,
+                            const MemTableKeyComparator& cmp,
+                            Arena* arena, size_t hash_buckets) {
+  switch (type) {
+    case kHashMemTable:
+      return new HashRep(cmp, arena, hash_buckets);
+    case kSkipListMemTable:
+    default:
+      return new SkipListRep(cmp, arena);
+  }
+}
+
+}  // namespace leveldb
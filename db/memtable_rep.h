@@ -0,0 +1,98 @@
+// Copyright (c) 2026 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// The data structure holding the entries of one memtable partition.
+//
+// An entry is a pointer to a memtable record, as encoded by
+// MemTable::Add():
+//    key_size     : varint32 of internal_key.size()
+//    key bytes    : char[internal_key.size()]
+//    value_size   : varint32 of value.size()
+//    value bytes  : char[value.size()]
+// Entries are ordered by their internal keys.  A lookup key is encoded
+// like the start of an entry (see LookupKey::memtable_key()).
+//
+// Insert() requires external synchronization with other inserts;
+// InsertConcurrently() may run concurrently with other calls to it.
+// Get() and iterators may run concurrently with either.
+
+#ifndef STORAGE_LEVELDB_DB_MEMTABLE_REP_H_
+#define STORAGE_LEVELDB_DB_MEMTABLE_REP_H_
+
+#include <stddef.h>
+#include "db/dbformat.h"
+#include "leveldb/options.h"
+
+namespace leveldb {
+
+class Arena;
+
+// Orders entries by their internal keys.
+struct MemTableKeyComparator {
+  const InternalKeyComparator comparator;
+  explicit MemTableKeyComparator(const InternalKeyComparator& c)
+      : comparator(c) { }
+  int operator()(const char* a, const char* b) const;
+
+  // Returns true if entries a and b have the same user key.
+  bool SameUserKey(const char* a, const char* b) const;
+};
+
+class MemTableRep {
+ public:
+  MemTableRep() { }
+  virtual ~MemTableRep();
+
+  // Add "entry", which must not compare equal to any entry present.
+  virtual void Insert(const char* entry) = 0;
+  virtual void InsertConcurrently(const char* entry) = 0;
+
+  // Returns the first entry at or after the lookup key "key" if it has
+  // the user key of "key", else NULL.
+  virtual const char* Get(const char* key) const = 0;
+
+  // Returns the memory used besides the entries and what the rep
+  // allocates from the arena.
+  virtual size_t ApproximateMemoryUsage() const = 0;
+
+  // Iteration over the entries in order.  Entries inserted after the
+  // iterator was created may or may not be seen.
+  class Iterator {
+   public:
+    Iterator() { }
+    virtual ~Iterator();
+    virtual bool Valid() const = 0;
+    virtual const char* key() const = 0;  // The current entry
+    virtual void Next() = 0;
+    virtual void Prev() = 0;
+    virtual void Seek(const char* target) = 0;  // A lookup key
+    virtual void SeekToFirst() = 0;
+    virtual void SeekToLast() = 0;
+
+   private:
+    // No copying allowed
+    Iterator(const Iterator&);
+    void operator=(const Iterator&);
+  };
+
+  // Returns a new iterator.  The rep must outlive it.
+  virtual Iterator* NewIterator() = 0;
+
+ private:
+  // No copying allowed
+  MemTableRep(const MemTableRep&);
+  void operator=(const MemTableRep&);
+};
+
+// Returns a new rep of the given type.  The rep allocates its per-entry
+// memory from "arena", concurrently for InsertConcurrently().  Both cmp
+// and arena must outlive it.  "hash_buckets" is the number of buckets
+// of kHashMemTable.
+extern MemTableRep* NewMemTableRep(MemTableRepType type,
+                                   const MemTableKeyComparator& cmp,
+                                   Arena* arena, size_t hash_buckets);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_MEMTABLE_REP_H_
@@ -0,0 +1,333 @@
+// Copyright (c) 2026 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/memtable_rep.h"
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+#include "leveldb/comparator.h"
+#include "leveldb/env.h"
+#include "port/port.h"
+#include "util/arena.h"
+#include "util/coding.h"
+#include "util/logging.h"
+#include "util/mutexlock.h"
+#include "util/random.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+static const MemTableRepType kRepTypes[] = {
+  kSkipListMemTable, kHashMemTable
+};
+
+// Returns the internal key of an entry.
+static Slice EntryKey(const char* entry) {
+  uint32_t len;
+  const char* p = GetVarint32Ptr(entry, entry + 5, &len);
+  return Slice(p, len);
+}
+
+class MemTableRepTest {
+ public:
+  InternalKeyComparator icmp_;
+  MemTableKeyComparator cmp_;
+
+  MemTableRepTest()
+      : icmp_(BytewiseComparator()),
+        cmp_(icmp_) {
+  }
+
+  // Returns an entry for user_key@seq, with an empty value, allocated
+  // from "arena".
+  static const char* NewEntry(Arena* arena, const std::string& user_key,
+                              SequenceNumber seq, bool concurrent = false) {
+    std::string buf;
+    PutVarint32(&buf, user_key.size() + 8);
+    buf.append(user_key);
+    PutFixed64(&buf, (seq << 8) | kTypeValue);
+    PutVarint32(&buf, 0);
+    char* entry = concurrent ? arena->AllocateConcurrently(buf.size())
+                             : arena->Allocate(buf.size());
+    memcpy(entry, buf.data(), buf.size());
+    return entry;
+  }
+
+  // Returns the sequence number of the entry Get() finds for user_key
+  // at "snapshot", or -1 if it finds none.
+  int64_t Lookup(MemTableRep* rep, const std::string& user_key,
+                 SequenceNumber snapshot) {
+    LookupKey lkey(user_key, snapshot);
+    const char* entry = rep->Get(lkey.memtable_key().data());
+    if (entry == NULL) {
+      return -1;
+    }
+    ParsedInternalKey ikey(Slice(), 0, kTypeValue);
+    ASSERT_TRUE(ParseInternalKey(EntryKey(entry), &ikey));
+    ASSERT_EQ(user_key, ikey.user_key.ToString());
+    return static_cast<int64_t>(ikey.sequence);
+  }
+};
+
+TEST(MemTableRepTest, Empty) {
+  for (size_t t = 0; t < sizeof(kRepTypes) / sizeof(kRepTypes[0]); t++) {
+    Arena arena;
+    MemTableRep* rep = NewMemTableRep(kRepTypes[t], cmp_, &arena, 16);
+    ASSERT_EQ(-1, Lookup(rep, "foo", kMaxSequenceNumber));
+
+    MemTableRep::Iterator* iter = rep->NewIterator();
+    ASSERT_TRUE(!iter->Valid());
+    iter->SeekToFirst();
+    ASSERT_TRUE(!iter->Valid());
+    LookupKey lkey("foo", kMaxSequenceNumber);
+    iter->Seek(lkey.memtable_key().data());
+    ASSERT_TRUE(!iter->Valid());
+    iter->SeekToLast();
+    ASSERT_TRUE(!iter->Valid());
+    delete iter;
+    delete rep;
+  }
+}
+
+TEST(MemTableRepTest, InsertAndLookup) {
+  const int N = 2000;
+  const int R = 300;
+  for (size_t t = 0; t < sizeof(kRepTypes) / sizeof(kRepTypes[0]); t++) {
+    Random rnd(301);
+    Arena arena;
+    // Few buckets, so that the lists of the hash rep hold many keys
+    MemTableRep* rep = NewMemTableRep(kRepTypes[t], cmp_, &arena, 16);
+    std::map<std::string, std::vector<SequenceNumber> > model;
+    std::vector<const char*> entries;
+    for (int i = 0; i < N; i++) {
+      const std::string key = NumberToString(rnd.Uniform(R));
+      const SequenceNumber seq = 100 + rnd.Uniform(1000) * N + i;
+      const char* entry = NewEntry(&arena, key, seq);
+      rep->Insert(entry);
+      entries.push_back(entry);
+      model[key].push_back(seq);
+    }
+
+    // Get() finds the newest entry at or below a snapshot
+    for (int i = 0; i < R; i++) {
+      const std::string key = NumberToString(i);
+      std::vector<SequenceNumber>& seqs = model[key];
+      std::sort(seqs.begin(), seqs.end());
+      ASSERT_EQ(-1, Lookup(rep, key, 99));
+      for (size_t j = 0; j < seqs.size(); j++) {
+        const int64_t seq = static_cast<int64_t>(seqs[j]);
+        ASSERT_EQ(seq, Lookup(rep, key, seqs[j]));
+        if (j + 1 < seqs.size()) {
+          ASSERT_EQ(seq, Lookup(rep, key, seqs[j + 1] - 1));
+        } else {
+          ASSERT_EQ(seq, Lookup(rep, key, kMaxSequenceNumber));
+        }
+      }
+    }
+
+    // Iteration visits the entries in order, both ways
+    struct Less {
+      const MemTableKeyComparator* cmp;
+      bool operator()(const char* a, const char* b) const {
+        return (*cmp)(a, b) < 0;
+      }
+    } less = { &cmp_ };
+    std::sort(entries.begin(), entries.end(), less);
+    MemTableRep::Iterator* iter = rep->NewIterator();
+    iter->SeekToFirst();
+    for (size_t i = 0; i < entries.size(); i++) {
+      ASSERT_TRUE(iter->Valid());
+      ASSERT_EQ(entries[i], iter->key());
+      iter->Next();
+    }
+    ASSERT_TRUE(!iter->Valid());
+    iter->SeekToLast();
+    for (size_t i = entries.size(); i > 0; i--) {
+      ASSERT_TRUE(iter->Valid());
+      ASSERT_EQ(entries[i - 1], iter->key());
+      iter->Prev();
+    }
+    ASSERT_TRUE(!iter->Valid());
+
+    // Seek() lands on the first entry at or after the target
+    for (int i = 0; i < R; i++) {
+      LookupKey lkey(NumberToString(i), kMaxSequenceNumber);
+      const char* target = lkey.memtable_key().data();
+      iter->Seek(target);
+      std::vector<const char*>::iterator pos =
+          std::lower_bound(entries.begin(), entries.end(), target, less);
+      if (pos == entries.end()) {
+        ASSERT_TRUE(!iter->Valid());
+      } else {
+        ASSERT_TRUE(iter->Valid());
+        ASSERT_EQ(*pos, iter->key());
+      }
+    }
+    delete iter;
+    delete rep;
+  }
+}
+
+TEST(MemTableRepTest, IteratorSnapshots) {
+  // Iterators of the hash rep share a sorted snapshot until an entry is
+  // added; each must keep seeing its own.
+  Arena arena;
+  MemTableRep* rep = NewMemTableRep(kHashMemTable, cmp_, &arena, 4);
+  rep->Insert(NewEntry(&arena, "b", 1));
+  MemTableRep::Iterator* first = rep->NewIterator();
+  MemTableRep::Iterator* same = rep->NewIterator();
+  rep->Insert(NewEntry(&arena, "a", 2));
+  MemTableRep::Iterator* second = rep->NewIterator();
+
+  int counts[3] = { 0, 0, 0 };
+  MemTableRep::Iterator* iters[3] = { first, same, second };
+  for (int i = 0; i < 3; i++) {
+    for (iters[i]->SeekToFirst(); iters[i]->Valid(); iters[i]->Next()) {
+      counts[i]++;
+    }
+    delete iters[i];
+  }
+  ASSERT_EQ(1, counts[0]);
+  ASSERT_EQ(1, counts[1]);
+  ASSERT_EQ(2, counts[2]);
+  delete rep;
+}
+
+namespace {
+
+// Orders keys by the part before any '#', so that keys with different
+// bytes may be equal.
+class PrefixComparator : public Comparator {
+ public:
+  virtual const char* Name() const { return "test.PrefixComparator"; }
+  virtual int Compare(const Slice& a, const Slice& b) const {
+    return BytewiseComparator()->Compare(Prefix(a), Prefix(b));
+  }
+  virtual void FindShortestSeparator(std::string* start,
+                                     const Slice& limit) const { }
+  virtual void FindShortSuccessor(std::string* key) const { }
+  virtual Slice KeyForHashing(const Slice& key) const { return Prefix(key); }
+
+ private:
+  static Slice Prefix(const Slice& key) {
+    const char* p = static_cast<const char*>(
+        memchr(key.data(), '#', key.size()));
+    return p == NULL ? key : Slice(key.data(), p - key.data());
+  }
+};
+
+}  // namespace
+
+TEST(MemTableRepTest, EqualKeysWithDifferentBytes) {
+  PrefixComparator ucmp;
+  InternalKeyComparator icmp(&ucmp);
+  MemTableKeyComparator cmp(icmp);
+  for (size_t t = 0; t < sizeof(kRepTypes) / sizeof(kRepTypes[0]); t++) {
+    Arena arena;
+    MemTableRep* rep = NewMemTableRep(kRepTypes[t], cmp, &arena, 1024);
+    for (int i = 0; i < 100; i++) {
+      rep->Insert(NewEntry(&arena, NumberToString(i) + "#" +
+                           NumberToString(i * 7), 10 + i));
+    }
+    for (int i = 0; i < 100; i++) {
+      LookupKey lkey(NumberToString(i) + "#lookup", kMaxSequenceNumber);
+      const char* entry = rep->Get(lkey.memtable_key().data());
+      ASSERT_TRUE(entry != NULL);
+      ParsedInternalKey ikey(Slice(), 0, kTypeValue);
+      ASSERT_TRUE(ParseInternalKey(EntryKey(entry), &ikey));
+      ASSERT_EQ(10 + i, ikey.sequence);
+    }
+    delete rep;
+  }
+}
+
+TEST(MemTableRepTest, SortedViewMemoryUsage) {
+  Arena arena;
+  MemTableRep* rep = NewMemTableRep(kHashMemTable, cmp_, &arena, 16);
+  for (int i = 0; i < 1000; i++) {
+    rep->Insert(NewEntry(&arena, NumberToString(i), i + 1));
+  }
+  const size_t before = rep->ApproximateMemoryUsage();
+  delete rep->NewIterator();
+  ASSERT_GE(rep->ApproximateMemoryUsage(),
+            before + 1000 * sizeof(const char*));
+  delete rep;
+}
+
+namespace {
+
+static const int kNumThreads = 4;
+static const int kKeysPerThread = 5000;
+
+struct ConcurrentState {
+  MemTableRep* rep;
+  Arena* arena;
+  port::Mutex mu;
+  port::CondVar cv;
+  int next_id;
+  int done;
+  ConcurrentState() : cv(&mu), next_id(0), done(0) { }
+};
+
+static void InsertKeys(void* arg) {
+  ConcurrentState* state = reinterpret_cast<ConcurrentState*>(arg);
+  int id;
+  {
+    MutexLock l(&state->mu);
+    id = state->next_id++;
+  }
+  // Threads insert interleaved keys, so they race for the same lists
+  for (int i = id; i < kNumThreads * kKeysPerThread; i += kNumThreads) {
+    state->rep->InsertConcurrently(MemTableRepTest::NewEntry(
+        state->arena, NumberToString(i % 1000), i + 1, true));
+  }
+  MutexLock l(&state->mu);
+  state->done++;
+  state->cv.SignalAll();
+}
+
+}  // namespace
+
+TEST(MemTableRepTest, ConcurrentInsert) {
+  for (size_t t = 0; t < sizeof(kRepTypes) / sizeof(kRepTypes[0]); t++) {
+    Arena arena;
+    ConcurrentState state;
+    state.arena = &arena;
+    state.rep = NewMemTableRep(kRepTypes[t], cmp_, &arena, 64);
+    for (int i = 0; i < kNumThreads; i++) {
+      Env::Default()->StartThread(&InsertKeys, &state);
+    }
+    {
+      MutexLock l(&state.mu);
+      while (state.done < kNumThreads) {
+        state.cv.Wait();
+      }
+    }
+
+    for (int i = 0; i < kNumThreads * kKeysPerThread; i++) {
+      ASSERT_EQ(i + 1, Lookup(state.rep, NumberToString(i % 1000), i + 1));
+    }
+    MemTableRep::Iterator* iter = state.rep->NewIterator();
+    int count = 0;
+    const char* last = NULL;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      if (last != NULL) {
+        ASSERT_LT(cmp_(last, iter->key()), 0);
+      }
+      last = iter->key();
+      count++;
+    }
+    ASSERT_EQ(kNumThreads * kKeysPerThread, count);
+    delete iter;
+    delete state.rep;
+  }
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
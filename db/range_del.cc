@@ -0,0 +1,218 @@
+// Copyright (c) 2026 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/range_del.h"
+
+#include <algorithm>
+#include <functional>
+#include "leveldb/comparator.h"
+#include "leveldb/iterator.h"
+#include "leveldb/table_builder.h"
+
+namespace leveldb {
+
+void ExtendRangeTombstoneBounds(const Comparator* icmp,
+                                const Slice& begin, const Slice& end,
+                                InternalKey* smallest, InternalKey* largest) {
+  const InternalKey start_key(begin, kMaxSequenceNumber, kValueTypeForSeek);
+  // kTypeRangeDeletion is above kValueTypeForSeek, so this sorts before
+  // the start key of a tombstone that begins at "end" as well
+  const InternalKey end_key(end, kMaxSequenceNumber, kTypeRangeDeletion);
+  if (smallest->empty() ||
+      icmp->Compare(start_key.Encode(), smallest->Encode()) < 0) {
+    *smallest = start_key;
+  }
+  if (largest->empty() ||
+      icmp->Compare(end_key.Encode(), largest->Encode()) > 0) {
+    *largest = end_key;
+  }
+}
+
+namespace {
+struct UserKeyLess {
+  const Comparator* ucmp;
+  bool operator()(const std::string& a, const std::string& b) const {
+    return ucmp->Compare(a, b) < 0;
+  }
+};
+
+struct UserKeyEqual {
+  const Comparator* ucmp;
+  bool operator()(const std::string& a, const std::string& b) const {
+    return ucmp->Compare(a, b) == 0;
+  }
+};
+}  // namespace
+
+RangeDelMap::RangeDelMap(const Comparator* user_comparator)
+    : ucmp_(user_comparator),
+      icmp_(user_comparator),
+      finished_(false) {
+}
+
+void RangeDelMap::Add(const Slice& begin, const Slice& end,
+                      SequenceNumber seq) {
+  assert(!finished_);
+  if (ucmp_->Compare(begin, end) >= 0) {
+    return;
+  }
+  Tombstone t;
+  t.begin = begin.ToString();
+  t.end = end.ToString();
+  t.seq = seq;
+  tombstones_.push_back(t);
+}
+
+Status RangeDelMap::AddTombstones(Iterator* iter) {
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ParsedInternalKey ikey;
+    if (!ParseInternalKey(iter->key(), &ikey) ||
+        ikey.type != kTypeRangeDeletion) {
+      return Status::Corruption("corrupted range tombstone");
+    }
+    Add(ikey.user_key, iter->value(), ikey.sequence);
+  }
+  return iter->status();
+}
+
+void RangeDelMap::AddTombstones(const RangeDelMap& other) {
+  assert(other.finished_);
+  for (size_t i = 0; i < other.fragments_.size(); i++) {
+    const Fragment& f = other.fragments_[i];
+    for (size_t j = 0; j < f.seqs.size(); j++) {
+      Add(f.begin, f.end, f.seqs[j]);
+    }
+  }
+}
+
+void RangeDelMap::Finish() {
+  assert(!finished_);
+  finished_ = true;
+  if (tombstones_.empty()) {
+    return;
+  }
+
+  // Cut the key space at every begin and end key.  Tombstone i then
+  // covers the pieces [bounds[j], bounds[j+1]) for j in [first, last).
+  std::vector<std::string> bounds;
+  bounds.reserve(2 * tombstones_.size());
+  for (size_t i = 0; i < tombstones_.size(); i++) {
+    bounds.push_back(tombstones_[i].begin);
+    bounds.push_back(tombstones_[i].end);
+  }
+  UserKeyLess less = { ucmp_ };
+  UserKeyEqual equal = { ucmp_ };
+  std::sort(bounds.begin(), bounds.end(), less);
+  bounds.erase(std::unique(bounds.begin(), bounds.end(), equal),
+               bounds.end());
+  std::vector<std::vector<SequenceNumber> > pieces(bounds.size() - 1);
+  for (size_t i = 0; i < tombstones_.size(); i++) {
+    const Tombstone& t = tombstones_[i];
+    const size_t first = std::lower_bound(bounds.begin(), bounds.end(),
+                                          t.begin, less) - bounds.begin();
+    const size_t last = std::lower_bound(bounds.begin(), bounds.end(),
+                                         t.end, less) - bounds.begin();
+    for (size_t j = first; j < last; j++) {
+      pieces[j].push_back(t.seq);
+    }
+  }
+  tombstones_.clear();
+
+  // Merge adjacent pieces covered by the same tombstones
+  for (size_t j = 0; j < pieces.size(); j++) {
+    std::vector<SequenceNumber>& seqs = pieces[j];
+    if (seqs.empty()) {
+      continue;
+    }
+    std::sort(seqs.begin(), seqs.end(), std::greater<SequenceNumber>());
+    seqs.erase(std::unique(seqs.begin(), seqs.end()), seqs.end());
+    if (!fragments_.empty() && fragments_.back().seqs == seqs &&
+        fragments_.back().end == bounds[j]) {
+      fragments_.back().end = bounds[j + 1];
+    } else {
+      Fragment f;
+      f.begin = bounds[j];
+      f.end = bounds[j + 1];
+      f.seqs.swap(seqs);
+      fragments_.push_back(f);
+    }
+  }
+}
+
+SequenceNumber RangeDelMap::MaxCoveringSeq(const Slice& user_key,
+                                           SequenceNumber snapshot) const {
+  assert(finished_);
+  // Find the last fragment that begins at or before user_key
+  size_t left = 0;
+  size_t right = fragments_.size();
+  while (left < right) {
+    const size_t mid = (left + right) / 2;
+    if (ucmp_->Compare(fragments_[mid].begin, user_key) <= 0) {
+      left = mid + 1;
+    } else {
+      right = mid;
+    }
+  }
+  if (left == 0) {
+    return 0;
+  }
+  const Fragment& f = fragments_[left - 1];
+  if (ucmp_->Compare(user_key, f.end) >= 0) {
+    return 0;
+  }
+  for (size_t i = 0; i < f.seqs.size(); i++) {
+    if (f.seqs[i] <= snapshot) {
+      return f.seqs[i];
+    }
+  }
+  return 0;
+}
+
+bool RangeDelMap::Clip(const Fragment& f,
+                       const Slice* lower, const Slice* upper,
+                       Slice* begin, Slice* end) const {
+  *begin = f.begin;
+  *end = f.end;
+  if (lower != NULL && ucmp_->Compare(*begin, *lower) < 0) {
+    *begin = *lower;
+  }
+  if (upper != NULL && ucmp_->Compare(*upper, *end) < 0) {
+    *end = *upper;
+  }
+  return ucmp_->Compare(*begin, *end) < 0;
+}
+
+int RangeDelMap::AddTo(TableBuilder* builder,
+                       const Slice* lower, const Slice* upper,
+                       InternalKey* smallest, InternalKey* largest) const {
+  assert(finished_);
+  int added = 0;
+  for (size_t i = 0; i < fragments_.size(); i++) {
+    const Fragment& f = fragments_[i];
+    Slice begin, end;
+    if (!Clip(f, lower, upper, &begin, &end)) {
+      continue;
+    }
+    for (size_t j = 0; j < f.seqs.size(); j++) {
+      InternalKey key(begin, f.seqs[j], kTypeRangeDeletion);
+      builder->AddRangeTombstone(key.Encode(), end);
+    }
+    added += f.seqs.size();
+    ExtendRangeTombstoneBounds(&icmp_, begin, end, smallest, largest);
+  }
+  return added;
+}
+
+bool RangeDelMap::Overlaps(const Slice* lower, const Slice* upper) const {
+  assert(finished_);
+  Slice begin, end;
+  for (size_t i = 0; i < fragments_.size(); i++) {
+    if (Clip(fragments_[i], lower, upper, &begin, &end)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace leveldb
@@ -0,0 +1,116 @@
+// Copyright (c) 2026 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A range tombstone, written by DB::DeleteRange(), deletes every entry
+// with a smaller sequence number whose user key is in [begin, end).
+// Tombstones are kept apart from the other entries: in a list of their
+// own in memtables, and in the "rangedel" meta block in tables.  Either
+// way they are stored as entries
+//    key:   internal key (begin, sequence, kTypeRangeDeletion)
+//    value: end
+// in internal key order.
+
+#ifndef STORAGE_LEVELDB_DB_RANGE_DEL_H_
+#define STORAGE_LEVELDB_DB_RANGE_DEL_H_
+
+#include <string>
+#include <vector>
+#include "db/dbformat.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class Iterator;
+class TableBuilder;
+
+// Extend [*smallest, *largest] (either may be empty) to span the
+// internal keys that a table holding the tombstone [begin, end) must
+// cover.  The largest of these sorts before every key of user key "end",
+// including seek keys, so that a table whose tombstones end where the
+// next table of its level begins does not overlap that table.  "icmp"
+// compares internal keys.
+extern void ExtendRangeTombstoneBounds(const Comparator* icmp,
+                                       const Slice& begin, const Slice& end,
+                                       InternalKey* smallest,
+                                       InternalKey* largest);
+
+// A set of range tombstones, split into non-overlapping fragments that
+// each list the sequence numbers of the tombstones covering them, so
+// that a lookup is a binary search.
+//
+// A map is filled by Add() calls and then frozen by Finish(), after
+// which it is immutable and may be shared between threads.
+class RangeDelMap {
+ public:
+  explicit RangeDelMap(const Comparator* user_comparator);
+
+  // Add the tombstone [begin, end) at "seq".  Empty ranges are ignored.
+  // REQUIRES: Finish() has not been called
+  void Add(const Slice& begin, const Slice& end, SequenceNumber seq);
+
+  // Add the tombstones yielded by "iter", which are encoded as described
+  // at the top of this file.  Does not take ownership of "iter".
+  // REQUIRES: Finish() has not been called
+  Status AddTombstones(Iterator* iter);
+
+  // Add the tombstones of the frozen map "other".
+  // REQUIRES: Finish() has not been called
+  void AddTombstones(const RangeDelMap& other);
+
+  void Finish();
+
+  bool empty() const { return fragments_.empty(); }
+
+  // Returns the largest sequence number at or below "snapshot" of a
+  // tombstone covering "user_key", or zero if there is none.
+  SequenceNumber MaxCoveringSeq(const Slice& user_key,
+                                SequenceNumber snapshot) const;
+
+  // A range [begin, end) covered by the same tombstones, whose sequence
+  // numbers are in "seqs" in decreasing order.
+  struct Fragment {
+    std::string begin;
+    std::string end;
+    std::vector<SequenceNumber> seqs;
+  };
+
+  // The fragments in order.  Ranges covered by no tombstone have none.
+  const std::vector<Fragment>& fragments() const { return fragments_; }
+
+  // Add to "builder" the tombstones of the fragments, clipped to the
+  // range [*lower, *upper), where a NULL bound is unbounded, and extend
+  // [*smallest, *largest] (either may be empty) to cover them.  Returns
+  // the number of tombstones added.
+  int AddTo(TableBuilder* builder, const Slice* lower, const Slice* upper,
+            InternalKey* smallest, InternalKey* largest) const;
+
+  // Returns true iff AddTo() would add some tombstone with these bounds.
+  bool Overlaps(const Slice* lower, const Slice* upper) const;
+
+ private:
+  struct Tombstone {
+    std::string begin;
+    std::string end;
+    SequenceNumber seq;
+  };
+
+  const Comparator* const ucmp_;
+  const InternalKeyComparator icmp_;
+  std::vector<Tombstone> tombstones_;  // Added but not yet fragmented
+  std::vector<Fragment> fragments_;
+  bool finished_;
+
+  // Stores in [*begin, *end) the range of "f" clipped to [*lower, *upper)
+  // and returns true iff it is not empty.
+  bool Clip(const Fragment& f, const Slice* lower, const Slice* upper,
+            Slice* begin, Slice* end) const;
+
+  // No copying allowed
+  RangeDelMap(const RangeDelMap&);
+  void operator=(const RangeDelMap&);
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_RANGE_DEL_H_
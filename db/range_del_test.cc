@@ -0,0 +1,135 @@
+// Copyright (c) 2026 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/range_del.h"
+
+#include <string>
+#include "leveldb/comparator.h"
+#include "leveldb/env.h"
+#include "leveldb/options.h"
+#include "leveldb/table_builder.h"
+#include "util/logging.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+namespace {
+// Discards what is written to it.
+class NullFile : public WritableFile {
+ public:
+  virtual Status Append(const Slice& data) { return Status::OK(); }
+  virtual Status Close() { return Status::OK(); }
+  virtual Status Flush() { return Status::OK(); }
+  virtual Status Sync() { return Status::OK(); }
+};
+}  // namespace
+
+class RangeDelTest {
+ public:
+  // Returns the fragments of "map" as "[begin,end)@seq,seq..." strings.
+  static std::string Fragments(const RangeDelMap& map) {
+    std::string result;
+    for (size_t i = 0; i < map.fragments().size(); i++) {
+      const RangeDelMap::Fragment& f = map.fragments()[i];
+      result += "[" + f.begin + "," + f.end + ")@";
+      for (size_t j = 0; j < f.seqs.size(); j++) {
+        if (j > 0) result += ",";
+        result += NumberToString(f.seqs[j]);
+      }
+      result += " ";
+    }
+    return result;
+  }
+};
+
+TEST(RangeDelTest, Empty) {
+  RangeDelMap map(BytewiseComparator());
+  map.Finish();
+  ASSERT_TRUE(map.empty());
+  ASSERT_EQ(0, map.MaxCoveringSeq("a", kMaxSequenceNumber));
+  ASSERT_TRUE(!map.Overlaps(NULL, NULL));
+}
+
+TEST(RangeDelTest, Fragments) {
+  RangeDelMap map(BytewiseComparator());
+  map.Add("a", "e", 5);
+  map.Add("c", "g", 10);
+  map.Add("x", "x", 20);   // Empty
+  map.Add("z", "y", 20);   // Empty
+  map.Add("g", "h", 10);   // Continues [e,g)@10
+  map.Finish();
+  ASSERT_TRUE(!map.empty());
+  ASSERT_EQ("[a,c)@5 [c,e)@10,5 [e,h)@10 ", Fragments(map));
+
+  ASSERT_EQ(0, map.MaxCoveringSeq("0", kMaxSequenceNumber));
+  ASSERT_EQ(5, map.MaxCoveringSeq("a", kMaxSequenceNumber));
+  ASSERT_EQ(5, map.MaxCoveringSeq("b", kMaxSequenceNumber));
+  ASSERT_EQ(10, map.MaxCoveringSeq("c", kMaxSequenceNumber));
+  ASSERT_EQ(10, map.MaxCoveringSeq("d", 10));
+  ASSERT_EQ(5, map.MaxCoveringSeq("d", 9));
+  ASSERT_EQ(0, map.MaxCoveringSeq("d", 4));
+  ASSERT_EQ(10, map.MaxCoveringSeq("gg", kMaxSequenceNumber));
+  ASSERT_EQ(0, map.MaxCoveringSeq("h", kMaxSequenceNumber));
+  ASSERT_EQ(0, map.MaxCoveringSeq("x", kMaxSequenceNumber));
+}
+
+TEST(RangeDelTest, AddMap) {
+  RangeDelMap first(BytewiseComparator());
+  first.Add("a", "c", 3);
+  first.Add("b", "d", 4);
+  first.Finish();
+  RangeDelMap map(BytewiseComparator());
+  map.AddTombstones(first);
+  map.Add("b", "c", 4);   // Duplicate
+  map.Add("c", "e", 7);
+  map.Finish();
+  ASSERT_EQ("[a,b)@3 [b,c)@4,3 [c,d)@7,4 [d,e)@7 ", Fragments(map));
+}
+
+TEST(RangeDelTest, AddTo) {
+  RangeDelMap map(BytewiseComparator());
+  map.Add("a", "e", 5);
+  map.Add("c", "g", 10);
+  map.Finish();
+
+  InternalKeyComparator icmp(BytewiseComparator());
+  Options options;
+  options.comparator = &icmp;
+  NullFile file;
+  TableBuilder builder(options, &file);
+  InternalKey smallest, largest;
+  Slice lower("b");
+  Slice upper("f");
+  ASSERT_EQ(4, map.AddTo(&builder, &lower, &upper, &smallest, &largest));
+  ASSERT_EQ(0, icmp.Compare(smallest,
+                            InternalKey("b", kMaxSequenceNumber,
+                                        kValueTypeForSeek)));
+  ASSERT_EQ(0, icmp.Compare(largest,
+                            InternalKey("f", kMaxSequenceNumber,
+                                        kTypeRangeDeletion)));
+  // The end of the range sorts before any key of the next table
+  ASSERT_LT(icmp.Compare(largest,
+                         InternalKey("f", kMaxSequenceNumber,
+                                     kValueTypeForSeek)), 0);
+
+  // Bounds are only widened
+  Slice far_lower("f");
+  ASSERT_EQ(1, map.AddTo(&builder, &far_lower, NULL, &smallest, &largest));
+  ASSERT_EQ("b", smallest.user_key().ToString());
+  ASSERT_EQ("g", largest.user_key().ToString());
+  ASSERT_OK(builder.Finish());
+
+  ASSERT_TRUE(map.Overlaps(NULL, NULL));
+  ASSERT_TRUE(map.Overlaps(&far_lower, NULL));
+  Slice g("g");
+  ASSERT_TRUE(!map.Overlaps(&g, NULL));
+  Slice a("a");
+  ASSERT_TRUE(!map.Overlaps(NULL, &a));
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
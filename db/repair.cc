@@ -31,6 +31,7 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/range_del.h"
 #include "db/table_cache.h"
 #include "db/version_edit.h"
 #include "db/write_batch_internal.h"
@@ -48,8 +49,8 @@ class Repairer {
       : dbname_(dbname),
         env_(options.env),
         icmp_(options.comparator),
-        ipolicy_(options.filter_policy),
-        options_(SanitizeOptions(dbname, &icmp_, &ipolicy_, options)),
+        ipolicies_(options),
+        options_(SanitizeOptions(dbname, &icmp_, &ipolicies_, options)),
         owns_info_log_(options_.info_log != options.info_log),
         owns_cache_(options_.block_cache != options.block_cache),
         next_file_number_(1) {
@@ -100,7 +101,7 @@ class Repairer {
   std::string const dbname_;
   Env* const env_;
   InternalKeyComparator const icmp_;
-  InternalFilterPolicy const ipolicy_;
+  InternalFilterPolicies const ipolicies_;
   Options const options_;
   bool owns_info_log_;
   bool owns_cache_;
@@ -224,8 +225,11 @@ class Repairer {
     FileMetaData meta;
     meta.number = next_file_number_++;
     Iterator* iter = mem->NewIterator();
-    status = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+    Iterator* range_del_iter = mem->NewRangeTombstoneIterator();
+    status = BuildTable(dbname_, env_, OptionsForLevel(options_, 0),
+                        table_cache_, iter, range_del_iter, &meta);
     delete iter;
+    delete range_del_iter;
     mem->Unref();
     mem = NULL;
     if (status.ok()) {
@@ -252,7 +256,8 @@ class Repairer {
     // on checksum verification.
     ReadOptions r;
     r.verify_checksums = options_.paranoid_checks;
-    return table_cache_->NewIterator(r, meta.number, meta.file_size);
+    return table_cache_->NewIterator(r, meta.number, meta.file_size,
+                                     meta.global_seqno);
   }
 
   void ScanTable(uint64_t number) {
@@ -306,6 +311,24 @@ class Repairer {
       status = iter->status();
     }
     delete iter;
+
+    // The range tombstones widen the key range of the table
+    RangeDelMap range_dels(icmp_.user_comparator());
+    if (status.ok()) {
+      status = table_cache_->AddRangeTombstones(t.meta.number,
+                                                t.meta.file_size,
+                                                &range_dels);
+    }
+    range_dels.Finish();
+    t.meta.has_range_dels = !range_dels.empty();
+    for (size_t i = 0; i < range_dels.fragments().size(); i++) {
+      const RangeDelMap::Fragment& f = range_dels.fragments()[i];
+      ExtendRangeTombstoneBounds(&icmp_, f.begin, f.end,
+                                 &t.meta.smallest, &t.meta.largest);
+      if (f.seqs[0] > t.max_sequence) {
+        t.max_sequence = f.seqs[0];
+      }
+    }
     Log(options_.info_log, "Table #%llu: %d entries %s",
         (unsigned long long) t.meta.number,
         counter,
@@ -329,7 +352,11 @@ class Repairer {
     if (!s.ok()) {
       return;
     }
-    TableBuilder* builder = new TableBuilder(options_, file);
+    // Repaired tables are all placed in level-0.  Only the entries are
+    // copied, not the range tombstones.
+    t.meta.has_range_dels = false;
+    TableBuilder* builder = new TableBuilder(OptionsForLevel(options_, 0),
+                                             file);
 
     // Copy data.
     Iterator* iter = NewTableIterator(t.meta);
@@ -396,7 +423,7 @@ class Repairer {
       // TODO(opt): separate out into multiple levels
       const TableInfo& t = tables_[i];
       edit_.AddFile(0, t.meta.number, t.meta.file_size,
-                    t.meta.smallest, t.meta.largest);
+                    t.meta.smallest, t.meta.largest, t.meta.has_range_dels);
     }
 
     //fprintf(stderr, "NewDescriptor:\n%s\n", edit_.DebugString().c_str());
@@ -7,6 +7,7 @@
 #include "leveldb/env.h"
 #include "util/arena.h"
 #include "util/hash.h"
+#include "util/mutexlock.h"
 #include "util/random.h"
 #include "util/testharness.h"
 
@@ -195,7 +196,7 @@ class ConcurrentTest {
     }
 
     State() {
-      for (int k = 0; k < K; k++) {
+      for (uint32_t k = 0; k < K; k++) {
         Set(k, 0);
       }
     }
@@ -225,7 +226,7 @@ class ConcurrentTest {
   void ReadStep(Random* rnd) {
     // Remember the initial committed state of the skiplist.
     State initial_state;
-    for (int k = 0; k < K; k++) {
+    for (uint32_t k = 0; k < K; k++) {
       initial_state.Set(k, current_.Get(k));
     }
 
@@ -371,6 +372,119 @@ TEST(SkipTest, Concurrent3) { RunConcurrent(3); }
 TEST(SkipTest, Concurrent4) { RunConcurrent(4); }
 TEST(SkipTest, Concurrent5) { RunConcurrent(5); }
 
+// Several threads insert disjoint sets of keys with InsertConcurrently()
+// while a reader keeps checking that the list stays sorted.
+class MultiWriterState {
+ public:
+  static const int kWriters = 4;
+  static const int kKeysPerWriter = 20000;
+
+  Arena arena_;
+  SkipList<Key, Comparator> list_;
+  port::AtomicPointer quit_flag_;
+  port::Mutex mu_;
+  port::CondVar cv_;
+  int running_;
+  bool reader_ok_;
+
+  MultiWriterState()
+      : list_(Comparator(), &arena_),
+        quit_flag_(NULL),
+        cv_(&mu_),
+        running_(0),
+        reader_ok_(true) { }
+
+  void Done() {
+    MutexLock l(&mu_);
+    running_--;
+    cv_.SignalAll();
+  }
+};
+
+struct MultiWriterArg {
+  MultiWriterState* state;
+  int id;
+};
+
+static void MultiWriter(void* arg) {
+  MultiWriterArg* a = reinterpret_cast<MultiWriterArg*>(arg);
+  // Writer "id" owns the keys congruent to id mod kWriters and inserts
+  // them in a scrambled order.
+  const int n = MultiWriterState::kKeysPerWriter;
+  for (int i = 0; i < n; i++) {
+    Key k = static_cast<Key>(((i * 7919) % n)) * MultiWriterState::kWriters +
+            a->id;
+    a->state->list_.InsertConcurrently(k);
+  }
+  a->state->Done();
+}
+
+static void MultiWriterReader(void* arg) {
+  MultiWriterState* state = reinterpret_cast<MultiWriterState*>(arg);
+  bool ok = true;
+  while (ok && !state->quit_flag_.Acquire_Load()) {
+    SkipList<Key, Comparator>::Iterator iter(&state->list_);
+    bool first = true;
+    Key last = 0;
+    for (iter.SeekToFirst(); iter.Valid(); iter.Next()) {
+      if (!first && iter.key() <= last) {
+        ok = false;
+        break;
+      }
+      first = false;
+      last = iter.key();
+    }
+  }
+  MutexLock l(&state->mu_);
+  state->reader_ok_ = ok;
+  state->running_--;
+  state->cv_.SignalAll();
+}
+
+TEST(SkipTest, ConcurrentWriters) {
+  MultiWriterState state;
+  MultiWriterArg args[MultiWriterState::kWriters];
+  state.running_ = MultiWriterState::kWriters + 1;
+  Env::Default()->StartThread(MultiWriterReader, &state);
+  for (int id = 0; id < MultiWriterState::kWriters; id++) {
+    args[id].state = &state;
+    args[id].id = id;
+    Env::Default()->StartThread(MultiWriter, &args[id]);
+  }
+  {
+    MutexLock l(&state.mu_);
+    while (state.running_ > 1) {
+      state.cv_.Wait();
+    }
+  }
+  state.quit_flag_.Release_Store(&state);
+  {
+    MutexLock l(&state.mu_);
+    while (state.running_ > 0) {
+      state.cv_.Wait();
+    }
+  }
+  ASSERT_TRUE(state.reader_ok_);
+
+  const Key total = static_cast<Key>(MultiWriterState::kWriters) *
+                    MultiWriterState::kKeysPerWriter;
+  SkipList<Key, Comparator>::Iterator iter(&state.list_);
+  iter.SeekToFirst();
+  for (Key k = 0; k < total; k++) {
+    ASSERT_TRUE(iter.Valid());
+    ASSERT_EQ(k, iter.key());
+    iter.Next();
+  }
+  ASSERT_TRUE(!iter.Valid());
+  for (Key k = 0; k < total; k += 97) {
+    ASSERT_TRUE(state.list_.Contains(k));
+    iter.Seek(k);
+    ASSERT_TRUE(iter.Valid());
+    ASSERT_EQ(k, iter.key());
+  }
+  ASSERT_TRUE(!state.list_.Contains(total));
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
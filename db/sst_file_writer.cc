@@ -0,0 +1,148 @@
+// Copyright (c) 2026 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/sst_file_writer.h"
+
+#include "db/db_impl.h"
+#include "db/dbformat.h"
+#include "leveldb/env.h"
+#include "leveldb/table_builder.h"
+
+namespace leveldb {
+
+struct SstFileWriter::Rep {
+  Env* env;
+  const InternalKeyComparator icmp;
+  const InternalFilterPolicies filter_policies;
+  Options table_options;    // table_options.comparator == &icmp
+  std::string fname;
+  WritableFile* file;       // NULL unless a table is being written
+  TableBuilder* builder;    // NULL unless a table is being written
+  uint64_t num_entries;
+  uint64_t file_size;
+  std::string last_key;     // User key of the last entry added
+  std::string key_buf;      // Internal key of the entry being added
+
+  explicit Rep(const Options& options)
+      : env(options.env),
+        icmp(options.comparator),
+        filter_policies(options),
+        file(NULL),
+        builder(NULL),
+        num_entries(0),
+        file_size(0) {
+    // Build the tables as DBImpl does for its last level
+    Options o = options;
+    o.comparator = &icmp;
+    o.filter_policy = filter_policies.Wrap(options.filter_policy);
+    for (size_t i = 0; i < o.filter_policy_per_level.size(); i++) {
+      o.filter_policy_per_level[i] =
+          filter_policies.Wrap(options.filter_policy_per_level[i]);
+    }
+    table_options = OptionsForLevel(o, config::kNumLevels - 1);
+  }
+
+  // Entries are written with sequence number zero, which ingestion
+  // replaces with the global sequence number of the file.
+  Status Add(const Slice& key, ValueType type, const Slice& value) {
+    if (builder == NULL) {
+      return Status::InvalidArgument("no table is being written");
+    }
+    if (num_entries > 0 &&
+        icmp.user_comparator()->Compare(key, last_key) <= 0) {
+      return Status::InvalidArgument("keys not added in increasing order",
+                                     key);
+    }
+    key_buf.clear();
+    AppendInternalKey(&key_buf, ParsedInternalKey(key, 0, type));
+    builder->Add(key_buf, value);
+    last_key.assign(key.data(), key.size());
+    num_entries++;
+    file_size = builder->FileSize();
+    return builder->status();
+  }
+
+  void Abandon() {
+    if (builder != NULL) {
+      builder->Abandon();
+      delete builder;
+      builder = NULL;
+      delete file;
+      file = NULL;
+      env->DeleteFile(fname);
+    }
+  }
+};
+
+SstFileWriter::SstFileWriter(const Options& options)
+    : rep_(new Rep(options)) {
+}
+
+SstFileWriter::~SstFileWriter() {
+  rep_->Abandon();
+  delete rep_;
+}
+
+Status SstFileWriter::Open(const std::string& fname) {
+  Rep* r = rep_;
+  if (r->builder != NULL) {
+    return Status::InvalidArgument("a table is already being written",
+                                   r->fname);
+  }
+  Status s = r->env->NewWritableFile(fname, &r->file);
+  if (s.ok()) {
+    r->fname = fname;
+    r->builder = new TableBuilder(r->table_options, r->file);
+    r->builder->SetProperty(kExternalFileProperty, "1");
+    r->num_entries = 0;
+    r->file_size = 0;
+    r->last_key.clear();
+  }
+  return s;
+}
+
+Status SstFileWriter::Put(const Slice& key, const Slice& value) {
+  return rep_->Add(key, kTypeValue, value);
+}
+
+Status SstFileWriter::Delete(const Slice& key) {
+  return rep_->Add(key, kTypeDeletion, Slice());
+}
+
+Status SstFileWriter::Finish() {
+  Rep* r = rep_;
+  if (r->builder == NULL) {
+    return Status::InvalidArgument("no table is being written");
+  }
+  if (r->num_entries == 0) {
+    r->Abandon();
+    return Status::InvalidArgument("cannot write an empty table", r->fname);
+  }
+  Status s = r->builder->Finish();
+  if (s.ok()) {
+    r->file_size = r->builder->FileSize();
+    s = r->file->Sync();
+  }
+  if (s.ok()) {
+    s = r->file->Close();
+  }
+  delete r->builder;
+  r->builder = NULL;
+  delete r->file;
+  r->file = NULL;
+  if (!s.ok()) {
+    r->env->DeleteFile(r->fname);
+  }
+  return s;
+}
+
+uint64_t SstFileWriter::NumEntries() const {
+  return rep_->num_entries;
+}
+
+uint64_t SstFileWriter::FileSize() const {
+  return rep_->file_size;
+}
+
+}  // namespace leveldb
@@ -5,19 +5,25 @@
 #include "db/table_cache.h"
 
 #include "db/filename.h"
+#include "db/range_del.h"
 #include "leveldb/env.h"
+#include "leveldb/pinned_value.h"
+#include "leveldb/slice_transform.h"
 #include "leveldb/table.h"
 #include "util/coding.h"
+#include "util/mutexlock.h"
 
 namespace leveldb {
 
 struct TableAndFile {
   RandomAccessFile* file;
   Table* table;
+  RangeDelMap* range_dels;  // The table's range tombstones, or NULL
 };
 
 static void DeleteEntry(const Slice& key, void* value) {
   TableAndFile* tf = reinterpret_cast<TableAndFile*>(value);
+  delete tf->range_dels;
   delete tf->table;
   delete tf->file;
   delete tf;
@@ -29,6 +35,259 @@ static void UnrefEntry(void* arg1, void* arg2) {
   cache->Release(h);
 }
 
+static void DeleteTableAndFile(void* arg1, void* arg2) {
+  delete reinterpret_cast<Table*>(arg1);
+  delete reinterpret_cast<RandomAccessFile*>(arg2);
+}
+
+// Returns false if the filter of "table" rules out the prefix of the
+// internal key "target" for a seek to it.
+static bool PrefixMayMatch(Table* table, const ReadOptions& options,
+                           const SliceTransform* prefix_extractor,
+                           const Slice& target) {
+  Slice user_key = ExtractUserKey(target);
+  if (!prefix_extractor->InDomain(user_key)) {
+    return true;
+  }
+  // Probe with an internal key for the prefix, which is how the prefix
+  // was added to the filter
+  InternalKey probe(prefix_extractor->Transform(user_key),
+                    kMaxSequenceNumber, kValueTypeForSeek);
+  return table->FilterMayMatch(options, target, probe.Encode());
+}
+
+namespace {
+// Wraps the iterator of a table.  A Seek() to a key whose prefix the
+// table's filter rules out leaves the iterator invalid without reading
+// any data block.
+class PrefixFilterIterator : public Iterator {
+ public:
+  PrefixFilterIterator(Iterator* iter, Table* table,
+                       const ReadOptions& options,
+                       const SliceTransform* prefix_extractor)
+      : iter_(iter),
+        table_(table),
+        options_(options),
+        prefix_extractor_(prefix_extractor),
+        filtered_(false) {
+  }
+  virtual ~PrefixFilterIterator() {
+    delete iter_;
+  }
+  virtual bool Valid() const { return !filtered_ && iter_->Valid(); }
+  virtual void Seek(const Slice& target) {
+    filtered_ = !PrefixMayMatch(table_, options_, prefix_extractor_, target);
+    if (!filtered_) {
+      iter_->Seek(target);
+    }
+  }
+  virtual void SeekToFirst() {
+    filtered_ = false;
+    iter_->SeekToFirst();
+  }
+  virtual void SeekToLast() {
+    filtered_ = false;
+    iter_->SeekToLast();
+  }
+  virtual void Next() {
+    assert(Valid());
+    iter_->Next();
+  }
+  virtual void Prev() {
+    assert(Valid());
+    iter_->Prev();
+  }
+  virtual Slice key() const {
+    assert(Valid());
+    return iter_->key();
+  }
+  virtual Slice value() const {
+    assert(Valid());
+    return iter_->value();
+  }
+  virtual Status status() const {
+    return iter_->status();
+  }
+
+ private:
+  Iterator* const iter_;
+  Table* const table_;
+  const ReadOptions options_;
+  const SliceTransform* const prefix_extractor_;
+  bool filtered_;     // Whether the last Seek() was ruled out by the filter
+};
+
+// Stores in *dst the internal key "ikey" with its sequence number replaced
+// by "seq".  Keys too short to be internal keys are copied unchanged, to
+// be reported as corrupted by their readers.
+static void SetGlobalSeqno(const Slice& ikey, SequenceNumber seq,
+                           std::string* dst) {
+  dst->assign(ikey.data(), ikey.size());
+  if (dst->size() >= 8) {
+    char* trailer = &(*dst)[dst->size() - 8];
+    EncodeFixed64(trailer, (seq << 8) | (DecodeFixed64(trailer) & 0xff));
+  }
+}
+
+// Wraps the iterator of an ingested table, whose entries were all written
+// with sequence number zero, and gives them the global sequence number of
+// the table instead.  The user keys of such a table are distinct, so this
+// does not change the order of its entries.
+class GlobalSeqnoIterator : public Iterator {
+ public:
+  GlobalSeqnoIterator(Iterator* iter, const Comparator* icmp,
+                      SequenceNumber seq)
+      : iter_(iter), icmp_(icmp), seq_(seq) {
+  }
+  virtual ~GlobalSeqnoIterator() {
+    delete iter_;
+  }
+  virtual bool Valid() const { return iter_->Valid(); }
+  virtual void Seek(const Slice& target) {
+    iter_->Seek(target);
+    Update();
+    // The entry for the user key of target sorts before target once it
+    // has a sequence number above the one of target
+    if (Valid() && icmp_->Compare(key_, target) < 0) {
+      Next();
+    }
+  }
+  virtual void SeekToFirst() {
+    iter_->SeekToFirst();
+    Update();
+  }
+  virtual void SeekToLast() {
+    iter_->SeekToLast();
+    Update();
+  }
+  virtual void Next() {
+    assert(Valid());
+    iter_->Next();
+    Update();
+  }
+  virtual void Prev() {
+    assert(Valid());
+    iter_->Prev();
+    Update();
+  }
+  virtual Slice key() const {
+    assert(Valid());
+    return key_;
+  }
+  virtual Slice value() const {
+    assert(Valid());
+    return iter_->value();
+  }
+  virtual Status status() const {
+    return iter_->status();
+  }
+
+ private:
+  void Update() {
+    if (iter_->Valid()) {
+      SetGlobalSeqno(iter_->key(), seq_, &key_);
+    }
+  }
+
+  Iterator* const iter_;
+  const Comparator* const icmp_;
+  const SequenceNumber seq_;
+  std::string key_;   // Key of the current entry, with seq_
+};
+
+// Passes the entries found in an ingested table to the callers of the
+// Get() methods with the global sequence number of the table.
+struct GlobalSeqnoSaver {
+  const Comparator* icmp;
+  SequenceNumber seq;
+  Slice k;
+  void* arg;
+  void (*saver)(void*, const Slice&, const Slice&);
+  bool (*pin_saver)(void*, const Slice&, const Slice&);
+  std::string key;
+};
+
+// Returns false if the entry "ikey" is newer than the lookup key, which
+// it then sorts before.  The lookup only finds entries of other user keys
+// past it, so it then finds nothing.
+static bool ApplyGlobalSeqno(GlobalSeqnoSaver* s, const Slice& ikey) {
+  SetGlobalSeqno(ikey, s->seq, &s->key);
+  return s->icmp->Compare(s->key, s->k) >= 0;
+}
+
+static void SaveWithGlobalSeqno(void* arg, const Slice& ikey, const Slice& v) {
+  GlobalSeqnoSaver* s = reinterpret_cast<GlobalSeqnoSaver*>(arg);
+  if (ApplyGlobalSeqno(s, ikey)) {
+    (*s->saver)(s->arg, s->key, v);
+  }
+}
+
+static bool PinWithGlobalSeqno(void* arg, const Slice& ikey, const Slice& v) {
+  GlobalSeqnoSaver* s = reinterpret_cast<GlobalSeqnoSaver*>(arg);
+  return ApplyGlobalSeqno(s, ikey) && (*s->pin_saver)(s->arg, s->key, v);
+}
+
+// Size of the chunks compactions read their inputs in when they bypass
+// the page cache, which leaves them without the readahead of the OS.
+static const size_t kCompactionReadaheadSize = 1 << 20;
+
+// Wraps a file that bypasses the page cache for the sequential reads of
+// a compaction: a read that misses the chunk read last reads the chunk
+// that starts at its offset.
+class ReadaheadRandomAccessFile : public RandomAccessFile {
+ public:
+  ReadaheadRandomAccessFile(RandomAccessFile* file, size_t readahead_size)
+      : file_(file),
+        readahead_size_(readahead_size),
+        buf_(new char[readahead_size]),
+        buf_offset_(0),
+        buf_len_(0) {
+  }
+  virtual ~ReadaheadRandomAccessFile() {
+    delete[] buf_;
+    delete file_;
+  }
+
+  virtual Status Read(uint64_t offset, size_t n, Slice* result,
+                      char* scratch) const {
+    if (n >= readahead_size_) {
+      return file_->Read(offset, n, result, scratch);
+    }
+    MutexLock l(&mu_);
+    if (offset < buf_offset_ || offset + n > buf_offset_ + buf_len_) {
+      Slice chunk;
+      Status s = file_->Read(offset, readahead_size_, &chunk, buf_);
+      if (!s.ok()) {
+        buf_len_ = 0;
+        *result = Slice(scratch, 0);
+        return s;
+      }
+      if (chunk.data() != buf_) {
+        memcpy(buf_, chunk.data(), chunk.size());
+      }
+      buf_offset_ = offset;
+      buf_len_ = chunk.size();
+    }
+    // Short of n bytes only at the end of the file
+    size_t avail = buf_offset_ + buf_len_ - offset;
+    if (avail > n) {
+      avail = n;
+    }
+    memcpy(scratch, buf_ + (offset - buf_offset_), avail);
+    *result = Slice(scratch, avail);
+    return Status::OK();
+  }
+
+ private:
+  RandomAccessFile* const file_;
+  const size_t readahead_size_;
+  mutable port::Mutex mu_;
+  char* const buf_;             // Holds the chunk read last
+  mutable uint64_t buf_offset_; // File offset of buf_[0]
+  mutable size_t buf_len_;      // Number of bytes in buf_
+};
+}  // namespace
+
 TableCache::TableCache(const std::string& dbname,
                        const Options* options,
                        int entries)
@@ -42,6 +301,36 @@ TableCache::~TableCache() {
   delete cache_;
 }
 
+Status TableCache::OpenTable(uint64_t file_number, uint64_t file_size,
+                             bool for_compaction, RandomAccessFile** file,
+                             Table** table) {
+  *file = NULL;
+  *table = NULL;
+  const bool direct = for_compaction || options_->use_direct_reads;
+  std::string fname = TableFileName(dbname_, file_number);
+  Status s = direct ? env_->NewDirectRandomAccessFile(fname, file)
+                    : env_->NewRandomAccessFile(fname, file);
+  if (!s.ok()) {
+    std::string old_fname = SSTTableFileName(dbname_, file_number);
+    Status old_s = direct ? env_->NewDirectRandomAccessFile(old_fname, file)
+                          : env_->NewRandomAccessFile(old_fname, file);
+    if (old_s.ok()) {
+      s = Status::OK();
+    }
+  }
+  if (s.ok() && for_compaction) {
+    *file = new ReadaheadRandomAccessFile(*file, kCompactionReadaheadSize);
+  }
+  if (s.ok()) {
+    s = Table::Open(*options_, *file, file_size, table);
+    if (!s.ok()) {
+      delete *file;
+      *file = NULL;
+    }
+  }
+  return s;
+}
+
 Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
                              Cache::Handle** handle) {
   Status s;
@@ -50,19 +339,27 @@ Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
   Slice key(buf, sizeof(buf));
   *handle = cache_->Lookup(key);
   if (*handle == NULL) {
-    std::string fname = TableFileName(dbname_, file_number);
     RandomAccessFile* file = NULL;
     Table* table = NULL;
-    s = env_->NewRandomAccessFile(fname, &file);
-    if (!s.ok()) {
-      std::string old_fname = SSTTableFileName(dbname_, file_number);
-      if (env_->NewRandomAccessFile(old_fname, &file).ok()) {
-        s = Status::OK();
+    s = OpenTable(file_number, file_size, false, &file, &table);
+
+    // Split the range tombstones into fragments once, for all lookups
+    RangeDelMap* range_dels = NULL;
+    Iterator* range_del_iter =
+        s.ok() ? table->NewRangeTombstoneIterator(ReadOptions()) : NULL;
+    if (range_del_iter != NULL) {
+      // The options of the DB hold its internal key comparator
+      range_dels = new RangeDelMap(static_cast<const InternalKeyComparator*>(
+          options_->comparator)->user_comparator());
+      s = range_dels->AddTombstones(range_del_iter);
+      range_dels->Finish();
+      delete range_del_iter;
+      if (!s.ok()) {
+        delete range_dels;
+        delete table;
+        table = NULL;
       }
     }
-    if (s.ok()) {
-      s = Table::Open(*options_, file, file_size, &table);
-    }
 
     if (!s.ok()) {
       assert(table == NULL);
@@ -73,6 +370,7 @@ Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
       TableAndFile* tf = new TableAndFile;
       tf->file = file;
       tf->table = table;
+      tf->range_dels = range_dels;
       *handle = cache_->Insert(key, tf, 1, &DeleteEntry);
     }
   }
@@ -82,6 +380,7 @@ Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
 Iterator* TableCache::NewIterator(const ReadOptions& options,
                                   uint64_t file_number,
                                   uint64_t file_size,
+                                  SequenceNumber global_seqno,
                                   Table** tableptr) {
   if (tableptr != NULL) {
     *tableptr = NULL;
@@ -95,6 +394,14 @@ Iterator* TableCache::NewIterator(const ReadOptions& options,
 
   Table* table = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
   Iterator* result = table->NewIterator(options);
+  if (FiltersPrefixes(options)) {
+    result = new PrefixFilterIterator(result, table, options,
+                                      options_->prefix_extractor);
+  }
+  if (global_seqno != 0) {
+    result = new GlobalSeqnoIterator(result, options_->comparator,
+                                     global_seqno);
+  }
   result->RegisterCleanup(&UnrefEntry, cache_, handle);
   if (tableptr != NULL) {
     *tableptr = table;
@@ -102,9 +409,58 @@ Iterator* TableCache::NewIterator(const ReadOptions& options,
   return result;
 }
 
+Iterator* TableCache::NewCompactionInputIterator(const ReadOptions& options,
+                                                 uint64_t file_number,
+                                                 uint64_t file_size,
+                                                 SequenceNumber global_seqno) {
+  if (!options_->use_direct_io_for_flush_and_compaction) {
+    return NewIterator(options, file_number, file_size, global_seqno);
+  }
+
+  RandomAccessFile* file = NULL;
+  Table* table = NULL;
+  Status s = OpenTable(file_number, file_size, true, &file, &table);
+  if (!s.ok()) {
+    return NewErrorIterator(s);
+  }
+  Iterator* result = table->NewIterator(options);
+  if (global_seqno != 0) {
+    result = new GlobalSeqnoIterator(result, options_->comparator,
+                                     global_seqno);
+  }
+  result->RegisterCleanup(&DeleteTableAndFile, table, file);
+  return result;
+}
+
+bool TableCache::FiltersPrefixes(const ReadOptions& options) const {
+  return options.prefix_same_as_start && options_->prefix_extractor != NULL &&
+         (options_->filter_policy != NULL ||
+          !options_->filter_policy_per_level.empty());
+}
+
+bool TableCache::PrefixMayMatch(const ReadOptions& options,
+                                uint64_t file_number,
+                                uint64_t file_size,
+                                const Slice& target) {
+  if (!FiltersPrefixes(options)) {
+    return true;
+  }
+  Cache::Handle* handle = NULL;
+  if (!FindTable(file_number, file_size, &handle).ok()) {
+    return true;  // Left to the iterator of the file to report
+  }
+  Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+  const bool result = leveldb::PrefixMayMatch(t, options,
+                                              options_->prefix_extractor,
+                                              target);
+  cache_->Release(handle);
+  return result;
+}
+
 Status TableCache::Get(const ReadOptions& options,
                        uint64_t file_number,
                        uint64_t file_size,
+                       SequenceNumber global_seqno,
                        const Slice& k,
                        void* arg,
                        void (*saver)(void*, const Slice&, const Slice&)) {
@@ -112,7 +468,119 @@ Status TableCache::Get(const ReadOptions& options,
   Status s = FindTable(file_number, file_size, &handle);
   if (s.ok()) {
     Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
-    s = t->InternalGet(options, k, arg, saver);
+    if (global_seqno != 0) {
+      GlobalSeqnoSaver g;
+      g.icmp = options_->comparator;
+      g.seq = global_seqno;
+      g.k = k;
+      g.arg = arg;
+      g.saver = saver;
+      s = t->InternalGet(options, k, &g, SaveWithGlobalSeqno);
+    } else {
+      s = t->InternalGet(options, k, arg, saver);
+    }
+    cache_->Release(handle);
+  }
+  return s;
+}
+
+Status TableCache::Get(const ReadOptions& options,
+                       uint64_t file_number,
+                       uint64_t file_size,
+                       SequenceNumber global_seqno,
+                       const Slice& k,
+                       void* arg,
+                       bool (*saver)(void*, const Slice&, const Slice&),
+                       PinnedValue* pin) {
+  Cache::Handle* handle = NULL;
+  Status s = FindTable(file_number, file_size, &handle);
+  if (s.ok()) {
+    Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+    const bool was_pinned = pin->pinned();
+    if (global_seqno != 0) {
+      GlobalSeqnoSaver g;
+      g.icmp = options_->comparator;
+      g.seq = global_seqno;
+      g.k = k;
+      g.arg = arg;
+      g.pin_saver = saver;
+      s = t->InternalGet(options, k, &g, PinWithGlobalSeqno, pin);
+    } else {
+      s = t->InternalGet(options, k, arg, saver, pin);
+    }
+    if (pin->pinned() != was_pinned) {
+      // Blocks may point into memory owned by the table's file.
+      pin->RegisterCleanup(&UnrefEntry, cache_, handle);
+    } else {
+      cache_->Release(handle);
+    }
+  }
+  return s;
+}
+
+Status TableCache::MultiGet(const ReadOptions& options,
+                            uint64_t file_number,
+                            uint64_t file_size,
+                            SequenceNumber global_seqno,
+                            int n,
+                            const Slice* keys,
+                            void* const* args,
+                            void (*saver)(void*, const Slice&, const Slice&)) {
+  Cache::Handle* handle = NULL;
+  Status s = FindTable(file_number, file_size, &handle);
+  if (s.ok()) {
+    Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+    if (global_seqno != 0) {
+      std::vector<GlobalSeqnoSaver> g(n);
+      std::vector<void*> g_args(n);
+      for (int i = 0; i < n; i++) {
+        g[i].icmp = options_->comparator;
+        g[i].seq = global_seqno;
+        g[i].k = keys[i];
+        g[i].arg = args[i];
+        g[i].saver = saver;
+        g_args[i] = &g[i];
+      }
+      s = t->InternalMultiGet(options, n, keys, &g_args[0],
+                              SaveWithGlobalSeqno);
+    } else {
+      s = t->InternalMultiGet(options, n, keys, args, saver);
+    }
+    cache_->Release(handle);
+  }
+  return s;
+}
+
+Status TableCache::MaxCoveringTombstone(uint64_t file_number,
+                                        uint64_t file_size,
+                                        const Slice& user_key,
+                                        SequenceNumber snapshot,
+                                        SequenceNumber* seq) {
+  *seq = 0;
+  Cache::Handle* handle = NULL;
+  Status s = FindTable(file_number, file_size, &handle);
+  if (s.ok()) {
+    const RangeDelMap* range_dels =
+        reinterpret_cast<TableAndFile*>(cache_->Value(handle))->range_dels;
+    if (range_dels != NULL) {
+      *seq = range_dels->MaxCoveringSeq(user_key, snapshot);
+    }
+    cache_->Release(handle);
+  }
+  return s;
+}
+
+Status TableCache::AddRangeTombstones(uint64_t file_number,
+                                      uint64_t file_size,
+                                      RangeDelMap* map) {
+  Cache::Handle* handle = NULL;
+  Status s = FindTable(file_number, file_size, &handle);
+  if (s.ok()) {
+    const RangeDelMap* range_dels =
+        reinterpret_cast<TableAndFile*>(cache_->Value(handle))->range_dels;
+    if (range_dels != NULL) {
+      map->AddTombstones(*range_dels);
+    }
     cache_->Release(handle);
   }
   return s;
@@ -17,6 +17,8 @@
 namespace leveldb {
 
 class Env;
+class RandomAccessFile;
+class RangeDelMap;
 
 class TableCache {
  public:
@@ -30,20 +32,82 @@ class TableCache {
   // the returned iterator.  The returned "*tableptr" object is owned by
   // the cache and should not be deleted, and is valid for as long as the
   // returned iterator is live.
+  //
+  // A non-zero "global_seqno" is the one of an ingested file (see
+  // FileMetaData): the entries of the file are read as if they had that
+  // sequence number.  The same holds for the methods below.
   Iterator* NewIterator(const ReadOptions& options,
                         uint64_t file_number,
                         uint64_t file_size,
+                        SequenceNumber global_seqno,
                         Table** tableptr = NULL);
 
+  // Like NewIterator(), for reading the whole file as the input of a
+  // compaction.  With Options::use_direct_io_for_flush_and_compaction,
+  // the file is opened apart from the cache, bypassing the page cache,
+  // and read in large chunks.
+  Iterator* NewCompactionInputIterator(const ReadOptions& options,
+                                       uint64_t file_number,
+                                       uint64_t file_size,
+                                       SequenceNumber global_seqno);
+
   // If a seek to internal key "k" in specified file finds an entry,
   // call (*handle_result)(arg, found_key, found_value).
   Status Get(const ReadOptions& options,
              uint64_t file_number,
              uint64_t file_size,
+             SequenceNumber global_seqno,
              const Slice& k,
              void* arg,
              void (*handle_result)(void*, const Slice&, const Slice&));
 
+  // Like the above, but if (*handle_result) returns true it may keep
+  // referring to the value it was passed until *pin is reset: the block
+  // holding the value and the table it belongs to stay pinned until then.
+  Status Get(const ReadOptions& options,
+             uint64_t file_number,
+             uint64_t file_size,
+             SequenceNumber global_seqno,
+             const Slice& k,
+             void* arg,
+             bool (*handle_result)(void*, const Slice&, const Slice&),
+             PinnedValue* pin);
+
+  // Batched form of Get(): for every i in [0,n), if a seek to internal
+  // key keys[i] in the specified file finds an entry, call
+  // (*handle_result)(args[i], found_key, found_value).
+  // REQUIRES: keys[0,n) are sorted in ascending order.
+  Status MultiGet(const ReadOptions& options,
+                  uint64_t file_number,
+                  uint64_t file_size,
+                  SequenceNumber global_seqno,
+                  int n,
+                  const Slice* keys,
+                  void* const* args,
+                  void (*handle_result)(void*, const Slice&, const Slice&));
+
+  // Stores in *seq the largest sequence number at or below "snapshot" of
+  // a range tombstone in the specified file that covers "user_key", or
+  // zero if there is none.
+  Status MaxCoveringTombstone(uint64_t file_number,
+                              uint64_t file_size,
+                              const Slice& user_key,
+                              SequenceNumber snapshot,
+                              SequenceNumber* seq);
+
+  // Add the range tombstones of the specified file to *map.
+  Status AddRangeTombstones(uint64_t file_number,
+                            uint64_t file_size,
+                            RangeDelMap* map);
+
+  // Returns false if, under ReadOptions::prefix_same_as_start, the
+  // filter of the specified file shows that a seek to internal key
+  // "target" finds no key with the prefix of "target".
+  bool PrefixMayMatch(const ReadOptions& options,
+                      uint64_t file_number,
+                      uint64_t file_size,
+                      const Slice& target);
+
   // Evict any entry for the specified file number
   void Evict(uint64_t file_number);
 
@@ -53,7 +117,16 @@ class TableCache {
   const Options* options_;
   Cache* cache_;
 
+  // Opens the specified table, bypassing the page cache if it is read for
+  // a compaction under use_direct_io_for_flush_and_compaction, or under
+  // use_direct_reads.
+  Status OpenTable(uint64_t file_number, uint64_t file_size,
+                   bool for_compaction, RandomAccessFile** file,
+                   Table** table);
   Status FindTable(uint64_t file_number, uint64_t file_size, Cache::Handle**);
+
+  // Whether the iterators of "options" skip tables by their filters.
+  bool FiltersPrefixes(const ReadOptions& options) const;
 };
 
 }  // namespace leveldb
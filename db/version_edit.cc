@@ -20,7 +20,11 @@ enum Tag {
   kDeletedFile          = 6,
   kNewFile              = 7,
   // 8 was used for large value refs
-  kPrevLogNumber        = 9
+  kPrevLogNumber        = 9,
+  kNewFileWithRangeDels = 10,   // Like kNewFile, for a table with range
+                                // tombstones
+  kIngestedFile         = 11    // Like kNewFile, followed by the global
+                                // sequence number of the table
 };
 
 void VersionEdit::Clear() {
@@ -76,12 +80,20 @@ void VersionEdit::EncodeTo(std::string* dst) const {
 
   for (size_t i = 0; i < new_files_.size(); i++) {
     const FileMetaData& f = new_files_[i].second;
-    PutVarint32(dst, kNewFile);
+    assert(f.global_seqno == 0 || !f.has_range_dels);
+    if (f.global_seqno != 0) {
+      PutVarint32(dst, kIngestedFile);
+    } else {
+      PutVarint32(dst, f.has_range_dels ? kNewFileWithRangeDels : kNewFile);
+    }
     PutVarint32(dst, new_files_[i].first);  // level
     PutVarint64(dst, f.number);
     PutVarint64(dst, f.file_size);
     PutLengthPrefixedSlice(dst, f.smallest.Encode());
     PutLengthPrefixedSlice(dst, f.largest.Encode());
+    if (f.global_seqno != 0) {
+      PutVarint64(dst, f.global_seqno);
+    }
   }
 }
 
@@ -181,11 +193,16 @@ Status VersionEdit::DecodeFrom(const Slice& src) {
         break;
 
       case kNewFile:
+      case kNewFileWithRangeDels:
+      case kIngestedFile:
+        f.has_range_dels = (tag == kNewFileWithRangeDels);
+        f.global_seqno = 0;
         if (GetLevel(&input, &level) &&
             GetVarint64(&input, &f.number) &&
             GetVarint64(&input, &f.file_size) &&
             GetInternalKey(&input, &f.smallest) &&
-            GetInternalKey(&input, &f.largest)) {
+            GetInternalKey(&input, &f.largest) &&
+            (tag != kIngestedFile || GetVarint64(&input, &f.global_seqno))) {
           new_files_.push_back(std::make_pair(level, f));
         } else {
           msg = "new-file entry";
@@ -258,6 +275,14 @@ std::string VersionEdit::DebugString() const {
     r.append(f.smallest.DebugString());
     r.append(" .. ");
     r.append(f.largest.DebugString());
+    if (f.has_range_dels) {
+      r.append(" (range tombstones)");
+    }
+    if (f.global_seqno != 0) {
+      r.append(" (ingested @ ");
+      AppendNumberTo(&r, f.global_seqno);
+      r.append(")");
+    }
   }
   r.append("\n}\n");
   return r;
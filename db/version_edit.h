@@ -21,8 +21,13 @@ struct FileMetaData {
   uint64_t file_size;         // File size in bytes
   InternalKey smallest;       // Smallest internal key served by table
   InternalKey largest;        // Largest internal key served by table
+  bool being_compacted;       // Input of a running compaction
+  bool has_range_dels;        // Table holds range tombstones
+  SequenceNumber global_seqno;  // Of all entries of an ingested table, or 0
 
-  FileMetaData() : refs(0), allowed_seeks(1 << 30), file_size(0) { }
+  FileMetaData()
+      : refs(0), allowed_seeks(1 << 30), file_size(0),
+        being_compacted(false), has_range_dels(false), global_seqno(0) { }
 };
 
 class VersionEdit {
@@ -58,16 +63,24 @@ class VersionEdit {
 
   // Add the specified file at the specified number.
   // REQUIRES: This version has not been saved (see VersionSet::SaveTo)
-  // REQUIRES: "smallest" and "largest" are smallest and largest keys in file
+  // REQUIRES: "smallest" and "largest" are smallest and largest keys in file,
+  //           extended to cover its range tombstones if it has any
+  // A non-zero "global_seqno" is the sequence number that replaces the zero
+  // sequence numbers of all entries of an ingested file when they are read.
+  // REQUIRES: the file holds no range tombstones if global_seqno != 0
   void AddFile(int level, uint64_t file,
                uint64_t file_size,
                const InternalKey& smallest,
-               const InternalKey& largest) {
+               const InternalKey& largest,
+               bool has_range_dels = false,
+               SequenceNumber global_seqno = 0) {
     FileMetaData f;
     f.number = file;
     f.file_size = file_size;
     f.smallest = smallest;
     f.largest = largest;
+    f.has_range_dels = has_range_dels;
+    f.global_seqno = global_seqno;
     new_files_.push_back(std::make_pair(level, f));
   }
 
@@ -27,7 +27,12 @@ TEST(VersionEditTest, EncodeDecode) {
     TestEncodeDecode(edit);
     edit.AddFile(3, kBig + 300 + i, kBig + 400 + i,
                  InternalKey("foo", kBig + 500 + i, kTypeValue),
-                 InternalKey("zoo", kBig + 600 + i, kTypeDeletion));
+                 InternalKey("zoo", kBig + 600 + i, kTypeDeletion),
+                 i % 2 == 1);
+    edit.AddFile(5, kBig + 800 + i, kBig + 400 + i,
+                 InternalKey("bar", kBig + 500 + i, kTypeValue),
+                 InternalKey("baz", kBig + 500 + i, kTypeValue),
+                 false, kBig + 500 + i);
     edit.DeleteFile(4, kBig + 700 + i);
     edit.SetCompactPointer(i, InternalKey("x", kBig + 900 + i, kTypeValue));
   }
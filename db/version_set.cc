@@ -12,6 +12,8 @@
 #include "db/memtable.h"
 #include "db/table_cache.h"
 #include "leveldb/env.h"
+#include "leveldb/pinned_value.h"
+#include "leveldb/slice_transform.h"
 #include "leveldb/table_builder.h"
 #include "table/merger.h"
 #include "table/two_level_iterator.h"
@@ -31,6 +33,11 @@ static const int64_t kMaxGrandParentOverlapBytes = 10 * kTargetFileSize;
 // total compaction cover more than this many bytes.
 static const int64_t kExpandedCompactionByteSizeLimit = 25 * kTargetFileSize;
 
+// Once a file has used up its allowed seeks, readers that do not hold
+// the lock ask for it to be recorded for compaction once every this
+// many further seeks (see Version::ChargeSeek).
+static const int kSeekRecheckInterval = 64;
+
 static double MaxBytesForLevel(int level) {
   // Note: the result for level zero is not really used since we set
   // the level-0 compaction threshold based on number of files.
@@ -151,12 +158,23 @@ bool SomeFileOverlapsRange(
 // is the largest key that occurs in the file, and value() is an
 // 16-byte value containing the file number and file size, both
 // encoded using EncodeFixed64.
+//
+// If "table_cache" is non-NULL, a Seek() to a key whose prefix the filter
+// of the file it lands on rules out leaves the iterator invalid: the
+// later files of the level start past that prefix too, so the level
+// holds no key with it.
 class Version::LevelFileNumIterator : public Iterator {
  public:
   LevelFileNumIterator(const InternalKeyComparator& icmp,
-                       const std::vector<FileMetaData*>* flist)
+                       const std::vector<FileMetaData*>* flist,
+                       TableCache* table_cache = NULL,
+                       const ReadOptions& options = ReadOptions(),
+                       const SliceTransform* prefix_extractor = NULL)
       : icmp_(icmp),
         flist_(flist),
+        table_cache_(table_cache),
+        options_(options),
+        prefix_extractor_(prefix_extractor),
         index_(flist->size()) {        // Marks as invalid
   }
   virtual bool Valid() const {
@@ -164,6 +182,9 @@ class Version::LevelFileNumIterator : public Iterator {
   }
   virtual void Seek(const Slice& target) {
     index_ = FindFile(icmp_, *flist_, target);
+    if (table_cache_ != NULL && Valid() && !PrefixMayMatch(target)) {
+      index_ = flist_->size();
+    }
   }
   virtual void SeekToFirst() { index_ = 0; }
   virtual void SeekToLast() {
@@ -189,37 +210,89 @@ class Version::LevelFileNumIterator : public Iterator {
     assert(Valid());
     EncodeFixed64(value_buf_, (*flist_)[index_]->number);
     EncodeFixed64(value_buf_+8, (*flist_)[index_]->file_size);
+    EncodeFixed64(value_buf_+16, (*flist_)[index_]->global_seqno);
     return Slice(value_buf_, sizeof(value_buf_));
   }
   virtual Status status() const { return Status::OK(); }
  private:
+  // Returns false if no file of the level at or after the current one
+  // holds a key with the prefix of "target".
+  bool PrefixMayMatch(const Slice& target) const {
+    const FileMetaData* f = (*flist_)[index_];
+    Slice user_key = ExtractUserKey(target);
+    if (!prefix_extractor_->InDomain(user_key)) {
+      return true;
+    }
+    // The largest key of a file can be the limit of a range tombstone
+    // rather than a key of the file.  If it has the prefix, the next
+    // file can start with the prefix too.
+    Slice largest = f->largest.user_key();
+    if (prefix_extractor_->InDomain(largest) &&
+        prefix_extractor_->Transform(largest) ==
+        prefix_extractor_->Transform(user_key)) {
+      return true;
+    }
+    return table_cache_->PrefixMayMatch(options_, f->number, f->file_size,
+                                        target);
+  }
+
   const InternalKeyComparator icmp_;
   const std::vector<FileMetaData*>* const flist_;
+  TableCache* const table_cache_;
+  const ReadOptions options_;
+  const SliceTransform* const prefix_extractor_;
   uint32_t index_;
 
-  // Backing store for value().  Holds the file number and size.
-  mutable char value_buf_[16];
+  // Backing store for value().  Holds the file number, size and global
+  // sequence number.
+  mutable char value_buf_[24];
 };
 
 static Iterator* GetFileIterator(void* arg,
                                  const ReadOptions& options,
                                  const Slice& file_value) {
   TableCache* cache = reinterpret_cast<TableCache*>(arg);
-  if (file_value.size() != 16) {
+  if (file_value.size() != 24) {
     return NewErrorIterator(
         Status::Corruption("FileReader invoked with unexpected value"));
   } else {
     return cache->NewIterator(options,
                               DecodeFixed64(file_value.data()),
-                              DecodeFixed64(file_value.data() + 8));
+                              DecodeFixed64(file_value.data() + 8),
+                              DecodeFixed64(file_value.data() + 16));
+  }
+}
+
+// Like GetFileIterator(), for the inputs of a compaction.
+static Iterator* GetCompactionInputIterator(void* arg,
+                                            const ReadOptions& options,
+                                            const Slice& file_value) {
+  TableCache* cache = reinterpret_cast<TableCache*>(arg);
+  if (file_value.size() != 24) {
+    return NewErrorIterator(
+        Status::Corruption("FileReader invoked with unexpected value"));
+  } else {
+    return cache->NewCompactionInputIterator(
+        options,
+        DecodeFixed64(file_value.data()),
+        DecodeFixed64(file_value.data() + 8),
+        DecodeFixed64(file_value.data() + 16));
   }
 }
 
 Iterator* Version::NewConcatenatingIterator(const ReadOptions& options,
                                             int level) const {
-  return NewTwoLevelIterator(
-      new LevelFileNumIterator(vset_->icmp_, &files_[level]),
-      &GetFileIterator, vset_->table_cache_, options);
+  LevelFileNumIterator* files;
+  if (options.prefix_same_as_start &&
+      vset_->options_->prefix_extractor != NULL) {
+    files = new LevelFileNumIterator(vset_->icmp_, &files_[level],
+                                     vset_->table_cache_, options,
+                                     vset_->options_->prefix_extractor);
+  } else {
+    files = new LevelFileNumIterator(vset_->icmp_, &files_[level]);
+  }
+  return NewTwoLevelIterator(files, &GetFileIterator, vset_->table_cache_,
+                             options);
 }
 
 void Version::AddIterators(const ReadOptions& options,
@@ -228,7 +301,8 @@ void Version::AddIterators(const ReadOptions& options,
   for (size_t i = 0; i < files_[0].size(); i++) {
     iters->push_back(
         vset_->table_cache_->NewIterator(
-            options, files_[0][i]->number, files_[0][i]->file_size));
+            options, files_[0][i]->number, files_[0][i]->file_size,
+            files_[0][i]->global_seqno));
   }
 
   // For levels > 0, we can use a concatenating iterator that sequentially
@@ -241,6 +315,20 @@ void Version::AddIterators(const ReadOptions& options,
   }
 }
 
+Status Version::AddRangeTombstones(RangeDelMap* map) {
+  Status s;
+  for (int level = 0; level < config::kNumLevels && s.ok(); level++) {
+    for (size_t i = 0; i < files_[level].size() && s.ok(); i++) {
+      const FileMetaData* f = files_[level][i];
+      if (f->has_range_dels) {
+        s = vset_->table_cache_->AddRangeTombstones(f->number, f->file_size,
+                                                    map);
+      }
+    }
+  }
+  return s;
+}
+
 // Callback from TableCache::Get()
 namespace {
 enum SaverState {
@@ -253,7 +341,9 @@ struct Saver {
   SaverState state;
   const Comparator* ucmp;
   Slice user_key;
+  SequenceNumber tombstone;  // Of a range tombstone covering user_key
   std::string* value;
+  PinnedValue* pinned;
 };
 }
 static void SaveValue(void* arg, const Slice& ikey, const Slice& v) {
@@ -263,14 +353,27 @@ static void SaveValue(void* arg, const Slice& ikey, const Slice& v) {
     s->state = kCorrupt;
   } else {
     if (s->ucmp->Compare(parsed_key.user_key, s->user_key) == 0) {
-      s->state = (parsed_key.type == kTypeValue) ? kFound : kDeleted;
-      if (s->state == kFound) {
+      s->state = (parsed_key.type == kTypeValue &&
+                  parsed_key.sequence > s->tombstone) ? kFound : kDeleted;
+      if (s->state == kFound && s->value != NULL) {
         s->value->assign(v.data(), v.size());
       }
     }
   }
 }
 
+// Like SaveValue(), but points s->pinned at the value instead of copying
+// it.  Returns true iff the value must stay pinned.
+static bool PinValue(void* arg, const Slice& ikey, const Slice& v) {
+  Saver* s = reinterpret_cast<Saver*>(arg);
+  SaveValue(arg, ikey, v);
+  if (s->state == kFound) {
+    s->pinned->PinSlice(v);
+    return true;
+  }
+  return false;
+}
+
 static bool NewestFirst(FileMetaData* a, FileMetaData* b) {
   return a->number > b->number;
 }
@@ -324,6 +427,21 @@ Status Version::Get(const ReadOptions& options,
                     const LookupKey& k,
                     std::string* value,
                     GetStats* stats) {
+  return GetImpl(options, k, value, NULL, stats);
+}
+
+Status Version::Get(const ReadOptions& options,
+                    const LookupKey& k,
+                    PinnedValue* value,
+                    GetStats* stats) {
+  return GetImpl(options, k, NULL, value, stats);
+}
+
+Status Version::GetImpl(const ReadOptions& options,
+                        const LookupKey& k,
+                        std::string* value,
+                        PinnedValue* pinned,
+                        GetStats* stats) {
   Slice ikey = k.internal_key();
   Slice user_key = k.user_key();
   const Comparator* ucmp = vset_->icmp_.user_comparator();
@@ -395,12 +513,33 @@ Status Version::Get(const ReadOptions& options,
       saver.state = kNotFound;
       saver.ucmp = ucmp;
       saver.user_key = user_key;
+      saver.tombstone = 0;
       saver.value = value;
-      s = vset_->table_cache_->Get(options, f->number, f->file_size,
-                                   ikey, &saver, SaveValue);
+      saver.pinned = pinned;
+      if (f->has_range_dels) {
+        s = vset_->table_cache_->MaxCoveringTombstone(
+            f->number, f->file_size, user_key, k.sequence(),
+            &saver.tombstone);
+        if (!s.ok()) {
+          return s;
+        }
+      }
+      if (pinned != NULL) {
+        s = vset_->table_cache_->Get(options, f->number, f->file_size,
+                                     f->global_seqno, ikey, &saver, PinValue,
+                                     pinned);
+      } else {
+        s = vset_->table_cache_->Get(options, f->number, f->file_size,
+                                     f->global_seqno, ikey, &saver,
+                                     SaveValue);
+      }
       if (!s.ok()) {
         return s;
       }
+      if (saver.state == kNotFound && saver.tombstone > 0) {
+        // Older files may hold entries for user_key, all deleted
+        saver.state = kDeleted;
+      }
       switch (saver.state) {
         case kNotFound:
           break;      // Keep searching in other files
@@ -419,15 +558,196 @@ Status Version::Get(const ReadOptions& options,
   return Status::NotFound(Slice());  // Use an empty error message for speed
 }
 
+// Decrement and return the number of seeks "f" has left.  Readers
+// charge seeks concurrently, so the update must be atomic.
+static int ChargeFileSeek(FileMetaData* f) {
+  return __sync_sub_and_fetch(&f->allowed_seeks, 1);
+}
+
+namespace {
+// Per-key state kept by Version::MultiGet().
+struct MultiGetState {
+  Version::KeyRequest* request;
+  FileMetaData* last_file_read;
+  int last_file_read_level;
+  bool done;
+  Saver saver;
+};
+}
+
+// Look up the keys in "batch" in file "f" of "level" with a single
+// table cache access.  Marks the keys that were resolved as done and
+// returns how many of them there were.
+static size_t MultiGetFromFile(TableCache* table_cache,
+                               const ReadOptions& options,
+                               const Comparator* ucmp,
+                               int level, FileMetaData* f,
+                               const std::vector<MultiGetState*>& batch) {
+  std::vector<Slice> keys(batch.size());
+  std::vector<void*> args(batch.size());
+  for (size_t i = 0; i < batch.size(); i++) {
+    MultiGetState* state = batch[i];
+    Version::KeyRequest* r = state->request;
+    if (state->last_file_read != NULL && r->stats.seek_file == NULL) {
+      // We have had more than one seek for this key.  Charge the 1st file.
+      r->stats.seek_file = state->last_file_read;
+      r->stats.seek_file_level = state->last_file_read_level;
+    }
+    state->last_file_read = f;
+    state->last_file_read_level = level;
+    state->saver.state = kNotFound;
+    state->saver.ucmp = ucmp;
+    state->saver.user_key = r->key->user_key();
+    state->saver.tombstone = 0;
+    state->saver.value = r->value;
+    state->saver.pinned = NULL;
+    keys[i] = r->key->internal_key();
+    args[i] = &state->saver;
+  }
+  Status s;
+  for (size_t i = 0; i < batch.size() && s.ok() && f->has_range_dels; i++) {
+    s = table_cache->MaxCoveringTombstone(
+        f->number, f->file_size, batch[i]->saver.user_key,
+        batch[i]->request->key->sequence(), &batch[i]->saver.tombstone);
+  }
+  if (s.ok()) {
+    s = table_cache->MultiGet(options, f->number, f->file_size,
+                              f->global_seqno, batch.size(), &keys[0],
+                              &args[0], SaveValue);
+  }
+  size_t resolved = 0;
+  for (size_t i = 0; i < batch.size(); i++) {
+    MultiGetState* state = batch[i];
+    Status* status = state->request->status;
+    if (state->saver.state == kNotFound && state->saver.tombstone > 0) {
+      state->saver.state = kDeleted;  // As in Version::GetImpl()
+    }
+    if (!s.ok()) {
+      *status = s;
+    } else {
+      switch (state->saver.state) {
+        case kNotFound:
+          continue;      // Keep searching in other files
+        case kFound:
+          *status = Status::OK();
+          break;
+        case kDeleted:
+          break;         // Status is already NotFound
+        case kCorrupt:
+          *status = Status::Corruption("corrupted key for ",
+                                       state->saver.user_key);
+          break;
+      }
+    }
+    state->done = true;
+    resolved++;
+  }
+  return resolved;
+}
+
+void Version::MultiGet(const ReadOptions& options,
+                       std::vector<KeyRequest>* requests) {
+  const Comparator* ucmp = vset_->icmp_.user_comparator();
+  const size_t num_keys = requests->size();
+  std::vector<MultiGetState> states(num_keys);
+  for (size_t i = 0; i < num_keys; i++) {
+    KeyRequest* r = &(*requests)[i];
+    r->stats.seek_file = NULL;
+    r->stats.seek_file_level = -1;
+    *r->status = Status::NotFound(Slice());  // Use empty error message
+    states[i].request = r;
+    states[i].last_file_read = NULL;
+    states[i].last_file_read_level = -1;
+    states[i].done = false;
+  }
+  size_t remaining = num_keys;
+  std::vector<MultiGetState*> batch;
+  batch.reserve(num_keys);
+
+  // Level-0 files may overlap each other.  Process them from newest to
+  // oldest, each with all of the pending keys that it covers.
+  std::vector<FileMetaData*> level0(files_[0]);
+  std::sort(level0.begin(), level0.end(), NewestFirst);
+  for (size_t i = 0; i < level0.size() && remaining > 0; i++) {
+    FileMetaData* f = level0[i];
+    batch.clear();
+    for (size_t k = 0; k < num_keys; k++) {
+      const Slice user_key = states[k].request->key->user_key();
+      if (!states[k].done &&
+          ucmp->Compare(user_key, f->smallest.user_key()) >= 0 &&
+          ucmp->Compare(user_key, f->largest.user_key()) <= 0) {
+        batch.push_back(&states[k]);
+      }
+    }
+    if (!batch.empty()) {
+      remaining -= MultiGetFromFile(vset_->table_cache_, options, ucmp,
+                                    0, f, batch);
+    }
+  }
+
+  // Files in other levels are sorted and disjoint, so a single pass over
+  // the sorted keys visits every file that may hold one of them once.
+  for (int level = 1; level < config::kNumLevels && remaining > 0; level++) {
+    const std::vector<FileMetaData*>& files = files_[level];
+    size_t k = 0;
+    while (k < num_keys) {
+      if (states[k].done) {
+        k++;
+        continue;
+      }
+      // Binary search to find earliest index whose largest key >= key k.
+      uint32_t index = FindFile(vset_->icmp_, files,
+                                states[k].request->key->internal_key());
+      if (index >= files.size()) {
+        break;  // Remaining keys are past the last file
+      }
+      FileMetaData* f = files[index];
+      batch.clear();
+      for (; k < num_keys; k++) {
+        MultiGetState* state = &states[k];
+        if (vset_->icmp_.Compare(state->request->key->internal_key(),
+                                 f->largest.Encode()) > 0) {
+          break;  // Key is past f
+        }
+        if (!state->done &&
+            ucmp->Compare(state->request->key->user_key(),
+                          f->smallest.user_key()) >= 0) {
+          batch.push_back(state);
+        }
+      }
+      if (!batch.empty()) {
+        remaining -= MultiGetFromFile(vset_->table_cache_, options, ucmp,
+                                      level, f, batch);
+      }
+    }
+  }
+}
+
 bool Version::UpdateStats(const GetStats& stats) {
   FileMetaData* f = stats.seek_file;
-  if (f != NULL) {
-    f->allowed_seeks--;
-    if (f->allowed_seeks <= 0 && file_to_compact_ == NULL) {
-      file_to_compact_ = f;
-      file_to_compact_level_ = stats.seek_file_level;
-      return true;
-    }
+  if (f != NULL && ChargeFileSeek(f) <= 0) {
+    return RecordSeekCompaction(stats);
+  }
+  return false;
+}
+
+bool Version::ChargeSeek(const GetStats& stats) {
+  FileMetaData* f = stats.seek_file;
+  if (f == NULL) {
+    return false;
+  }
+  // Report the seek that exhausts the allowance, and every
+  // kSeekRecheckInterval-th one after that in case another file was
+  // already pending compaction at the time.
+  const int remaining = ChargeFileSeek(f);
+  return remaining <= 0 && (remaining % kSeekRecheckInterval) == 0;
+}
+
+bool Version::RecordSeekCompaction(const GetStats& stats) {
+  if (file_to_compact_ == NULL) {
+    file_to_compact_ = stats.seek_file;
+    file_to_compact_level_ = stats.seek_file_level;
+    return true;
   }
   return false;
 }
@@ -562,6 +882,25 @@ void Version::GetOverlappingInputs(
   }
 }
 
+void Version::GetContainedInputs(int level,
+                                 const Slice& begin, const Slice& end,
+                                 std::vector<FileMetaData*>* inputs) {
+  assert(level >= 0);
+  assert(level < config::kNumLevels);
+  inputs->clear();
+  // Compared as internal keys, so that a file whose range tombstones end
+  // at "end" counts as contained
+  const InternalKey start(begin, kMaxSequenceNumber, kValueTypeForSeek);
+  const InternalKey limit(end, kMaxSequenceNumber, kValueTypeForSeek);
+  for (size_t i = 0; i < files_[level].size(); i++) {
+    FileMetaData* f = files_[level][i];
+    if (vset_->icmp_.Compare(f->smallest, start) >= 0 &&
+        vset_->icmp_.Compare(f->largest, limit) < 0) {
+      inputs->push_back(f);
+    }
+  }
+}
+
 std::string Version::DebugString() const {
   std::string r;
   for (int level = 0; level < config::kNumLevels; level++) {
@@ -785,6 +1124,7 @@ VersionSet::VersionSet(const std::string& dbname,
 }
 
 VersionSet::~VersionSet() {
+  assert(running_compactions_.empty());
   current_->Unref();
   assert(dummy_versions_.next_ == &dummy_versions_);  // List must be empty
   delete descriptor_log_;
@@ -821,7 +1161,7 @@ Status VersionSet::LogAndApply(VersionEdit* edit, port::Mutex* mu) {
   }
 
   edit->SetNextFile(next_file_number_);
-  edit->SetLastSequence(last_sequence_);
+  edit->SetLastSequence(LastSequence());
 
   Version* v = new Version(this);
   {
@@ -1053,8 +1393,7 @@ void VersionSet::MarkFileNumberUsed(uint64_t number) {
 }
 
 void VersionSet::Finalize(Version* v) {
-  // Precomputed best level for next compaction
-  int best_level = -1;
+  // Precomputed scores for the next compactions
   double best_score = -1;
 
   for (int level = 0; level < config::kNumLevels-1; level++) {
@@ -1079,13 +1418,12 @@ void VersionSet::Finalize(Version* v) {
       score = static_cast<double>(level_bytes) / MaxBytesForLevel(level);
     }
 
+    v->compaction_scores_[level] = score;
     if (score > best_score) {
-      best_level = level;
       best_score = score;
     }
   }
 
-  v->compaction_level_ = best_level;
   v->compaction_score_ = best_score;
 }
 
@@ -1110,7 +1448,8 @@ Status VersionSet::WriteSnapshot(log::Writer* log) {
     const std::vector<FileMetaData*>& files = current_->files_[level];
     for (size_t i = 0; i < files.size(); i++) {
       const FileMetaData* f = files[i];
-      edit.AddFile(level, f->number, f->file_size, f->smallest, f->largest);
+      edit.AddFile(level, f->number, f->file_size, f->smallest, f->largest,
+                   f->has_range_dels, f->global_seqno);
     }
   }
 
@@ -1159,19 +1498,31 @@ uint64_t VersionSet::ApproximateOffsetOf(Version* v, const InternalKey& ikey) {
       } else {
         // "ikey" falls in the range for this table.  Add the
         // approximate offset of "ikey" within the table.
-        Table* tableptr;
-        Iterator* iter = table_cache_->NewIterator(
-            ReadOptions(), files[i]->number, files[i]->file_size, &tableptr);
-        if (tableptr != NULL) {
-          result += tableptr->ApproximateOffsetOf(ikey.Encode());
-        }
-        delete iter;
+        result += ApproximateOffsetInFile(files[i], ikey);
       }
     }
   }
   return result;
 }
 
+uint64_t VersionSet::ApproximateOffsetInFile(const FileMetaData* f,
+                                             const InternalKey& ikey) {
+  if (icmp_.Compare(f->largest, ikey) <= 0) {
+    return f->file_size;
+  } else if (icmp_.Compare(f->smallest, ikey) > 0) {
+    return 0;
+  }
+  uint64_t result = 0;
+  Table* tableptr;
+  Iterator* iter = table_cache_->NewIterator(
+      ReadOptions(), f->number, f->file_size, f->global_seqno, &tableptr);
+  if (tableptr != NULL) {
+    result = tableptr->ApproximateOffsetOf(ikey.Encode());
+  }
+  delete iter;
+  return result;
+}
+
 void VersionSet::AddLiveFiles(std::set<uint64_t>* live) {
   for (Version* v = dummy_versions_.next_;
        v != &dummy_versions_;
@@ -1261,14 +1612,15 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
       if (c->level() + which == 0) {
         const std::vector<FileMetaData*>& files = c->inputs_[which];
         for (size_t i = 0; i < files.size(); i++) {
-          list[num++] = table_cache_->NewIterator(
-              options, files[i]->number, files[i]->file_size);
+          list[num++] = table_cache_->NewCompactionInputIterator(
+              options, files[i]->number, files[i]->file_size,
+              files[i]->global_seqno);
         }
       } else {
         // Create concatenating iterator for the files from this level
         list[num++] = NewTwoLevelIterator(
             new Version::LevelFileNumIterator(icmp_, &c->inputs_[which]),
-            &GetFileIterator, table_cache_, options);
+            &GetCompactionInputIterator, table_cache_, options);
       }
     }
   }
@@ -1278,46 +1630,137 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
   return result;
 }
 
-Compaction* VersionSet::PickCompaction() {
-  Compaction* c;
-  int level;
+namespace {
+struct UserKeyLess {
+  const Comparator* cmp;
+  explicit UserKeyLess(const Comparator* c) : cmp(c) { }
+  bool operator()(const Slice& a, const Slice& b) const {
+    return cmp->Compare(a, b) < 0;
+  }
+};
 
-  // We prefer compactions triggered by too much data in a level over
-  // the compactions triggered by seeks.
-  const bool size_compaction = (current_->compaction_score_ >= 1);
-  const bool seek_compaction = (current_->file_to_compact_ != NULL);
-  if (size_compaction) {
-    level = current_->compaction_level_;
-    assert(level >= 0);
-    assert(level+1 < config::kNumLevels);
-    c = new Compaction(level);
-
-    // Pick the first file that comes after compact_pointer_[level]
-    for (size_t i = 0; i < current_->files_[level].size(); i++) {
-      FileMetaData* f = current_->files_[level][i];
-      if (compact_pointer_[level].empty() ||
-          icmp_.Compare(f->largest.Encode(), compact_pointer_[level]) > 0) {
-        c->inputs_[0].push_back(f);
+struct UserKeyEqual {
+  const Comparator* cmp;
+  explicit UserKeyEqual(const Comparator* c) : cmp(c) { }
+  bool operator()(const Slice& a, const Slice& b) const {
+    return cmp->Compare(a, b) == 0;
+  }
+};
+}  // namespace
+
+void VersionSet::SplitCompaction(Compaction* c, int max_parts,
+                                 std::vector<std::string>* boundaries) {
+  boundaries->clear();
+  if (max_parts <= 1) {
+    return;
+  }
+
+  // The candidate boundaries are the ends of the input files.
+  const Comparator* user_cmp = icmp_.user_comparator();
+  std::vector<const FileMetaData*> files;
+  std::vector<Slice> keys;
+  uint64_t total_bytes = 0;
+  for (int which = 0; which < 2; which++) {
+    for (size_t i = 0; i < c->inputs_[which].size(); i++) {
+      const FileMetaData* f = c->inputs_[which][i];
+      files.push_back(f);
+      keys.push_back(f->smallest.user_key());
+      keys.push_back(f->largest.user_key());
+      total_bytes += f->file_size;
+    }
+  }
+
+  // Parts smaller than an output file would only fragment the output.
+  if (total_bytes / c->MaxOutputFileSize() < static_cast<uint64_t>(max_parts)) {
+    max_parts = static_cast<int>(total_bytes / c->MaxOutputFileSize());
+  }
+  if (max_parts <= 1) {
+    return;
+  }
+
+  std::sort(keys.begin(), keys.end(), UserKeyLess(user_cmp));
+  keys.erase(std::unique(keys.begin(), keys.end(), UserKeyEqual(user_cmp)),
+             keys.end());
+
+  // Cut before the first candidate that has the next share of the input
+  // bytes in front of it.  The smallest key cannot end a non-empty part.
+  for (size_t k = 1; k < keys.size(); k++) {
+    const uint64_t target =
+        total_bytes * (boundaries->size() + 1) / max_parts;
+    InternalKey ikey(keys[k], kMaxSequenceNumber, kValueTypeForSeek);
+    uint64_t before = 0;
+    for (size_t i = 0; i < files.size(); i++) {
+      before += ApproximateOffsetInFile(files[i], ikey);
+    }
+    if (before >= target) {
+      boundaries->push_back(keys[k].ToString());
+      if (static_cast<int>(boundaries->size()) == max_parts - 1) {
         break;
       }
     }
-    if (c->inputs_[0].empty()) {
-      // Wrap-around to the beginning of the key space
-      c->inputs_[0].push_back(current_->files_[level][0]);
+  }
+}
+
+Compaction* VersionSet::PickCompaction() {
+  // We prefer compactions triggered by too much data in a level over
+  // the compactions triggered by seeks, and levels with higher scores
+  // over those with lower scores.
+  std::vector<std::pair<double, int> > levels;
+  for (int level = 0; level < config::kNumLevels - 1; level++) {
+    if (current_->compaction_scores_[level] >= 1) {
+      levels.push_back(std::make_pair(-current_->compaction_scores_[level],
+                                      level));
     }
-  } else if (seek_compaction) {
-    level = current_->file_to_compact_level_;
-    c = new Compaction(level);
-    c->inputs_[0].push_back(current_->file_to_compact_);
-  } else {
-    return NULL;
   }
+  std::sort(levels.begin(), levels.end());
+
+  for (size_t l = 0; l < levels.size(); l++) {
+    const int level = levels[l].second;
+    const std::vector<FileMetaData*>& files = current_->files_[level];
+
+    // Try the files in order, starting with the first file that comes
+    // after compact_pointer_[level] and wrapping around to the beginning
+    // of the key space, until one can be compacted without conflicts.
+    size_t start = 0;
+    while (start < files.size() && !compact_pointer_[level].empty() &&
+           icmp_.Compare(files[start]->largest.Encode(),
+                         compact_pointer_[level]) <= 0) {
+      start++;
+    }
+    for (size_t i = 0; i < files.size(); i++) {
+      FileMetaData* f = files[(start + i) % files.size()];
+      if (f->being_compacted) {
+        continue;
+      }
+      Compaction* c = new Compaction(level);
+      c->inputs_[0].push_back(f);
+      c = SetupCompaction(c);
+      if (c != NULL) {
+        return c;
+      }
+      if (level == 0) {
+        // Level-0 files overlapping f are all picked with it, so a
+        // conflict most likely holds for the other files too.
+        break;
+      }
+    }
+  }
+
+  FileMetaData* f = current_->file_to_compact_;
+  if (f != NULL && !f->being_compacted) {
+    Compaction* c = new Compaction(current_->file_to_compact_level_);
+    c->inputs_[0].push_back(f);
+    return SetupCompaction(c);
+  }
+  return NULL;
+}
 
+Compaction* VersionSet::SetupCompaction(Compaction* c) {
   c->input_version_ = current_;
   c->input_version_->Ref();
 
   // Files in level 0 may overlap each other, so pick up all overlapping ones
-  if (level == 0) {
+  if (c->level() == 0) {
     InternalKey smallest, largest;
     GetRange(c->inputs_[0], &smallest, &largest);
     // Note that the next call will discard the file we placed in
@@ -1329,9 +1772,89 @@ Compaction* VersionSet::PickCompaction() {
 
   SetupOtherInputs(c);
 
+  if (ConflictsWithRunning(c)) {
+    delete c;
+    return NULL;
+  }
+  RegisterCompaction(c);
   return c;
 }
 
+bool VersionSet::ConflictsWithRunning(const Compaction* c) const {
+  for (int which = 0; which < 2; which++) {
+    for (size_t i = 0; i < c->inputs_[which].size(); i++) {
+      if (c->inputs_[which][i]->being_compacted) {
+        return true;
+      }
+    }
+  }
+  const Comparator* user_cmp = icmp_.user_comparator();
+  for (size_t i = 0; i < running_compactions_.size(); i++) {
+    const Compaction* r = running_compactions_[i];
+    if (c->level() == 0 && r->level() == 0) {
+      // Level-0 files overlap each other and have to be compacted in
+      // order, so only one compaction out of level-0 may run at a time.
+      return true;
+    }
+    if (r->level() > c->level() + 1 || c->level() > r->level() + 1) {
+      // No level in common
+      continue;
+    }
+    if (user_cmp->Compare(r->largest_.user_key(),
+                          c->smallest_.user_key()) >= 0 &&
+        user_cmp->Compare(c->largest_.user_key(),
+                          r->smallest_.user_key()) >= 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void VersionSet::RegisterCompaction(Compaction* c) {
+  for (int which = 0; which < 2; which++) {
+    for (size_t i = 0; i < c->inputs_[which].size(); i++) {
+      assert(!c->inputs_[which][i]->being_compacted);
+      c->inputs_[which][i]->being_compacted = true;
+    }
+  }
+  running_compactions_.push_back(c);
+
+  // Update the place where we will do the next compaction for this level.
+  // We update this immediately instead of waiting for the VersionEdit
+  // to be applied so that if the compaction fails, we will try a different
+  // key range next time.
+  InternalKey smallest, largest;
+  GetRange(c->inputs_[0], &smallest, &largest);
+  compact_pointer_[c->level()] = largest.Encode().ToString();
+}
+
+void VersionSet::ReleaseCompaction(Compaction* c) {
+  std::vector<Compaction*>::iterator it =
+      std::find(running_compactions_.begin(), running_compactions_.end(), c);
+  assert(it != running_compactions_.end());
+  running_compactions_.erase(it);
+  for (int which = 0; which < 2; which++) {
+    for (size_t i = 0; i < c->inputs_[which].size(); i++) {
+      c->inputs_[which][i]->being_compacted = false;
+    }
+  }
+}
+
+bool VersionSet::RangeUnderCompaction(int level,
+                                      const Slice& smallest_user_key,
+                                      const Slice& largest_user_key) const {
+  const Comparator* user_cmp = icmp_.user_comparator();
+  for (size_t i = 0; i < running_compactions_.size(); i++) {
+    const Compaction* r = running_compactions_[i];
+    if (r->level() + 1 == level &&
+        user_cmp->Compare(r->largest_.user_key(), smallest_user_key) >= 0 &&
+        user_cmp->Compare(largest_user_key, r->smallest_.user_key()) >= 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
 void VersionSet::SetupOtherInputs(Compaction* c) {
   const int level = c->level();
   InternalKey smallest, largest;
@@ -1383,6 +1906,8 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
     current_->GetOverlappingInputs(level + 2, &all_start, &all_limit,
                                    &c->grandparents_);
   }
+  c->smallest_ = all_start;
+  c->largest_ = all_limit;
 
   if (false) {
     Log(options_->info_log, "Compacting %d '%s' .. '%s'",
@@ -1391,11 +1916,6 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
         largest.DebugString().c_str());
   }
 
-  // Update the place where we will do the next compaction for this level.
-  // We update this immediately instead of waiting for the VersionEdit
-  // to be applied so that if the compaction fails, we will try a different
-  // key range next time.
-  compact_pointer_[level] = largest.Encode().ToString();
   c->edit_.SetCompactPointer(level, largest);
 }
 
@@ -1431,19 +1951,23 @@ Compaction* VersionSet::CompactRange(
   c->input_version_->Ref();
   c->inputs_[0] = inputs;
   SetupOtherInputs(c);
+  RegisterCompaction(c);
   return c;
 }
 
+Compaction::Cursor::Cursor()
+    : grandparent_index(0),
+      seen_key(false),
+      overlapped_bytes(0) {
+  for (int i = 0; i < config::kNumLevels; i++) {
+    level_ptrs[i] = 0;
+  }
+}
+
 Compaction::Compaction(int level)
     : level_(level),
       max_output_file_size_(MaxFileSizeForLevel(level)),
-      input_version_(NULL),
-      grandparent_index_(0),
-      seen_key_(false),
-      overlapped_bytes_(0) {
-  for (int i = 0; i < config::kNumLevels; i++) {
-    level_ptrs_[i] = 0;
-  }
+      input_version_(NULL) {
 }
 
 Compaction::~Compaction() {
@@ -1469,13 +1993,15 @@ void Compaction::AddInputDeletions(VersionEdit* edit) {
   }
 }
 
-bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
+bool Compaction::IsBaseLevelForKey(const Slice& user_key,
+                                   Cursor* cursor) const {
   // Maybe use binary search to find right entry instead of linear search?
   const Comparator* user_cmp = input_version_->vset_->icmp_.user_comparator();
   for (int lvl = level_ + 2; lvl < config::kNumLevels; lvl++) {
     const std::vector<FileMetaData*>& files = input_version_->files_[lvl];
-    for (; level_ptrs_[lvl] < files.size(); ) {
-      FileMetaData* f = files[level_ptrs_[lvl]];
+    size_t* level_ptr = &cursor->level_ptrs[lvl];
+    for (; *level_ptr < files.size(); ) {
+      FileMetaData* f = files[*level_ptr];
       if (user_cmp->Compare(user_key, f->largest.user_key()) <= 0) {
         // We've advanced far enough
         if (user_cmp->Compare(user_key, f->smallest.user_key()) >= 0) {
@@ -1484,28 +2010,41 @@ bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
         }
         break;
       }
-      level_ptrs_[lvl]++;
+      (*level_ptr)++;
+    }
+  }
+  return true;
+}
+
+bool Compaction::IsBaseLevelForRange(const Slice& begin,
+                                     const Slice& end) const {
+  for (int lvl = level_ + 2; lvl < config::kNumLevels; lvl++) {
+    if (input_version_->OverlapInLevel(lvl, &begin, &end)) {
+      return false;
     }
   }
   return true;
 }
 
-bool Compaction::ShouldStopBefore(const Slice& internal_key) {
+bool Compaction::ShouldStopBefore(const Slice& internal_key,
+                                  Cursor* cursor) const {
   // Scan to find earliest grandparent file that contains key.
   const InternalKeyComparator* icmp = &input_version_->vset_->icmp_;
-  while (grandparent_index_ < grandparents_.size() &&
+  while (cursor->grandparent_index < grandparents_.size() &&
       icmp->Compare(internal_key,
-                    grandparents_[grandparent_index_]->largest.Encode()) > 0) {
-    if (seen_key_) {
-      overlapped_bytes_ += grandparents_[grandparent_index_]->file_size;
+                    grandparents_[cursor->grandparent_index]->largest.Encode())
+      > 0) {
+    if (cursor->seen_key) {
+      cursor->overlapped_bytes +=
+          grandparents_[cursor->grandparent_index]->file_size;
     }
-    grandparent_index_++;
+    cursor->grandparent_index++;
   }
-  seen_key_ = true;
+  cursor->seen_key = true;
 
-  if (overlapped_bytes_ > kMaxGrandParentOverlapBytes) {
+  if (cursor->overlapped_bytes > kMaxGrandParentOverlapBytes) {
     // Too much overlap for current output; start new output
-    overlapped_bytes_ = 0;
+    cursor->overlapped_bytes = 0;
     return true;
   } else {
     return false;
@@ -10,11 +10,13 @@
 // entire set of versions is maintained in a VersionSet.
 //
 // Version,VersionSet are thread-compatible, but require external
-// synchronization on all accesses.
+// synchronization on all accesses (except for LastSequence(), which
+// may be called without synchronization).
 
 #ifndef STORAGE_LEVELDB_DB_VERSION_SET_H_
 #define STORAGE_LEVELDB_DB_VERSION_SET_H_
 
+#include <atomic>
 #include <map>
 #include <set>
 #include <vector>
@@ -30,6 +32,8 @@ namespace log { class Writer; }
 class Compaction;
 class Iterator;
 class MemTable;
+class PinnedValue;
+class RangeDelMap;
 class TableBuilder;
 class TableCache;
 class Version;
@@ -63,6 +67,10 @@ class Version {
   // REQUIRES: This version has been saved (see VersionSet::SaveTo)
   void AddIterators(const ReadOptions&, std::vector<Iterator*>* iters);
 
+  // Add the range tombstones of this Version to *map.
+  // REQUIRES: This version has been saved (see VersionSet::SaveTo)
+  Status AddRangeTombstones(RangeDelMap* map);
+
   // Lookup the value for key.  If found, store it in *val and
   // return OK.  Else return a non-OK status.  Fills *stats.
   // REQUIRES: lock is not held
@@ -73,11 +81,44 @@ class Version {
   Status Get(const ReadOptions&, const LookupKey& key, std::string* val,
              GetStats* stats);
 
+  // Like the above, but store the value in *val without copying it.
+  // REQUIRES: *val has been Reset()
+  Status Get(const ReadOptions&, const LookupKey& key, PinnedValue* val,
+             GetStats* stats);
+
+  // One key of a MultiGet() batch.  "status" and "stats" are filled in
+  // exactly as by the corresponding Get() call.
+  struct KeyRequest {
+    const LookupKey* key;
+    std::string* value;
+    Status* status;
+    GetStats stats;
+  };
+
+  // Equivalent to calling Get() for every request in *requests, but
+  // walks each level once for the whole batch and looks up all keys
+  // that fall into the same table with a single table cache access.
+  // REQUIRES: *requests is sorted by user key.
+  // REQUIRES: lock is not held
+  void MultiGet(const ReadOptions&, std::vector<KeyRequest>* requests);
+
   // Adds "stats" into the current state.  Returns true if a new
   // compaction may need to be triggered, false otherwise.
   // REQUIRES: lock is held
   bool UpdateStats(const GetStats& stats);
 
+  // Like UpdateStats(), but safe to call without the lock: charges the
+  // seek in "stats" and returns true iff the caller should take the lock
+  // and call RecordSeekCompaction(stats).  Only some of the seeks past a
+  // file's allowance return true, so readers rarely need the lock.
+  bool ChargeSeek(const GetStats& stats);
+
+  // Remember the file charged in "stats" as the next one to compact
+  // unless another file is already pending.  Returns true if a new
+  // compaction may need to be triggered, false otherwise.
+  // REQUIRES: lock is held
+  bool RecordSeekCompaction(const GetStats& stats);
+
   // Record a sample of bytes read at the specified internal key.
   // Samples are taken approximately once every config::kReadBytesPeriod
   // bytes.  Returns true if a new compaction may need to be triggered.
@@ -95,6 +136,11 @@ class Version {
       const InternalKey* end,           // NULL means after all keys
       std::vector<FileMetaData*>* inputs);
 
+  // Store in "*inputs" the files of the specified level whose keys all
+  // lie in the user key range [begin, end).
+  void GetContainedInputs(int level, const Slice& begin, const Slice& end,
+                          std::vector<FileMetaData*>* inputs);
+
   // Returns true iff some file in the specified level overlaps
   // some part of [*smallest_user_key,*largest_user_key].
   // smallest_user_key==NULL represents a key smaller than all keys in the DB.
@@ -129,6 +175,11 @@ class Version {
                           void* arg,
                           bool (*func)(void*, int, FileMetaData*));
 
+  // Shared implementation of the Get() variants.  Exactly one of "value"
+  // and "pinned" is non-NULL.
+  Status GetImpl(const ReadOptions&, const LookupKey& key,
+                 std::string* value, PinnedValue* pinned, GetStats* stats);
+
   VersionSet* vset_;            // VersionSet to which this Version belongs
   Version* next_;               // Next version in linked list
   Version* prev_;               // Previous version in linked list
@@ -141,18 +192,20 @@ class Version {
   FileMetaData* file_to_compact_;
   int file_to_compact_level_;
 
-  // Level that should be compacted next and its compaction score.
-  // Score < 1 means compaction is not strictly needed.  These fields
-  // are initialized by Finalize().
+  // Compaction score of every level and the highest of them.  Score < 1
+  // means compaction is not strictly needed.  These fields are
+  // initialized by Finalize().
+  double compaction_scores_[config::kNumLevels];
   double compaction_score_;
-  int compaction_level_;
 
   explicit Version(VersionSet* vset)
       : vset_(vset), next_(this), prev_(this), refs_(0),
         file_to_compact_(NULL),
         file_to_compact_level_(-1),
-        compaction_score_(-1),
-        compaction_level_(-1) {
+        compaction_score_(-1) {
+    for (int level = 0; level < config::kNumLevels; level++) {
+      compaction_scores_[level] = -1;
+    }
   }
 
   ~Version();
@@ -206,12 +259,15 @@ class VersionSet {
   int64_t NumLevelBytes(int level) const;
 
   // Return the last sequence number.
-  uint64_t LastSequence() const { return last_sequence_; }
+  // Entries up to the returned sequence are visible in the memtable.
+  uint64_t LastSequence() const {
+    return last_sequence_.load(std::memory_order_acquire);
+  }
 
   // Set the last sequence number to s.
   void SetLastSequence(uint64_t s) {
-    assert(s >= last_sequence_);
-    last_sequence_ = s;
+    assert(s >= LastSequence());
+    last_sequence_.store(s, std::memory_order_release);
   }
 
   // Mark the specified file number as used.
@@ -224,21 +280,42 @@ class VersionSet {
   // being compacted, or zero if there is no such log file.
   uint64_t PrevLogNumber() const { return prev_log_number_; }
 
-  // Pick level and inputs for a new compaction.
-  // Returns NULL if there is no compaction to be done.
+  // Pick level and inputs for a new compaction that can run concurrently
+  // with the running compactions: it does not share input files with
+  // them, and the key ranges of compactions that touch a common level do
+  // not overlap.  Returns NULL if there is no such compaction to be done.
   // Otherwise returns a pointer to a heap-allocated object that
-  // describes the compaction.  Caller should delete the result.
+  // describes the compaction and registers it as running.  Caller
+  // should call ReleaseCompaction() once the compaction is done and
+  // then delete the result.
   Compaction* PickCompaction();
 
   // Return a compaction object for compacting the range [begin,end] in
   // the specified level.  Returns NULL if there is nothing in that
-  // level that overlaps the specified range.  Caller should delete
-  // the result.
+  // level that overlaps the specified range.  The result is registered
+  // as running like the result of PickCompaction() but, unlike those,
+  // may conflict with other running compactions.  Caller should call
+  // ReleaseCompaction() and delete the result.
   Compaction* CompactRange(
       int level,
       const InternalKey* begin,
       const InternalKey* end);
 
+  // Unregister a compaction returned by PickCompaction() or
+  // CompactRange().  Must be called before c->ReleaseInputs().
+  void ReleaseCompaction(Compaction* c);
+
+  // Returns the number of registered compactions.
+  int NumRunningCompactions() const {
+    return static_cast<int>(running_compactions_.size());
+  }
+
+  // Returns true iff a running compaction writes output files into
+  // "level" in a key range that overlaps [smallest_user_key,
+  // largest_user_key].
+  bool RangeUnderCompaction(int level, const Slice& smallest_user_key,
+                            const Slice& largest_user_key) const;
+
   // Return the maximum overlapping data (in bytes) at next level for any
   // file at a level >= 1.
   int64_t MaxNextLevelOverlappingBytes();
@@ -247,6 +324,15 @@ class VersionSet {
   // The caller should delete the iterator when no longer needed.
   Iterator* MakeInputIterator(Compaction* c);
 
+  // Stores in *boundaries up to max_parts-1 user keys, in increasing
+  // order, that split the inputs of "*c" into parts of about the same
+  // size.  Every boundary is the smallest or largest user key of some
+  // input file.  No part is made smaller than an output file.  Reads the
+  // index blocks of the inputs.
+  // REQUIRES: lock is not held
+  void SplitCompaction(Compaction* c, int max_parts,
+                       std::vector<std::string>* boundaries);
+
   // Returns true iff some level needs a compaction.
   bool NeedsCompaction() const {
     Version* v = current_;
@@ -278,6 +364,10 @@ class VersionSet {
 
   void Finalize(Version* v);
 
+  // Return the approximate offset in file "f" of the data for "key".
+  uint64_t ApproximateOffsetInFile(const FileMetaData* f,
+                                   const InternalKey& key);
+
   void GetRange(const std::vector<FileMetaData*>& inputs,
                 InternalKey* smallest,
                 InternalKey* largest);
@@ -289,6 +379,16 @@ class VersionSet {
 
   void SetupOtherInputs(Compaction* c);
 
+  // Completes the inputs of c, whose first input files are picked, from
+  // the current version.  Returns c, registered as running, or NULL after
+  // deleting c if it conflicts with a running compaction.
+  Compaction* SetupCompaction(Compaction* c);
+
+  // Returns true iff c must not run concurrently with a running compaction.
+  bool ConflictsWithRunning(const Compaction* c) const;
+
+  void RegisterCompaction(Compaction* c);
+
   // Save current contents to *log
   Status WriteSnapshot(log::Writer* log);
 
@@ -301,7 +401,7 @@ class VersionSet {
   const InternalKeyComparator icmp_;
   uint64_t next_file_number_;
   uint64_t manifest_file_number_;
-  uint64_t last_sequence_;
+  std::atomic<uint64_t> last_sequence_;
   uint64_t log_number_;
   uint64_t prev_log_number_;  // 0 or backing store for memtable being compacted
 
@@ -315,6 +415,9 @@ class VersionSet {
   // Either an empty string, or a valid InternalKey.
   std::string compact_pointer_[config::kNumLevels];
 
+  // Compactions handed out and not yet released.
+  std::vector<Compaction*> running_compactions_;
+
   // No copying allowed
   VersionSet(const VersionSet&);
   void operator=(const VersionSet&);
@@ -349,14 +452,38 @@ class Compaction {
   // Add all inputs to this compaction as delete operations to *edit.
   void AddInputDeletions(VersionEdit* edit);
 
+  // Position of a pass over the compaction's keys in increasing order, as
+  // needed by IsBaseLevelForKey() and ShouldStopBefore().  Passes over
+  // disjoint parts of the key range may run concurrently, each with its
+  // own cursor, which starts out at the beginning of the key range.
+  struct Cursor {
+    // State used to check for number of of overlapping grandparent files
+    // (parent == level_ + 1, grandparent == level_ + 2)
+    size_t grandparent_index;  // Index in grandparents_
+    bool seen_key;             // Some output key has been seen
+    int64_t overlapped_bytes;  // Bytes of overlap between current output
+                               // and grandparent files
+
+    // level_ptrs holds indices into input_version_->levels_: our state
+    // is that we are positioned at one of the file ranges for each
+    // higher level than the ones involved in this compaction (i.e. for
+    // all L >= level_ + 2).
+    size_t level_ptrs[config::kNumLevels];
+
+    Cursor();
+  };
+
   // Returns true if the information we have available guarantees that
   // the compaction is producing data in "level+1" for which no data exists
   // in levels greater than "level+1".
-  bool IsBaseLevelForKey(const Slice& user_key);
+  bool IsBaseLevelForKey(const Slice& user_key, Cursor* cursor) const;
+
+  // Like IsBaseLevelForKey(), for every user key in [begin, end].
+  bool IsBaseLevelForRange(const Slice& begin, const Slice& end) const;
 
   // Returns true iff we should stop building the current output
   // before processing "internal_key".
-  bool ShouldStopBefore(const Slice& internal_key);
+  bool ShouldStopBefore(const Slice& internal_key, Cursor* cursor) const;
 
   // Release the input version for the compaction, once the compaction
   // is successful.
@@ -373,24 +500,17 @@ class Compaction {
   Version* input_version_;
   VersionEdit edit_;
 
+  // Range of internal keys covered by the inputs from both levels.
+  // Set by SetupOtherInputs().
+  InternalKey smallest_;
+  InternalKey largest_;
+
   // Each compaction reads inputs from "level_" and "level_+1"
   std::vector<FileMetaData*> inputs_[2];      // The two sets of inputs
 
-  // State used to check for number of of overlapping grandparent files
+  // Grandparent files overlapping the compaction
   // (parent == level_ + 1, grandparent == level_ + 2)
   std::vector<FileMetaData*> grandparents_;
-  size_t grandparent_index_;  // Index in grandparent_starts_
-  bool seen_key_;             // Some output key has been seen
-  int64_t overlapped_bytes_;  // Bytes of overlap between current output
-                              // and grandparent files
-
-  // State for implementing IsBaseLevelForKey
-
-  // level_ptrs_ holds indices into input_version_->levels_: our state
-  // is that we are positioned at one of the file ranges for each
-  // higher level than the ones involved in this compaction (i.e. for
-  // all L >= level_ + 2).
-  size_t level_ptrs_[config::kNumLevels];
 };
 
 }  // namespace leveldb
@@ -8,7 +8,8 @@
 //    data: record[count]
 // record :=
 //    kTypeValue varstring varstring         |
-//    kTypeDeletion varstring
+//    kTypeDeletion varstring                |
+//    kTypeRangeDeletion varstring varstring
 // varstring :=
 //    len: varint32
 //    data: uint8[len]
@@ -34,6 +35,9 @@ WriteBatch::~WriteBatch() { }
 
 WriteBatch::Handler::~Handler() { }
 
+void WriteBatch::Handler::DeleteRange(const Slice& begin, const Slice& end) {
+}
+
 void WriteBatch::Clear() {
   rep_.clear();
   rep_.resize(kHeader);
@@ -68,6 +72,14 @@ Status WriteBatch::Iterate(Handler* handler) const {
           return Status::Corruption("bad WriteBatch Delete");
         }
         break;
+      case kTypeRangeDeletion:
+        if (GetLengthPrefixedSlice(&input, &key) &&
+            GetLengthPrefixedSlice(&input, &value)) {
+          handler->DeleteRange(key, value);
+        } else {
+          return Status::Corruption("bad WriteBatch DeleteRange");
+        }
+        break;
       default:
         return Status::Corruption("unknown WriteBatch tag");
     }
@@ -108,28 +120,79 @@ void WriteBatch::Delete(const Slice& key) {
   PutLengthPrefixedSlice(&rep_, key);
 }
 
+void WriteBatch::DeleteRange(const Slice& begin, const Slice& end) {
+  WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
+  rep_.push_back(static_cast<char>(kTypeRangeDeletion));
+  PutLengthPrefixedSlice(&rep_, begin);
+  PutLengthPrefixedSlice(&rep_, end);
+}
+
 namespace {
 class MemTableInserter : public WriteBatch::Handler {
  public:
   SequenceNumber sequence_;
   MemTable* mem_;
+  int shard_;
+  int num_shards_;
+  int index_;   // Position of the current entry in the batch
 
   virtual void Put(const Slice& key, const Slice& value) {
-    mem_->Add(sequence_, kTypeValue, key, value);
+    if (Owns(key)) {
+      mem_->Add(sequence_, kTypeValue, key, value);
+    }
     sequence_++;
+    index_++;
   }
   virtual void Delete(const Slice& key) {
-    mem_->Add(sequence_, kTypeDeletion, key, Slice());
+    if (Owns(key)) {
+      mem_->Add(sequence_, kTypeDeletion, key, Slice());
+    }
     sequence_++;
+    index_++;
+  }
+  virtual void DeleteRange(const Slice& begin, const Slice& end) {
+    // Range tombstones all go to the same list: the first shard owns them
+    // unless any entry may be added concurrently.  Empty ranges are
+    // dropped, but still use up their sequence number.
+    if (mem_->user_comparator()->Compare(begin, end) >= 0) {
+      // Nothing to delete
+    } else if (num_shards_ == 1 ||
+               (mem_->concurrent_adds() ? index_ % num_shards_ == shard_
+                                        : shard_ == 0)) {
+      mem_->Add(sequence_, kTypeRangeDeletion, begin, end);
+    }
+    sequence_++;
+    index_++;
+  }
+
+ private:
+  bool Owns(const Slice& key) const {
+    if (num_shards_ == 1) {
+      return true;
+    } else if (mem_->concurrent_adds()) {
+      return index_ % num_shards_ == shard_;
+    } else {
+      return mem_->PartitionOf(key) % num_shards_ == shard_;
+    }
   }
 };
 }  // namespace
 
 Status WriteBatchInternal::InsertInto(const WriteBatch* b,
                                       MemTable* memtable) {
+  return InsertInto(b, memtable, 0, 1);
+}
+
+Status WriteBatchInternal::InsertInto(const WriteBatch* b,
+                                      MemTable* memtable,
+                                      int shard, int num_shards) {
+  assert(0 <= shard && shard < num_shards);
   MemTableInserter inserter;
   inserter.sequence_ = WriteBatchInternal::Sequence(b);
   inserter.mem_ = memtable;
+  inserter.shard_ = shard;
+  inserter.num_shards_ = num_shards;
+  inserter.index_ = 0;
   return b->Iterate(&inserter);
 }
 
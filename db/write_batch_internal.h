@@ -41,6 +41,15 @@ class WriteBatchInternal {
 
   static Status InsertInto(const WriteBatch* batch, MemTable* memtable);
 
+  // Like the above, but only inserts the entries whose memtable partition
+  // p satisfies p % num_shards == shard, or, if the memtable allows
+  // concurrent adds, the entries whose position i in the batch does.
+  // Range deletions belong to shard 0 in the former case.
+  // Inserting all shards of a batch, in any order or concurrently, is
+  // equivalent to inserting the batch.
+  static Status InsertInto(const WriteBatch* batch, MemTable* memtable,
+                           int shard, int num_shards);
+
   static void Append(WriteBatch* dst, const WriteBatch* src);
 };
 
@@ -12,16 +12,23 @@
 
 namespace leveldb {
 
-static std::string PrintContents(WriteBatch* b) {
+// Inserts b into a memtable with the given configuration, one shard at
+// a time in reverse order, and prints the memtable contents.
+static std::string PrintContents(WriteBatch* b,
+                                 int partitions = 1, int shards = 1,
+                                 bool concurrent = false) {
   InternalKeyComparator cmp(BytewiseComparator());
-  MemTable* mem = new MemTable(cmp);
+  MemTable* mem = new MemTable(cmp, partitions, concurrent);
   mem->Ref();
   std::string state;
-  Status s = WriteBatchInternal::InsertInto(b, mem);
+  Status s;
+  for (int shard = shards - 1; shard >= 0 && s.ok(); shard--) {
+    s = WriteBatchInternal::InsertInto(b, mem, shard, shards);
+  }
   int count = 0;
   Iterator* iter = mem->NewIterator();
   for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
-    ParsedInternalKey ikey;
+    ParsedInternalKey ikey(Slice(), 0, kTypeValue);
     ASSERT_TRUE(ParseInternalKey(iter->key(), &ikey));
     switch (ikey.type) {
       case kTypeValue:
@@ -38,11 +45,33 @@ static std::string PrintContents(WriteBatch* b) {
         state.append(")");
         count++;
         break;
+      case kTypeRangeDeletion:
+        // Range tombstones are kept apart, and printed below
+        state.append("Misplaced(");
+        state.append(ikey.user_key.ToString());
+        state.append(")");
+        break;
     }
     state.append("@");
     state.append(NumberToString(ikey.sequence));
   }
   delete iter;
+  iter = mem->NewRangeTombstoneIterator();
+  if (iter != NULL) {
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      ParsedInternalKey ikey(Slice(), 0, kTypeRangeDeletion);
+      ASSERT_TRUE(ParseInternalKey(iter->key(), &ikey));
+      ASSERT_EQ(kTypeRangeDeletion, ikey.type);
+      state.append("DeleteRange(");
+      state.append(ikey.user_key.ToString());
+      state.append(", ");
+      state.append(iter->value().ToString());
+      state.append(")@");
+      state.append(NumberToString(ikey.sequence));
+      count++;
+    }
+    delete iter;
+  }
   if (!s.ok()) {
     state.append("ParseError()");
   } else if (count != WriteBatchInternal::Count(b)) {
@@ -74,6 +103,111 @@ TEST(WriteBatchTest, Multiple) {
             PrintContents(&batch));
 }
 
+TEST(WriteBatchTest, DeleteRange) {
+  WriteBatch batch;
+  batch.Put(Slice("foo"), Slice("bar"));
+  batch.DeleteRange(Slice("a"), Slice("c"));
+  batch.Put(Slice("baz"), Slice("boo"));
+  batch.DeleteRange(Slice("b"), Slice("g"));
+  WriteBatchInternal::SetSequence(&batch, 100);
+  ASSERT_EQ(4, WriteBatchInternal::Count(&batch));
+  const std::string expected =
+      "Put(baz, boo)@102"
+      "Put(foo, bar)@100"
+      "DeleteRange(a, c)@101"
+      "DeleteRange(b, g)@103";
+  ASSERT_EQ(expected, PrintContents(&batch));
+  ASSERT_EQ(expected, PrintContents(&batch, 4, 3));
+  ASSERT_EQ(expected, PrintContents(&batch, 2, 3, true));
+}
+
+TEST(WriteBatchTest, EmptyDeleteRange) {
+  WriteBatch batch;
+  batch.DeleteRange(Slice("c"), Slice("a"));
+  batch.DeleteRange(Slice("b"), Slice("b"));
+  batch.Put(Slice("foo"), Slice("bar"));
+  WriteBatchInternal::SetSequence(&batch, 100);
+  ASSERT_EQ(3, WriteBatchInternal::Count(&batch));
+
+  // The empty ranges use up sequence numbers but leave no tombstones
+  InternalKeyComparator cmp(BytewiseComparator());
+  MemTable* mem = new MemTable(cmp);
+  mem->Ref();
+  ASSERT_OK(WriteBatchInternal::InsertInto(&batch, mem));
+  ASSERT_TRUE(mem->NewRangeTombstoneIterator() == NULL);
+  Iterator* iter = mem->NewIterator();
+  iter->SeekToFirst();
+  ASSERT_TRUE(iter->Valid());
+  ParsedInternalKey ikey(Slice(), 0, kTypeValue);
+  ASSERT_TRUE(ParseInternalKey(iter->key(), &ikey));
+  ASSERT_EQ(102u, ikey.sequence);
+  delete iter;
+  mem->Unref();
+}
+
+// Looks up key in mem as of seq, returning its value, "NOT_FOUND" for a
+// deletion, or "MISSING".
+static std::string MemGet(MemTable* mem, const std::string& key,
+                          SequenceNumber seq) {
+  LookupKey lkey(key, seq);
+  std::string value;
+  Status s;
+  if (!mem->Get(lkey, &value, &s)) {
+    return "MISSING";
+  }
+  return s.IsNotFound() ? "NOT_FOUND" : value;
+}
+
+TEST(WriteBatchTest, DeleteRangeGet) {
+  InternalKeyComparator cmp(BytewiseComparator());
+  MemTable* mem = new MemTable(cmp);
+  mem->Ref();
+  mem->Add(100, kTypeValue, "b", "v1");
+  mem->Add(101, kTypeRangeDeletion, "a", "c");
+  ASSERT_EQ("v1", MemGet(mem, "b", 100));
+  ASSERT_EQ("NOT_FOUND", MemGet(mem, "b", 101));
+  ASSERT_EQ("MISSING", MemGet(mem, "c", 101));
+
+  // Tombstones added after a lookup are seen by the next one
+  mem->Add(102, kTypeValue, "d", "v2");
+  ASSERT_EQ("v2", MemGet(mem, "d", 102));
+  mem->Add(103, kTypeRangeDeletion, "c", "e");
+  ASSERT_EQ("NOT_FOUND", MemGet(mem, "d", 103));
+  ASSERT_EQ("v2", MemGet(mem, "d", 102));
+  ASSERT_EQ("NOT_FOUND", MemGet(mem, "c", 103));
+  mem->Add(104, kTypeValue, "b", "v3");
+  ASSERT_EQ("v3", MemGet(mem, "b", 104));
+  for (int i = 0; i < 100; i++) {
+    char key[10];
+    snprintf(key, sizeof(key), "k%02d", i);
+    mem->Add(105 + i, kTypeRangeDeletion, key, "z");
+    ASSERT_EQ("NOT_FOUND", MemGet(mem, "x", 105 + i));
+    ASSERT_EQ("v3", MemGet(mem, "b", 105 + i));
+  }
+  mem->Unref();
+}
+
+TEST(WriteBatchTest, PartitionedMemTable) {
+  WriteBatch batch;
+  for (int i = 0; i < 20; i++) {
+    char key[10];
+    snprintf(key, sizeof(key), "k%02d", i);
+    if (i % 3 == 0) {
+      batch.Delete(key);
+    } else {
+      batch.Put(key, "v");
+    }
+  }
+  batch.Put("k05", "again");
+  WriteBatchInternal::SetSequence(&batch, 100);
+  const std::string expected = PrintContents(&batch);
+  ASSERT_EQ(expected, PrintContents(&batch, 4, 1));
+  ASSERT_EQ(expected, PrintContents(&batch, 4, 3));
+  ASSERT_EQ(expected, PrintContents(&batch, 7, 7));
+  ASSERT_EQ(expected, PrintContents(&batch, 1, 5, true));
+  ASSERT_EQ(expected, PrintContents(&batch, 3, 2, true));
+}
+
 TEST(WriteBatchTest, Corruption) {
   WriteBatch batch;
   batch.Put(Slice("foo"), Slice("bar"));
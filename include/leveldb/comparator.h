@@ -51,6 +51,13 @@ class Comparator {
   // Simple comparator implementations may return with *key unchanged,
   // i.e., an implementation of this method that does nothing is correct.
   virtual void FindShortSuccessor(std::string* key) const = 0;
+
+  // Returns the part of "key" that point lookups for "key" must match,
+  // which the hash indexes of data blocks are built on: keys for which
+  // Compare() returns 0 must yield bytewise equal results.  The default
+  // implementation returns "key" itself, which is correct for any
+  // comparator that only considers bytewise identical keys equal.
+  virtual Slice KeyForHashing(const Slice& key) const;
 };
 
 // Return a builtin comparator that uses lexicographic byte-wise
@@ -7,8 +7,10 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <vector>
 #include "leveldb/iterator.h"
 #include "leveldb/options.h"
+#include "leveldb/pinned_value.h"
 
 namespace leveldb {
 
@@ -68,6 +70,15 @@ class DB {
   // Note: consider setting options.sync = true.
   virtual Status Delete(const WriteOptions& options, const Slice& key) = 0;
 
+  // Remove the database entries (if any) for all keys in the range
+  // ["begin", "end").  Returns OK on success, and a non-OK status on
+  // error.  The cost of the call does not depend on the number of keys
+  // in the range: it writes a single range tombstone, which hides the
+  // older entries from reads and lets compactions drop them.
+  // Note: consider setting options.sync = true.
+  virtual Status DeleteRange(const WriteOptions& options,
+                             const Slice& begin, const Slice& end);
+
   // Apply the specified updates to the database.
   // Returns OK on success, non-OK on failure.
   // Note: consider setting options.sync = true.
@@ -83,6 +94,25 @@ class DB {
   virtual Status Get(const ReadOptions& options,
                      const Slice& key, std::string* value) = 0;
 
+  // Like Get(), but where possible "*value" points directly into the
+  // block cache or memtable holding the value instead of receiving a
+  // copy of it.  Any value "*value" held before the call is released.
+  //
+  // "*value" must be reset or destroyed before the DB is deleted.
+  virtual Status GetPinned(const ReadOptions& options,
+                           const Slice& key, PinnedValue* value);
+
+  // Look up every key in "keys" as if by Get(), against one consistent
+  // view of the database.  On return values->size() == keys.size(), and
+  // the i-th element of the result is the status of the lookup of
+  // keys[i]; (*values)[i] holds its value iff that status is ok.
+  //
+  // Cheaper than calling Get() for each key since the lookups share
+  // table and block accesses.
+  virtual std::vector<Status> MultiGet(const ReadOptions& options,
+                                       const std::vector<Slice>& keys,
+                                       std::vector<std::string>* values);
+
   // Return a heap-allocated iterator over the contents of the database.
   // The result of NewIterator() is initially invalid (caller must
   // call one of the Seek methods on the iterator before using it).
@@ -142,6 +172,29 @@ class DB {
   //    db->CompactRange(NULL, NULL);
   virtual void CompactRange(const Slice* begin, const Slice* end) = 0;
 
+  // Remove the database entries (if any) for all keys in the range
+  // ["begin", "end") like DeleteRange(), then reclaim their space at
+  // once: the files holding only keys of the range are dropped without
+  // being read, and the few that straddle its bounds are compacted.  The
+  // call blocks for the latter, like CompactRange() does.
+  //
+  // Snapshots taken before the call may no longer see the dropped keys.
+  virtual Status BulkDeleteForRange(const WriteOptions& options,
+                                    const Slice& begin, const Slice& end);
+
+  // Add the tables written by SstFileWriter into the named files to the
+  // database, as if their entries had been written in one batch, but
+  // without going through the log, the memtable or compactions: the
+  // files are moved into the database directory, which must be on the
+  // same file system, and each is placed in the deepest level where it
+  // overlaps no newer data.  Either all files are added or none is.
+  // Returns OK on success, and a non-OK status on error, for example if
+  // the key ranges of the files overlap each other.
+  //
+  // The call blocks writes while it runs, and flushes the memtable first
+  // if it holds keys in the range of the files.
+  virtual Status IngestExternalFiles(const std::vector<std::string>& files);
+
  private:
   // No copying allowed
   DB(const DB&);
@@ -84,6 +84,25 @@ class Env {
   virtual Status NewAppendableFile(const std::string& fname,
                                    WritableFile** result);
 
+  // Like NewRandomAccessFile(), but reads of the returned file bypass the
+  // operating system's page cache where the platform allows it, so that
+  // they neither use nor evict the cached data of other files.  Every
+  // read costs a trip to the device: callers should read in large chunks
+  // or cache what they read themselves.
+  //
+  // The default implementation calls NewRandomAccessFile().
+  virtual Status NewDirectRandomAccessFile(const std::string& fname,
+                                           RandomAccessFile** result);
+
+  // Like NewWritableFile(), but the data written to the returned file
+  // bypasses the operating system's page cache where the platform allows
+  // it.  The file may keep data buffered across Flush() calls; Sync()
+  // and Close() write all of it.
+  //
+  // The default implementation calls NewWritableFile().
+  virtual Status NewDirectWritableFile(const std::string& fname,
+                                       WritableFile** result);
+
   // Returns true iff the named file exists.
   virtual bool FileExists(const std::string& fname) = 0;
 
@@ -140,6 +159,31 @@ class Env {
       void (*function)(void* arg),
       void* arg) = 0;
 
+  // Background work is queued by priority.  In an Env with priority
+  // pools (see HasPriorityPools()), work of one priority never waits for
+  // work of the other priority to finish.  The two-argument Schedule()
+  // uses kLowPriority.
+  enum Priority {
+    kLowPriority = 0,
+    kHighPriority = 1
+  };
+
+  // Like Schedule(function, arg), but queues "function" with priority
+  // "pri".  The default implementation ignores the priority.
+  virtual void Schedule(void (*function)(void* arg), void* arg,
+                        Priority pri) {
+    Schedule(function, arg);
+  }
+
+  // Make sure that at least "threads" background threads run the work
+  // queued with priority "pri".  The default implementation does nothing.
+  virtual void IncreaseBackgroundThreads(int threads, Priority pri) { }
+
+  // Returns true if work queued with kHighPriority runs in threads of its
+  // own, so that it never waits behind work queued with kLowPriority.
+  // The default implementation returns false.
+  virtual bool HasPriorityPools() { return false; }
+
   // Start a new thread, invoking "function(arg)" within the new thread.
   // When "function(arg)" returns, the thread will be destroyed.
   virtual void StartThread(void (*function)(void* arg), void* arg) = 0;
@@ -307,6 +351,13 @@ class EnvWrapper : public Env {
   Status NewAppendableFile(const std::string& f, WritableFile** r) {
     return target_->NewAppendableFile(f, r);
   }
+  Status NewDirectRandomAccessFile(const std::string& f,
+                                   RandomAccessFile** r) {
+    return target_->NewDirectRandomAccessFile(f, r);
+  }
+  Status NewDirectWritableFile(const std::string& f, WritableFile** r) {
+    return target_->NewDirectWritableFile(f, r);
+  }
   bool FileExists(const std::string& f) { return target_->FileExists(f); }
   Status GetChildren(const std::string& dir, std::vector<std::string>* r) {
     return target_->GetChildren(dir, r);
@@ -327,6 +378,13 @@ class EnvWrapper : public Env {
   void Schedule(void (*f)(void*), void* a) {
     return target_->Schedule(f, a);
   }
+  void Schedule(void (*f)(void*), void* a, Priority pri) {
+    return target_->Schedule(f, a, pri);
+  }
+  void IncreaseBackgroundThreads(int threads, Priority pri) {
+    return target_->IncreaseBackgroundThreads(threads, pri);
+  }
+  bool HasPriorityPools() { return target_->HasPriorityPools(); }
   void StartThread(void (*f)(void*), void* a) {
     return target_->StartThread(f, a);
   }
@@ -65,6 +65,33 @@ class FilterPolicy {
 // trailing spaces in keys.
 extern const FilterPolicy* NewBloomFilterPolicy(int bits_per_key);
 
+// Return a new filter policy that uses a bloom filter split into blocks
+// of one cache line each, with approximately the specified number of
+// bits per key.  All bits for a key lie in one block, so checking a key
+// costs at most one cache miss, where the filters returned by
+// NewBloomFilterPolicy() cost up to one per probe.  Filters are rounded
+// up to whole 64-byte blocks, and for the same number of bits per key
+// the false positive rate can be slightly higher.
+//
+// The filters are not compatible with those of NewBloomFilterPolicy(),
+// and the policy has a different name, so a database can switch between
+// the two: tables with filters of the other policy are read as if they
+// had no filters.  The same restriction on comparators applies.
+extern const FilterPolicy* NewBlockedBloomFilterPolicy(int bits_per_key);
+
+// Return a new filter policy that uses Ribbon filters with the false
+// positive rate of the bloom filters of NewBloomFilterPolicy(bits_per_key),
+// or a lower one, in 20-25% less space: about 7.7 bits per key where bloom
+// filters take 10.  Building a filter costs three to four times more CPU
+// than a bloom filter; checking a key costs about the same.
+//
+// The savings need a few hundred keys per filter, so use the policy with
+// Options::whole_file_filter or Options::partition_index_and_filters:
+// filters over fewer keys, like those for 2KB of data blocks, fall back
+// to bloom filters.  Options::filter_policy_per_level can limit them to
+// the bottom levels.  The same restriction on comparators applies.
+extern const FilterPolicy* NewRibbonFilterPolicy(int bits_per_key);
+
 }
 
 #endif  // STORAGE_LEVELDB_INCLUDE_FILTER_POLICY_H_
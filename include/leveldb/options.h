@@ -6,6 +6,7 @@
 #define STORAGE_LEVELDB_INCLUDE_OPTIONS_H_
 
 #include <stddef.h>
+#include <vector>
 
 namespace leveldb {
 
@@ -14,6 +15,7 @@ class Comparator;
 class Env;
 class FilterPolicy;
 class Logger;
+class SliceTransform;
 class Snapshot;
 
 // DB contents are stored in a set of blocks, each of which holds a
@@ -24,7 +26,22 @@ enum CompressionType {
   // NOTE: do not change the values of existing entries, as these are
   // part of the persistent format on disk.
   kNoCompression     = 0x0,
-  kSnappyCompression = 0x1
+  kSnappyCompression = 0x1,
+  kLZ4Compression    = 0x2,
+  kZstdCompression   = 0x3
+};
+
+// The data structure holding the entries of a memtable.
+enum MemTableRepType {
+  // A skiplist: O(log n) inserts and lookups, and ordered iteration at no
+  // extra cost.
+  kSkipListMemTable = 0x0,
+
+  // A hash table of small sorted lists: O(1) inserts and lookups, but
+  // iterators have to sort the entries first.  Suits point reads and
+  // writes; each iterator over a memtable being written to, including
+  // those of DB::NewIterator(), costs a sort of the whole memtable.
+  kHashMemTable     = 0x1
 };
 
 // Options to control the behavior of a database (passed to DB::Open)
@@ -82,6 +99,69 @@ struct Options {
   // Default: 4MB
   size_t write_buffer_size;
 
+  // Number of independent skiplists the write buffer is split into.  Keys
+  // are spread over the partitions by a hash of their bytes, and the
+  // writers of a group commit insert into different partitions in
+  // parallel instead of leaving all insertions to a single thread.  Only
+  // useful with many concurrent writers.  Because partitions are picked
+  // by hashing, a comparator must not treat keys with different bytes as
+  // equal when this is larger than 1.
+  //
+  // Default: 1
+  int memtable_partitions;
+
+  // If true, the memtable supports inserts from many threads at once and
+  // the writers of a group commit insert the entries of the group into it
+  // in parallel, whether or not it is partitioned.
+  //
+  // Default: false
+  bool allow_concurrent_memtable_write;
+
+  // If positive, every memtable gets a bloom filter over its user keys
+  // that takes this fraction of write_buffer_size, at most 0.25.  Get()
+  // then skips the memtable and the immutable memtable for most keys they
+  // do not hold instead of searching them.  For entries taking about 100
+  // bytes of memtable, 0.0125 gives 10 bits per key and keeps false
+  // positives near 1%.  The memory counts against write_buffer_size.
+  // Like memtable_partitions, requires a comparator that does not treat
+  // keys with different bytes as equal.
+  //
+  // Default: 0 (no filter)
+  double memtable_bloom_size_ratio;
+
+  // The data structure of the memtable.  kHashMemTable makes Get() and
+  // writes O(1); it hashes user keys with Comparator::KeyForHashing().
+  //
+  // Default: kSkipListMemTable
+  MemTableRepType memtable_rep;
+
+  // Number of hash buckets of a kHashMemTable memtable, split over its
+  // partitions.  About one per entry keeps lookups O(1); each bucket
+  // takes 8 bytes, which count against write_buffer_size.
+  //
+  // Default: 50000
+  size_t memtable_hash_buckets;
+
+  // Maximum number of compactions that may run concurrently.  Compactions
+  // only run concurrently if they do not touch overlapping key ranges of
+  // a common level.  Flushes of the write buffer do not count against
+  // this limit: they run in the Env's high priority background pool.
+  // The Env's low priority pool is grown to this many threads for each
+  // subcompaction a compaction may run (see max_subcompactions).
+  //
+  // Default: 1
+  int max_background_compactions;
+
+  // Maximum number of threads a single compaction is split over.  The
+  // key range of a large compaction is cut at input file boundaries into
+  // up to this many parts of at least one output file each, which are
+  // compacted in parallel into separate output files and installed
+  // together.  The parts run on the Env's low priority pool, which is
+  // grown to max_background_compactions * max_subcompactions threads.
+  //
+  // Default: 1
+  int max_subcompactions;
+
   // Number of open files that can be used by the DB.  You may need to
   // increase this if your database has a large working set (budget
   // one open file per 2MB of working set).
@@ -89,6 +169,23 @@ struct Options {
   // Default: 1000
   int max_open_files;
 
+  // If true, the tables written by memtable flushes and compactions,
+  // and the tables read by compactions, bypass the operating system's
+  // page cache, so that the data a compaction moves through does not
+  // evict the data foreground reads rely on.  Compactions then read
+  // their inputs in large chunks of their own.  Has no effect on
+  // platforms or file systems without direct I/O.
+  //
+  // Default: false
+  bool use_direct_io_for_flush_and_compaction;
+
+  // If true, tables are opened for reads by Get() and iterators that
+  // bypass the operating system's page cache, and only block_cache
+  // holds their data in memory.  Size block_cache accordingly.
+  //
+  // Default: false
+  bool use_direct_reads;
+
   // Control over blocks (user data is stored in a set of blocks, and
   // a block is the unit of reading from disk).
 
@@ -126,8 +223,80 @@ struct Options {
   // worth switching to kNoCompression.  Even if the input data is
   // incompressible, the kSnappyCompression implementation will
   // efficiently detect that and will switch to uncompressed mode.
+  //
+  // kLZ4Compression is about as fast as snappy and usually compresses
+  // a bit better.  kZstdCompression compresses considerably better at
+  // several times the CPU cost, which suits the large, rarely rewritten
+  // bottom level.  Blocks are stored uncompressed if the chosen
+  // algorithm is not supported by this build.
   CompressionType compression;
 
+  // If non-empty, the compression used for tables written to level L is
+  // compression_per_level[L], or its last entry if L is beyond its end,
+  // and "compression" is ignored.  For example {kLZ4Compression,
+  // kLZ4Compression, kZstdCompression} keeps levels 0 and 1 cheap to
+  // write and compresses levels 2 and up densely.  Tables written by
+  // memtable flushes use the entry for level 0.
+  //
+  // Default: empty
+  std::vector<CompressionType> compression_per_level;
+
+  // If true, each data block of a table ends in a hash index from its
+  // keys to the restart interval holding them (see
+  // block_restart_interval), so that Get() can usually go straight to
+  // its key instead of binary searching the block, and skips blocks that
+  // do not hold the key at all.  The index costs about 1.3 bytes per key.
+  // Iterators do not use it.  Blocks with a hash index cannot be read by
+  // versions of leveldb without support for it.
+  //
+  // Default: false
+  bool data_block_hash_index;
+
+  // If true, the index of each table is split into partitions of about
+  // index_partition_size bytes, and a small top-level index points to
+  // the partitions.  Filters are then built per index partition instead
+  // of per 2KB of data blocks.  Only the top-level indexes are kept in
+  // memory for open tables; partitions are read on demand through the
+  // block cache like data blocks, so that the memory used for indexes
+  // and filters is bounded by the cache rather than growing with the
+  // size of the database.  Costs an extra block read per lookup when a
+  // partition is not cached.  Tables with partitioned indexes cannot be
+  // read by versions of leveldb without support for them.
+  //
+  // Default: false
+  bool partition_index_and_filters;
+
+  // Approximate size of index partitions, when
+  // partition_index_and_filters is set.
+  //
+  // Default: 4K
+  size_t index_partition_size;
+
+  // If true, and filter_policy is set, each table gets a single filter
+  // over all of its keys instead of one filter per 2KB of data blocks.
+  // Get() checks it before looking at the index, so that lookups of
+  // keys not in the table never search the index.  The filter is
+  // loaded into memory with the table.  Ignored if
+  // partition_index_and_filters is set, which filters per partition.
+  //
+  // Default: false
+  bool whole_file_filter;
+
+  // If non-zero, tables compressed with kZstdCompression train a
+  // Zstandard dictionary of at most this many bytes on their first data
+  // blocks, store it in the table and compress all their data blocks
+  // with it.  This exploits redundancy across blocks, which pays off for
+  // small values that resemble each other.  16KB is a reasonable size.
+  //
+  // Default: 0
+  size_t zstd_max_dict_bytes;
+
+  // Amount of uncompressed data a table buffers in memory to train its
+  // dictionary on.  Only used if zstd_max_dict_bytes is non-zero.
+  //
+  // Default: 1MB
+  size_t zstd_max_train_bytes;
+
   // EXPERIMENTAL: If true, append to existing MANIFEST and log files
   // when a database is opened.  This can significantly speed up open.
   //
@@ -141,6 +310,35 @@ struct Options {
   // Default: NULL
   const FilterPolicy* filter_policy;
 
+  // If non-empty, the filters of tables written to level L are built
+  // with filter_policy_per_level[L], or its last entry if L is beyond its
+  // end, and filter_policy is ignored for writing; a NULL entry builds no
+  // filters.  For example {bloom, bloom, ribbon}, with the policies of
+  // NewBloomFilterPolicy(10) and NewRibbonFilterPolicy(10), keeps flushes
+  // and small compactions cheap and gives the bottom levels, which hold
+  // most keys, the denser filters.  Tables written by memtable flushes
+  // use the entry for level 0.
+  //
+  // Tables are read with whichever of filter_policy and these policies
+  // built their filters, so a policy should stay in the list as long as
+  // tables written with it may remain.
+  //
+  // Default: empty
+  std::vector<const FilterPolicy*> filter_policy_per_level;
+
+  // If non-NULL, use the specified transform to extract a prefix from
+  // each user key.  The filters built with filter_policy then record
+  // the prefix of every key besides the key itself, which lets
+  // iterators with ReadOptions::prefix_same_as_start skip the tables
+  // holding no key with the prefix they are confined to.
+  //
+  // Filters record the name of the transform.  Tables written with a
+  // different transform, or none, are read as if they had no filters
+  // until they are compacted.
+  //
+  // Default: NULL
+  const SliceTransform* prefix_extractor;
+
   // Create an Options object with default values for all fields.
   Options();
 };
@@ -164,10 +362,21 @@ struct ReadOptions {
   // Default: NULL
   const Snapshot* snapshot;
 
+  // If true, and the database has a prefix_extractor, an iterator
+  // positioned by Seek() only yields keys with the same prefix as the
+  // seek target, and becomes invalid when it moves past them.  Tables
+  // whose filters show that they hold no such key are not read.  Such
+  // an iterator cannot move backwards: Prev() makes it invalid with a
+  // NotSupported status.  Has no effect after SeekToFirst() or
+  // SeekToLast(), or if the target has no prefix.
+  // Default: false
+  bool prefix_same_as_start;
+
   ReadOptions()
       : verify_checksums(false),
         fill_cache(true),
-        snapshot(NULL) {
+        snapshot(NULL),
+        prefix_same_as_start(false) {
   }
 };
 
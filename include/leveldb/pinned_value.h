@@ -0,0 +1,82 @@
+// Copyright (c) 2026 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A PinnedValue holds a value read by DB::GetPinned().  Unlike the
+// std::string filled in by DB::Get(), the value is usually not copied:
+// it points directly into the block cache entry or memtable that holds
+// it, which is kept alive until the PinnedValue is reset or destroyed.
+// Holding on to PinnedValues therefore holds on to block cache space
+// and memtables, so they should be released promptly.
+//
+// Multiple threads can invoke const methods on a PinnedValue without
+// external synchronization, but if any of the threads may call a
+// non-const method, all threads accessing the same PinnedValue must use
+// external synchronization.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_PINNED_VALUE_H_
+#define STORAGE_LEVELDB_INCLUDE_PINNED_VALUE_H_
+
+#include <string>
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+class PinnedValue {
+ public:
+  // Create an empty value.
+  PinnedValue();
+
+  // Releases the memory the value points into.
+  ~PinnedValue();
+
+  // Return the value.  The returned slice remains valid until this
+  // PinnedValue is reset, destroyed or passed to DB::GetPinned() again.
+  const Slice& value() const { return value_; }
+  const char* data() const { return value_.data(); }
+  size_t size() const { return value_.size(); }
+
+  // Return true iff the value points into memory owned by the database
+  // rather than into a private copy.
+  bool pinned() const { return cleanup_.function != NULL; }
+
+  // Release the memory the value points into and make the value empty.
+  void Reset();
+
+  // The remaining methods are used by DB implementations to fill in a
+  // PinnedValue.  REQUIRES: the PinnedValue has been Reset().
+
+  // Point the value at "value", whose storage the caller keeps alive
+  // until the cleanup functions registered below are invoked.
+  void PinSlice(const Slice& value) { value_ = value; }
+
+  // Register function/arg1/arg2 triples that will be invoked when this
+  // PinnedValue is reset or destroyed.
+  typedef void (*CleanupFunction)(void* arg1, void* arg2);
+  void RegisterCleanup(CleanupFunction function, void* arg1, void* arg2);
+
+  // Return a buffer that the caller may fill in with a copy of the value,
+  // followed by a call to PinSelf() to make it the value.
+  std::string* GetSelf() { return &buf_; }
+  void PinSelf() { value_ = buf_; }
+
+ private:
+  struct Cleanup {
+    CleanupFunction function;
+    void* arg1;
+    void* arg2;
+    Cleanup* next;
+  };
+
+  Slice value_;
+  std::string buf_;
+  Cleanup cleanup_;
+
+  // No copying allowed
+  PinnedValue(const PinnedValue&);
+  void operator=(const PinnedValue&);
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_PINNED_VALUE_H_
@@ -0,0 +1,52 @@
+// Copyright (c) 2026 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A database can be configured with a SliceTransform that extracts a
+// prefix from each key.  Keys that share a prefix are then recorded as
+// a group in the database's filters (see filter_policy.h), so that an
+// iterator confined to one prefix can skip the tables that hold none
+// of its keys.  See Options::prefix_extractor and
+// ReadOptions::prefix_same_as_start.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
+#define STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
+
+#include <stddef.h>
+
+namespace leveldb {
+
+class Slice;
+
+class SliceTransform {
+ public:
+  virtual ~SliceTransform();
+
+  // Return the name of this transform.  The name is recorded along with
+  // the filters built with it, so if the prefixes it extracts change,
+  // the name must change as well.  Otherwise filters built with the old
+  // prefixes may be consulted for the new ones.
+  virtual const char* Name() const = 0;
+
+  // Return true if "key" has a prefix.  Keys without one are never
+  // skipped by prefix filtering.
+  virtual bool InDomain(const Slice& key) const = 0;
+
+  // Return the prefix of "key", which must point into "key".
+  // REQUIRES: InDomain(key)
+  //
+  // All keys with a given prefix must be adjacent in the order of the
+  // database's comparator.
+  virtual Slice Transform(const Slice& key) const = 0;
+};
+
+// Return a new transform whose prefix is the first "prefix_len" bytes of
+// a key.  Shorter keys have no prefix.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.
+extern const SliceTransform* NewFixedPrefixTransform(size_t prefix_len);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
@@ -0,0 +1,76 @@
+// Copyright (c) 2026 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// SstFileWriter builds a table file outside of any database, from keys
+// added in sorted order, so that DB::IngestExternalFiles() can later
+// link it into a database without going through the log, the memtable
+// and compactions.
+//
+// Multiple threads can invoke const methods on an SstFileWriter without
+// external synchronization, but if any of the threads may call a
+// non-const method, all threads accessing the same SstFileWriter must use
+// external synchronization.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_SST_FILE_WRITER_H_
+#define STORAGE_LEVELDB_INCLUDE_SST_FILE_WRITER_H_
+
+#include <stdint.h>
+#include <string>
+#include "leveldb/options.h"
+#include "leveldb/slice.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class SstFileWriter {
+ public:
+  // Create a writer of tables for a database opened with "options".  The
+  // comparator, the filter policies, the prefix extractor and the table
+  // format options must be the ones of that database.  The tables are
+  // written as for the last level of the database, where bulk loads
+  // usually land.
+  explicit SstFileWriter(const Options& options);
+
+  // Abandons the file being written, if any.
+  ~SstFileWriter();
+
+  // Create the file named "fname" and start writing a table into it.
+  // REQUIRES: No file is being written
+  Status Open(const std::string& fname);
+
+  // Add key,value to the table.
+  // REQUIRES: key is after any previously added key according to the
+  //           comparator; an error is returned otherwise.
+  // REQUIRES: Open() has succeeded and Finish() has not been called
+  Status Put(const Slice& key, const Slice& value);
+
+  // Add a deletion of key to the table, which hides the entries for key
+  // that the database holds when the table is ingested.
+  // REQUIRES: Same as Put()
+  Status Delete(const Slice& key);
+
+  // Finish the table and sync and close its file.  Fails if nothing was
+  // added to the table.
+  // REQUIRES: Open() has succeeded and Finish() has not been called
+  Status Finish();
+
+  // Number of calls to Put() and Delete() since Open().
+  uint64_t NumEntries() const;
+
+  // Size of the file generated so far.  If invoked after a successful
+  // Finish() call, returns the size of the final file.
+  uint64_t FileSize() const;
+
+ private:
+  struct Rep;
+  Rep* rep_;
+
+  // No copying allowed
+  SstFileWriter(const SstFileWriter&);
+  void operator=(const SstFileWriter&);
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_SST_FILE_WRITER_H_
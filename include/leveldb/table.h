@@ -6,6 +6,7 @@
 #define STORAGE_LEVELDB_INCLUDE_TABLE_H_
 
 #include <stdint.h>
+#include <string>
 #include "leveldb/iterator.h"
 
 namespace leveldb {
@@ -14,6 +15,7 @@ class Block;
 class BlockHandle;
 class Footer;
 struct Options;
+class PinnedValue;
 class RandomAccessFile;
 struct ReadOptions;
 class TableCache;
@@ -47,6 +49,15 @@ class Table {
   // call one of the Seek methods on the iterator before using it).
   Iterator* NewIterator(const ReadOptions&) const;
 
+  // Returns a new iterator over the range tombstones added by
+  // TableBuilder::AddRangeTombstone(), or NULL if the table has none.
+  Iterator* NewRangeTombstoneIterator(const ReadOptions&) const;
+
+  // If the table has the property "name", set with
+  // TableBuilder::SetProperty(), stores its value in *value and returns
+  // true.  Else returns false.
+  bool GetProperty(const Slice& name, std::string* value) const;
+
   // Given a key, return an approximate byte offset in the file where
   // the data for that key begins (or would begin if the key were
   // present in the file).  The returned value is in terms of file
@@ -55,6 +66,15 @@ class Table {
   // be close to the file length.
   uint64_t ApproximateOffsetOf(const Slice& key) const;
 
+  // Returns false if the table's filter shows that "key" was not added
+  // to the filter covering the first entry at or after "target", or to
+  // the table's only filter if it has just one.  Entries added to the
+  // filters along with a run of adjacent keys, like the prefix they
+  // share, can thereby be looked up for a seek into the run.  Returns
+  // true if the table has no filter.
+  bool FilterMayMatch(const ReadOptions& options, const Slice& target,
+                      const Slice& key);
+
  private:
   struct Rep;
   Rep* rep_;
@@ -62,6 +82,24 @@ class Table {
   explicit Table(Rep* rep) { rep_ = rep; }
   static Iterator* BlockReader(void*, const ReadOptions&, const Slice&);
 
+  // Returns an iterator over the index entries of all data blocks, which
+  // reads index partitions on demand if the index is partitioned.
+  Iterator* NewIndexIterator(const ReadOptions& options) const;
+
+  // Returns false if the filter partition covering "target" shows that
+  // "key" was not added to it.
+  // REQUIRES: rep_->filter_index != NULL
+  bool FilterPartitionMayMatch(const ReadOptions& options,
+                               const Slice& target, const Slice& key);
+
+  // Reads the block referenced by the index entry "index_value" into
+  // *block.  On success the caller must invoke (*release)(*arg1, *arg2)
+  // once done with the block.
+  static Status LoadBlock(Table* table, const ReadOptions& options,
+                          const Slice& index_value, Block** block,
+                          Iterator::CleanupFunction* release,
+                          void** arg1, void** arg2);
+
   // Calls (*handle_result)(arg, ...) with the entry found after a call
   // to Seek(key).  May not make such a call if filter policy says
   // that key is not present.
@@ -71,9 +109,31 @@ class Table {
       void* arg,
       void (*handle_result)(void* arg, const Slice& k, const Slice& v));
 
+  // Like the above, but if (*handle_result) returns true it may keep
+  // referring to the value it was passed: the block holding the value is
+  // then released when *pin is reset rather than before returning.
+  Status InternalGet(
+      const ReadOptions&, const Slice& key,
+      void* arg,
+      bool (*handle_result)(void* arg, const Slice& k, const Slice& v),
+      PinnedValue* pin);
+
+  // Equivalent to calling InternalGet(keys[i], args[i], handle_result)
+  // for each i in [0,n), but keys that fall into the same data block
+  // share a single BlockReader() call.
+  // REQUIRES: keys[0,n) are sorted in ascending order.
+  Status InternalMultiGet(
+      const ReadOptions&, int n, const Slice* keys,
+      void* const* args,
+      void (*handle_result)(void* arg, const Slice& k, const Slice& v));
+
 
   void ReadMeta(const Footer& footer);
   void ReadFilter(const Slice& filter_handle_value);
+  void ReadFullFilter(const Slice& filter_handle_value);
+  void ReadFilterIndex(const Slice& filter_index_handle_value);
+  void ReadZstdDict(const Slice& dict_handle_value);
+  void ReadProperties(const Slice& properties_handle_value);
 
   // No copying allowed
   Table(const Table&);
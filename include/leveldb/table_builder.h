@@ -46,6 +46,20 @@ class TableBuilder {
   // REQUIRES: Finish(), Abandon() have not been called
   void Add(const Slice& key, const Slice& value);
 
+  // Add key,value to the table's block of range tombstones, which is kept
+  // apart from the entries added by Add() and read back with
+  // Table::NewRangeTombstoneIterator().
+  // REQUIRES: key is after any previously added range tombstone key
+  //           according to comparator.
+  // REQUIRES: Finish(), Abandon() have not been called
+  void AddRangeTombstone(const Slice& key, const Slice& value);
+
+  // Record "value" as the value of the property "name" of the table,
+  // which Table::GetProperty() returns.  Setting a property again
+  // replaces its value.
+  // REQUIRES: Finish(), Abandon() have not been called
+  void SetProperty(const Slice& name, const Slice& value);
+
   // Advanced operation: flush any buffered key/value pairs to file.
   // Can be used to ensure that two adjacent entries never live in
   // the same data block.  Most clients should not need to use this method.
@@ -70,13 +84,20 @@ class TableBuilder {
   // Number of calls to Add() so far.
   uint64_t NumEntries() const;
 
-  // Size of the file generated so far.  If invoked after a successful
-  // Finish() call, returns the size of the final generated file.
+  // Size of the file generated so far, including data blocks that are
+  // still buffered to train a compression dictionary on.  If invoked
+  // after a successful Finish() call, returns the size of the final
+  // generated file.
   uint64_t FileSize() const;
 
  private:
   bool ok() const { return status().ok(); }
   void WriteBlock(BlockBuilder* block, BlockHandle* handle);
+  void CompressAndWriteBlock(const Slice& raw, bool use_dict,
+                             BlockHandle* handle);
+  void WriteBufferedBlocks();
+  void AddIndexEntry(const Slice& key, const BlockHandle& handle);
+  void FinishIndexPartition(const Slice& last_key);
   void WriteRawBlock(const Slice& data, CompressionType, BlockHandle* handle);
 
   struct Rep;
@@ -122,6 +122,69 @@ extern bool Snappy_GetUncompressedLength(const char* input, size_t length,
 extern bool Snappy_Uncompress(const char* input_data, size_t input_length,
                               char* output);
 
+// Store the LZ4 block compression of "input[0,input_length-1]" in
+// *output.  The uncompressed length is not part of the result.  Returns
+// false if LZ4 is not supported by this port.
+extern bool LZ4_Compress(const char* input, size_t input_length,
+                         std::string* output);
+
+// Attempt to LZ4 uncompress input[0,input_length-1] into
+// output[0,output_length-1].  Returns true iff successful and the
+// uncompressed data is exactly output_length bytes long.
+extern bool LZ4_Uncompress(const char* input, size_t input_length,
+                           char* output, size_t output_length);
+
+// Store the Zstandard compression of "input[0,input_length-1]" in
+// *output.  Returns false if Zstandard is not supported by this port.
+extern bool Zstd_Compress(const char* input, size_t input_length,
+                          std::string* output);
+
+// If input[0,input_length-1] looks like a valid Zstandard frame, store
+// the size of its uncompressed data in *result and return true.  Else
+// return false.
+extern bool Zstd_GetUncompressedLength(const char* input, size_t length,
+                                       size_t* result);
+
+// Attempt to Zstandard uncompress input[0,input_length-1] into
+// output[0,output_length-1].  Returns true iff successful and the
+// uncompressed data is exactly output_length bytes long.
+extern bool Zstd_Uncompress(const char* input, size_t input_length,
+                            char* output, size_t output_length);
+
+// Train a Zstandard dictionary of at most max_dict_bytes on the samples
+// stored back to back in "samples", whose lengths are "sample_lengths",
+// and store it in *dict.  Returns false if Zstandard is not supported by
+// this port or the samples are too few to train on.
+extern bool Zstd_TrainDictionary(const std::string& samples,
+                                 const std::vector<size_t>& sample_lengths,
+                                 size_t max_dict_bytes, std::string* dict);
+
+// A dictionary digested for compressing, respectively uncompressing,
+// many blocks.  Both are opaque.
+struct ZstdCompressionDict;
+struct ZstdUncompressionDict;
+
+// Digest the dictionary in dict[0,length-1].  Return NULL if Zstandard
+// is not supported by this port or "dict" is invalid.  The result does
+// not refer to "dict" and must be freed with the matching Delete
+// function.
+extern ZstdCompressionDict* Zstd_NewCompressionDict(const char* dict,
+                                                    size_t length);
+extern void Zstd_DeleteCompressionDict(ZstdCompressionDict* dict);
+extern ZstdUncompressionDict* Zstd_NewUncompressionDict(const char* dict,
+                                                        size_t length);
+extern void Zstd_DeleteUncompressionDict(ZstdUncompressionDict* dict);
+
+// Like Zstd_Compress() and Zstd_Uncompress(), but using a dictionary.
+// Data compressed with a dictionary can only be uncompressed with the
+// same one.  Safe to call concurrently from different threads.
+extern bool Zstd_CompressWithDict(const char* input, size_t input_length,
+                                  const ZstdCompressionDict* dict,
+                                  std::string* output);
+extern bool Zstd_UncompressWithDict(const char* input, size_t input_length,
+                                    const ZstdUncompressionDict* dict,
+                                    char* output, size_t output_length);
+
 // ------------------ Miscellaneous -------------------
 
 // If heap profiling is not supported, returns false.
@@ -129,6 +192,12 @@ extern bool Snappy_Uncompress(const char* input_data, size_t input_length,
 // The concatenation of all "data[0,n-1]" fragments is the heap profile.
 extern bool GetHeapProfile(void (*func)(void*, const char*, int), void* arg);
 
+// Extend the CRC to include the first n bytes of buf.
+//
+// Returns zero if the CRC cannot be extended using acceleration, else returns
+// the newly extended CRC value (which may also be zero).
+uint32_t AcceleratedCRC32C(uint32_t crc, const char* buf, size_t size);
+
 }  // namespace port
 }  // namespace leveldb
 
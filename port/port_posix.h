@@ -42,8 +42,16 @@
 #ifdef SNAPPY
 #include <snappy.h>
 #endif
+#ifdef LZ4
+#include <lz4.h>
+#endif
+#ifdef ZSTD
+#include <zstd.h>
+#include <zdict.h>
+#endif
 #include <stdint.h>
 #include <string>
+#include <vector>
 #include "port/atomic_pointer.h"
 
 #ifndef PLATFORM_IS_LITTLE_ENDIAN
@@ -144,10 +152,199 @@ inline bool Snappy_Uncompress(const char* input, size_t length,
 #endif
 }
 
+inline bool LZ4_Compress(const char* input, size_t length,
+                         ::std::string* output) {
+#ifdef LZ4
+  const int bound = LZ4_compressBound(static_cast<int>(length));
+  if (bound <= 0) {
+    return false;
+  }
+  output->resize(bound);
+  const int outlen = LZ4_compress_default(input, &(*output)[0],
+                                          static_cast<int>(length), bound);
+  if (outlen <= 0) {
+    return false;
+  }
+  output->resize(outlen);
+  return true;
+#endif
+
+  return false;
+}
+
+inline bool LZ4_Uncompress(const char* input, size_t length,
+                           char* output, size_t output_length) {
+#ifdef LZ4
+  const int outlen = LZ4_decompress_safe(input, output,
+                                         static_cast<int>(length),
+                                         static_cast<int>(output_length));
+  return outlen >= 0 && static_cast<size_t>(outlen) == output_length;
+#else
+  return false;
+#endif
+}
+
+#ifdef ZSTD
+typedef ZSTD_CDict ZstdCompressionDict;
+typedef ZSTD_DDict ZstdUncompressionDict;
+
+// Compression contexts are expensive to set up, so each thread keeps one
+// of each kind for all its (un)compression.
+struct ZstdThreadContexts {
+  ZSTD_CCtx* cctx;
+  ZSTD_DCtx* dctx;
+
+  ZstdThreadContexts() : cctx(ZSTD_createCCtx()), dctx(ZSTD_createDCtx()) { }
+  ~ZstdThreadContexts() {
+    ZSTD_freeCCtx(cctx);
+    ZSTD_freeDCtx(dctx);
+  }
+};
+
+inline ZstdThreadContexts* Zstd_GetThreadContexts() {
+  static thread_local ZstdThreadContexts contexts;
+  return &contexts;
+}
+#else
+struct ZstdCompressionDict;
+struct ZstdUncompressionDict;
+#endif
+
+inline bool Zstd_Compress(const char* input, size_t length,
+                          ::std::string* output) {
+#ifdef ZSTD
+  output->resize(ZSTD_compressBound(length));
+  // Level 3 is the library's default
+  const size_t outlen = ZSTD_compressCCtx(Zstd_GetThreadContexts()->cctx,
+                                          &(*output)[0], output->size(),
+                                          input, length, 3);
+  if (ZSTD_isError(outlen)) {
+    return false;
+  }
+  output->resize(outlen);
+  return true;
+#endif
+
+  return false;
+}
+
+inline bool Zstd_GetUncompressedLength(const char* input, size_t length,
+                                       size_t* result) {
+#ifdef ZSTD
+  const unsigned long long size = ZSTD_getFrameContentSize(input, length);
+  if (size == ZSTD_CONTENTSIZE_UNKNOWN || size == ZSTD_CONTENTSIZE_ERROR) {
+    return false;
+  }
+  *result = static_cast<size_t>(size);
+  return true;
+#else
+  return false;
+#endif
+}
+
+inline bool Zstd_Uncompress(const char* input, size_t length,
+                            char* output, size_t output_length) {
+#ifdef ZSTD
+  const size_t outlen = ZSTD_decompressDCtx(Zstd_GetThreadContexts()->dctx,
+                                            output, output_length,
+                                            input, length);
+  return !ZSTD_isError(outlen) && outlen == output_length;
+#else
+  return false;
+#endif
+}
+
+inline bool Zstd_TrainDictionary(const ::std::string& samples,
+                                 const ::std::vector<size_t>& sample_lengths,
+                                 size_t max_dict_bytes,
+                                 ::std::string* dict) {
+#ifdef ZSTD
+  if (sample_lengths.empty() || max_dict_bytes == 0) {
+    return false;
+  }
+  dict->resize(max_dict_bytes);
+  const size_t dict_len = ZDICT_trainFromBuffer(
+      &(*dict)[0], dict->size(), samples.data(), &sample_lengths[0],
+      static_cast<unsigned>(sample_lengths.size()));
+  if (ZDICT_isError(dict_len)) {
+    dict->clear();
+    return false;
+  }
+  dict->resize(dict_len);
+  return true;
+#else
+  return false;
+#endif
+}
+
+inline ZstdCompressionDict* Zstd_NewCompressionDict(const char* dict,
+                                                    size_t length) {
+#ifdef ZSTD
+  return ZSTD_createCDict(dict, length, 3);
+#else
+  return NULL;
+#endif
+}
+
+inline void Zstd_DeleteCompressionDict(ZstdCompressionDict* dict) {
+#ifdef ZSTD
+  ZSTD_freeCDict(dict);
+#endif
+}
+
+inline ZstdUncompressionDict* Zstd_NewUncompressionDict(const char* dict,
+                                                        size_t length) {
+#ifdef ZSTD
+  return ZSTD_createDDict(dict, length);
+#else
+  return NULL;
+#endif
+}
+
+inline void Zstd_DeleteUncompressionDict(ZstdUncompressionDict* dict) {
+#ifdef ZSTD
+  ZSTD_freeDDict(dict);
+#endif
+}
+
+inline bool Zstd_CompressWithDict(const char* input, size_t length,
+                                  const ZstdCompressionDict* dict,
+                                  ::std::string* output) {
+#ifdef ZSTD
+  output->resize(ZSTD_compressBound(length));
+  const size_t outlen = ZSTD_compress_usingCDict(
+      Zstd_GetThreadContexts()->cctx, &(*output)[0], output->size(),
+      input, length, dict);
+  if (ZSTD_isError(outlen)) {
+    return false;
+  }
+  output->resize(outlen);
+  return true;
+#endif
+
+  return false;
+}
+
+inline bool Zstd_UncompressWithDict(const char* input, size_t length,
+                                    const ZstdUncompressionDict* dict,
+                                    char* output, size_t output_length) {
+#ifdef ZSTD
+  const size_t outlen = ZSTD_decompress_usingDDict(
+      Zstd_GetThreadContexts()->dctx, output, output_length,
+      input, length, dict);
+  return !ZSTD_isError(outlen) && outlen == output_length;
+#else
+  return false;
+#endif
+}
+
 inline bool GetHeapProfile(void (*func)(void*, const char*, int), void* arg) {
   return false;
 }
 
+// Defined in port_posix_sse.cc.
+uint32_t AcceleratedCRC32C(uint32_t crc, const char* buf, size_t size);
+
 } // namespace port
 } // namespace leveldb
 
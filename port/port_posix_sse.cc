@@ -0,0 +1,170 @@
+// Copyright (c) 2026 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// An implementation of crc32c using the SSE 4.2 crc32 instruction.  This
+// file is compiled with -msse4.2, so nothing in it may run before
+// HaveSSE42() has confirmed that the CPU has the instruction.
+//
+// Large buffers are split into three streams whose CRCs are computed
+// with interleaved instructions, which hides the latency of crc32, and
+// then combined.
+
+#include <stdint.h>
+#include <string.h>
+#include "port/port.h"
+
+#if defined(LEVELDB_PLATFORM_POSIX_SSE)
+#include <cpuid.h>
+#include <nmmintrin.h>
+#endif
+
+namespace leveldb {
+namespace port {
+
+#if defined(LEVELDB_PLATFORM_POSIX_SSE)
+
+namespace {
+
+// Bytes covered by each of the three streams in one round.  A multiple
+// of eight.
+static const size_t kStreamBytes = 256;
+
+// The CRC32C polynomial in the bit-reversed order used by crc32.
+static const uint32_t kPoly = 0x82f63b78u;
+
+// Used to fetch a naturally-aligned 32-bit word in little endian byte-order
+static inline uint32_t LE_LOAD32(const uint8_t *p) {
+  // SSE is x86 only, so the load is always little-endian.
+  uint32_t word;
+  memcpy(&word, p, sizeof(word));
+  return word;
+}
+
+#if defined(__x86_64__)
+// Used to fetch a naturally-aligned 64-bit word in little endian byte-order
+static inline uint64_t LE_LOAD64(const uint8_t *p) {
+  uint64_t dword;
+  memcpy(&dword, p, sizeof(dword));
+  return dword;
+}
+
+static inline uint32_t Step8(uint32_t crc, const uint8_t* p) {
+  return static_cast<uint32_t>(_mm_crc32_u64(crc, LE_LOAD64(p)));
+}
+#else
+static inline uint32_t Step8(uint32_t crc, const uint8_t* p) {
+  crc = _mm_crc32_u32(crc, LE_LOAD32(p));
+  return _mm_crc32_u32(crc, LE_LOAD32(p + 4));
+}
+#endif
+
+// Returns true if the CPU running this program has the crc32 instruction.
+static bool HaveSSE42() {
+  unsigned int eax, ebx, ecx, edx;
+  if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) == 0) {
+    return false;
+  }
+  return (ecx & bit_SSE4_2) != 0;
+}
+
+// Returns the CRC register after feeding "n" zero bytes to it in state
+// "crc", one bit at a time.
+static uint32_t ShiftSlow(uint32_t crc, size_t n) {
+  for (size_t i = 0; i < 8 * n; i++) {
+    crc = (crc >> 1) ^ (kPoly & (0u - (crc & 1)));
+  }
+  return crc;
+}
+
+// Tables for feeding kStreamBytes zero bytes to the CRC register at once.
+// Doing so is linear in the register, so it is the xor of the results
+// for each of its bytes.
+struct ShiftTable {
+  uint32_t table[4][256];
+
+  ShiftTable() {
+    uint32_t bits[32];
+    for (int b = 0; b < 32; b++) {
+      bits[b] = ShiftSlow(1u << b, kStreamBytes);
+    }
+    for (int k = 0; k < 4; k++) {
+      for (int v = 0; v < 256; v++) {
+        uint32_t r = 0;
+        for (int b = 0; b < 8; b++) {
+          if (v & (1 << b)) {
+            r ^= bits[8 * k + b];
+          }
+        }
+        table[k][v] = r;
+      }
+    }
+  }
+
+  uint32_t Shift(uint32_t crc) const {
+    return table[0][crc & 0xff] ^
+           table[1][(crc >> 8) & 0xff] ^
+           table[2][(crc >> 16) & 0xff] ^
+           table[3][crc >> 24];
+  }
+};
+
+}  // namespace
+
+#endif  // defined(LEVELDB_PLATFORM_POSIX_SSE)
+
+uint32_t AcceleratedCRC32C(uint32_t crc, const char* buf, size_t size) {
+#if !defined(LEVELDB_PLATFORM_POSIX_SSE)
+  return 0;
+#else
+  static const bool have_sse42 = HaveSSE42();
+  if (!have_sse42) {
+    return 0;
+  }
+  static const ShiftTable shift;
+
+  const uint8_t *p = reinterpret_cast<const uint8_t *>(buf);
+  const uint8_t *e = p + size;
+  uint32_t l = crc ^ 0xffffffffu;
+
+  // Point x at first 8-byte aligned byte in string.  This might be
+  // just past the end of the string.
+  const uintptr_t pval = reinterpret_cast<uintptr_t>(p);
+  const uint8_t* x = reinterpret_cast<const uint8_t*>(((pval + 7) >> 3) << 3);
+  if (x <= e) {
+    // Process bytes until finished or p is 8-byte aligned
+    while (p != x) {
+      l = _mm_crc32_u8(l, *p++);
+    }
+  }
+
+  // Process three streams of kStreamBytes at a time.  The CRC of the
+  // concatenation of a and b is the CRC of a shifted past b's bytes,
+  // xor'ed with b's CRC started from zero.
+  while (static_cast<size_t>(e - p) >= 3 * kStreamBytes) {
+    uint32_t l1 = 0;
+    uint32_t l2 = 0;
+    for (size_t i = 0; i < kStreamBytes; i += 8) {
+      l = Step8(l, p + i);
+      l1 = Step8(l1, p + kStreamBytes + i);
+      l2 = Step8(l2, p + 2 * kStreamBytes + i);
+    }
+    l = shift.Shift(shift.Shift(l) ^ l1) ^ l2;
+    p += 3 * kStreamBytes;
+  }
+
+  // Process the remaining bytes 8 at a time
+  while ((e - p) >= 8) {
+    l = Step8(l, p);
+    p += 8;
+  }
+  // Process the last few bytes
+  while (p != e) {
+    l = _mm_crc32_u8(l, *p++);
+  }
+  return l ^ 0xffffffffu;
+#endif
+}
+
+}  // namespace port
+}  // namespace leveldb
@@ -15,25 +15,42 @@
 
 namespace leveldb {
 
-inline uint32_t Block::NumRestarts() const {
-  assert(size_ >= sizeof(uint32_t));
-  return DecodeFixed32(data_ + size_ - sizeof(uint32_t));
-}
-
 Block::Block(const BlockContents& contents)
     : data_(contents.data.data()),
       size_(contents.data.size()),
-      owned_(contents.heap_allocated) {
+      owned_(contents.heap_allocated),
+      num_restarts_(0),
+      hash_buckets_(NULL),
+      num_buckets_(0) {
   if (size_ < sizeof(uint32_t)) {
     size_ = 0;  // Error marker
-  } else {
-    size_t max_restarts_allowed = (size_-sizeof(uint32_t)) / sizeof(uint32_t);
-    if (NumRestarts() > max_restarts_allowed) {
-      // The size is too small for NumRestarts()
+    return;
+  }
+
+  // Size of everything after the restart array
+  size_t trailer = sizeof(uint32_t);
+  num_restarts_ = DecodeFixed32(data_ + size_ - sizeof(uint32_t));
+  if ((num_restarts_ & kBlockHashIndexFlag) != 0) {
+    num_restarts_ &= ~kBlockHashIndexFlag;
+    if (size_ < 2 * sizeof(uint32_t)) {
       size_ = 0;
-    } else {
-      restart_offset_ = size_ - (1 + NumRestarts()) * sizeof(uint32_t);
+      return;
     }
+    num_buckets_ = DecodeFixed32(data_ + size_ - 2 * sizeof(uint32_t));
+    trailer += sizeof(uint32_t) + num_buckets_;
+    if (num_buckets_ == 0 || trailer > size_) {
+      size_ = 0;
+      return;
+    }
+    hash_buckets_ = reinterpret_cast<const uint8_t*>(data_ + size_ - trailer);
+  }
+
+  size_t max_restarts_allowed = (size_ - trailer) / sizeof(uint32_t);
+  if (num_restarts_ > max_restarts_allowed) {
+    // The size is too small for num_restarts_
+    size_ = 0;
+  } else {
+    restart_offset_ = size_ - trailer - num_restarts_ * sizeof(uint32_t);
   }
 }
 
@@ -191,7 +208,14 @@ class Block::Iter : public Iterator {
     }
 
     // Linear search (within restart block) for first key >= target
-    SeekToRestartPoint(left);
+    SeekFromRestartPoint(left, target);
+  }
+
+  // Position at the first key >= target at or after restart point
+  // "index".  Equivalent to Seek(target) if no key before that restart
+  // point is >= target.
+  void SeekFromRestartPoint(uint32_t index, const Slice& target) {
+    SeekToRestartPoint(index);
     while (true) {
       if (!ParseNextKey()) {
         return;
@@ -257,12 +281,36 @@ Iterator* Block::NewIterator(const Comparator* cmp) {
   if (size_ < sizeof(uint32_t)) {
     return NewErrorIterator(Status::Corruption("bad block contents"));
   }
-  const uint32_t num_restarts = NumRestarts();
-  if (num_restarts == 0) {
+  if (num_restarts_ == 0) {
+    return NewEmptyIterator();
+  } else {
+    return new Iter(cmp, data_, restart_offset_, num_restarts_);
+  }
+}
+
+Iterator* Block::SeekForGet(const Comparator* cmp, const Slice& target) {
+  if (hash_buckets_ == NULL || size_ < sizeof(uint32_t) ||
+      num_restarts_ == 0) {
+    Iterator* iter = NewIterator(cmp);
+    iter->Seek(target);
+    return iter;
+  }
+
+  const uint32_t hash = BlockKeyHash(cmp->KeyForHashing(target));
+  const uint8_t bucket = hash_buckets_[hash % num_buckets_];
+  if (bucket == kHashBucketEmpty) {
+    // No version of target is in this block
     return NewEmptyIterator();
+  }
+  Iter* iter = new Iter(cmp, data_, restart_offset_, num_restarts_);
+  if (bucket == kHashBucketCollision || bucket >= num_restarts_) {
+    iter->Seek(target);
   } else {
-    return new Iter(cmp, data_, restart_offset_, num_restarts);
+    // Keys in earlier restart intervals are smaller than any version of
+    // target, so scanning from its interval finds what Seek() would.
+    iter->SeekFromRestartPoint(bucket, target);
   }
+  return iter;
 }
 
 }  // namespace leveldb
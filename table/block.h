@@ -24,13 +24,20 @@ class Block {
   size_t size() const { return size_; }
   Iterator* NewIterator(const Comparator* comparator);
 
- private:
-  uint32_t NumRestarts() const;
+  // Return an iterator positioned as NewIterator(comparator)->Seek(target)
+  // would be, for a point lookup of target.  If the block has a hash
+  // index, it is used to skip the binary search, and the result is
+  // !Valid() if the block holds no key matching target.
+  Iterator* SeekForGet(const Comparator* comparator, const Slice& target);
 
+ private:
   const char* data_;
   size_t size_;
   uint32_t restart_offset_;     // Offset in data_ of restart array
   bool owned_;                  // Block owns data_[]
+  uint32_t num_restarts_;
+  const uint8_t* hash_buckets_; // Hash index, or NULL if there is none
+  uint32_t num_buckets_;
 
   // No copying allowed
   Block(const Block&);
@@ -25,6 +25,20 @@
 //     restarts: uint32[num_restarts]
 //     num_restarts: uint32
 // restarts[i] contains the offset within the block of the ith restart point.
+//
+// If options->data_block_hash_index is set, the trailer instead has the
+// form:
+//     restarts: uint32[num_restarts]
+//     buckets: uint8[num_buckets]
+//     num_buckets: uint32
+//     num_restarts | kBlockHashIndexFlag: uint32
+// Every key is hashed into one of the buckets, which holds the index of
+// the restart interval the key lives in.  A bucket holding several
+// intervals is marked kHashBucketCollision, and one that holds no key
+// kHashBucketEmpty.  Keys are hashed by the comparator's
+// KeyForHashing(), so that all versions of a key in a table share a
+// bucket.  Blocks with more than kMaxHashIndexRestarts restart points
+// get no hash index.
 
 #include "table/block_builder.h"
 
@@ -32,6 +46,7 @@
 #include <assert.h>
 #include "leveldb/comparator.h"
 #include "leveldb/table_builder.h"
+#include "table/format.h"
 #include "util/coding.h"
 
 namespace leveldb {
@@ -52,12 +67,23 @@ void BlockBuilder::Reset() {
   counter_ = 0;
   finished_ = false;
   last_key_.clear();
+  key_hashes_.clear();
+  key_restarts_.clear();
 }
 
+// Buckets per distinct key in the hash index
+static const double kHashBucketsPerKey = 4.0 / 3.0;
+
 size_t BlockBuilder::CurrentSizeEstimate() const {
-  return (buffer_.size() +                        // Raw data buffer
-          restarts_.size() * sizeof(uint32_t) +   // Restart array
-          sizeof(uint32_t));                      // Restart array length
+  size_t estimate = (buffer_.size() +                        // Raw data buffer
+                     restarts_.size() * sizeof(uint32_t) +   // Restart array
+                     sizeof(uint32_t));                      // Array length
+  if (options_->data_block_hash_index) {
+    // Buckets and their count
+    estimate += static_cast<size_t>(key_hashes_.size() * kHashBucketsPerKey) +
+                sizeof(uint32_t);
+  }
+  return estimate;
 }
 
 Slice BlockBuilder::Finish() {
@@ -65,7 +91,26 @@ Slice BlockBuilder::Finish() {
   for (size_t i = 0; i < restarts_.size(); i++) {
     PutFixed32(&buffer_, restarts_[i]);
   }
-  PutFixed32(&buffer_, restarts_.size());
+  uint32_t num_restarts = restarts_.size();
+  if (options_->data_block_hash_index && !key_hashes_.empty() &&
+      num_restarts <= kMaxHashIndexRestarts) {
+    const uint32_t num_buckets =
+        static_cast<uint32_t>(key_hashes_.size() * kHashBucketsPerKey) + 1;
+    const size_t start = buffer_.size();
+    buffer_.resize(start + num_buckets, static_cast<char>(kHashBucketEmpty));
+    uint8_t* buckets = reinterpret_cast<uint8_t*>(&buffer_[start]);
+    for (size_t i = 0; i < key_hashes_.size(); i++) {
+      uint8_t* bucket = &buckets[key_hashes_[i] % num_buckets];
+      if (*bucket == kHashBucketEmpty) {
+        *bucket = key_restarts_[i];
+      } else if (*bucket != key_restarts_[i]) {
+        *bucket = kHashBucketCollision;
+      }
+    }
+    PutFixed32(&buffer_, num_buckets);
+    num_restarts |= kBlockHashIndexFlag;
+  }
+  PutFixed32(&buffer_, num_restarts);
   finished_ = true;
   return Slice(buffer_);
 }
@@ -99,6 +144,19 @@ void BlockBuilder::Add(const Slice& key, const Slice& value) {
   buffer_.append(key.data() + shared, non_shared);
   buffer_.append(value.data(), value.size());
 
+  if (options_->data_block_hash_index &&
+      restarts_.size() <= kMaxHashIndexRestarts) {
+    // Consecutive versions of a key share an entry
+    const Slice hash_key = options_->comparator->KeyForHashing(key);
+    const uint32_t hash = BlockKeyHash(hash_key);
+    const uint8_t restart = restarts_.size() - 1;
+    if (key_hashes_.empty() || key_hashes_.back() != hash ||
+        key_restarts_.back() != restart) {
+      key_hashes_.push_back(hash);
+      key_restarts_.push_back(restart);
+    }
+  }
+
   // Update state
   last_key_.resize(shared);
   last_key_.append(key.data() + shared, non_shared);
@@ -47,6 +47,11 @@ class BlockBuilder {
   bool                  finished_;    // Has Finish() been called?
   std::string           last_key_;
 
+  // Hash index entries: the hash of each distinct key and the index of
+  // the restart interval it lives in
+  std::vector<uint32_t> key_hashes_;
+  std::vector<uint8_t>  key_restarts_;
+
   // No copying allowed
   BlockBuilder(const BlockBuilder&);
   void operator=(const BlockBuilder&);
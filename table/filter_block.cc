@@ -75,6 +75,37 @@ void FilterBlockBuilder::GenerateFilter() {
   start_.clear();
 }
 
+FilterPartitionBuilder::FilterPartitionBuilder(const FilterPolicy* policy)
+    : policy_(policy) {
+}
+
+void FilterPartitionBuilder::AddKey(const Slice& key) {
+  start_.push_back(keys_.size());
+  keys_.append(key.data(), key.size());
+}
+
+Slice FilterPartitionBuilder::FinishPartition() {
+  const size_t num_keys = start_.size();
+  start_.push_back(keys_.size());  // Simplify length computation
+  tmp_keys_.resize(num_keys);
+  for (size_t i = 0; i < num_keys; i++) {
+    const char* base = keys_.data() + start_[i];
+    size_t length = start_[i+1] - start_[i];
+    tmp_keys_[i] = Slice(base, length);
+  }
+
+  result_.clear();
+  if (num_keys > 0) {
+    policy_->CreateFilter(&tmp_keys_[0], static_cast<int>(num_keys),
+                          &result_);
+  }
+
+  tmp_keys_.clear();
+  keys_.clear();
+  start_.clear();
+  return Slice(result_);
+}
+
 FilterBlockReader::FilterBlockReader(const FilterPolicy* policy,
                                      const Slice& contents)
     : policy_(policy),
@@ -49,6 +49,35 @@ class FilterBlockBuilder {
   void operator=(const FilterBlockBuilder&);
 };
 
+// A FilterPartitionBuilder builds the filters of a table with a
+// partitioned index: a single filter over all keys of the data blocks
+// covered by each index partition.  Each filter is stored as a block of
+// its own and passed to FilterPolicy::KeyMayMatch() as is.
+//
+// The sequence of calls to FilterPartitionBuilder must match the regexp:
+//      (AddKey* FinishPartition)*
+class FilterPartitionBuilder {
+ public:
+  explicit FilterPartitionBuilder(const FilterPolicy*);
+
+  void AddKey(const Slice& key);
+
+  // Return the filter for the keys added since the previous call.  The
+  // result remains valid until the next call.
+  Slice FinishPartition();
+
+ private:
+  const FilterPolicy* policy_;
+  std::string keys_;              // Flattened key contents
+  std::vector<size_t> start_;     // Starting index in keys_ of each key
+  std::string result_;            // Filter of the last partition
+  std::vector<Slice> tmp_keys_;   // policy_->CreateFilter() argument
+
+  // No copying allowed
+  FilterPartitionBuilder(const FilterPartitionBuilder&);
+  void operator=(const FilterPartitionBuilder&);
+};
+
 class FilterBlockReader {
  public:
  // REQUIRES: "contents" and *policy must stay live while *this is live.
@@ -121,6 +121,29 @@ TEST(FilterBlockTest, MultiChunk) {
   ASSERT_TRUE(! reader.KeyMayMatch(9000, "bar"));
 }
 
+TEST(FilterBlockTest, Partitions) {
+  FilterPartitionBuilder builder(&policy_);
+
+  // First partition
+  builder.AddKey("foo");
+  builder.AddKey("bar");
+  std::string first = builder.FinishPartition().ToString();
+
+  // Second partition is empty
+  ASSERT_EQ("", EscapeString(builder.FinishPartition()));
+
+  // Last partition
+  builder.AddKey("box");
+  std::string last = builder.FinishPartition().ToString();
+
+  ASSERT_TRUE(policy_.KeyMayMatch("foo", first));
+  ASSERT_TRUE(policy_.KeyMayMatch("bar", first));
+  ASSERT_TRUE(! policy_.KeyMayMatch("box", first));
+  ASSERT_TRUE(policy_.KeyMayMatch("box", last));
+  ASSERT_TRUE(! policy_.KeyMayMatch("foo", last));
+  ASSERT_TRUE(! policy_.KeyMayMatch("bar", last));
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
@@ -10,6 +10,8 @@
 #include "leveldb/slice.h"
 #include "leveldb/status.h"
 #include "leveldb/table_builder.h"
+#include "port/port.h"
+#include "util/hash.h"
 
 namespace leveldb {
 
@@ -46,7 +48,7 @@ class BlockHandle {
 // end of every table file.
 class Footer {
  public:
-  Footer() { }
+  Footer() : partitioned_index_(false) { }
 
   // The block handle for the metaindex block of the table
   const BlockHandle& metaindex_handle() const { return metaindex_handle_; }
@@ -60,6 +62,13 @@ class Footer {
     index_handle_ = h;
   }
 
+  // Whether the index block is a top-level index whose entries point to
+  // index partitions rather than to data blocks.  Recorded in the magic
+  // number, so that readers without support for partitioned indexes
+  // reject the table.
+  bool partitioned_index() const { return partitioned_index_; }
+  void set_partitioned_index(bool b) { partitioned_index_ = b; }
+
   void EncodeTo(std::string* dst) const;
   Status DecodeFrom(Slice* input);
 
@@ -73,6 +82,7 @@ class Footer {
  private:
   BlockHandle metaindex_handle_;
   BlockHandle index_handle_;
+  bool partitioned_index_;
 };
 
 // kTableMagicNumber was picked by running
@@ -80,6 +90,12 @@ class Footer {
 // and taking the leading 64 bits.
 static const uint64_t kTableMagicNumber = 0xdb4775248b80fb57ull;
 
+// Magic number of tables with a partitioned index, picked by running
+//    echo -n http://code.google.com/p/leveldb/partitioned | sha1sum
+// and taking the leading 64 bits.
+static const uint64_t kPartitionedIndexTableMagicNumber =
+    0xef8b5644ba1d6a1bull;
+
 // 1-byte type + 32-bit crc
 static const size_t kBlockTrailerSize = 5;
 
@@ -89,12 +105,42 @@ struct BlockContents {
   bool heap_allocated;  // True iff caller should delete[] data.data()
 };
 
+// Data blocks may end in a hash index that maps hashes of their keys to
+// the restart interval holding them; see block_builder.cc.  The flag is
+// set in the block's restart count if it does.
+static const uint32_t kBlockHashIndexFlag = 1u << 31;
+static const uint8_t kHashBucketEmpty = 255;        // No key in bucket
+static const uint8_t kHashBucketCollision = 254;    // Several intervals
+static const uint32_t kMaxHashIndexRestarts = 254;  // Indices must fit
+
+// Hash of a key for block hash indexes; a key lives in bucket
+// BlockKeyHash(key) % num_buckets.  "hash_key" is the result of
+// Comparator::KeyForHashing().
+inline uint32_t BlockKeyHash(const Slice& hash_key) {
+  return Hash(hash_key.data(), hash_key.size(), 0x4e9a1b3d);
+}
+
+// Name of the metaindex entry for the dictionary that the data blocks
+// of a Zstandard-compressed table were compressed with, if any.
+static const char kZstdDictBlockName[] = "zstd.dict";
+
+// Name of the metaindex entry for the block of properties set with
+// TableBuilder::SetProperty(), if any.
+static const char kPropertiesBlockName[] = "properties";
+
+// Name of the metaindex entry for the block of range tombstones added by
+// TableBuilder::AddRangeTombstone(), if any.
+static const char kRangeDelBlockName[] = "rangedel";
+
 // Read the block identified by "handle" from "file".  On failure
-// return non-OK.  On success fill *result and return OK.
+// return non-OK.  On success fill *result and return OK.  "dict" is the
+// dictionary to uncompress a Zstandard-compressed block with, or NULL if
+// the block was compressed without one.
 extern Status ReadBlock(RandomAccessFile* file,
                         const ReadOptions& options,
                         const BlockHandle& handle,
-                        BlockContents* result);
+                        BlockContents* result,
+                        const port::ZstdUncompressionDict* dict = NULL);
 
 // Implementation details follow.  Clients should ignore,
 
@@ -9,6 +9,7 @@
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/options.h"
+#include "leveldb/pinned_value.h"
 #include "table/block.h"
 #include "table/filter_block.h"
 #include "table/format.h"
@@ -21,18 +22,33 @@ struct Table::Rep {
   ~Rep() {
     delete filter;
     delete [] filter_data;
+    delete [] full_filter_data;
+    delete filter_index;
+    delete properties;
     delete index_block;
+    if (zstd_dict != NULL) {
+      port::Zstd_DeleteUncompressionDict(zstd_dict);
+    }
   }
 
   Options options;
   Status status;
   RandomAccessFile* file;
   uint64_t cache_id;
+  const FilterPolicy* filter_policy;  // Policy that built the filters
   FilterBlockReader* filter;
   const char* filter_data;
+  Slice full_filter;    // Whole-file filter, or empty
+  const char* full_filter_data;
+  port::ZstdUncompressionDict* zstd_dict;  // Used for all data blocks
+  Block* filter_index;  // Top-level index of filter partitions, or NULL
+  Block* properties;    // Properties of the table, or NULL
+  bool has_range_dels;
+  BlockHandle range_del_handle;  // Valid iff has_range_dels
 
   BlockHandle metaindex_handle;  // Handle to metaindex_block: saved from footer
-  Block* index_block;
+  Block* index_block;   // Top-level index if partitioned_index
+  bool partitioned_index;
 };
 
 Status Table::Open(const Options& options,
@@ -76,9 +92,16 @@ Status Table::Open(const Options& options,
     rep->file = file;
     rep->metaindex_handle = footer.metaindex_handle();
     rep->index_block = index_block;
+    rep->partitioned_index = footer.partitioned_index();
     rep->cache_id = (options.block_cache ? options.block_cache->NewId() : 0);
+    rep->filter_policy = NULL;
     rep->filter_data = NULL;
     rep->filter = NULL;
+    rep->zstd_dict = NULL;
+    rep->filter_index = NULL;
+    rep->properties = NULL;
+    rep->full_filter_data = NULL;
+    rep->has_range_dels = false;
     *table = new Table(rep);
     (*table)->ReadMeta(footer);
   } else {
@@ -89,12 +112,10 @@ Status Table::Open(const Options& options,
 }
 
 void Table::ReadMeta(const Footer& footer) {
-  if (rep_->options.filter_policy == NULL) {
-    return;  // Do not need any metadata
+  if (footer.metaindex_handle().size() <= 2 * sizeof(uint32_t)) {
+    return;  // Empty block: holds nothing but its restart array
   }
 
-  // TODO(sanjay): Skip this if footer.metaindex_handle() size indicates
-  // it is an empty block.
   ReadOptions opt;
   if (rep_->options.paranoid_checks) {
     opt.verify_checksums = true;
@@ -107,11 +128,55 @@ void Table::ReadMeta(const Footer& footer) {
   Block* meta = new Block(contents);
 
   Iterator* iter = meta->NewIterator(BytewiseComparator());
-  std::string key = "filter.";
-  key.append(rep_->options.filter_policy->Name());
-  iter->Seek(key);
-  if (iter->Valid() && iter->key() == Slice(key)) {
-    ReadFilter(iter->value());
+  // The table may have been written with filter_policy or with any of
+  // filter_policy_per_level: use the first one that has filters in it.
+  std::vector<const FilterPolicy*> policies;
+  policies.push_back(rep_->options.filter_policy);
+  policies.insert(policies.end(),
+                  rep_->options.filter_policy_per_level.begin(),
+                  rep_->options.filter_policy_per_level.end());
+  for (size_t i = 0; i < policies.size(); i++) {
+    const FilterPolicy* policy = policies[i];
+    if (policy == NULL) {
+      continue;
+    }
+    rep_->filter_policy = policy;
+    std::string key = "filter.";
+    key.append(policy->Name());
+    iter->Seek(key);
+    if (iter->Valid() && iter->key() == Slice(key)) {
+      ReadFilter(iter->value());
+    }
+    key = "partitionedfilter.";
+    key.append(policy->Name());
+    iter->Seek(key);
+    if (iter->Valid() && iter->key() == Slice(key)) {
+      ReadFilterIndex(iter->value());
+    }
+    key = "fullfilter.";
+    key.append(policy->Name());
+    iter->Seek(key);
+    if (iter->Valid() && iter->key() == Slice(key)) {
+      ReadFullFilter(iter->value());
+    }
+    if (rep_->filter != NULL || rep_->filter_index != NULL ||
+        !rep_->full_filter.empty()) {
+      break;
+    }
+    rep_->filter_policy = NULL;
+  }
+  iter->Seek(kPropertiesBlockName);
+  if (iter->Valid() && iter->key() == Slice(kPropertiesBlockName)) {
+    ReadProperties(iter->value());
+  }
+  iter->Seek(kRangeDelBlockName);
+  if (iter->Valid() && iter->key() == Slice(kRangeDelBlockName)) {
+    Slice v = iter->value();
+    rep_->has_range_dels = rep_->range_del_handle.DecodeFrom(&v).ok();
+  }
+  iter->Seek(kZstdDictBlockName);
+  if (iter->Valid() && iter->key() == Slice(kZstdDictBlockName)) {
+    ReadZstdDict(iter->value());
   }
   delete iter;
   delete meta;
@@ -137,13 +202,190 @@ void Table::ReadFilter(const Slice& filter_handle_value) {
   if (block.heap_allocated) {
     rep_->filter_data = block.data.data();     // Will need to delete later
   }
-  rep_->filter = new FilterBlockReader(rep_->options.filter_policy, block.data);
+  rep_->filter = new FilterBlockReader(rep_->filter_policy, block.data);
+}
+
+void Table::ReadFullFilter(const Slice& filter_handle_value) {
+  Slice v = filter_handle_value;
+  BlockHandle filter_handle;
+  if (!filter_handle.DecodeFrom(&v).ok()) {
+    return;
+  }
+
+  ReadOptions opt;
+  if (rep_->options.paranoid_checks) {
+    opt.verify_checksums = true;
+  }
+  BlockContents block;
+  if (!ReadBlock(rep_->file, opt, filter_handle, &block).ok()) {
+    return;
+  }
+  if (block.heap_allocated) {
+    rep_->full_filter_data = block.data.data();  // Will need to delete later
+  }
+  rep_->full_filter = block.data;
+}
+
+void Table::ReadFilterIndex(const Slice& filter_index_handle_value) {
+  Slice v = filter_index_handle_value;
+  BlockHandle filter_index_handle;
+  if (!filter_index_handle.DecodeFrom(&v).ok()) {
+    return;
+  }
+
+  ReadOptions opt;
+  if (rep_->options.paranoid_checks) {
+    opt.verify_checksums = true;
+  }
+  BlockContents block;
+  if (!ReadBlock(rep_->file, opt, filter_index_handle, &block).ok()) {
+    return;
+  }
+  rep_->filter_index = new Block(block);
+}
+
+void Table::ReadZstdDict(const Slice& dict_handle_value) {
+  Slice v = dict_handle_value;
+  BlockHandle dict_handle;
+  if (!dict_handle.DecodeFrom(&v).ok()) {
+    return;
+  }
+
+  // Without the dictionary the data blocks cannot be uncompressed, which
+  // is reported when they are read.
+  ReadOptions opt;
+  if (rep_->options.paranoid_checks) {
+    opt.verify_checksums = true;
+  }
+  BlockContents block;
+  if (!ReadBlock(rep_->file, opt, dict_handle, &block).ok()) {
+    return;
+  }
+  rep_->zstd_dict = port::Zstd_NewUncompressionDict(block.data.data(),
+                                                    block.data.size());
+  if (block.heap_allocated) {
+    delete[] block.data.data();
+  }
+}
+
+void Table::ReadProperties(const Slice& properties_handle_value) {
+  Slice v = properties_handle_value;
+  BlockHandle properties_handle;
+  if (!properties_handle.DecodeFrom(&v).ok()) {
+    return;
+  }
+
+  // The table reads as having no properties if they cannot be read
+  ReadOptions opt;
+  if (rep_->options.paranoid_checks) {
+    opt.verify_checksums = true;
+  }
+  BlockContents block;
+  if (!ReadBlock(rep_->file, opt, properties_handle, &block).ok()) {
+    return;
+  }
+  rep_->properties = new Block(block);
 }
 
 Table::~Table() {
   delete rep_;
 }
 
+namespace {
+// A filter partition, as held by the block cache
+struct FilterPartition {
+  Slice data;
+  bool heap_allocated;
+
+  ~FilterPartition() {
+    if (heap_allocated) {
+      delete[] data.data();
+    }
+  }
+};
+}
+
+static void DeleteCachedFilterPartition(const Slice& key, void* value) {
+  delete reinterpret_cast<FilterPartition*>(value);
+}
+
+bool Table::FilterPartitionMayMatch(const ReadOptions& options,
+                                    const Slice& target,
+                                    const Slice& key) {
+  Iterator* iter = rep_->filter_index->NewIterator(rep_->options.comparator);
+  iter->Seek(target);
+  BlockHandle handle;
+  Slice input;
+  if (iter->Valid()) {
+    input = iter->value();
+  }
+  const bool found = iter->Valid() && handle.DecodeFrom(&input).ok();
+  delete iter;
+  if (!found) {
+    return true;  // Errors are treated as potential matches
+  }
+
+  Cache* block_cache = rep_->options.block_cache;
+  char cache_key_buffer[16];
+  EncodeFixed64(cache_key_buffer, rep_->cache_id);
+  EncodeFixed64(cache_key_buffer+8, handle.offset());
+  Slice cache_key(cache_key_buffer, sizeof(cache_key_buffer));
+  if (block_cache != NULL) {
+    Cache::Handle* cache_handle = block_cache->Lookup(cache_key);
+    if (cache_handle != NULL) {
+      FilterPartition* partition =
+          reinterpret_cast<FilterPartition*>(block_cache->Value(cache_handle));
+      const bool result =
+          rep_->filter_policy->KeyMayMatch(key, partition->data);
+      block_cache->Release(cache_handle);
+      return result;
+    }
+  }
+
+  BlockContents contents;
+  if (!ReadBlock(rep_->file, options, handle, &contents).ok()) {
+    return true;
+  }
+  FilterPartition* partition = new FilterPartition;
+  partition->data = contents.data;
+  partition->heap_allocated = contents.heap_allocated;
+  const bool result =
+      rep_->filter_policy->KeyMayMatch(key, partition->data);
+  if (block_cache != NULL && contents.cachable && options.fill_cache) {
+    block_cache->Release(block_cache->Insert(
+        cache_key, partition, partition->data.size(),
+        &DeleteCachedFilterPartition));
+  } else {
+    delete partition;
+  }
+  return result;
+}
+
+bool Table::FilterMayMatch(const ReadOptions& options, const Slice& target,
+                           const Slice& key) {
+  const FilterPolicy* policy = rep_->filter_policy;
+  if (!rep_->full_filter.empty()) {
+    return policy->KeyMayMatch(key, rep_->full_filter);
+  }
+  if (rep_->filter_index != NULL) {
+    return FilterPartitionMayMatch(options, target, key);
+  }
+  bool result = true;
+  if (rep_->filter != NULL) {
+    Iterator* iiter = NewIndexIterator(options);
+    iiter->Seek(target);
+    if (iiter->Valid()) {
+      Slice handle_value = iiter->value();
+      BlockHandle handle;
+      if (handle.DecodeFrom(&handle_value).ok()) {
+        result = rep_->filter->KeyMayMatch(handle.offset(), key);
+      }
+    }
+    delete iiter;
+  }
+  return result;
+}
+
 static void DeleteBlock(void* arg, void* ignored) {
   delete reinterpret_cast<Block*>(arg);
 }
@@ -159,15 +401,15 @@ static void ReleaseBlock(void* arg, void* h) {
   cache->Release(handle);
 }
 
-// Convert an index iterator value (i.e., an encoded BlockHandle)
-// into an iterator over the contents of the corresponding block.
-Iterator* Table::BlockReader(void* arg,
-                             const ReadOptions& options,
-                             const Slice& index_value) {
-  Table* table = reinterpret_cast<Table*>(arg);
+Status Table::LoadBlock(Table* table,
+                        const ReadOptions& options,
+                        const Slice& index_value,
+                        Block** block,
+                        Iterator::CleanupFunction* release,
+                        void** arg1, void** arg2) {
   Cache* block_cache = table->rep_->options.block_cache;
-  Block* block = NULL;
   Cache::Handle* cache_handle = NULL;
+  *block = NULL;
 
   BlockHandle handle;
   Slice input = index_value;
@@ -184,50 +426,131 @@ Iterator* Table::BlockReader(void* arg,
       Slice key(cache_key_buffer, sizeof(cache_key_buffer));
       cache_handle = block_cache->Lookup(key);
       if (cache_handle != NULL) {
-        block = reinterpret_cast<Block*>(block_cache->Value(cache_handle));
+        *block = reinterpret_cast<Block*>(block_cache->Value(cache_handle));
       } else {
-        s = ReadBlock(table->rep_->file, options, handle, &contents);
+        s = ReadBlock(table->rep_->file, options, handle, &contents,
+                      table->rep_->zstd_dict);
         if (s.ok()) {
-          block = new Block(contents);
+          *block = new Block(contents);
           if (contents.cachable && options.fill_cache) {
             cache_handle = block_cache->Insert(
-                key, block, block->size(), &DeleteCachedBlock);
+                key, *block, (*block)->size(), &DeleteCachedBlock);
           }
         }
       }
     } else {
-      s = ReadBlock(table->rep_->file, options, handle, &contents);
+      s = ReadBlock(table->rep_->file, options, handle, &contents,
+                    table->rep_->zstd_dict);
       if (s.ok()) {
-        block = new Block(contents);
+        *block = new Block(contents);
       }
     }
   }
 
-  Iterator* iter;
-  if (block != NULL) {
-    iter = block->NewIterator(table->rep_->options.comparator);
+  if (*block != NULL) {
     if (cache_handle == NULL) {
-      iter->RegisterCleanup(&DeleteBlock, block, NULL);
+      *release = &DeleteBlock;
+      *arg1 = *block;
+      *arg2 = NULL;
     } else {
-      iter->RegisterCleanup(&ReleaseBlock, block_cache, cache_handle);
+      *release = &ReleaseBlock;
+      *arg1 = block_cache;
+      *arg2 = cache_handle;
     }
+  }
+  return s;
+}
+
+// Convert an index iterator value (i.e., an encoded BlockHandle)
+// into an iterator over the contents of the corresponding block.
+Iterator* Table::BlockReader(void* arg,
+                             const ReadOptions& options,
+                             const Slice& index_value) {
+  Table* table = reinterpret_cast<Table*>(arg);
+  Block* block;
+  Iterator::CleanupFunction release;
+  void* arg1;
+  void* arg2;
+  Status s = LoadBlock(table, options, index_value, &block,
+                       &release, &arg1, &arg2);
+
+  Iterator* iter;
+  if (block != NULL) {
+    iter = block->NewIterator(table->rep_->options.comparator);
+    iter->RegisterCleanup(release, arg1, arg2);
   } else {
     iter = NewErrorIterator(s);
   }
   return iter;
 }
 
+Iterator* Table::NewIndexIterator(const ReadOptions& options) const {
+  Iterator* iter = rep_->index_block->NewIterator(rep_->options.comparator);
+  if (rep_->partitioned_index) {
+    // Index partitions are read like data blocks
+    iter = NewTwoLevelIterator(iter, &Table::BlockReader,
+                               const_cast<Table*>(this), options);
+  }
+  return iter;
+}
+
 Iterator* Table::NewIterator(const ReadOptions& options) const {
   return NewTwoLevelIterator(
-      rep_->index_block->NewIterator(rep_->options.comparator),
+      NewIndexIterator(options),
       &Table::BlockReader, const_cast<Table*>(this), options);
 }
 
+Iterator* Table::NewRangeTombstoneIterator(const ReadOptions& options) const {
+  if (!rep_->has_range_dels) {
+    return NULL;
+  }
+  BlockContents contents;
+  Status s = ReadBlock(rep_->file, options, rep_->range_del_handle,
+                       &contents);
+  if (!s.ok()) {
+    return NewErrorIterator(s);
+  }
+  Block* block = new Block(contents);
+  Iterator* iter = block->NewIterator(rep_->options.comparator);
+  iter->RegisterCleanup(&DeleteBlock, block, NULL);
+  return iter;
+}
+
+namespace {
+struct CopyingSaver {
+  void* arg;
+  void (*saver)(void*, const Slice&, const Slice&);
+};
+}
+
+static bool SaveWithoutPinning(void* arg, const Slice& k, const Slice& v) {
+  CopyingSaver* s = reinterpret_cast<CopyingSaver*>(arg);
+  (*s->saver)(s->arg, k, v);
+  return false;
+}
+
 Status Table::InternalGet(const ReadOptions& options, const Slice& k,
                           void* arg,
                           void (*saver)(void*, const Slice&, const Slice&)) {
+  CopyingSaver copying_saver;
+  copying_saver.arg = arg;
+  copying_saver.saver = saver;
+  return InternalGet(options, k, &copying_saver, &SaveWithoutPinning, NULL);
+}
+
+Status Table::InternalGet(const ReadOptions& options, const Slice& k,
+                          void* arg,
+                          bool (*saver)(void*, const Slice&, const Slice&),
+                          PinnedValue* pin) {
   Status s;
-  Iterator* iiter = rep_->index_block->NewIterator(rep_->options.comparator);
+  if (!rep_->full_filter.empty() &&
+      !rep_->filter_policy->KeyMayMatch(k, rep_->full_filter)) {
+    return s;  // Not found
+  }
+  if (rep_->filter_index != NULL && !FilterPartitionMayMatch(options, k, k)) {
+    return s;  // Not found
+  }
+  Iterator* iiter = NewIndexIterator(options);
   iiter->Seek(k);
   if (iiter->Valid()) {
     Slice handle_value = iiter->value();
@@ -238,14 +561,96 @@ Status Table::InternalGet(const ReadOptions& options, const Slice& k,
         !filter->KeyMayMatch(handle.offset(), k)) {
       // Not found
     } else {
-      Iterator* block_iter = BlockReader(this, options, iiter->value());
-      block_iter->Seek(k);
-      if (block_iter->Valid()) {
-        (*saver)(arg, block_iter->key(), block_iter->value());
+      Block* block;
+      Iterator::CleanupFunction release;
+      void* arg1;
+      void* arg2;
+      s = LoadBlock(this, options, iiter->value(), &block,
+                    &release, &arg1, &arg2);
+      if (s.ok()) {
+        // The block iterator does not own the block, so the entry it
+        // yields stays valid after the iterator is gone.
+        Iterator* block_iter = block->SeekForGet(rep_->options.comparator, k);
+        bool keep = false;
+        if (block_iter->Valid()) {
+          keep = (*saver)(arg, block_iter->key(), block_iter->value());
+        }
+        s = block_iter->status();
+        delete block_iter;
+        if (keep) {
+          pin->RegisterCleanup(release, arg1, arg2);
+        } else {
+          (*release)(arg1, arg2);
+        }
+      }
+    }
+  }
+  if (s.ok()) {
+    s = iiter->status();
+  }
+  delete iiter;
+  return s;
+}
+
+Status Table::InternalMultiGet(const ReadOptions& options, int n,
+                               const Slice* keys, void* const* args,
+                               void (*saver)(void*, const Slice&,
+                                             const Slice&)) {
+  Status s;
+  const Comparator* cmp = rep_->options.comparator;
+  FilterBlockReader* filter = rep_->filter;
+  Iterator* iiter = NewIndexIterator(options);
+  Block* block = NULL;           // Block of the previous key looked up
+  uint64_t block_offset = 0;     // Offset of block
+  Iterator::CleanupFunction release = NULL;
+  void* arg1 = NULL;
+  void* arg2 = NULL;
+  for (int i = 0; i < n && s.ok(); i++) {
+    if (!rep_->full_filter.empty() &&
+        !rep_->filter_policy->KeyMayMatch(keys[i], rep_->full_filter)) {
+      continue;  // Not found
+    }
+    if (rep_->filter_index != NULL &&
+        !FilterPartitionMayMatch(options, keys[i], keys[i])) {
+      continue;  // Not found
+    }
+    // The keys are sorted, so the index entry found for the previous key
+    // still applies as long as its separator is >= the current key.
+    if (i == 0 || !iiter->Valid() || cmp->Compare(iiter->key(), keys[i]) < 0) {
+      iiter->Seek(keys[i]);
+    }
+    if (!iiter->Valid()) {
+      break;  // This and all later keys are past the end of the table
+    }
+    Slice handle_value = iiter->value();
+    BlockHandle handle;
+    s = handle.DecodeFrom(&handle_value);
+    if (!s.ok()) {
+      break;
+    }
+    if (filter != NULL && !filter->KeyMayMatch(handle.offset(), keys[i])) {
+      continue;  // Not found
+    }
+    if (block == NULL || block_offset != handle.offset()) {
+      if (block != NULL) {
+        (*release)(arg1, arg2);
+      }
+      s = LoadBlock(this, options, iiter->value(), &block,
+                    &release, &arg1, &arg2);
+      if (!s.ok()) {
+        break;
       }
-      s = block_iter->status();
-      delete block_iter;
+      block_offset = handle.offset();
     }
+    Iterator* block_iter = block->SeekForGet(cmp, keys[i]);
+    if (block_iter->Valid()) {
+      (*saver)(args[i], block_iter->key(), block_iter->value());
+    }
+    s = block_iter->status();
+    delete block_iter;
+  }
+  if (block != NULL) {
+    (*release)(arg1, arg2);
   }
   if (s.ok()) {
     s = iiter->status();
@@ -254,10 +659,22 @@ Status Table::InternalGet(const ReadOptions& options, const Slice& k,
   return s;
 }
 
+bool Table::GetProperty(const Slice& name, std::string* value) const {
+  if (rep_->properties == NULL) {
+    return false;
+  }
+  Iterator* iter = rep_->properties->NewIterator(BytewiseComparator());
+  iter->Seek(name);
+  const bool found = iter->Valid() && iter->key() == name;
+  if (found) {
+    value->assign(iter->value().data(), iter->value().size());
+  }
+  delete iter;
+  return found;
+}
 
 uint64_t Table::ApproximateOffsetOf(const Slice& key) const {
-  Iterator* index_iter =
-      rep_->index_block->NewIterator(rep_->options.comparator);
+  Iterator* index_iter = NewIndexIterator(ReadOptions());
   index_iter->Seek(key);
   uint64_t result;
   if (index_iter->Valid()) {
@@ -5,10 +5,12 @@
 #include "leveldb/table_builder.h"
 
 #include <assert.h>
+#include <map>
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/options.h"
+#include "table/block.h"
 #include "table/block_builder.h"
 #include "table/filter_block.h"
 #include "table/format.h"
@@ -25,11 +27,24 @@ struct TableBuilder::Rep {
   Status status;
   BlockBuilder data_block;
   BlockBuilder index_block;
+  BlockBuilder range_del_block;
+  std::map<std::string, std::string> properties;
   std::string last_key;
   int64_t num_entries;
   bool closed;          // Either Finish() or Abandon() has been called.
   FilterBlockBuilder* filter_block;
 
+  // With a partitioned index, index_block holds the current index
+  // partition.  Finished partitions and their filters are kept until
+  // Finish() writes them out, along with the last index key of each,
+  // which becomes its key in the top-level indexes.  Otherwise a
+  // whole-file filter is built by filter_partition as a single partition.
+  bool partitioned;
+  FilterPartitionBuilder* filter_partition;
+  std::vector<std::string> index_partitions;
+  std::vector<std::string> filter_partitions;
+  std::vector<std::string> partition_keys;
+
   // We do not emit the index entry for a block until we have seen the
   // first key for the next data block.  This allows us to use shorter
   // keys in the index block.  For example, consider a block boundary
@@ -44,6 +59,20 @@ struct TableBuilder::Rep {
 
   std::string compressed_output;
 
+  // When dictionary compression is enabled, finished data blocks are
+  // first kept in memory, uncompressed and back to back in
+  // buffered_data, until there is enough data to train the dictionary
+  // on.  Their index entries and filters are generated once they are
+  // written.  buffered_index_keys[i] is the index key for block i; the
+  // last block's key is not known before the next key is added.
+  bool buffering;
+  std::string buffered_data;
+  std::vector<size_t> buffered_lengths;
+  std::vector<std::string> buffered_index_keys;
+
+  std::string dict;                        // Empty if not trained
+  port::ZstdCompressionDict* compression_dict;
+
   Rep(const Options& opt, WritableFile* f)
       : options(opt),
         index_block_options(opt),
@@ -51,12 +80,30 @@ struct TableBuilder::Rep {
         offset(0),
         data_block(&options),
         index_block(&index_block_options),
+        range_del_block(&index_block_options),
         num_entries(0),
         closed(false),
-        filter_block(opt.filter_policy == NULL ? NULL
+        filter_block(opt.filter_policy == NULL ||
+                     opt.partition_index_and_filters ||
+                     opt.whole_file_filter ? NULL
                      : new FilterBlockBuilder(opt.filter_policy)),
-        pending_index_entry(false) {
+        partitioned(opt.partition_index_and_filters),
+        filter_partition(opt.filter_policy == NULL ||
+                         !(opt.partition_index_and_filters ||
+                           opt.whole_file_filter) ? NULL
+                         : new FilterPartitionBuilder(opt.filter_policy)),
+        pending_index_entry(false),
+        buffering(opt.compression == kZstdCompression &&
+                  opt.zstd_max_dict_bytes > 0),
+        compression_dict(NULL) {
     index_block_options.block_restart_interval = 1;
+    index_block_options.data_block_hash_index = false;
+  }
+
+  ~Rep() {
+    if (compression_dict != NULL) {
+      port::Zstd_DeleteCompressionDict(compression_dict);
+    }
   }
 };
 
@@ -70,6 +117,7 @@ TableBuilder::TableBuilder(const Options& options, WritableFile* file)
 TableBuilder::~TableBuilder() {
   assert(rep_->closed);  // Catch errors where caller forgot to call Finish()
   delete rep_->filter_block;
+  delete rep_->filter_partition;
   delete rep_;
 }
 
@@ -86,6 +134,7 @@ Status TableBuilder::ChangeOptions(const Options& options) {
   rep_->options = options;
   rep_->index_block_options = options;
   rep_->index_block_options.block_restart_interval = 1;
+  rep_->index_block_options.data_block_hash_index = false;
   return Status::OK();
 }
 
@@ -100,14 +149,20 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
   if (r->pending_index_entry) {
     assert(r->data_block.empty());
     r->options.comparator->FindShortestSeparator(&r->last_key, key);
-    std::string handle_encoding;
-    r->pending_handle.EncodeTo(&handle_encoding);
-    r->index_block.Add(r->last_key, Slice(handle_encoding));
+    if (r->buffering) {
+      r->buffered_index_keys.push_back(r->last_key);
+    } else {
+      AddIndexEntry(r->last_key, r->pending_handle);
+    }
     r->pending_index_entry = false;
   }
 
-  if (r->filter_block != NULL) {
-    r->filter_block->AddKey(key);
+  if (!r->buffering) {
+    if (r->filter_block != NULL) {
+      r->filter_block->AddKey(key);
+    } else if (r->filter_partition != NULL) {
+      r->filter_partition->AddKey(key);
+    }
   }
 
   r->last_key.assign(key.data(), key.size());
@@ -120,13 +175,38 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
   }
 }
 
+void TableBuilder::AddRangeTombstone(const Slice& key, const Slice& value) {
+  Rep* r = rep_;
+  assert(!r->closed);
+  if (!ok()) return;
+  r->range_del_block.Add(key, value);
+}
+
+void TableBuilder::SetProperty(const Slice& name, const Slice& value) {
+  Rep* r = rep_;
+  assert(!r->closed);
+  r->properties[name.ToString()] = value.ToString();
+}
+
 void TableBuilder::Flush() {
   Rep* r = rep_;
   assert(!r->closed);
   if (!ok()) return;
   if (r->data_block.empty()) return;
   assert(!r->pending_index_entry);
-  WriteBlock(&r->data_block, &r->pending_handle);
+  if (r->buffering) {
+    Slice raw = r->data_block.Finish();
+    r->buffered_data.append(raw.data(), raw.size());
+    r->buffered_lengths.push_back(raw.size());
+    r->data_block.Reset();
+    r->pending_index_entry = true;
+    if (r->buffered_data.size() >= r->options.zstd_max_train_bytes) {
+      WriteBufferedBlocks();
+    }
+    return;
+  }
+  CompressAndWriteBlock(r->data_block.Finish(), true, &r->pending_handle);
+  r->data_block.Reset();
   if (ok()) {
     r->pending_index_entry = true;
     r->status = r->file->Flush();
@@ -136,40 +216,150 @@ void TableBuilder::Flush() {
   }
 }
 
+void TableBuilder::WriteBufferedBlocks() {
+  Rep* r = rep_;
+  assert(r->buffering);
+  r->buffering = false;
+  if (r->options.compression == kZstdCompression &&
+      port::Zstd_TrainDictionary(r->buffered_data, r->buffered_lengths,
+                                 r->options.zstd_max_dict_bytes, &r->dict)) {
+    r->compression_dict = port::Zstd_NewCompressionDict(r->dict.data(),
+                                                        r->dict.size());
+    if (r->compression_dict == NULL) {
+      r->dict.clear();
+    }
+  }
+
+  const size_t n = r->buffered_lengths.size();
+  assert(n == 0 || r->buffered_index_keys.size() == n - 1);
+  const char* data = r->buffered_data.data();
+  for (size_t i = 0; i < n && ok(); i++) {
+    Slice raw(data, r->buffered_lengths[i]);
+    data += raw.size();
+    if (r->filter_block != NULL || r->filter_partition != NULL) {
+      BlockContents contents;
+      contents.data = raw;
+      contents.cachable = false;
+      contents.heap_allocated = false;
+      Block block(contents);
+      Iterator* iter = block.NewIterator(r->options.comparator);
+      for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        if (r->filter_block != NULL) {
+          r->filter_block->AddKey(iter->key());
+        } else {
+          r->filter_partition->AddKey(iter->key());
+        }
+      }
+      delete iter;
+    }
+
+    BlockHandle handle;
+    CompressAndWriteBlock(raw, true, &handle);
+    if (i + 1 < n) {
+      AddIndexEntry(r->buffered_index_keys[i], handle);
+    } else {
+      // The last block's index entry stays pending, exactly as if it had
+      // just been written by Flush().
+      r->pending_handle = handle;
+    }
+    if (r->filter_block != NULL) {
+      r->filter_block->StartBlock(r->offset);
+    }
+  }
+  if (ok()) {
+    r->status = r->file->Flush();
+  }
+
+  std::string().swap(r->buffered_data);
+  std::vector<size_t>().swap(r->buffered_lengths);
+  std::vector<std::string>().swap(r->buffered_index_keys);
+}
+
+void TableBuilder::AddIndexEntry(const Slice& key, const BlockHandle& handle) {
+  Rep* r = rep_;
+  std::string handle_encoding;
+  handle.EncodeTo(&handle_encoding);
+  r->index_block.Add(key, Slice(handle_encoding));
+  if (r->partitioned &&
+      r->index_block.CurrentSizeEstimate() >= r->options.index_partition_size) {
+    FinishIndexPartition(key);
+  }
+}
+
+void TableBuilder::FinishIndexPartition(const Slice& last_key) {
+  Rep* r = rep_;
+  r->partition_keys.push_back(last_key.ToString());
+  r->index_partitions.push_back(r->index_block.Finish().ToString());
+  r->index_block.Reset();
+  if (r->filter_partition != NULL) {
+    r->filter_partitions.push_back(
+        r->filter_partition->FinishPartition().ToString());
+  }
+}
+
 void TableBuilder::WriteBlock(BlockBuilder* block, BlockHandle* handle) {
+  CompressAndWriteBlock(block->Finish(), false, handle);
+  block->Reset();
+}
+
+void TableBuilder::CompressAndWriteBlock(const Slice& raw,
+                                         bool use_dict,
+                                         BlockHandle* handle) {
   // File format contains a sequence of blocks where each block has:
   //    block_data: uint8[n]
   //    type: uint8
   //    crc: uint32
   assert(ok());
   Rep* r = rep_;
-  Slice raw = block->Finish();
 
   Slice block_contents;
   CompressionType type = r->options.compression;
-  // TODO(postrelease): Support more compression options: zlib?
+  std::string* compressed = &r->compressed_output;
+  bool compressed_ok = false;
   switch (type) {
     case kNoCompression:
-      block_contents = raw;
       break;
 
-    case kSnappyCompression: {
-      std::string* compressed = &r->compressed_output;
-      if (port::Snappy_Compress(raw.data(), raw.size(), compressed) &&
-          compressed->size() < raw.size() - (raw.size() / 8u)) {
-        block_contents = *compressed;
-      } else {
-        // Snappy not supported, or compressed less than 12.5%, so just
-        // store uncompressed form
-        block_contents = raw;
-        type = kNoCompression;
+    case kSnappyCompression:
+      compressed_ok = port::Snappy_Compress(raw.data(), raw.size(),
+                                            compressed);
+      break;
+
+    case kLZ4Compression: {
+      // LZ4 blocks do not record their uncompressed length, so it is
+      // stored in front of them.
+      std::string lz4;
+      if (port::LZ4_Compress(raw.data(), raw.size(), &lz4)) {
+        PutVarint32(compressed, static_cast<uint32_t>(raw.size()));
+        compressed->append(lz4);
+        compressed_ok = true;
       }
       break;
     }
+
+    case kZstdCompression:
+      if (use_dict && r->compression_dict != NULL) {
+        compressed_ok = port::Zstd_CompressWithDict(
+            raw.data(), raw.size(), r->compression_dict, compressed);
+      } else {
+        compressed_ok = port::Zstd_Compress(raw.data(), raw.size(),
+                                            compressed);
+      }
+      break;
+  }
+  if (type == kNoCompression) {
+    block_contents = raw;
+  } else if (compressed_ok &&
+             compressed->size() < raw.size() - (raw.size() / 8u)) {
+    block_contents = *compressed;
+  } else {
+    // Compression not supported, or compressed less than 12.5%, so just
+    // store uncompressed form
+    block_contents = raw;
+    type = kNoCompression;
   }
   WriteRawBlock(block_contents, type, handle);
   r->compressed_output.clear();
-  block->Reset();
 }
 
 void TableBuilder::WriteRawBlock(const Slice& block_contents,
@@ -199,10 +389,26 @@ Status TableBuilder::status() const {
 Status TableBuilder::Finish() {
   Rep* r = rep_;
   Flush();
+  if (r->buffering && ok()) {
+    WriteBufferedBlocks();
+  }
   assert(!r->closed);
   r->closed = true;
 
   BlockHandle filter_block_handle, metaindex_block_handle, index_block_handle;
+  BlockHandle dict_block_handle, range_del_block_handle;
+  BlockHandle properties_block_handle;
+
+  // Add the index entry for the last data block.  This finishes the last
+  // index partition and its filter, which must be written next.
+  if (ok() && r->pending_index_entry) {
+    r->options.comparator->FindShortSuccessor(&r->last_key);
+    AddIndexEntry(r->last_key, r->pending_handle);
+    r->pending_index_entry = false;
+  }
+  if (ok() && r->partitioned && !r->index_block.empty()) {
+    FinishIndexPartition(r->last_key);
+  }
 
   // Write filter block
   if (ok() && r->filter_block != NULL) {
@@ -210,9 +416,59 @@ Status TableBuilder::Finish() {
                   &filter_block_handle);
   }
 
-  // Write metaindex block
+  // Write whole-file filter
+  if (ok() && r->filter_partition != NULL && !r->partitioned) {
+    WriteRawBlock(r->filter_partition->FinishPartition(), kNoCompression,
+                  &filter_block_handle);
+  }
+
+  // Write filter partitions and the top-level index over them, whose
+  // keys are the same as those of the top-level index
+  if (ok() && r->filter_partition != NULL && r->partitioned) {
+    BlockBuilder filter_index_block(&r->index_block_options);
+    for (size_t i = 0; i < r->filter_partitions.size() && ok(); i++) {
+      BlockHandle handle;
+      WriteRawBlock(r->filter_partitions[i], kNoCompression, &handle);
+      std::string handle_encoding;
+      handle.EncodeTo(&handle_encoding);
+      filter_index_block.Add(r->partition_keys[i], handle_encoding);
+    }
+    if (ok()) {
+      WriteBlock(&filter_index_block, &filter_block_handle);
+    }
+  }
+
+  // Write compression dictionary block
+  if (ok() && !r->dict.empty()) {
+    WriteRawBlock(r->dict, kNoCompression, &dict_block_handle);
+  }
+
+  // Write properties block, whose keys are the property names in
+  // bytewise order
+  if (ok() && !r->properties.empty()) {
+    Options properties_options = r->index_block_options;
+    properties_options.comparator = BytewiseComparator();
+    BlockBuilder properties_block(&properties_options);
+    for (std::map<std::string, std::string>::const_iterator it =
+             r->properties.begin();
+         it != r->properties.end(); ++it) {
+      properties_block.Add(it->first, it->second);
+    }
+    WriteBlock(&properties_block, &properties_block_handle);
+  }
+
+  // Write range tombstone block
+  const bool has_range_dels = !r->range_del_block.empty();
+  if (ok() && has_range_dels) {
+    WriteBlock(&r->range_del_block, &range_del_block_handle);
+  }
+
+  // Write metaindex block.  Its keys are names, which Table::ReadMeta()
+  // looks up in bytewise order.
   if (ok()) {
-    BlockBuilder meta_index_block(&r->options);
+    Options meta_index_options = r->index_block_options;
+    meta_index_options.comparator = BytewiseComparator();
+    BlockBuilder meta_index_block(&meta_index_options);
     if (r->filter_block != NULL) {
       // Add mapping from "filter.Name" to location of filter data
       std::string key = "filter.";
@@ -221,20 +477,54 @@ Status TableBuilder::Finish() {
       filter_block_handle.EncodeTo(&handle_encoding);
       meta_index_block.Add(key, handle_encoding);
     }
+    if (r->filter_partition != NULL) {
+      // Add mapping from "fullfilter.Name" to location of the whole-file
+      // filter, or from "partitionedfilter.Name" to location of the
+      // top-level filter index
+      std::string key = r->partitioned ? "partitionedfilter." : "fullfilter.";
+      key.append(r->options.filter_policy->Name());
+      std::string handle_encoding;
+      filter_block_handle.EncodeTo(&handle_encoding);
+      meta_index_block.Add(key, handle_encoding);
+    }
+    if (!r->properties.empty()) {
+      // Add mapping from "properties" to location of the properties
+      std::string handle_encoding;
+      properties_block_handle.EncodeTo(&handle_encoding);
+      meta_index_block.Add(kPropertiesBlockName, handle_encoding);
+    }
+    if (has_range_dels) {
+      // Add mapping from "rangedel" to location of the range tombstones
+      std::string handle_encoding;
+      range_del_block_handle.EncodeTo(&handle_encoding);
+      meta_index_block.Add(kRangeDelBlockName, handle_encoding);
+    }
+    if (!r->dict.empty()) {
+      // Add mapping from "zstd.dict" to location of the dictionary
+      std::string handle_encoding;
+      dict_block_handle.EncodeTo(&handle_encoding);
+      meta_index_block.Add(kZstdDictBlockName, handle_encoding);
+    }
 
     // TODO(postrelease): Add stats and other meta blocks
     WriteBlock(&meta_index_block, &metaindex_block_handle);
   }
 
-  // Write index block
-  if (ok()) {
-    if (r->pending_index_entry) {
-      r->options.comparator->FindShortSuccessor(&r->last_key);
+  // Write index partitions.  They are read through the block cache like
+  // data blocks, so they share the data blocks' compression dictionary.
+  if (ok() && r->partitioned) {
+    assert(r->index_block.empty());
+    for (size_t i = 0; i < r->index_partitions.size() && ok(); i++) {
+      BlockHandle handle;
+      CompressAndWriteBlock(r->index_partitions[i], true, &handle);
       std::string handle_encoding;
-      r->pending_handle.EncodeTo(&handle_encoding);
-      r->index_block.Add(r->last_key, Slice(handle_encoding));
-      r->pending_index_entry = false;
+      handle.EncodeTo(&handle_encoding);
+      r->index_block.Add(r->partition_keys[i], handle_encoding);
     }
+  }
+
+  // Write index block, which is the top-level index if partitioned
+  if (ok()) {
     WriteBlock(&r->index_block, &index_block_handle);
   }
 
@@ -243,6 +533,7 @@ Status TableBuilder::Finish() {
     Footer footer;
     footer.set_metaindex_handle(metaindex_block_handle);
     footer.set_index_handle(index_block_handle);
+    footer.set_partitioned_index(r->partitioned);
     std::string footer_encoding;
     footer.EncodeTo(&footer_encoding);
     r->status = r->file->Append(footer_encoding);
@@ -264,7 +555,7 @@ uint64_t TableBuilder::NumEntries() const {
 }
 
 uint64_t TableBuilder::FileSize() const {
-  return rep_->offset;
+  return rep_->offset + rep_->buffered_data.size();
 }
 
 }  // namespace leveldb
@@ -407,30 +407,43 @@ struct TestArgs {
   TestType type;
   bool reverse_compare;
   int restart_interval;
+  bool hash_index;
+  bool partitioned;
 };
 
 static const TestArgs kTestArgList[] = {
-  { TABLE_TEST, false, 16 },
-  { TABLE_TEST, false, 1 },
-  { TABLE_TEST, false, 1024 },
-  { TABLE_TEST, true, 16 },
-  { TABLE_TEST, true, 1 },
-  { TABLE_TEST, true, 1024 },
-
-  { BLOCK_TEST, false, 16 },
-  { BLOCK_TEST, false, 1 },
-  { BLOCK_TEST, false, 1024 },
-  { BLOCK_TEST, true, 16 },
-  { BLOCK_TEST, true, 1 },
-  { BLOCK_TEST, true, 1024 },
+  { TABLE_TEST, false, 16, false, false },
+  { TABLE_TEST, false, 1, false, false },
+  { TABLE_TEST, false, 1024, false, false },
+  { TABLE_TEST, true, 16, false, false },
+  { TABLE_TEST, true, 1, false, false },
+  { TABLE_TEST, true, 1024, false, false },
+
+  { BLOCK_TEST, false, 16, false, false },
+  { BLOCK_TEST, false, 1, false, false },
+  { BLOCK_TEST, false, 1024, false, false },
+  { BLOCK_TEST, true, 16, false, false },
+  { BLOCK_TEST, true, 1, false, false },
+  { BLOCK_TEST, true, 1024, false, false },
+
+  { TABLE_TEST, false, 16, true, false },
+  { TABLE_TEST, true, 1, true, false },
+  { BLOCK_TEST, false, 16, true, false },
+  { BLOCK_TEST, true, 1, true, false },
+
+  { TABLE_TEST, false, 16, false, true },
+  { TABLE_TEST, true, 1, false, true },
+  { TABLE_TEST, false, 16, true, true },
 
   // Restart interval does not matter for memtables
-  { MEMTABLE_TEST, false, 16 },
-  { MEMTABLE_TEST, true, 16 },
+  { MEMTABLE_TEST, false, 16, false, false },
+  { MEMTABLE_TEST, true, 16, false, false },
 
   // Do not bother with restart interval variations for DB
-  { DB_TEST, false, 16 },
-  { DB_TEST, true, 16 },
+  { DB_TEST, false, 16, false, false },
+  { DB_TEST, true, 16, false, false },
+  { DB_TEST, false, 16, true, false },
+  { DB_TEST, false, 16, false, true },
 };
 static const int kNumTestArgs = sizeof(kTestArgList) / sizeof(kTestArgList[0]);
 
@@ -444,6 +457,9 @@ class Harness {
     options_ = Options();
 
     options_.block_restart_interval = args.restart_interval;
+    options_.data_block_hash_index = args.hash_index;
+    options_.partition_index_and_filters = args.partitioned;
+    options_.index_partition_size = 64;
     // Use shorter block size for tests to exercise block boundary
     // conditions more.
     options_.block_size = 256;
@@ -759,6 +775,62 @@ TEST(Harness, RandomizedLongDB) {
 
 class MemTableTest { };
 
+class BlockTest { };
+
+TEST(BlockTest, HashIndex) {
+  InternalKeyComparator cmp(BytewiseComparator());
+  Options options;
+  options.comparator = &cmp;
+  options.block_restart_interval = 4;
+  options.data_block_hash_index = true;
+
+  // Three versions of each even key, so that some straddle restart
+  // points
+  BlockBuilder builder(&options);
+  for (int i = 0; i < 100; i += 2) {
+    char key[10];
+    snprintf(key, sizeof(key), "k%03d", i);
+    for (int seq = 3; seq >= 1; seq--) {
+      std::string ikey;
+      AppendInternalKey(&ikey, ParsedInternalKey(key, 10 * i + seq,
+                                                 kTypeValue));
+      builder.Add(ikey, key);
+    }
+  }
+  Slice raw = builder.Finish();
+  ASSERT_NE(0u, DecodeFixed32(raw.data() + raw.size() - 4) &
+                kBlockHashIndexFlag);
+  BlockContents contents;
+  contents.data = raw;
+  contents.cachable = false;
+  contents.heap_allocated = false;
+  Block block(contents);
+
+  for (int i = 0; i < 100; i++) {
+    char key[10];
+    snprintf(key, sizeof(key), "k%03d", i);
+    for (int seq = 4; seq >= 0; seq--) {
+      LookupKey lkey(key, 10 * i + seq);
+      Iterator* expected = block.NewIterator(&cmp);
+      expected->Seek(lkey.internal_key());
+      Iterator* iter = block.SeekForGet(&cmp, lkey.internal_key());
+      if (expected->Valid() &&
+          ExtractUserKey(expected->key()) == Slice(key)) {
+        ASSERT_TRUE(iter->Valid()) << key << "@" << seq;
+        ASSERT_EQ(expected->key().ToString(), iter->key().ToString());
+        ASSERT_EQ(expected->value().ToString(), iter->value().ToString());
+      } else {
+        // Any entry found must belong to a different key
+        ASSERT_TRUE(!iter->Valid() ||
+                    ExtractUserKey(iter->key()) != Slice(key));
+      }
+      ASSERT_OK(iter->status());
+      delete iter;
+      delete expected;
+    }
+  }
+}
+
 TEST(MemTableTest, Simple) {
   InternalKeyComparator cmp(BytewiseComparator());
   MemTable* memtable = new MemTable(cmp);
@@ -861,6 +933,151 @@ TEST(TableTest, ApproximateOffsetOfCompressed) {
   ASSERT_TRUE(Between(c.ApproximateOffsetOf("xyz"),    4000,   6000));
 }
 
+static bool CompressionSupported(CompressionType type) {
+  std::string out;
+  Slice in = "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa";
+  switch (type) {
+    case kSnappyCompression:
+      return port::Snappy_Compress(in.data(), in.size(), &out);
+    case kLZ4Compression:
+      return port::LZ4_Compress(in.data(), in.size(), &out);
+    case kZstdCompression:
+      return port::Zstd_Compress(in.data(), in.size(), &out);
+    default:
+      return true;
+  }
+}
+
+// Builds a table of compressible values with the given compression and
+// checks that it is both smaller than the raw data and readable.
+static void TestCompressedRoundTrip(CompressionType type) {
+  Random rnd(301);
+  TableConstructor c(BytewiseComparator());
+  std::string tmp;
+  for (int i = 0; i < 100; i++) {
+    char key[10];
+    snprintf(key, sizeof(key), "k%03d", i);
+    c.Add(key, test::CompressibleString(&rnd, 0.25, 1000, &tmp));
+  }
+  std::vector<std::string> keys;
+  KVMap kvmap;
+  Options options;
+  options.block_size = 1024;
+  options.compression = type;
+  c.Finish(options, &keys, &kvmap);
+
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("xyz"), 20000, 40000));
+  Iterator* iter = c.NewIterator();
+  KVMap::const_iterator model = kvmap.begin();
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next(), ++model) {
+    ASSERT_TRUE(model != kvmap.end());
+    ASSERT_EQ(model->first, iter->key().ToString());
+    ASSERT_EQ(model->second, iter->value().ToString());
+  }
+  ASSERT_TRUE(model == kvmap.end());
+  ASSERT_OK(iter->status());
+  delete iter;
+}
+
+TEST(TableTest, LZ4Compression) {
+  if (!CompressionSupported(kLZ4Compression)) {
+    fprintf(stderr, "skipping lz4 compression tests\n");
+    return;
+  }
+  TestCompressedRoundTrip(kLZ4Compression);
+}
+
+TEST(TableTest, ZstdCompression) {
+  if (!CompressionSupported(kZstdCompression)) {
+    fprintf(stderr, "skipping zstd compression tests\n");
+    return;
+  }
+  TestCompressedRoundTrip(kZstdCompression);
+}
+
+TEST(TableTest, ZstdDictionaryCompression) {
+  if (!CompressionSupported(kZstdCompression)) {
+    fprintf(stderr, "skipping zstd compression tests\n");
+    return;
+  }
+
+  // Small values that share a lot of content across blocks but little
+  // within one, which per-block compression cannot exploit.
+  Random rnd(301);
+  std::vector<std::string> templates;
+  for (int i = 0; i < 8; i++) {
+    templates.push_back(test::RandomKey(&rnd, 200));
+  }
+  uint64_t sizes[2];
+  for (int with_dict = 0; with_dict < 2; with_dict++) {
+    TableConstructor c(BytewiseComparator());
+    for (int i = 0; i < 2000; i++) {
+      char key[20];
+      snprintf(key, sizeof(key), "k%06d", i);
+      std::string value = templates[rnd.Uniform(templates.size())];
+      value[rnd.Uniform(value.size())] = 'x';
+      c.Add(key, value);
+    }
+    std::vector<std::string> keys;
+    KVMap kvmap;
+    Options options;
+    options.block_size = 1024;
+    options.compression = kZstdCompression;
+    options.zstd_max_dict_bytes = with_dict ? 4096 : 0;
+    options.zstd_max_train_bytes = 64 << 10;
+    c.Finish(options, &keys, &kvmap);
+    sizes[with_dict] = c.ApproximateOffsetOf("xyz");
+
+    Iterator* iter = c.NewIterator();
+    KVMap::const_iterator model = kvmap.begin();
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next(), ++model) {
+      ASSERT_TRUE(model != kvmap.end());
+      ASSERT_EQ(model->first, iter->key().ToString());
+      ASSERT_EQ(model->second, iter->value().ToString());
+    }
+    ASSERT_TRUE(model == kvmap.end());
+    ASSERT_OK(iter->status());
+    delete iter;
+  }
+  ASSERT_LT(sizes[1] * 2, sizes[0]);
+}
+
+TEST(TableTest, Properties) {
+  for (int with_props = 0; with_props < 2; with_props++) {
+    Options options;
+    StringSink sink;
+    TableBuilder builder(options, &sink);
+    if (with_props) {
+      builder.SetProperty("zeta", "z");
+      builder.SetProperty("alpha", "a0");
+      builder.SetProperty("alpha", "a");
+    }
+    builder.Add("k1", "v1");
+    builder.Add("k2", "v2");
+    ASSERT_OK(builder.Finish());
+
+    StringSource source(sink.contents());
+    Table* table;
+    ASSERT_OK(Table::Open(options, &source, source.Size(), &table));
+    std::string value;
+    ASSERT_EQ(with_props != 0, table->GetProperty("alpha", &value));
+    if (with_props) {
+      ASSERT_EQ("a", value);
+      ASSERT_TRUE(table->GetProperty("zeta", &value));
+      ASSERT_EQ("z", value);
+    }
+    ASSERT_TRUE(!table->GetProperty("beta", &value));
+    ASSERT_TRUE(!table->GetProperty("", &value));
+
+    Iterator* iter = table->NewIterator(ReadOptions());
+    iter->SeekToFirst();
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ("k1", iter->key().ToString());
+    delete iter;
+    delete table;
+  }
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
@@ -4,6 +4,8 @@
 
 #include "util/arena.h"
 #include <assert.h>
+#include <atomic>
+#include "util/mutexlock.h"
 
 namespace leveldb {
 
@@ -57,6 +59,55 @@ char* Arena::AllocateAligned(size_t bytes) {
   return result;
 }
 
+char* Arena::AllocateConcurrently(size_t bytes) {
+  return AllocateFromShard(bytes, 1);
+}
+
+char* Arena::AllocateAlignedConcurrently(size_t bytes) {
+  const int align = (sizeof(void*) > 8) ? sizeof(void*) : 8;
+  return AllocateFromShard(bytes, align);
+}
+
+// Returns the shard of the calling thread.  Threads are spread over the
+// shards in the order they first allocate.
+static int ThreadShard(int num_shards) {
+  static std::atomic<unsigned int> next_shard(0);
+  static thread_local unsigned int shard = next_shard.fetch_add(1);
+  return shard % num_shards;
+}
+
+char* Arena::AllocateFromShard(size_t bytes, size_t align) {
+  assert(bytes > 0);
+  if (bytes > kBlockSize / 4) {
+    // As in AllocateFallback(), large objects get blocks of their own
+    MutexLock l(&mu_);
+    return AllocateNewBlock(bytes);
+  }
+
+  Shard* shard = &shards_[ThreadShard(kNumShards)];
+  MutexLock l(&shard->mu);
+  size_t current_mod =
+      reinterpret_cast<uintptr_t>(shard->alloc_ptr) & (align-1);
+  size_t slop = (current_mod == 0 ? 0 : align - current_mod);
+  size_t needed = bytes + slop;
+  if (needed > shard->alloc_bytes_remaining) {
+    // We waste the remaining space in the shard's block.  New blocks are
+    // aligned.
+    {
+      MutexLock arena_lock(&mu_);
+      shard->alloc_ptr = AllocateNewBlock(kBlockSize);
+    }
+    shard->alloc_bytes_remaining = kBlockSize;
+    needed = bytes;
+    slop = 0;
+  }
+  char* result = shard->alloc_ptr + slop;
+  shard->alloc_ptr += needed;
+  shard->alloc_bytes_remaining -= needed;
+  assert((reinterpret_cast<uintptr_t>(result) & (align-1)) == 0);
+  return result;
+}
+
 char* Arena::AllocateNewBlock(size_t block_bytes) {
   char* result = new char[block_bytes];
   blocks_.push_back(result);
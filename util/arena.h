@@ -24,6 +24,13 @@ class Arena {
   // Allocate memory with the normal alignment guarantees provided by malloc
   char* AllocateAligned(size_t bytes);
 
+  // Variants of the above that may be called from several threads at
+  // once.  They must not run concurrently with Allocate() or
+  // AllocateAligned().  Threads allocate from blocks of their own shard,
+  // so that they rarely wait for each other.
+  char* AllocateConcurrently(size_t bytes);
+  char* AllocateAlignedConcurrently(size_t bytes);
+
   // Returns an estimate of the total memory usage of data allocated
   // by the arena.
   size_t MemoryUsage() const {
@@ -33,6 +40,7 @@ class Arena {
  private:
   char* AllocateFallback(size_t bytes);
   char* AllocateNewBlock(size_t block_bytes);
+  char* AllocateFromShard(size_t bytes, size_t align);
 
   // Allocation state
   char* alloc_ptr_;
@@ -44,6 +52,22 @@ class Arena {
   // Total memory usage of the arena.
   port::AtomicPointer memory_usage_;
 
+  // Allocation state of the concurrent variants.  Each thread allocates
+  // from one shard, which takes its blocks from the arena.  The padding
+  // keeps shards used by different threads off each other's cache lines.
+  struct Shard {
+    port::Mutex mu;
+    char* alloc_ptr;
+    size_t alloc_bytes_remaining;
+    char padding[64];
+    Shard() : alloc_ptr(NULL), alloc_bytes_remaining(0) { }
+  };
+  enum { kNumShards = 8 };
+  Shard shards_[kNumShards];
+
+  // Protects blocks_ and memory_usage_ in the concurrent variants.
+  port::Mutex mu_;
+
   // No copying allowed
   Arena(const Arena&);
   void operator=(const Arena&);
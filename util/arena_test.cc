@@ -4,6 +4,10 @@
 
 #include "util/arena.h"
 
+#include <string.h>
+#include "leveldb/env.h"
+#include "port/port.h"
+#include "util/mutexlock.h"
 #include "util/random.h"
 #include "util/testharness.h"
 
@@ -61,6 +65,78 @@ TEST(ArenaTest, Simple) {
   }
 }
 
+// Several threads allocate concurrently and fill their allocations with a
+// pattern of their own, which no other allocation may overwrite.
+namespace {
+struct ConcurrentState {
+  static const int kThreads = 8;
+  static const int kAllocations = 20000;
+
+  Arena arena;
+  port::Mutex mu;
+  port::CondVar cv;
+  int running;
+  std::vector<std::pair<size_t, char*> > allocated[kThreads];
+
+  ConcurrentState() : cv(&mu), running(0) { }
+};
+
+struct ConcurrentArg {
+  ConcurrentState* state;
+  int id;
+};
+}  // namespace
+
+static void ConcurrentAllocator(void* arg) {
+  ConcurrentArg* a = reinterpret_cast<ConcurrentArg*>(arg);
+  ConcurrentState* state = a->state;
+  Random rnd(301 + a->id);
+  for (int i = 0; i < ConcurrentState::kAllocations; i++) {
+    size_t s = rnd.OneIn(1000) ? 1 + rnd.Uniform(6000) : 1 + rnd.Uniform(100);
+    char* r;
+    if (rnd.OneIn(2)) {
+      r = state->arena.AllocateAlignedConcurrently(s);
+      ASSERT_EQ(0u, reinterpret_cast<uintptr_t>(r) & (sizeof(void*) - 1));
+    } else {
+      r = state->arena.AllocateConcurrently(s);
+    }
+    memset(r, a->id, s);
+    state->allocated[a->id].push_back(std::make_pair(s, r));
+  }
+  MutexLock l(&state->mu);
+  state->running--;
+  state->cv.SignalAll();
+}
+
+TEST(ArenaTest, Concurrent) {
+  ConcurrentState state;
+  ConcurrentArg args[ConcurrentState::kThreads];
+  state.running = ConcurrentState::kThreads;
+  for (int id = 0; id < ConcurrentState::kThreads; id++) {
+    args[id].state = &state;
+    args[id].id = id;
+    Env::Default()->StartThread(ConcurrentAllocator, &args[id]);
+  }
+  state.mu.Lock();
+  while (state.running > 0) {
+    state.cv.Wait();
+  }
+  state.mu.Unlock();
+
+  size_t bytes = 0;
+  for (int id = 0; id < ConcurrentState::kThreads; id++) {
+    for (size_t i = 0; i < state.allocated[id].size(); i++) {
+      size_t num_bytes = state.allocated[id][i].first;
+      const char* p = state.allocated[id][i].second;
+      for (size_t b = 0; b < num_bytes; b++) {
+        ASSERT_EQ(id, p[b]);
+      }
+      bytes += num_bytes;
+    }
+  }
+  ASSERT_GE(state.arena.MemoryUsage(), bytes);
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
@@ -5,6 +5,7 @@
 #include "leveldb/filter_policy.h"
 
 #include "leveldb/slice.h"
+#include "util/coding.h"
 #include "util/hash.h"
 
 namespace leveldb {
@@ -86,10 +87,101 @@ class BloomFilterPolicy : public FilterPolicy {
     return true;
   }
 };
+
+// A bloom filter made of 64-byte blocks, the size of a cache line.  Each
+// key sets and probes bits of a single block chosen by its hash, so a
+// lookup touches one cache line instead of k scattered ones, at the cost
+// of a slightly higher false positive rate for the same size.
+class BlockedBloomFilterPolicy : public FilterPolicy {
+ private:
+  static const size_t kBlockBytes = 64;
+  static const uint32_t kMultiplier = 0x9e3779b9;  // 2^32 / golden ratio
+
+  size_t bits_per_key_;
+  size_t k_;
+
+  // Returns the offset in the filter of the block for hash h.
+  static size_t BlockOffset(uint32_t h, size_t num_blocks) {
+    // Maps h to [0, num_blocks) without a division
+    return static_cast<size_t>(
+        (static_cast<uint64_t>(h) * num_blocks) >> 32) * kBlockBytes;
+  }
+
+ public:
+  explicit BlockedBloomFilterPolicy(int bits_per_key)
+      : bits_per_key_(bits_per_key) {
+    k_ = static_cast<size_t>(bits_per_key * 0.69);  // 0.69 =~ ln(2)
+    if (k_ < 1) k_ = 1;
+    if (k_ > 30) k_ = 30;
+  }
+
+  virtual const char* Name() const {
+    return "leveldb.BuiltinBlockedBloomFilter";
+  }
+
+  virtual void CreateFilter(const Slice* keys, int n, std::string* dst) const {
+    // Round the filter up to whole blocks, with at least one block
+    const size_t bits = n * bits_per_key_;
+    size_t num_blocks = (bits + kBlockBytes * 8 - 1) / (kBlockBytes * 8);
+    if (num_blocks < 1) num_blocks = 1;
+
+    const size_t init_size = dst->size();
+    dst->resize(init_size + num_blocks * kBlockBytes, 0);
+    dst->push_back(static_cast<char>(k_));  // Remember # of probes in filter
+    char* array = &(*dst)[init_size];
+    for (int i = 0; i < n; i++) {
+      // The block is chosen by the high bits of the product with
+      // num_blocks, and each probe takes the top 9 bits of successive
+      // multiples of the hash.
+      uint32_t h = BloomHash(keys[i]);
+      char* block = array + BlockOffset(h, num_blocks);
+      for (size_t j = 0; j < k_; j++) {
+        h *= kMultiplier;
+        const uint32_t bitpos = h >> 23;
+        block[bitpos/8] |= (1 << (bitpos % 8));
+      }
+    }
+  }
+
+  virtual bool KeyMayMatch(const Slice& key, const Slice& bloom_filter) const {
+    const size_t len = bloom_filter.size();
+    if (len < kBlockBytes + 1) return false;
+
+    const char* array = bloom_filter.data();
+    const size_t k = array[len-1];
+    if (k > 30 || (len - 1) % kBlockBytes != 0) {
+      // Reserved for potentially new encodings.  Consider it a match.
+      return true;
+    }
+
+    uint32_t h = BloomHash(key);
+    const char* block =
+        array + BlockOffset(h, (len - 1) / kBlockBytes);
+
+    // Collect the probed bits into a mask of the block and test all of
+    // them at once: the loops below have no data-dependent branches and
+    // are vectorized by the compiler.
+    uint64_t mask[kBlockBytes / 8] = { 0 };
+    for (size_t j = 0; j < k; j++) {
+      h *= kMultiplier;
+      const uint32_t bitpos = h >> 23;
+      mask[bitpos / 64] |= static_cast<uint64_t>(1) << (bitpos % 64);
+    }
+    uint64_t missing = 0;
+    for (size_t i = 0; i < kBlockBytes / 8; i++) {
+      missing |= mask[i] & ~DecodeFixed64(block + i * 8);
+    }
+    return missing == 0;
+  }
+};
 }
 
 const FilterPolicy* NewBloomFilterPolicy(int bits_per_key) {
   return new BloomFilterPolicy(bits_per_key);
 }
 
+const FilterPolicy* NewBlockedBloomFilterPolicy(int bits_per_key) {
+  return new BlockedBloomFilterPolicy(bits_per_key);
+}
+
 }  // namespace leveldb
@@ -18,6 +18,19 @@ static Slice Key(int i, char* buffer) {
   return Slice(buffer, sizeof(uint32_t));
 }
 
+static int NextLength(int length) {
+  if (length < 10) {
+    length += 1;
+  } else if (length < 100) {
+    length += 10;
+  } else if (length < 1000) {
+    length += 100;
+  } else {
+    length += 1000;
+  }
+  return length;
+}
+
 class BloomTest {
  private:
   const FilterPolicy* policy_;
@@ -26,6 +39,7 @@ class BloomTest {
 
  public:
   BloomTest() : policy_(NewBloomFilterPolicy(10)) { }
+  explicit BloomTest(const FilterPolicy* policy) : policy_(policy) { }
 
   ~BloomTest() {
     delete policy_;
@@ -84,6 +98,61 @@ class BloomTest {
     }
     return result / 10000.0;
   }
+
+  // Checks filters for a range of key counts, which must not be larger
+  // than "slack" bytes over 10 bits per key.  Fails if too many
+  // of them have a false positive rate over "mediocre_rate".
+  void CheckVaryingLengths(size_t slack, double mediocre_rate) {
+    char buffer[sizeof(int)];
+
+    // Count number of filters that significantly exceed the false
+    // positive rate
+    int mediocre_filters = 0;
+    int good_filters = 0;
+
+    for (int length = 1; length <= 10000; length = NextLength(length)) {
+      Reset();
+      for (int i = 0; i < length; i++) {
+        Add(Key(i, buffer));
+      }
+      Build();
+
+      ASSERT_LE(FilterSize(), static_cast<size_t>((length * 10 / 8) + slack))
+          << length;
+
+      // All added keys must match
+      for (int i = 0; i < length; i++) {
+        ASSERT_TRUE(Matches(Key(i, buffer)))
+            << "Length " << length << "; key " << i;
+      }
+
+      // Check false positive rate
+      double rate = FalsePositiveRate();
+      if (kVerbose >= 1) {
+        fprintf(stderr,
+                "False positives: %5.2f%% @ length = %6d ; bytes = %6d\n",
+                rate*100.0, length, static_cast<int>(FilterSize()));
+      }
+      ASSERT_LE(rate, 0.02);   // Must not be over 2%
+      if (rate > mediocre_rate) mediocre_filters++;  // Allowed, but rarely
+      else good_filters++;
+    }
+    if (kVerbose >= 1) {
+      fprintf(stderr, "Filters: %d good, %d mediocre\n",
+              good_filters, mediocre_filters);
+    }
+    ASSERT_LE(mediocre_filters, good_filters/5);
+  }
+};
+
+class BlockedBloomTest : public BloomTest {
+ public:
+  BlockedBloomTest() : BloomTest(NewBlockedBloomFilterPolicy(10)) { }
+};
+
+class RibbonTest : public BloomTest {
+ public:
+  RibbonTest() : BloomTest(NewRibbonFilterPolicy(10)) { }
 };
 
 TEST(BloomTest, EmptyFilter) {
@@ -100,57 +169,75 @@ TEST(BloomTest, Small) {
   ASSERT_TRUE(! Matches("foo"));
 }
 
-static int NextLength(int length) {
-  if (length < 10) {
-    length += 1;
-  } else if (length < 100) {
-    length += 10;
-  } else if (length < 1000) {
-    length += 100;
-  } else {
-    length += 1000;
-  }
-  return length;
+TEST(BloomTest, VaryingLengths) {
+  CheckVaryingLengths(40, 0.0125);
 }
 
-TEST(BloomTest, VaryingLengths) {
-  char buffer[sizeof(int)];
+TEST(BlockedBloomTest, BlockedEmptyFilter) {
+  ASSERT_TRUE(! Matches("hello"));
+  ASSERT_TRUE(! Matches("world"));
+}
+
+TEST(BlockedBloomTest, BlockedSmall) {
+  Add("hello");
+  Add("world");
+  ASSERT_TRUE(Matches("hello"));
+  ASSERT_TRUE(Matches("world"));
+  ASSERT_TRUE(! Matches("x"));
+  ASSERT_TRUE(! Matches("foo"));
+}
+
+TEST(BlockedBloomTest, BlockedVaryingLengths) {
+  // Filters are rounded up to whole 64-byte blocks
+  CheckVaryingLengths(65, 0.0125);
+}
+
+TEST(RibbonTest, RibbonEmptyFilter) {
+  ASSERT_TRUE(! Matches("hello"));
+  ASSERT_TRUE(! Matches("world"));
+}
+
+TEST(RibbonTest, RibbonSmall) {
+  Add("hello");
+  Add("world");
+  ASSERT_TRUE(Matches("hello"));
+  ASSERT_TRUE(Matches("world"));
+  ASSERT_TRUE(! Matches("x"));
+  ASSERT_TRUE(! Matches("foo"));
+}
 
-  // Count number of filters that significantly exceed the false positive rate
-  int mediocre_filters = 0;
-  int good_filters = 0;
+TEST(RibbonTest, RibbonVaryingLengths) {
+  CheckVaryingLengths(40, 0.0125);
+}
 
-  for (int length = 1; length <= 10000; length = NextLength(length)) {
+TEST(RibbonTest, RibbonSize) {
+  char buffer[sizeof(int)];
+  for (int length = 10000; length <= 1000000; length *= 10) {
     Reset();
     for (int i = 0; i < length; i++) {
       Add(Key(i, buffer));
     }
     Build();
-
-    ASSERT_LE(FilterSize(), static_cast<size_t>((length * 10 / 8) + 40))
+    // A bloom filter takes 10 bits per key
+    ASSERT_LE(FilterSize(), static_cast<size_t>(length * 10 / 8 * 0.8))
         << length;
-
-    // All added keys must match
     for (int i = 0; i < length; i++) {
-      ASSERT_TRUE(Matches(Key(i, buffer)))
-          << "Length " << length << "; key " << i;
+      ASSERT_TRUE(Matches(Key(i, buffer)));
     }
-
-    // Check false positive rate
-    double rate = FalsePositiveRate();
-    if (kVerbose >= 1) {
-      fprintf(stderr, "False positives: %5.2f%% @ length = %6d ; bytes = %6d\n",
-              rate*100.0, length, static_cast<int>(FilterSize()));
-    }
-    ASSERT_LE(rate, 0.02);   // Must not be over 2%
-    if (rate > 0.0125) mediocre_filters++;  // Allowed, but not too often
-    else good_filters++;
+    ASSERT_LE(FalsePositiveRate(), 0.0125);
   }
-  if (kVerbose >= 1) {
-    fprintf(stderr, "Filters: %d good, %d mediocre\n",
-            good_filters, mediocre_filters);
+}
+
+TEST(RibbonTest, RibbonDuplicateKeys) {
+  Add("hello");
+  Add("hello");
+  Add("world");
+  for (int i = 0; i < 1000; i++) {
+    Add("hello");
   }
-  ASSERT_LE(mediocre_filters, good_filters/5);
+  ASSERT_TRUE(Matches("hello"));
+  ASSERT_TRUE(Matches("world"));
+  ASSERT_TRUE(! Matches("foo"));
 }
 
 // Different bits-per-byte
@@ -13,6 +13,10 @@ namespace leveldb {
 
 Comparator::~Comparator() { }
 
+Slice Comparator::KeyForHashing(const Slice& key) const {
+  return key;
+}
+
 namespace {
 class BytewiseComparatorImpl : public Comparator {
  public:
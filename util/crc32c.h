@@ -16,6 +16,13 @@ namespace crc32c {
 // crc32c of a stream of data.
 extern uint32_t Extend(uint32_t init_crc, const char* data, size_t n);
 
+// Same as Extend(), but always uses the portable table-driven code.
+// Extend() uses the SSE 4.2 crc32 instruction instead where the CPU has it.
+extern uint32_t ExtendPortable(uint32_t init_crc, const char* data, size_t n);
+
+// Returns true iff Extend() uses hardware instructions.
+extern bool IsAccelerated();
+
 // Return the crc32c of data[0,n-1]
 inline uint32_t Value(const char* data, size_t n) {
   return Extend(0, data, n);
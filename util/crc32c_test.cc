@@ -47,6 +47,31 @@ TEST(CRC, StandardResults) {
   ASSERT_EQ(0xd9963a56, Value(reinterpret_cast<char*>(data), sizeof(data)));
 }
 
+TEST(CRC, PortableStandardResults) {
+  char buf[32];
+  memset(buf, 0, sizeof(buf));
+  ASSERT_EQ(0x8a9136aa, ExtendPortable(0, buf, sizeof(buf)));
+
+  memset(buf, 0xff, sizeof(buf));
+  ASSERT_EQ(0x62a8ab43, ExtendPortable(0, buf, sizeof(buf)));
+}
+
+TEST(CRC, MatchesPortable) {
+  // Cover every alignment and lengths around the multiples of the
+  // block size of the interleaved hardware implementation.
+  std::string data;
+  for (int i = 0; i < 10000; i++) {
+    data.push_back(static_cast<char>(i * 7 + (i >> 8)));
+  }
+  for (int offset = 0; offset < 8; offset++) {
+    for (size_t n = 0; n + offset <= data.size(); n += (n < 1600 ? 1 : 97)) {
+      const char* p = data.data() + offset;
+      ASSERT_EQ(ExtendPortable(0, p, n), Value(p, n));
+      ASSERT_EQ(ExtendPortable(0x12345678, p, n), Extend(0x12345678, p, n));
+    }
+  }
+}
+
 TEST(CRC, Values) {
   ASSERT_NE(Value("a", 1), Value("foo", 3));
 }
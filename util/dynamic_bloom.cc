@@ -0,0 +1,99 @@
+// Copyright (c) 2026 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/dynamic_bloom.h"
+
+#include "util/hash.h"
+
+namespace leveldb {
+
+namespace {
+
+static const uint32_t kMultiplier = 0x9e3779b9;  // 2^32 / golden ratio
+
+static uint32_t BloomHash(const Slice& key) {
+  return Hash(key.data(), key.size(), 0xbc9f1d34);
+}
+
+// The probes of a key, as in the blocked bloom filters of bloom.cc: each
+// takes the top 9 bits of successive multiples of the hash.
+static inline uint32_t NextProbe(uint32_t* h) {
+  *h *= kMultiplier;
+  return *h >> 23;
+}
+
+}  // namespace
+
+DynamicBloom::DynamicBloom(size_t total_bits, int num_probes)
+    : num_blocks_(total_bits == 0 ? 1 : (total_bits + 511) / 512),
+      num_words_(num_blocks_ * kWordsPerBlock),
+      num_probes_(num_probes < 1 ? 1 : num_probes) {
+  // Allocate one block more than needed so that data_ can start on a
+  // cache line
+  raw_ = new std::atomic<uint64_t>[num_words_ + kWordsPerBlock - 1];
+  const uintptr_t misalignment = reinterpret_cast<uintptr_t>(raw_) % 64;
+  data_ = raw_ + (misalignment == 0 ? 0 : (64 - misalignment) / 8);
+  for (size_t i = 0; i < num_words_; i++) {
+    data_[i].store(0, std::memory_order_relaxed);
+  }
+}
+
+DynamicBloom::~DynamicBloom() {
+  delete[] raw_;
+}
+
+size_t DynamicBloom::BlockStart(uint32_t h) const {
+  // Maps h to [0, num_blocks_) without a division
+  return static_cast<size_t>(
+      (static_cast<uint64_t>(h) * num_blocks_) >> 32) * kWordsPerBlock;
+}
+
+void DynamicBloom::Add(const Slice& key) {
+  uint32_t h = BloomHash(key);
+  std::atomic<uint64_t>* block = data_ + BlockStart(h);
+  for (int i = 0; i < num_probes_; i++) {
+    const uint32_t bitpos = NextProbe(&h);
+    std::atomic<uint64_t>* word = &block[bitpos / 64];
+    // Only this thread writes: a plain read-modify-write suffices, and
+    // readers see either the old or the new word
+    word->store(word->load(std::memory_order_relaxed) |
+                    (static_cast<uint64_t>(1) << (bitpos % 64)),
+                std::memory_order_relaxed);
+  }
+}
+
+void DynamicBloom::AddConcurrently(const Slice& key) {
+  uint32_t h = BloomHash(key);
+  std::atomic<uint64_t>* block = data_ + BlockStart(h);
+  for (int i = 0; i < num_probes_; i++) {
+    const uint32_t bitpos = NextProbe(&h);
+    const uint64_t mask = static_cast<uint64_t>(1) << (bitpos % 64);
+    std::atomic<uint64_t>* word = &block[bitpos / 64];
+    // Skip the locked instruction if the bit is already set
+    if ((word->load(std::memory_order_relaxed) & mask) == 0) {
+      word->fetch_or(mask, std::memory_order_relaxed);
+    }
+  }
+}
+
+bool DynamicBloom::MayContain(const Slice& key) const {
+  uint32_t h = BloomHash(key);
+  const std::atomic<uint64_t>* block = data_ + BlockStart(h);
+  // Collect the probed bits into a mask of the block, then test each
+  // word of the block once
+  uint64_t mask[kWordsPerBlock] = { 0 };
+  for (int i = 0; i < num_probes_; i++) {
+    const uint32_t bitpos = NextProbe(&h);
+    mask[bitpos / 64] |= static_cast<uint64_t>(1) << (bitpos % 64);
+  }
+  for (size_t i = 0; i < kWordsPerBlock; i++) {
+    if (mask[i] != 0 &&
+        (block[i].load(std::memory_order_relaxed) & mask[i]) != mask[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace leveldb
@@ -0,0 +1,64 @@
+// Copyright (c) 2026 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A bloom filter of a fixed size for a set of keys that grows while it is
+// being queried, like the contents of a memtable.  Keys are added one at
+// a time and never removed.  Each key sets bits in a single 64-byte
+// block, so adding or checking it touches one cache line.
+
+#ifndef STORAGE_LEVELDB_UTIL_DYNAMIC_BLOOM_H_
+#define STORAGE_LEVELDB_UTIL_DYNAMIC_BLOOM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+class DynamicBloom {
+ public:
+  // Uses "total_bits" bits, rounded up to a whole number of 512-bit
+  // blocks, and sets "num_probes" of them per key.  Six probes suit
+  // filters with about 8 to 16 bits per key.
+  explicit DynamicBloom(size_t total_bits, int num_probes = 6);
+
+  ~DynamicBloom();
+
+  // Add "key" to the set.  Requires external synchronization with other
+  // Add() calls, but may run concurrently with MayContain().
+  void Add(const Slice& key);
+
+  // Like Add(), but may also run concurrently with other
+  // AddConcurrently() calls.
+  void AddConcurrently(const Slice& key);
+
+  // Returns false if "key" was definitely not added.  A key whose Add()
+  // happened before this call, in the sense of the memory model, is
+  // always found.
+  bool MayContain(const Slice& key) const;
+
+  // Returns the number of bytes of memory used by the filter.
+  size_t MemoryUsage() const { return (num_words_ + 7) * sizeof(uint64_t); }
+
+ private:
+  static const size_t kWordsPerBlock = 8;  // 64 bytes
+
+  // Returns the first word of the block of hash h.
+  size_t BlockStart(uint32_t h) const;
+
+  const size_t num_blocks_;
+  const size_t num_words_;
+  const int num_probes_;
+  std::atomic<uint64_t>* raw_;
+  std::atomic<uint64_t>* data_;  // raw_ aligned to 64 bytes
+
+  // No copying allowed
+  DynamicBloom(const DynamicBloom&);
+  void operator=(const DynamicBloom&);
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_DYNAMIC_BLOOM_H_
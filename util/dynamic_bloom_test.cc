@@ -0,0 +1,125 @@
+// Copyright (c) 2026 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/dynamic_bloom.h"
+
+#include "leveldb/env.h"
+#include "port/port.h"
+#include "util/coding.h"
+#include "util/mutexlock.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+static Slice Key(int i, char* buffer) {
+  EncodeFixed32(buffer, i);
+  return Slice(buffer, sizeof(uint32_t));
+}
+
+class DynamicBloomTest { };
+
+TEST(DynamicBloomTest, Empty) {
+  DynamicBloom bloom(1000);
+  char buffer[sizeof(int)];
+  ASSERT_TRUE(!bloom.MayContain("hello"));
+  ASSERT_TRUE(!bloom.MayContain(""));
+  ASSERT_TRUE(!bloom.MayContain(Key(0, buffer)));
+}
+
+TEST(DynamicBloomTest, Small) {
+  DynamicBloom bloom(0);  // A single block
+  bloom.Add("hello");
+  bloom.Add("world");
+  ASSERT_TRUE(bloom.MayContain("hello"));
+  ASSERT_TRUE(bloom.MayContain("world"));
+  ASSERT_TRUE(!bloom.MayContain("x"));
+  ASSERT_TRUE(!bloom.MayContain("foo"));
+}
+
+TEST(DynamicBloomTest, FalsePositives) {
+  char buffer[sizeof(int)];
+  for (int n = 1000; n <= 100000; n *= 10) {
+    DynamicBloom bloom(n * 10);
+    for (int i = 0; i < n; i++) {
+      bloom.Add(Key(i, buffer));
+    }
+    ASSERT_LE(bloom.MemoryUsage(), (n * 10 / 8) + 1024);
+
+    // All added keys must match
+    for (int i = 0; i < n; i++) {
+      ASSERT_TRUE(bloom.MayContain(Key(i, buffer))) << i;
+    }
+
+    // Check false positive rate
+    int hits = 0;
+    for (int i = 0; i < 10000; i++) {
+      if (bloom.MayContain(Key(i + 1000000000, buffer))) {
+        hits++;
+      }
+    }
+    const double rate = hits / 10000.0;
+    fprintf(stderr, "False positives: %5.2f%% @ length = %6d\n",
+            rate * 100.0, n);
+    ASSERT_LE(rate, 0.02);
+  }
+}
+
+namespace {
+
+static const int kNumThreads = 4;
+static const int kKeysPerThread = 20000;
+
+struct ConcurrentState {
+  DynamicBloom* bloom;
+  port::Mutex mu;
+  port::CondVar cv;
+  int next_id;
+  int done;
+  ConcurrentState() : cv(&mu), next_id(0), done(0) { }
+};
+
+static void AddKeys(void* arg) {
+  ConcurrentState* state = reinterpret_cast<ConcurrentState*>(arg);
+  int id;
+  {
+    MutexLock l(&state->mu);
+    id = state->next_id++;
+  }
+  char buffer[sizeof(int)];
+  for (int i = id; i < kNumThreads * kKeysPerThread; i += kNumThreads) {
+    state->bloom->AddConcurrently(Key(i, buffer));
+  }
+  MutexLock l(&state->mu);
+  state->done++;
+  state->cv.SignalAll();
+}
+
+}  // namespace
+
+TEST(DynamicBloomTest, Concurrent) {
+  // Threads add interleaved keys, so they often set bits in the same
+  // words; no bit may be lost.
+  DynamicBloom bloom(kNumThreads * kKeysPerThread * 10);
+  ConcurrentState state;
+  state.bloom = &bloom;
+  for (int i = 0; i < kNumThreads; i++) {
+    Env::Default()->StartThread(&AddKeys, &state);
+  }
+  {
+    MutexLock l(&state.mu);
+    while (state.done < kNumThreads) {
+      state.cv.Wait();
+    }
+  }
+  char buffer[sizeof(int)];
+  for (int i = 0; i < kNumThreads * kKeysPerThread; i++) {
+    ASSERT_TRUE(bloom.MayContain(Key(i, buffer))) << i;
+  }
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
@@ -253,6 +253,275 @@ class PosixWritableFile : public WritableFile {
   }
 };
 
+// Direct I/O transfers data between the device and the caller's buffer
+// without going through the page cache.  With O_DIRECT, the buffer, the
+// file offset and the length of every transfer must be multiples of the
+// logical block size of the device, which this is a multiple of for all
+// common devices.
+static const size_t kDirectIOAlignment = 4096;
+
+static uint64_t RoundDownToAlignment(uint64_t x) {
+  return x & ~static_cast<uint64_t>(kDirectIOAlignment - 1);
+}
+
+static uint64_t RoundUpToAlignment(uint64_t x) {
+  return RoundDownToAlignment(x + kDirectIOAlignment - 1);
+}
+
+// Opens fname for direct I/O.  Returns -1 and sets errno on failure;
+// errno is EINVAL if the file system does not support direct I/O.
+static int OpenDirect(const std::string& fname, int flags) {
+#if defined(O_DIRECT)
+  return open(fname.c_str(), flags | O_DIRECT, 0644);
+#elif defined(F_NOCACHE)
+  int fd = open(fname.c_str(), flags, 0644);
+  if (fd >= 0 && fcntl(fd, F_NOCACHE, 1) == -1) {
+    int err = errno;
+    close(fd);
+    errno = err;
+    fd = -1;
+  }
+  return fd;
+#else
+  errno = EINVAL;
+  return -1;
+#endif
+}
+
+// Aligned buffer a thread reads through for the reads of direct I/O files
+// that cannot go straight into the caller's memory.  It is kept from read
+// to read instead of being allocated for each one.
+class AlignedReadBuffer {
+ public:
+  AlignedReadBuffer() : buf_(NULL), size_(0) { }
+  ~AlignedReadBuffer() { free(buf_); }
+
+  // Returns a buffer of at least n bytes aligned to kDirectIOAlignment,
+  // or NULL if it cannot be allocated.  Buffers larger than
+  // kMaxKeptSize are not kept: the caller must pass the result to
+  // Release() once done with it.
+  char* Acquire(size_t n) {
+    if (n <= size_) {
+      return buf_;
+    }
+    void* buf;
+    if (posix_memalign(&buf, kDirectIOAlignment, n) != 0) {
+      return NULL;
+    }
+    if (n <= kMaxKeptSize) {
+      free(buf_);
+      buf_ = reinterpret_cast<char*>(buf);
+      size_ = n;
+    }
+    return reinterpret_cast<char*>(buf);
+  }
+
+  void Release(char* buf) {
+    if (buf != buf_) {
+      free(buf);
+    }
+  }
+
+ private:
+  static const size_t kMaxKeptSize = 2 << 20;
+
+  char* buf_;
+  size_t size_;
+
+  // No copying allowed
+  AlignedReadBuffer(const AlignedReadBuffer&);
+  void operator=(const AlignedReadBuffer&);
+};
+
+// pread() based random-access that bypasses the page cache.  A read of
+// whole aligned blocks into aligned memory goes straight into the
+// caller's buffer.  Any other read goes through the aligned buffer of the
+// reading thread, covering the blocks of the requested range.
+class PosixDirectRandomAccessFile: public RandomAccessFile {
+ private:
+  std::string filename_;
+  int fd_;
+
+  static bool IsAligned(uint64_t x) {
+    return RoundDownToAlignment(x) == x;
+  }
+
+ public:
+  PosixDirectRandomAccessFile(const std::string& fname, int fd)
+      : filename_(fname), fd_(fd) { }
+  virtual ~PosixDirectRandomAccessFile() { close(fd_); }
+
+  virtual Status Read(uint64_t offset, size_t n, Slice* result,
+                      char* scratch) const {
+    if (IsAligned(offset) && IsAligned(n) &&
+        IsAligned(reinterpret_cast<uintptr_t>(scratch))) {
+      ssize_t r = pread(fd_, scratch, n, static_cast<off_t>(offset));
+      if (r < 0) {
+        // An error: return a non-ok status
+        *result = Slice(scratch, 0);
+        return IOError(filename_, errno);
+      }
+      *result = Slice(scratch, r);
+      return Status::OK();
+    }
+
+    static thread_local AlignedReadBuffer aligned;
+    const uint64_t start = RoundDownToAlignment(offset);
+    const size_t skip = offset - start;
+    const size_t len = RoundUpToAlignment(offset + n) - start;
+    char* buf = aligned.Acquire(len);
+    if (buf == NULL) {
+      *result = Slice(scratch, 0);
+      return IOError(filename_, ENOMEM);
+    }
+    Status s;
+    size_t copied = 0;
+    ssize_t r = pread(fd_, buf, len, static_cast<off_t>(start));
+    if (r < 0) {
+      // An error: return a non-ok status
+      s = IOError(filename_, errno);
+    } else if (static_cast<size_t>(r) > skip) {
+      copied = static_cast<size_t>(r) - skip;
+      if (copied > n) {
+        copied = n;
+      }
+      memcpy(scratch, buf + skip, copied);
+    }
+    aligned.Release(buf);
+    *result = Slice(scratch, copied);
+    return s;
+  }
+};
+
+// Writes whole aligned blocks from an aligned buffer, bypassing the page
+// cache.  The partial block at the end of the data is written zero-padded
+// by Sync() and Close(), which then truncate the file to its real size,
+// and is written again once more data follows it.
+class PosixDirectWritableFile : public WritableFile {
+ private:
+  static const size_t kBufferSize = 1 << 20;
+
+  std::string filename_;
+  int fd_;
+  char* buf_;         // Aligned; holds the data from file offset offset_ on
+  size_t pos_;        // Number of bytes of data in buf_
+  uint64_t offset_;   // File offset of buf_[0], aligned
+
+  // Writes the data in buf_, with its last block zero-padded.
+  Status WriteBuffer() {
+    const size_t len = RoundUpToAlignment(pos_);
+    memset(buf_ + pos_, 0, len - pos_);
+    const char* p = buf_;
+    size_t left = len;
+    uint64_t off = offset_;
+    while (left > 0) {
+      ssize_t r = pwrite(fd_, p, left, static_cast<off_t>(off));
+      if (r < 0) {
+        if (errno == EINTR) {
+          continue;  // Retry
+        }
+        return IOError(filename_, errno);
+      }
+      p += r;
+      left -= r;
+      off += r;
+    }
+    return Status::OK();
+  }
+
+  // Drops the whole blocks of buf_ once written, keeping the partial
+  // block at its end.
+  void DropWrittenBlocks() {
+    const size_t whole = RoundDownToAlignment(pos_);
+    memmove(buf_, buf_ + whole, pos_ - whole);
+    pos_ -= whole;
+    offset_ += whole;
+  }
+
+  // Writes the data in buf_ and cuts the padding of its last block off
+  // the file.
+  Status WriteAll() {
+    Status s = WriteBuffer();
+    if (s.ok() && ftruncate(fd_, static_cast<off_t>(offset_ + pos_)) != 0) {
+      s = IOError(filename_, errno);
+    }
+    return s;
+  }
+
+ public:
+  PosixDirectWritableFile(const std::string& fname, int fd, char* buf)
+      : filename_(fname), fd_(fd), buf_(buf), pos_(0), offset_(0) { }
+
+  static Status New(const std::string& fname, int fd, WritableFile** result) {
+    void* buf;
+    if (posix_memalign(&buf, kDirectIOAlignment, kBufferSize) != 0) {
+      close(fd);
+      *result = NULL;
+      return IOError(fname, ENOMEM);
+    }
+    *result = new PosixDirectWritableFile(fname, fd,
+                                          reinterpret_cast<char*>(buf));
+    return Status::OK();
+  }
+
+  ~PosixDirectWritableFile() {
+    if (fd_ >= 0) {
+      // Ignoring any potential errors
+      WriteAll();
+      close(fd_);
+    }
+    free(buf_);
+  }
+
+  virtual Status Append(const Slice& data) {
+    const char* p = data.data();
+    size_t left = data.size();
+    while (left > 0) {
+      size_t n = kBufferSize - pos_;
+      if (n > left) {
+        n = left;
+      }
+      memcpy(buf_ + pos_, p, n);
+      pos_ += n;
+      p += n;
+      left -= n;
+      if (pos_ == kBufferSize) {
+        Status s = WriteBuffer();
+        if (!s.ok()) {
+          return s;
+        }
+        DropWrittenBlocks();
+      }
+    }
+    return Status::OK();
+  }
+
+  virtual Status Close() {
+    Status result = WriteAll();
+    if (close(fd_) != 0 && result.ok()) {
+      result = IOError(filename_, errno);
+    }
+    fd_ = -1;
+    return result;
+  }
+
+  virtual Status Flush() {
+    // Partial blocks stay buffered until Sync() or Close()
+    return Status::OK();
+  }
+
+  virtual Status Sync() {
+    Status s = WriteAll();
+    if (s.ok() && fdatasync(fd_) != 0) {
+      s = IOError(filename_, errno);
+    }
+    if (s.ok()) {
+      DropWrittenBlocks();
+    }
+    return s;
+  }
+};
+
 static int LockOrUnlock(int fd, bool lock) {
   errno = 0;
   struct flock f;
@@ -363,6 +632,35 @@ class PosixEnv : public Env {
     return s;
   }
 
+  virtual Status NewDirectRandomAccessFile(const std::string& fname,
+                                           RandomAccessFile** result) {
+    int fd = OpenDirect(fname, O_RDONLY);
+    if (fd < 0) {
+      if (errno == EINVAL) {
+        // The file system does not support direct I/O
+        return NewRandomAccessFile(fname, result);
+      }
+      *result = NULL;
+      return IOError(fname, errno);
+    }
+    *result = new PosixDirectRandomAccessFile(fname, fd);
+    return Status::OK();
+  }
+
+  virtual Status NewDirectWritableFile(const std::string& fname,
+                                       WritableFile** result) {
+    int fd = OpenDirect(fname, O_WRONLY | O_CREAT | O_TRUNC);
+    if (fd < 0) {
+      if (errno == EINVAL) {
+        // The file system does not support direct I/O
+        return NewWritableFile(fname, result);
+      }
+      *result = NULL;
+      return IOError(fname, errno);
+    }
+    return PosixDirectWritableFile::New(fname, fd, result);
+  }
+
   virtual bool FileExists(const std::string& fname) {
     return access(fname.c_str(), F_OK) == 0;
   }
@@ -460,7 +758,15 @@ class PosixEnv : public Env {
     return result;
   }
 
-  virtual void Schedule(void (*function)(void*), void* arg);
+  virtual void Schedule(void (*function)(void*), void* arg) {
+    Schedule(function, arg, kLowPriority);
+  }
+
+  virtual void Schedule(void (*function)(void*), void* arg, Priority pri);
+
+  virtual void IncreaseBackgroundThreads(int threads, Priority pri);
+
+  virtual bool HasPriorityPools() { return true; }
 
   virtual void StartThread(void (*function)(void* arg), void* arg);
 
@@ -514,68 +820,97 @@ class PosixEnv : public Env {
     }
   }
 
-  // BGThread() is the body of the background thread
-  void BGThread();
+  // BGThread() is the body of the background threads of a pool
+  void BGThread(Priority pri);
+  struct BGThreadArg {
+    PosixEnv* env;
+    Priority pri;
+  };
   static void* BGThreadWrapper(void* arg) {
-    reinterpret_cast<PosixEnv*>(arg)->BGThread();
+    BGThreadArg* a = reinterpret_cast<BGThreadArg*>(arg);
+    PosixEnv* env = a->env;
+    Priority pri = a->pri;
+    delete a;
+    env->BGThread(pri);
     return NULL;
   }
 
-  pthread_mutex_t mu_;
-  pthread_cond_t bgsignal_;
-  pthread_t bgthread_;
-  bool started_bgthread_;
-
   // Entry per Schedule() call
   struct BGItem { void* arg; void (*function)(void*); };
   typedef std::deque<BGItem> BGQueue;
-  BGQueue queue_;
+
+  // The threads running the work of one priority.  Threads are started
+  // lazily, when work is scheduled.
+  struct BGPool {
+    pthread_cond_t bgsignal;
+    int started_threads;
+    int max_threads;
+    BGQueue queue;
+  };
+
+  // Protects pools_
+  pthread_mutex_t mu_;
+  BGPool pools_[2];
 
   PosixLockTable locks_;
   MmapLimiter mmap_limit_;
 };
 
-PosixEnv::PosixEnv() : started_bgthread_(false) {
+PosixEnv::PosixEnv() {
   PthreadCall("mutex_init", pthread_mutex_init(&mu_, NULL));
-  PthreadCall("cvar_init", pthread_cond_init(&bgsignal_, NULL));
+  for (int i = 0; i < 2; i++) {
+    PthreadCall("cvar_init", pthread_cond_init(&pools_[i].bgsignal, NULL));
+    pools_[i].started_threads = 0;
+    pools_[i].max_threads = 1;
+  }
 }
 
-void PosixEnv::Schedule(void (*function)(void*), void* arg) {
+void PosixEnv::Schedule(void (*function)(void*), void* arg, Priority pri) {
   PthreadCall("lock", pthread_mutex_lock(&mu_));
-
-  // Start background thread if necessary
-  if (!started_bgthread_) {
-    started_bgthread_ = true;
+  BGPool* pool = &pools_[pri];
+
+  // Start background threads if necessary
+  while (pool->started_threads < pool->max_threads) {
+    pool->started_threads++;
+    BGThreadArg* a = new BGThreadArg;
+    a->env = this;
+    a->pri = pri;
+    pthread_t t;
     PthreadCall(
         "create thread",
-        pthread_create(&bgthread_, NULL,  &PosixEnv::BGThreadWrapper, this));
+        pthread_create(&t, NULL,  &PosixEnv::BGThreadWrapper, a));
+    PthreadCall("detach thread", pthread_detach(t));
   }
 
-  // If the queue is currently empty, the background thread may currently be
-  // waiting.
-  if (queue_.empty()) {
-    PthreadCall("signal", pthread_cond_signal(&bgsignal_));
-  }
+  // Add to priority queue and wake up an idle thread, if any
+  pool->queue.push_back(BGItem());
+  pool->queue.back().function = function;
+  pool->queue.back().arg = arg;
+  PthreadCall("signal", pthread_cond_signal(&pool->bgsignal));
 
-  // Add to priority queue
-  queue_.push_back(BGItem());
-  queue_.back().function = function;
-  queue_.back().arg = arg;
+  PthreadCall("unlock", pthread_mutex_unlock(&mu_));
+}
 
+void PosixEnv::IncreaseBackgroundThreads(int threads, Priority pri) {
+  PthreadCall("lock", pthread_mutex_lock(&mu_));
+  if (pools_[pri].max_threads < threads) {
+    pools_[pri].max_threads = threads;
+  }
   PthreadCall("unlock", pthread_mutex_unlock(&mu_));
 }
 
-void PosixEnv::BGThread() {
+void PosixEnv::BGThread(Priority pri) {
+  BGPool* pool = &pools_[pri];
   while (true) {
     // Wait until there is an item that is ready to run
     PthreadCall("lock", pthread_mutex_lock(&mu_));
-    while (queue_.empty()) {
-      PthreadCall("wait", pthread_cond_wait(&bgsignal_, &mu_));
+    while (pool->queue.empty()) {
+      PthreadCall("wait", pthread_cond_wait(&pool->bgsignal, &mu_));
     }
 
-    void (*function)(void*) = queue_.front().function;
-    void* arg = queue_.front().arg;
-    queue_.pop_front();
+    void (*function)(void*) = pool->queue.front().function;
+    void* arg = pool->queue.front().arg;
+    pool->queue.pop_front();
 
     PthreadCall("unlock", pthread_mutex_unlock(&mu_));
     (*function)(arg);
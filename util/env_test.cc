@@ -4,6 +4,8 @@
 
 #include "leveldb/env.h"
 
+#include <stdlib.h>
+
 #include "port/port.h"
 #include "util/testharness.h"
 
@@ -97,6 +99,92 @@ TEST(EnvPosixTest, StartThread) {
   ASSERT_EQ(state.val, 3);
 }
 
+static void WaitForRelease(void* ptr) {
+  port::AtomicPointer* release = reinterpret_cast<port::AtomicPointer*>(ptr);
+  while (release->Acquire_Load() == NULL) {
+    Env::Default()->SleepForMicroseconds(1000);
+  }
+}
+
+TEST(EnvPosixTest, HighPriorityDoesNotWaitForLowPriority) {
+  port::AtomicPointer release(NULL);
+  port::AtomicPointer low_called(NULL);
+  port::AtomicPointer high_called(NULL);
+  // Occupy the low priority thread; work queued behind it has to wait.
+  env_->Schedule(&WaitForRelease, &release, Env::kLowPriority);
+  env_->Schedule(&SetBool, &low_called, Env::kLowPriority);
+  env_->Schedule(&SetBool, &high_called, Env::kHighPriority);
+  Env::Default()->SleepForMicroseconds(kDelayMicros);
+  ASSERT_TRUE(high_called.NoBarrier_Load() != NULL);
+  ASSERT_TRUE(low_called.NoBarrier_Load() == NULL);
+  release.Release_Store(&release);
+  Env::Default()->SleepForMicroseconds(kDelayMicros);
+  ASSERT_TRUE(low_called.NoBarrier_Load() != NULL);
+}
+
+TEST(EnvPosixTest, DirectFiles) {
+  std::string test_dir;
+  ASSERT_OK(env_->GetTestDirectory(&test_dir));
+  std::string fname = test_dir + "/direct_file";
+
+  // Unaligned appends around a sync, spanning more than one buffer
+  std::string data;
+  WritableFile* wfile;
+  ASSERT_OK(env_->NewDirectWritableFile(fname, &wfile));
+  for (int i = 0; data.size() < (3 << 20); i++) {
+    std::string piece(1 + (i * 7919) % 100000, static_cast<char>('a' + i % 26));
+    ASSERT_OK(wfile->Append(piece));
+    data += piece;
+    if (i == 3) {
+      ASSERT_OK(wfile->Flush());
+      ASSERT_OK(wfile->Sync());
+    }
+  }
+  ASSERT_OK(wfile->Close());
+  delete wfile;
+
+  uint64_t size;
+  ASSERT_OK(env_->GetFileSize(fname, &size));
+  ASSERT_EQ(data.size(), size);
+  std::string contents;
+  ASSERT_OK(ReadFileToString(env_, fname, &contents));
+  ASSERT_TRUE(contents == data);
+
+  RandomAccessFile* rfile;
+  ASSERT_OK(env_->NewDirectRandomAccessFile(fname, &rfile));
+  std::string scratch(100000, '\0');
+  for (uint64_t offset = 0; offset < data.size(); offset += 77777) {
+    Slice result;
+    ASSERT_OK(rfile->Read(offset, scratch.size(), &result, &scratch[0]));
+    size_t expected = data.size() - offset;
+    if (expected > scratch.size()) {
+      expected = scratch.size();
+    }
+    ASSERT_TRUE(result == Slice(data.data() + offset, expected));
+  }
+
+  // Whole aligned blocks into aligned memory, up to past the end, and a
+  // read larger than the buffer kept for unaligned reads
+  void* aligned;
+  ASSERT_EQ(0, posix_memalign(&aligned, 4096, data.size() + 4096));
+  char* buf = reinterpret_cast<char*>(aligned);
+  for (uint64_t offset = 0; offset < data.size(); offset += 64 * 4096) {
+    Slice result;
+    ASSERT_OK(rfile->Read(offset, 128 * 4096, &result, buf));
+    size_t expected = data.size() - offset;
+    if (expected > 128 * 4096) {
+      expected = 128 * 4096;
+    }
+    ASSERT_TRUE(result == Slice(data.data() + offset, expected));
+  }
+  Slice result;
+  ASSERT_OK(rfile->Read(1, data.size() - 1, &result, buf + 1));
+  ASSERT_TRUE(result == Slice(data.data() + 1, data.size() - 1));
+  free(aligned);
+  delete rfile;
+  ASSERT_OK(env_->DeleteFile(fname));
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
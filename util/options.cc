@@ -17,13 +17,29 @@ Options::Options()
       env(Env::Default()),
       info_log(NULL),
       write_buffer_size(4<<20),
+      memtable_partitions(1),
+      allow_concurrent_memtable_write(false),
+      memtable_bloom_size_ratio(0),
+      memtable_rep(kSkipListMemTable),
+      memtable_hash_buckets(50000),
+      max_background_compactions(1),
+      max_subcompactions(1),
       max_open_files(1000),
+      use_direct_io_for_flush_and_compaction(false),
+      use_direct_reads(false),
       block_cache(NULL),
       block_size(4096),
       block_restart_interval(16),
       compression(kSnappyCompression),
+      data_block_hash_index(false),
+      partition_index_and_filters(false),
+      index_partition_size(4096),
+      whole_file_filter(false),
+      zstd_max_dict_bytes(0),
+      zstd_max_train_bytes(1 << 20),
       reuse_logs(false),
-      filter_policy(NULL) {
+      filter_policy(NULL),
+      prefix_extractor(NULL) {
 }
 
 }  // namespace leveldb
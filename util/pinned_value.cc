@@ -0,0 +1,52 @@
+// Copyright (c) 2026 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/pinned_value.h"
+
+#include <assert.h>
+
+namespace leveldb {
+
+PinnedValue::PinnedValue() {
+  cleanup_.function = NULL;
+  cleanup_.next = NULL;
+}
+
+PinnedValue::~PinnedValue() {
+  Reset();
+}
+
+void PinnedValue::Reset() {
+  if (cleanup_.function != NULL) {
+    (*cleanup_.function)(cleanup_.arg1, cleanup_.arg2);
+    for (Cleanup* c = cleanup_.next; c != NULL; ) {
+      (*c->function)(c->arg1, c->arg2);
+      Cleanup* next = c->next;
+      delete c;
+      c = next;
+    }
+    cleanup_.function = NULL;
+    cleanup_.next = NULL;
+  }
+  value_.clear();
+  buf_.clear();
+}
+
+void PinnedValue::RegisterCleanup(CleanupFunction func,
+                                  void* arg1, void* arg2) {
+  assert(func != NULL);
+  Cleanup* c;
+  if (cleanup_.function == NULL) {
+    c = &cleanup_;
+  } else {
+    c = new Cleanup;
+    c->next = cleanup_.next;
+    cleanup_.next = c;
+  }
+  c->function = func;
+  c->arg1 = arg1;
+  c->arg2 = arg2;
+}
+
+}  // namespace leveldb
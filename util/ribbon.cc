@@ -0,0 +1,267 @@
+// Copyright (c) 2026 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A Ribbon filter [Dillinger,Walzer 2021] stores an r-bit value S[i] for
+// each of m slots, such that every key x satisfies
+//
+//    XOR of S[start(x) + j] for all bits j set in coeff(x) == result(x)
+//
+// where start(x) < m - 63, coeff(x) is a 64-bit row with its lowest bit
+// set and result(x) an r-bit fingerprint, all derived from the hash of
+// x.  Other keys satisfy the equation with probability 2^-r.  The slots
+// are found by Gaussian elimination of the band-shaped system, which
+// only fails if the rows of some keys are dependent; the filter is then
+// rebuilt with another seed, and more slots if that keeps failing.  A
+// filter needs 5-15% more slots than keys, depending on their number, so
+// it takes ~1.1*r bits per key where a bloom filter takes ~1.44*r for the
+// same false positive rate.
+//
+// S is stored as r bit columns of m bits each, interleaved by 64-bit
+// word, so that a query reads two runs of r adjacent words.
+//
+// Filter format:
+//    column words   : fixed64[(m/64) * r]   word w of column k at w*r+k
+//    num_slots      : fixed32               m, a multiple of 64
+//    seed           : uint8
+//    result_bits    : uint8                 r
+//    kRibbonMarker  : uint8
+//
+// Filters over a few hundred keys or less, for which the slots would take
+// more space than a bloom filter, are bloom filters as built by
+// NewBloomFilterPolicy(), which end in their number of probes (at most
+// 30) instead.
+
+#include "leveldb/filter_policy.h"
+
+#include <math.h>
+#include <vector>
+#include "leveldb/slice.h"
+#include "util/coding.h"
+#include "util/hash.h"
+
+namespace leveldb {
+
+namespace {
+
+static const unsigned char kRibbonMarker = 0x80;
+static const size_t kMetadataBytes = 7;  // num_slots, seed, r, marker
+
+static uint32_t RibbonHash(const Slice& key) {
+  return Hash(key.data(), key.size(), 0x7e2b1a5d);
+}
+
+static inline uint64_t Mix(uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdull;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ull;
+  x ^= x >> 33;
+  return x;
+}
+
+static inline int Parity(uint64_t x) {
+#if defined(__GNUC__)
+  return __builtin_parityll(x);
+#else
+  x ^= x >> 32;
+  x ^= x >> 16;
+  x ^= x >> 8;
+  x ^= x >> 4;
+  x ^= x >> 2;
+  x ^= x >> 1;
+  return static_cast<int>(x & 1);
+#endif
+}
+
+// The equation of a key: start, coefficient row and result.
+struct Row {
+  uint32_t start;
+  uint64_t coeff;
+  uint32_t result;
+};
+
+static inline Row MakeRow(uint32_t hash, uint32_t seed, uint32_t num_starts,
+                          int r) {
+  const uint64_t a = Mix(hash + seed * 0x9e3779b97f4a7c15ull);
+  Row row;
+  row.start = static_cast<uint32_t>(((a >> 32) * num_starts) >> 32);
+  row.coeff = Mix(a ^ 0x5bd1e9955bd1e995ull) | 1;
+  row.result = static_cast<uint32_t>(a) & ((uint32_t(1) << r) - 1);
+  return row;
+}
+
+class RibbonFilterPolicy : public FilterPolicy {
+ private:
+  const FilterPolicy* const bloom_;
+  size_t bloom_bits_per_key_;
+  int r_;
+
+  // Gaussian elimination of the rows of "hashes" into m slots.  Returns
+  // false if some rows are inconsistent.  On success, the row with its
+  // leading bit at slot i is in (*coeffs)[i], (*results)[i].
+  bool Band(const std::vector<uint32_t>& hashes, uint32_t seed, uint32_t m,
+            std::vector<uint64_t>* coeffs,
+            std::vector<uint32_t>* results) const {
+    coeffs->assign(m, 0);
+    results->assign(m, 0);
+    for (size_t i = 0; i < hashes.size(); i++) {
+      Row row = MakeRow(hashes[i], seed, m - 63, r_);
+      uint32_t pos = row.start;
+      uint64_t c = row.coeff;
+      uint32_t b = row.result;
+      while (true) {
+        if ((*coeffs)[pos] == 0) {
+          (*coeffs)[pos] = c;
+          (*results)[pos] = b;
+          break;
+        }
+        c ^= (*coeffs)[pos];
+        b ^= (*results)[pos];
+        if (c == 0) {
+          if (b != 0) {
+            return false;
+          }
+          break;  // Redundant, e.g. a duplicate key
+        }
+        // Move to the new leading bit
+        while ((c & 1) == 0) {
+          c >>= 1;
+          pos++;
+        }
+      }
+    }
+    return true;
+  }
+
+ public:
+  explicit RibbonFilterPolicy(int bits_per_key)
+      : bloom_(NewBloomFilterPolicy(bits_per_key)),
+        bloom_bits_per_key_(bits_per_key) {
+    // Match the false positive rate of the bloom filter of that size,
+    // which uses k = bits_per_key * ln(2) probes (see bloom.cc)
+    int k = static_cast<int>(bits_per_key * 0.69);
+    if (k < 1) k = 1;
+    if (k > 30) k = 30;
+    const double fp_rate =
+        pow(1.0 - exp(-static_cast<double>(k) / bits_per_key), k);
+    r_ = static_cast<int>(ceil(-log(fp_rate) / log(2.0) - 0.05));
+    if (r_ < 1) r_ = 1;
+    if (r_ > 30) r_ = 30;
+  }
+
+  virtual ~RibbonFilterPolicy() {
+    delete bloom_;
+  }
+
+  virtual const char* Name() const {
+    return "leveldb.BuiltinRibbonFilter";
+  }
+
+  virtual void CreateFilter(const Slice* keys, int n, std::string* dst) const {
+    // Slots: the number of keys plus the width of a row, and an overhead
+    // that keeps failures rare.  It grows with the number of keys: 7%
+    // for 10K keys and 13% for 1M keys.
+    double overhead = 0.07 + 0.03 * log10(n / 10000.0);
+    if (n == 0 || overhead < 0.04) overhead = 0.04;
+    uint32_t m = static_cast<uint32_t>(n + n * overhead + 64);
+    m = (m + 63) / 64 * 64;
+    const size_t ribbon_bytes = m / 8 * r_ + kMetadataBytes;
+    size_t bloom_bytes = (n * bloom_bits_per_key_ + 7) / 8;
+    if (bloom_bytes < 8) bloom_bytes = 8;
+    if (ribbon_bytes >= bloom_bytes + 1) {
+      bloom_->CreateFilter(keys, n, dst);
+      return;
+    }
+
+    std::vector<uint32_t> hashes(n);
+    for (int i = 0; i < n; i++) {
+      hashes[i] = RibbonHash(keys[i]);
+    }
+    std::vector<uint64_t> coeffs;
+    std::vector<uint32_t> results;
+    uint32_t seed = 0;
+    while (!Band(hashes, seed, m, &coeffs, &results)) {
+      seed++;
+      if (seed % 4 == 0 || seed > 255) {
+        // Keep failing with this many slots: take 10% more
+        m = (m + m / 10 + 63) / 64 * 64;
+        seed %= 256;
+      }
+    }
+
+    // Back substitution, from the last slot to the first.  state[k] holds
+    // bit k of the values of the 64 slots after the current one, the
+    // nearest in the lowest bit.
+    const size_t num_words = m / 64;
+    const size_t init_size = dst->size();
+    dst->resize(init_size + num_words * r_ * 8, 0);
+    char* words = &(*dst)[init_size];
+    std::vector<uint64_t> state(r_, 0);
+    std::vector<uint64_t> column_word(r_, 0);
+    for (uint32_t i = m; i-- > 0; ) {
+      const uint64_t c = coeffs[i];
+      const uint32_t b = results[i];
+      for (int k = 0; k < r_; k++) {
+        // Slots without a row are free; they are set to 0
+        uint64_t bit = 0;
+        if (c != 0) {
+          bit = ((b >> k) & 1) ^ Parity(state[k] & (c >> 1));
+        }
+        state[k] = (state[k] << 1) | bit;
+        column_word[k] = (column_word[k] << 1) | bit;
+      }
+      if (i % 64 == 0) {
+        for (int k = 0; k < r_; k++) {
+          EncodeFixed64(words + ((i / 64) * r_ + k) * 8, column_word[k]);
+          column_word[k] = 0;
+        }
+      }
+    }
+    PutFixed32(dst, m);
+    dst->push_back(static_cast<char>(seed));
+    dst->push_back(static_cast<char>(r_));
+    dst->push_back(static_cast<char>(kRibbonMarker));
+  }
+
+  virtual bool KeyMayMatch(const Slice& key, const Slice& filter) const {
+    const size_t len = filter.size();
+    if (len < 2) return false;
+    if (static_cast<unsigned char>(filter[len-1]) != kRibbonMarker) {
+      return bloom_->KeyMayMatch(key, filter);
+    }
+    if (len < kMetadataBytes) return true;  // Corrupt: consider a match
+
+    const char* metadata = filter.data() + len - kMetadataBytes;
+    const uint32_t m = DecodeFixed32(metadata);
+    const uint32_t seed = static_cast<unsigned char>(metadata[4]);
+    const int r = static_cast<unsigned char>(metadata[5]);
+    if (m < 64 || m % 64 != 0 || r < 1 || r > 30 ||
+        (m / 8) * r + kMetadataBytes != len) {
+      return true;  // Unknown encoding: consider it a match
+    }
+
+    const Row row = MakeRow(RibbonHash(key), seed, m - 63, r);
+    const size_t w = row.start / 64;
+    const int shift = row.start % 64;
+    const char* lo = filter.data() + w * r * 8;
+    const char* hi = lo + r * 8;
+    uint32_t value = 0;
+    for (int k = 0; k < r; k++) {
+      uint64_t window = DecodeFixed64(lo + k * 8) >> shift;
+      if (shift != 0) {
+        window |= DecodeFixed64(hi + k * 8) << (64 - shift);
+      }
+      value |= static_cast<uint32_t>(Parity(window & row.coeff)) << k;
+    }
+    return value == row.result;
+  }
+};
+
+}  // namespace
+
+const FilterPolicy* NewRibbonFilterPolicy(int bits_per_key) {
+  return new RibbonFilterPolicy(bits_per_key);
+}
+
+}  // namespace leveldb
@@ -0,0 +1,159 @@
+// Copyright (c) 2026 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/thread_local.h"
+
+#include <atomic>
+#include <map>
+#include <stdio.h>
+#include <stdlib.h>
+#include "port/port.h"
+
+namespace leveldb {
+
+struct ThreadLocalPtr::Entry {
+  std::atomic<void*> ptr;
+  ThreadLocalPtr* owner;
+  Entry* next;
+  Entry* prev;
+
+  Entry() : ptr(NULL), owner(NULL), next(this), prev(this) { }
+};
+
+namespace {
+
+// Guards the entry lists and pending handler counts of all instances.
+// A single global mutex is fine since it is only taken the first time a
+// thread touches an instance, when a thread exits, and by Scrape().
+port::Mutex* global_mu;
+port::CondVar* global_cv;
+port::OnceType once = LEVELDB_ONCE_INIT;
+
+// The entries of all instances that have not been deleted yet, with the
+// thread each belongs to.  A thread may be handed its entry for an exit
+// handler just before the destructor of the instance deletes the entry,
+// so the handler checks here that the entry is still alive.  The thread
+// is checked too since a new entry may have been allocated at the same
+// address for another thread.
+std::map<void*, pthread_t>* live_entries;
+
+void InitGlobals() {
+  global_mu = new port::Mutex;
+  global_cv = new port::CondVar(global_mu);
+  live_entries = new std::map<void*, pthread_t>;
+}
+
+void PthreadCall(const char* label, int result) {
+  if (result != 0) {
+    fprintf(stderr, "pthread %s: %d\n", label, result);
+    abort();
+  }
+}
+
+}  // namespace
+
+ThreadLocalPtr::ThreadLocalPtr(UnrefHandler handler)
+    : handler_(handler),
+      head_(new Entry),
+      pending_handlers_(0) {
+  port::InitOnce(&once, InitGlobals);
+  PthreadCall("key_create", pthread_key_create(&key_, &OnThreadExit));
+}
+
+ThreadLocalPtr::~ThreadLocalPtr() {
+  global_mu->Lock();
+  // No thread starts running the exit handler for key_ once it is
+  // deleted, but some may already be in the middle of it.
+  PthreadCall("key_delete", pthread_key_delete(key_));
+  while (pending_handlers_ > 0) {
+    global_cv->Wait();
+  }
+  Entry* e = head_->next;
+  while (e != head_) {
+    Entry* next = e->next;
+    live_entries->erase(e);
+    delete e;
+    e = next;
+  }
+  delete head_;
+  global_mu->Unlock();
+}
+
+void ThreadLocalPtr::OnThreadExit(void* arg) {
+  global_mu->Lock();
+  std::map<void*, pthread_t>::iterator it = live_entries->find(arg);
+  if (it == live_entries->end() ||
+      !pthread_equal(it->second, pthread_self())) {
+    // The instance was deleted, along with the entry
+    global_mu->Unlock();
+    return;
+  }
+  live_entries->erase(it);
+  Entry* e = reinterpret_cast<Entry*>(arg);
+  ThreadLocalPtr* owner = e->owner;
+  e->prev->next = e->next;
+  e->next->prev = e->prev;
+  void* ptr = e->ptr.load(std::memory_order_acquire);
+  if (ptr != NULL && owner->handler_ != NULL) {
+    // Run the handler without the global mutex so that it may acquire
+    // locks that are also held around calls to Scrape().
+    owner->pending_handlers_++;
+    global_mu->Unlock();
+    (*owner->handler_)(ptr);
+    global_mu->Lock();
+    owner->pending_handlers_--;
+    if (owner->pending_handlers_ == 0) {
+      global_cv->SignalAll();
+    }
+  }
+  global_mu->Unlock();
+  delete e;
+}
+
+ThreadLocalPtr::Entry* ThreadLocalPtr::GetEntry() const {
+  Entry* e = reinterpret_cast<Entry*>(pthread_getspecific(key_));
+  if (e == NULL) {
+    e = new Entry;
+    e->owner = const_cast<ThreadLocalPtr*>(this);
+    global_mu->Lock();
+    e->next = head_;
+    e->prev = head_->prev;
+    head_->prev->next = e;
+    head_->prev = e;
+    (*live_entries)[e] = pthread_self();
+    global_mu->Unlock();
+    PthreadCall("setspecific", pthread_setspecific(key_, e));
+  }
+  return e;
+}
+
+void* ThreadLocalPtr::Get() const {
+  return GetEntry()->ptr.load(std::memory_order_acquire);
+}
+
+void ThreadLocalPtr::Reset(void* ptr) {
+  GetEntry()->ptr.store(ptr, std::memory_order_release);
+}
+
+void* ThreadLocalPtr::Swap(void* ptr) {
+  return GetEntry()->ptr.exchange(ptr, std::memory_order_acq_rel);
+}
+
+bool ThreadLocalPtr::CompareAndSwap(void* ptr, void** expected) {
+  return GetEntry()->ptr.compare_exchange_strong(*expected, ptr,
+                                                 std::memory_order_acq_rel);
+}
+
+void ThreadLocalPtr::Scrape(std::vector<void*>* ptrs, void* replacement) {
+  global_mu->Lock();
+  for (Entry* e = head_->next; e != head_; e = e->next) {
+    void* ptr = e->ptr.exchange(replacement, std::memory_order_acq_rel);
+    if (ptr != NULL) {
+      ptrs->push_back(ptr);
+    }
+  }
+  global_mu->Unlock();
+}
+
+}  // namespace leveldb
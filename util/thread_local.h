@@ -0,0 +1,74 @@
+// Copyright (c) 2026 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// ThreadLocalPtr gives every thread its own pointer-sized slot for each
+// ThreadLocalPtr instance (as opposed to a "__thread" variable, which is
+// shared by all instances).  Slots are updated with atomic operations so
+// that the owner of the ThreadLocalPtr can invalidate the slots of all
+// threads (see Scrape()) while those threads keep using them lock-free.
+
+#ifndef STORAGE_LEVELDB_UTIL_THREAD_LOCAL_H_
+#define STORAGE_LEVELDB_UTIL_THREAD_LOCAL_H_
+
+#include <pthread.h>
+#include <vector>
+
+namespace leveldb {
+
+class ThreadLocalPtr {
+ public:
+  // Called with the value stored in a thread's slot when that thread
+  // exits.  Not called for slots that hold NULL.
+  typedef void (*UnrefHandler)(void* ptr);
+
+  explicit ThreadLocalPtr(UnrefHandler handler = NULL);
+
+  // REQUIRES: Values still stored in slots have already been collected
+  // via Scrape(); they are not passed to the UnrefHandler.
+  ~ThreadLocalPtr();
+
+  // Return the value stored in the calling thread's slot.
+  void* Get() const;
+
+  // Store "ptr" in the calling thread's slot.
+  void Reset(void* ptr);
+
+  // Store "ptr" in the calling thread's slot and return the old value.
+  void* Swap(void* ptr);
+
+  // If the calling thread's slot holds "*expected", replace it with "ptr"
+  // and return true.  Otherwise store the current value in "*expected"
+  // and return false.
+  bool CompareAndSwap(void* ptr, void** expected);
+
+  // Replace the value of every thread's slot with "replacement" and
+  // append the non-NULL old values to *ptrs.
+  void Scrape(std::vector<void*>* ptrs, void* replacement);
+
+ private:
+  struct Entry;
+
+  static void OnThreadExit(void* arg);
+
+  Entry* GetEntry() const;
+
+  const UnrefHandler handler_;
+  pthread_key_t key_;
+
+  // Circular doubly-linked list of the entries of all threads that have
+  // touched this instance.  Protected by a global mutex.
+  Entry* head_;
+
+  // Number of UnrefHandler calls currently in progress.  Protected by a
+  // global mutex.
+  int pending_handlers_;
+
+  // No copying allowed
+  ThreadLocalPtr(const ThreadLocalPtr&);
+  void operator=(const ThreadLocalPtr&);
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_THREAD_LOCAL_H_
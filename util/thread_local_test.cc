@@ -0,0 +1,210 @@
+// Copyright (c) 2026 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/thread_local.h"
+
+#include <algorithm>
+#include "leveldb/env.h"
+#include "port/port.h"
+#include "util/mutexlock.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+class ThreadLocalTest { };
+
+namespace {
+
+struct ThreadState {
+  ThreadLocalPtr* tls;
+  void* value;
+  port::Mutex mu;
+  port::CondVar cv;
+  bool stored;     // Thread has stored its value
+  bool release;    // Thread may exit
+  bool done;
+
+  explicit ThreadState(ThreadLocalPtr* t, void* v)
+      : tls(t), value(v), cv(&mu), stored(false), release(false),
+        done(false) { }
+};
+
+void StoreAndWait(void* arg) {
+  ThreadState* state = reinterpret_cast<ThreadState*>(arg);
+  ASSERT_TRUE(state->tls->Get() == NULL);
+  state->tls->Reset(state->value);
+  MutexLock l(&state->mu);
+  state->stored = true;
+  state->cv.SignalAll();
+  while (!state->release) {
+    state->cv.Wait();
+  }
+  state->done = true;
+  state->cv.SignalAll();
+}
+
+port::Mutex unref_mu;
+std::vector<void*> unrefed;
+
+void RecordUnref(void* ptr) {
+  MutexLock l(&unref_mu);
+  unrefed.push_back(ptr);
+}
+
+}  // namespace
+
+TEST(ThreadLocalTest, SingleThread) {
+  ThreadLocalPtr tls;
+  int a, b;
+  ASSERT_TRUE(tls.Get() == NULL);
+  tls.Reset(&a);
+  ASSERT_EQ(&a, tls.Get());
+  ASSERT_EQ(&a, tls.Swap(&b));
+  ASSERT_EQ(&b, tls.Get());
+
+  void* expected = &a;
+  ASSERT_TRUE(!tls.CompareAndSwap(NULL, &expected));
+  ASSERT_EQ(&b, expected);
+  ASSERT_TRUE(tls.CompareAndSwap(NULL, &expected));
+  ASSERT_TRUE(tls.Get() == NULL);
+}
+
+TEST(ThreadLocalTest, IndependentInstances) {
+  ThreadLocalPtr tls1, tls2;
+  int a, b;
+  tls1.Reset(&a);
+  tls2.Reset(&b);
+  ASSERT_EQ(&a, tls1.Get());
+  ASSERT_EQ(&b, tls2.Get());
+}
+
+TEST(ThreadLocalTest, ScrapeAndThreadExit) {
+  ThreadLocalPtr tls(&RecordUnref);
+  unrefed.clear();
+
+  static const int kNumThreads = 4;
+  int values[kNumThreads];
+  ThreadState* states[kNumThreads];
+  for (int i = 0; i < kNumThreads; i++) {
+    states[i] = new ThreadState(&tls, &values[i]);
+    Env::Default()->StartThread(&StoreAndWait, states[i]);
+  }
+  for (int i = 0; i < kNumThreads; i++) {
+    MutexLock l(&states[i]->mu);
+    while (!states[i]->stored) {
+      states[i]->cv.Wait();
+    }
+  }
+
+  // Main thread has its own, untouched slot.
+  ASSERT_TRUE(tls.Get() == NULL);
+  int mine;
+  tls.Reset(&mine);
+
+  // Scraped values are owned by the caller and are not passed to the
+  // handler when the threads exit.
+  std::vector<void*> scraped;
+  tls.Scrape(&scraped, NULL);
+  ASSERT_EQ(kNumThreads + 1, scraped.size());
+  ASSERT_TRUE(tls.Get() == NULL);
+  for (int i = 0; i < kNumThreads; i++) {
+    ASSERT_TRUE(std::find(scraped.begin(), scraped.end(), &values[i]) !=
+                scraped.end());
+  }
+
+  for (int i = 0; i < kNumThreads; i++) {
+    MutexLock l(&states[i]->mu);
+    states[i]->release = true;
+    states[i]->cv.SignalAll();
+    while (!states[i]->done) {
+      states[i]->cv.Wait();
+    }
+  }
+  // Give the threads a chance to run their exit handlers.
+  Env::Default()->SleepForMicroseconds(100000);
+  {
+    MutexLock l(&unref_mu);
+    ASSERT_TRUE(unrefed.empty());
+  }
+  for (int i = 0; i < kNumThreads; i++) {
+    delete states[i];
+  }
+}
+
+TEST(ThreadLocalTest, UnrefOnThreadExit) {
+  ThreadLocalPtr tls(&RecordUnref);
+  unrefed.clear();
+  int value;
+  ThreadState state(&tls, &value);
+  Env::Default()->StartThread(&StoreAndWait, &state);
+  {
+    MutexLock l(&state.mu);
+    while (!state.stored) {
+      state.cv.Wait();
+    }
+    state.release = true;
+    state.cv.SignalAll();
+    while (!state.done) {
+      state.cv.Wait();
+    }
+  }
+  for (int i = 0; i < 100; i++) {
+    {
+      MutexLock l(&unref_mu);
+      if (!unrefed.empty()) break;
+    }
+    Env::Default()->SleepForMicroseconds(10000);
+  }
+  MutexLock l(&unref_mu);
+  ASSERT_EQ(1, unrefed.size());
+  ASSERT_EQ(&value, unrefed[0]);
+}
+
+TEST(ThreadLocalTest, DeleteWhileThreadsExit) {
+  static const int kNumThreads = 8;
+  int values[kNumThreads];
+  for (int iter = 0; iter < 20; iter++) {
+    ThreadLocalPtr* tls = new ThreadLocalPtr(&RecordUnref);
+    ThreadState* states[kNumThreads];
+    for (int i = 0; i < kNumThreads; i++) {
+      states[i] = new ThreadState(tls, &values[i]);
+      Env::Default()->StartThread(&StoreAndWait, states[i]);
+    }
+    for (int i = 0; i < kNumThreads; i++) {
+      MutexLock l(&states[i]->mu);
+      while (!states[i]->stored) {
+        states[i]->cv.Wait();
+      }
+    }
+
+    // Some threads run their exit handlers before the instance is deleted,
+    // some while it is, and some after.
+    for (int i = 0; i < kNumThreads; i++) {
+      if (i == kNumThreads / 2) {
+        Env::Default()->SleepForMicroseconds(iter * 100);
+      }
+      MutexLock l(&states[i]->mu);
+      states[i]->release = true;
+      states[i]->cv.SignalAll();
+    }
+    delete tls;
+
+    for (int i = 0; i < kNumThreads; i++) {
+      {
+        MutexLock l(&states[i]->mu);
+        while (!states[i]->done) {
+          states[i]->cv.Wait();
+        }
+      }
+      delete states[i];
+    }
+  }
+  Env::Default()->SleepForMicroseconds(100000);
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}